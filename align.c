@@ -18,6 +18,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "align.h"
 #include "util.h"
 #include "list_util.h"
@@ -92,6 +93,73 @@ static void align_effect_destroy(struct effect *e)
 	free(state);
 }
 
+static int align_effect_save(struct effect *e, struct snapshot_writer *w)
+{
+	struct align_state *state = (struct align_state *) e->data;
+	const int64_t discard_frames = state->discard_frames;
+	snapshot_write_str(w, "align");
+	SNAPSHOT_WRITE_VAL(w, discard_frames);
+	for (int k = 0; k < e->istream.channels; ++k) {
+		const int64_t len = state->cs[k].len;
+		SNAPSHOT_WRITE_VAL(w, len);
+	}
+	return w->err;
+}
+
+static struct effect * align_effect_new(const struct stream_info *istream)
+{
+	struct effect *e = calloc(1, sizeof(struct effect));
+	if (check_alloc("align", e)) return NULL;
+	e->name = "align";
+	e->istream.fs = e->ostream.fs = istream->fs;
+	e->istream.channels = e->ostream.channels = istream->channels;
+	e->flags |= EFFECT_FLAG_CH_DEPS_IDENTITY;
+	e->run = align_effect_run;
+	e->reset = align_effect_reset;
+	e->plot = effect_plot_noop;
+	e->drain_samples = align_effect_drain_samples;
+	e->destroy = align_effect_destroy;
+	e->save = align_effect_save;
+
+	struct align_state *state = calloc(1, sizeof(struct align_state));
+	if (check_alloc(e->name, state)) goto fail;
+	e->data = state;
+	state->cs = calloc(e->istream.channels, sizeof(struct align_channel_state));
+	if (check_alloc(e->name, state->cs)) goto fail;
+	return e;
+
+	fail:
+	if (state) align_effect_destroy(e);
+	free(e);
+	return NULL;
+}
+
+struct effect * align_effect_load(const char *name, const struct stream_info *istream, struct snapshot_reader *r)
+{
+	int64_t discard_frames;
+	if (SNAPSHOT_READ_VAL(r, discard_frames) || discard_frames < 0) return NULL;
+	struct effect *e = align_effect_new(istream);
+	if (e == NULL) return NULL;
+	struct align_state *state = (struct align_state *) e->data;
+	for (int k = 0; k < e->istream.channels; ++k) {
+		struct align_channel_state *cs = &state->cs[k];
+		int64_t len;
+		if (SNAPSHOT_READ_VAL(r, len) || len < 0) goto fail;
+		cs->len = len;
+		if (cs->len > 0) {
+			cs->buf = calloc(cs->len, sizeof(sample_t));
+			if (check_alloc(e->name, cs->buf)) goto fail;
+		}
+	}
+	state->discard_frames = discard_frames;
+	state->frames = -state->discard_frames;
+	return e;
+
+	fail:
+	destroy_effect(e);
+	return NULL;
+}
+
 int align_effect_insert(struct effects_chain *chain, struct effect *prev, ssize_t *offsets, ssize_t *align_refs)
 {
 	int do_align = 0;
@@ -110,23 +178,9 @@ int align_effect_insert(struct effects_chain *chain, struct effect *prev, ssize_
 		return 0;
 	}
 
-	struct effect *e = calloc(1, sizeof(struct effect));
-	if (check_alloc("align", e)) return 1;
-	e->name = "align";
-	e->istream.fs = e->ostream.fs = prev->ostream.fs;
-	e->istream.channels = e->ostream.channels = prev->ostream.channels;
-	e->flags |= EFFECT_FLAG_CH_DEPS_IDENTITY;
-	e->run = align_effect_run;
-	e->reset = align_effect_reset;
-	e->plot = effect_plot_noop;
-	e->drain_samples = align_effect_drain_samples;
-	e->destroy = align_effect_destroy;
-
-	struct align_state *state = calloc(1, sizeof(struct align_state));
-	if (check_alloc(e->name, state)) goto fail;
-	e->data = state;
-	state->cs = calloc(e->istream.channels, sizeof(struct align_channel_state));
-	if (check_alloc(e->name, state->cs)) goto fail;
+	struct effect *e = align_effect_new(&prev->ostream);
+	if (e == NULL) return 1;
+	struct align_state *state = (struct align_state *) e->data;
 	ssize_t max_offset = (prev->next) ? offsets[0] : 0;  /* zero negative offsets at end of chain */
 	for (int k = 0; k < e->istream.channels; ++k)
 		max_offset = MAXIMUM(max_offset, offsets[k]);
@@ -156,7 +210,6 @@ int align_effect_insert(struct effects_chain *chain, struct effect *prev, ssize_
 	return 0;
 
 	fail:
-	if (state) align_effect_destroy(e);
-	free(e);
+	destroy_effect(e);
 	return 1;
 }
@@ -24,5 +24,6 @@
 #include "effects_chain.h"
 
 int align_effect_insert(struct effects_chain *, struct effect *, ssize_t *, ssize_t *);
+struct effect * align_effect_load(const char *, const struct stream_info *, struct snapshot_reader *);
 
 #endif
@@ -18,6 +18,8 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
+#include <complex.h>
 #include "allpass.h"
 #include "util.h"
 
@@ -36,12 +38,13 @@ struct thiran_ap_state * thiran_ap_new(int n, double delay)
 	return state;
 }
 
-void thiran_ap_plot(struct thiran_ap_state *state)
+double complex thiran_ap_freq_resp(const struct thiran_ap_state *state, double w)
 {
-	printf("((abs(w)<=pi)?(1.0");
-	for (int k = 0; k < state->n; ++k)
-		printf("+%.15e/(%.15e*(exp(-j*w)/(1.0-exp(-j*w)))+%.15e/(2.0",
-			state->fb[k].c0, -state->fb[k].c2, 1.0/state->fb[k].c1);
-	for (int k = 0; k < state->n; ++k) printf("))");
-	printf("):0/0)");
+	if (fabs(w) > M_PI) return NAN;
+	if (w == 0.0) return 1.0;
+	const double complex z1 = cexp(-I*w), x = z1/(1.0-z1);
+	double complex s = 0.0;
+	for (int k = state->n-1; k >= 0; --k)
+		s = state->fb[k].c0/(-state->fb[k].c2*x + 1.0/state->fb[k].c1/(2.0+s));
+	return 1.0+s;
 }
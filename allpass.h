@@ -108,6 +108,6 @@ static inline sample_t thiran_ap_run(struct thiran_ap_state *state, sample_t s)
 }
 
 struct thiran_ap_state * thiran_ap_new(int, double);
-void thiran_ap_plot(struct thiran_ap_state *);
+double _Complex thiran_ap_freq_resp(const struct thiran_ap_state *, double);  /* w in radians/sample; NaN if |w| > pi */
 
 #endif
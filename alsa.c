@@ -39,9 +39,18 @@ struct alsa_state {
 	snd_pcm_t *dev;
 	struct alsa_enc_info *enc_info;
 	snd_pcm_sframes_t delay;
+	snd_pcm_uframes_t period_frames, tmp_frames;
+	sample_t *tmp;  /* for non-interleaved mmap access */
 	int pause;
 };
 
+/* access types in order of preference */
+static const snd_pcm_access_t access_types[] = {
+	SND_PCM_ACCESS_MMAP_INTERLEAVED,
+	SND_PCM_ACCESS_MMAP_NONINTERLEAVED,
+	SND_PCM_ACCESS_RW_INTERLEAVED,
+};
+
 static int alsa_prepare_device(struct codec *c)
 {
 	int err;
@@ -61,8 +70,11 @@ static int alsa_rw_err_recover(struct codec *c, int err, int dsp_err)
 		if ((err = alsa_prepare_device(c)) < 0) goto fail;
 		return 0;
 	}
-	else if (err == -EPIPE) LOG_FMT(LL_ERROR, "%s: warning: %srun occurred",
-		c->type, (dsp_err == DSP_EREAD) ? "over" : "under");
+	else if (err == -EPIPE) {
+		++c->xruns;
+		LOG_FMT(LL_ERROR, "%s: warning: %srun occurred",
+			c->type, (dsp_err == DSP_EREAD) ? "over" : "under");
+	}
 	if ((err = snd_pcm_recover(state->dev, err, 1)) < 0) {
 		fail:
 		dsp_perror(dsp_err, c->type, snd_strerror(err));
@@ -119,6 +131,122 @@ static ssize_t alsa_write(struct codec *c, sample_t *sbuf, ssize_t frames)
 	return w;
 }
 
+static void * alsa_area_ptr(const snd_pcm_channel_area_t *area, snd_pcm_uframes_t offset)
+{
+	return (uint8_t *) area->addr + (area->first + offset * area->step) / 8;
+}
+
+/* waits until at least one period (or the requested number of frames, if
+   smaller) can be transferred; returns non-zero on unrecoverable error */
+static int alsa_mmap_wait(struct codec *c, snd_pcm_uframes_t want, int dsp_err)
+{
+	int err;
+	struct alsa_state *state = (struct alsa_state *) c->data;
+	for (;;) {
+		const snd_pcm_sframes_t avail = snd_pcm_avail_update(state->dev);
+		if (avail < 0) {
+			if (alsa_rw_err_recover(c, avail, dsp_err)) return 1;
+			continue;
+		}
+		if ((snd_pcm_uframes_t) avail >= MINIMUM(want, state->period_frames))
+			return 0;
+		/* capture must be started explicitly; playback normally starts
+		   at the start threshold, but the buffer may already be full */
+		if (snd_pcm_state(state->dev) == SND_PCM_STATE_PREPARED) {
+			if ((err = snd_pcm_start(state->dev)) < 0 && alsa_rw_err_recover(c, err, dsp_err))
+				return 1;
+			continue;
+		}
+		if ((err = snd_pcm_wait(state->dev, -1)) < 0 && alsa_rw_err_recover(c, err, dsp_err))
+			return 1;
+	}
+}
+
+static ssize_t alsa_read_mmap(struct codec *c, sample_t *sbuf, ssize_t frames)
+{
+	int err;
+	ssize_t r = 0;
+	struct alsa_state *state = (struct alsa_state *) c->data;
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset, n;
+	snd_pcm_sframes_t n_commit;
+
+	if (snd_pcm_state(state->dev) == SND_PCM_STATE_SETUP && alsa_prepare_device(c) < 0)
+		return 0;
+
+	while (r < frames) {
+		if (alsa_mmap_wait(c, frames - r, DSP_EREAD)) return r;
+		n = frames - r;
+		if ((err = snd_pcm_mmap_begin(state->dev, &areas, &offset, &n)) < 0) {
+			if (alsa_rw_err_recover(c, err, DSP_EREAD)) return r;
+			continue;
+		}
+		sample_t *dest = &sbuf[r * c->channels];
+		if (state->tmp == NULL)
+			state->enc_info->read_func(alsa_area_ptr(&areas[0], offset), dest, n * c->channels);
+		else {
+			for (snd_pcm_uframes_t i = 0; i < n; i += state->tmp_frames) {
+				const snd_pcm_uframes_t len = MINIMUM(n - i, state->tmp_frames);
+				for (int k = 0; k < c->channels; ++k) {
+					state->enc_info->read_func(alsa_area_ptr(&areas[k], offset + i), state->tmp, len);
+					for (snd_pcm_uframes_t j = 0; j < len; ++j)
+						dest[(i+j)*c->channels + k] = state->tmp[j];
+				}
+			}
+		}
+		n_commit = snd_pcm_mmap_commit(state->dev, offset, n);
+		if (n_commit < 0 || (snd_pcm_uframes_t) n_commit != n) {
+			if (alsa_rw_err_recover(c, (n_commit < 0) ? n_commit : -EPIPE, DSP_EREAD)) return r;
+			continue;
+		}
+		r += n;
+	}
+	return r;
+}
+
+static ssize_t alsa_write_mmap(struct codec *c, sample_t *sbuf, ssize_t frames)
+{
+	int err;
+	ssize_t w = 0;
+	struct alsa_state *state = (struct alsa_state *) c->data;
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset, n;
+	snd_pcm_sframes_t n_commit;
+
+	if (snd_pcm_state(state->dev) == SND_PCM_STATE_SETUP && alsa_prepare_device(c) < 0)
+		return 0;
+
+	while (w < frames) {
+		if (alsa_mmap_wait(c, frames - w, DSP_EWRITE)) return w;
+		n = frames - w;
+		if ((err = snd_pcm_mmap_begin(state->dev, &areas, &offset, &n)) < 0) {
+			if (alsa_rw_err_recover(c, err, DSP_EWRITE)) return w;
+			continue;
+		}
+		/* convert directly into the hardware buffer */
+		sample_t *src = &sbuf[w * c->channels];
+		if (state->tmp == NULL)
+			state->enc_info->write_func(src, alsa_area_ptr(&areas[0], offset), n * c->channels);
+		else {
+			for (snd_pcm_uframes_t i = 0; i < n; i += state->tmp_frames) {
+				const snd_pcm_uframes_t len = MINIMUM(n - i, state->tmp_frames);
+				for (int k = 0; k < c->channels; ++k) {
+					for (snd_pcm_uframes_t j = 0; j < len; ++j)
+						state->tmp[j] = src[(i+j)*c->channels + k];
+					state->enc_info->write_func(state->tmp, alsa_area_ptr(&areas[k], offset + i), len);
+				}
+			}
+		}
+		n_commit = snd_pcm_mmap_commit(state->dev, offset, n);
+		if (n_commit < 0 || (snd_pcm_uframes_t) n_commit != n) {
+			if (alsa_rw_err_recover(c, (n_commit < 0) ? n_commit : -EPIPE, DSP_EWRITE)) return w;
+			continue;
+		}
+		w += n;
+	}
+	return w;
+}
+
 static ssize_t alsa_seek(struct codec *c, ssize_t pos)
 {
 	if (pos <= 0) {
@@ -174,6 +302,7 @@ static void alsa_destroy(struct codec *c)
 	if (snd_pcm_state(state->dev) == SND_PCM_STATE_RUNNING)
 		snd_pcm_drain(state->dev);
 	snd_pcm_close(state->dev);
+	free(state->tmp);
 	free(state);
 }
 
@@ -207,9 +336,11 @@ struct codec * alsa_codec_init(const struct codec_params *p)
 	snd_pcm_sw_params_t *sw_p = NULL;
 	struct codec *c = NULL;
 	struct alsa_state *state = NULL;
-	snd_pcm_uframes_t buf_frames_min, buf_frames_max, buf_frames;
+	snd_pcm_uframes_t buf_frames_min, buf_frames_max, buf_frames, period_frames;
 	unsigned int periods_min, periods_max, periods;
 	struct alsa_enc_info *enc_info;
+	snd_pcm_access_t access;
+	int i;
 
 	if ((err = snd_pcm_open(&dev, p->path, (p->mode == CODEC_MODE_WRITE) ? SND_PCM_STREAM_PLAYBACK : SND_PCM_STREAM_CAPTURE, 0)) < 0) {
 		LOG_FMT(LL_OPEN_ERROR, "%s: error: failed to open device: %s", p->type, snd_strerror(err));
@@ -228,7 +359,12 @@ struct codec * alsa_codec_init(const struct codec_params *p)
 		LOG_FMT(LL_ERROR, "%s: error: failed to initialize hw params: %s", p->type, snd_strerror(err));
 		goto fail;
 	}
-	if ((err = snd_pcm_hw_params_set_access(dev, hw_p, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+	for (i = 0; i < LENGTH(access_types); ++i) {
+		access = access_types[i];
+		if ((err = snd_pcm_hw_params_set_access(dev, hw_p, access)) == 0)
+			break;
+	}
+	if (err < 0) {
 		LOG_FMT(LL_ERROR, "%s: error: failed to set access: %s", p->type, snd_strerror(err));
 		goto fail;
 	}
@@ -275,35 +411,46 @@ struct codec * alsa_codec_init(const struct codec_params *p)
 		LOG_FMT(LL_ERROR, "%s: error: failed to set periods: %s", p->type, snd_strerror(err));
 		goto fail;
 	}
-	LOG_FMT(LL_VERBOSE, "%s: info: buffer: %lu frames [%lu %lu]; %u periods [%u %u]", p->type,
-		buf_frames, buf_frames_min, buf_frames_max, periods, periods_min, periods_max);
+	LOG_FMT(LL_VERBOSE, "%s: info: buffer: %lu frames [%lu %lu]; %u periods [%u %u]; access: %s", p->type,
+		buf_frames, buf_frames_min, buf_frames_max, periods, periods_min, periods_max, snd_pcm_access_name(access));
 	if ((err = snd_pcm_hw_params(dev, hw_p)) < 0) {
 		LOG_FMT(LL_ERROR, "%s: error: failed to set hw params: %s", p->type, snd_strerror(err));
 		goto fail;
 	}
 	const int can_pause = snd_pcm_hw_params_can_pause(hw_p);
+	if ((err = snd_pcm_hw_params_get_period_size(hw_p, &period_frames, NULL)) < 0) {
+		LOG_FMT(LL_ERROR, "%s: error: failed to get period size: %s", p->type, snd_strerror(err));
+		goto fail;
+	}
 
+	if ((err = snd_pcm_sw_params_malloc(&sw_p)) < 0) {
+		LOG_FMT(LL_ERROR, "%s: error: failed to allocate sw params: %s", p->type, snd_strerror(err));
+		goto fail;
+	}
+	if ((err = snd_pcm_sw_params_current(dev, sw_p)) < 0) {
+		LOG_FMT(LL_ERROR, "%s: error: failed to get current sw params: %s", p->type, snd_strerror(err));
+		goto fail;
+	}
 	if (p->mode == CODEC_MODE_WRITE) {
-		if ((err = snd_pcm_sw_params_malloc(&sw_p)) < 0) {
-			LOG_FMT(LL_ERROR, "%s: error: failed to allocate sw params: %s", p->type, snd_strerror(err));
-			goto fail;
-		}
-		if ((err = snd_pcm_sw_params_current(dev, sw_p)) < 0) {
-			LOG_FMT(LL_ERROR, "%s: error: failed to get current sw params: %s", p->type, snd_strerror(err));
-			goto fail;
-		}
 		if ((err = snd_pcm_sw_params_set_start_threshold(dev, sw_p, MINIMUM(p->block_frames * 2, buf_frames))) < 0) {
 			LOG_FMT(LL_ERROR, "%s: error: failed to set start threshold: %s", p->type, snd_strerror(err));
 			goto fail;
 		}
-		if ((err = snd_pcm_sw_params(dev, sw_p)) < 0) {
-			LOG_FMT(LL_ERROR, "%s: error: failed to set sw params: %s", p->type, snd_strerror(err));
-			goto fail;
-		}
+	}
+	/* wake up once per period */
+	if ((err = snd_pcm_sw_params_set_avail_min(dev, sw_p, period_frames)) < 0) {
+		LOG_FMT(LL_ERROR, "%s: error: failed to set avail min: %s", p->type, snd_strerror(err));
+		goto fail;
+	}
+	if ((err = snd_pcm_sw_params(dev, sw_p)) < 0) {
+		LOG_FMT(LL_ERROR, "%s: error: failed to set sw params: %s", p->type, snd_strerror(err));
+		goto fail;
 	}
 
-	if (hw_p) snd_pcm_hw_params_free(hw_p);
-	if (sw_p) snd_pcm_sw_params_free(sw_p);
+	snd_pcm_hw_params_free(hw_p);
+	snd_pcm_sw_params_free(sw_p);
+	hw_p = NULL;
+	sw_p = NULL;
 
 	#if DUMP_PCM_INFO
 		snd_output_t *output = NULL;
@@ -316,7 +463,13 @@ struct codec * alsa_codec_init(const struct codec_params *p)
 	state->dev = dev;
 	state->enc_info = enc_info;
 	state->delay = 0;
+	state->period_frames = period_frames;
 	if (can_pause) state->pause = -1;
+	if (access == SND_PCM_ACCESS_MMAP_NONINTERLEAVED) {
+		state->tmp_frames = p->block_frames;
+		state->tmp = calloc(state->tmp_frames, sizeof(sample_t));
+		if (check_alloc(p->type, state->tmp)) goto fail;
+	}
 
 	c = calloc(1, sizeof(struct codec));
 	if (check_alloc(p->type, c)) goto fail;
@@ -331,8 +484,14 @@ struct codec * alsa_codec_init(const struct codec_params *p)
 	c->hints |= CODEC_HINT_REALTIME;
 	c->buf_ratio = buf_frames / p->block_frames;
 	c->frames = -1;
-	if (p->mode == CODEC_MODE_READ) c->read = alsa_read;
-	else c->write = alsa_write;
+	if (access == SND_PCM_ACCESS_RW_INTERLEAVED) {
+		if (p->mode == CODEC_MODE_READ) c->read = alsa_read;
+		else c->write = alsa_write;
+	}
+	else {
+		if (p->mode == CODEC_MODE_READ) c->read = alsa_read_mmap;
+		else c->write = alsa_write_mmap;
+	}
 	c->seek = alsa_seek;
 	c->delay = alsa_delay;
 	c->drop = alsa_drop;
@@ -346,6 +505,7 @@ struct codec * alsa_codec_init(const struct codec_params *p)
 	if (hw_p) snd_pcm_hw_params_free(hw_p);
 	if (sw_p) snd_pcm_sw_params_free(sw_p);
 	if (dev) snd_pcm_close(dev);
+	if (state) free(state->tmp);
 	free(state);
 	free(c);
 	return NULL;
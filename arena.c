@@ -0,0 +1,123 @@
+/*
+ * This file is part of dsp.
+ *
+ * Copyright (c) 2026 Michael Barbour <barbour.michael.0@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "arena.h"
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size, used;
+	char *data;
+};
+
+struct arena {
+	struct arena_chunk *head;  /* bump allocations come from head */
+	struct arena_chunk *large;
+	size_t total;
+};
+
+static struct arena_chunk * arena_chunk_new(size_t size)
+{
+	struct arena_chunk *c;
+	void *data;
+	if (posix_memalign(&data, ARENA_ALIGN, size)) return NULL;
+	c = malloc(sizeof(struct arena_chunk));
+	if (c == NULL) {
+		free(data);
+		return NULL;
+	}
+	c->next = NULL;
+	c->size = size;
+	c->used = 0;
+	c->data = data;
+	return c;
+}
+
+static void arena_chunk_list_free(struct arena_chunk *c)
+{
+	while (c) {
+		struct arena_chunk *next = c->next;
+		free(c->data);
+		free(c);
+		c = next;
+	}
+}
+
+struct arena * arena_new(void)
+{
+	return calloc(1, sizeof(struct arena));
+}
+
+void * arena_alloc(struct arena *a, size_t n, size_t size)
+{
+	if (size != 0 && n > SIZE_MAX / size) return NULL;
+	size_t len = n * size;
+	if (len == 0) len = 1;
+	if (len > SIZE_MAX - (ARENA_ALIGN-1)) return NULL;
+	len = (len + (ARENA_ALIGN-1)) & ~((size_t) ARENA_ALIGN-1);
+	struct arena_chunk *c;
+	if (len > ARENA_CHUNK_SIZE/2) {
+		if ((c = arena_chunk_new(len)) == NULL) return NULL;
+		c->next = a->large;
+		a->large = c;
+	}
+	else {
+		c = a->head;
+		if (c == NULL || c->size - c->used < len) {
+			if ((c = arena_chunk_new(ARENA_CHUNK_SIZE)) == NULL) return NULL;
+			c->next = a->head;
+			a->head = c;
+		}
+	}
+	void *p = c->data + c->used;
+	c->used += len;
+	a->total += len;
+	/* Zeroing here also faults the pages in from the building thread
+	   instead of on the first run of the effect. */
+	memset(p, 0, len);
+	return p;
+}
+
+static int chunk_list_owns(const struct arena_chunk *c, const void *p)
+{
+	for (; c; c = c->next)
+		if ((const char *) p >= c->data && (const char *) p < c->data + c->size)
+			return 1;
+	return 0;
+}
+
+int arena_owns(const struct arena *a, const void *p)
+{
+	if (a == NULL || p == NULL) return 0;
+	return chunk_list_owns(a->head, p) || chunk_list_owns(a->large, p);
+}
+
+size_t arena_size(const struct arena *a)
+{
+	return (a) ? a->total : 0;
+}
+
+void arena_destroy(struct arena *a)
+{
+	if (a == NULL) return;
+	arena_chunk_list_free(a->head);
+	arena_chunk_list_free(a->large);
+	free(a);
+}
@@ -0,0 +1,38 @@
+/*
+ * This file is part of dsp.
+ *
+ * Copyright (c) 2026 Michael Barbour <barbour.michael.0@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef DSP_ARENA_H
+#define DSP_ARENA_H
+
+#include <stddef.h>
+
+/* Simple bump allocator. Memory is returned zeroed and aligned to
+   ARENA_ALIGN bytes and is only released by arena_destroy(). Allocations
+   larger than half the chunk size get a chunk of their own. */
+#define ARENA_ALIGN      64
+#define ARENA_CHUNK_SIZE (256*1024)
+
+struct arena;
+
+struct arena * arena_new(void);
+void * arena_alloc(struct arena *, size_t, size_t);
+int arena_owns(const struct arena *, const void *);
+size_t arena_size(const struct arena *);
+void arena_destroy(struct arena *);
+
+#endif
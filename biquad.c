@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <complex.h>
 #include "biquad.h"
 #include "util.h"
 #include "reverse_iir.h"
@@ -108,6 +109,13 @@ void biquad_reset(struct biquad_state *state)
 #endif
 }
 
+double complex biquad_freq_resp(const struct biquad_state *state, double w)
+{
+	if (fabs(w) > M_PI) return NAN;
+	const double complex z1 = cexp(-I*w), z2 = z1*z1;
+	return (state->c0 + state->c1*z1 + state->c2*z2) / (1.0 + state->c3*z1 + state->c4*z2);
+}
+
 void biquad_init_using_type(struct biquad_state *b, int type, double fs, double arg0, double arg1, double arg2, double arg3, int width_type)
 {
 	double b0 = 1.0, b1 = 0.0, b2 = 0.0, a0 = 1.0, a1 = 0.0, a2 = 0.0;
@@ -322,22 +330,23 @@ static void biquad_effect_reset(struct effect *e)
 			biquad_reset(&state[k]);
 }
 
-static void biquad_effect_plot(struct effect *e, int i)
+static void biquad_effect_plot(struct effect *e, ssize_t n, double df, const double complex *ih, double complex *oh)
 {
 	struct biquad_state *state = (struct biquad_state *) e->data;
 	for (int k = 0; k < e->ostream.channels; ++k) {
+		const double complex *ih_k = &ih[k*n];
+		double complex *oh_k = &oh[k*n];
 		if (GET_BIT(e->channel_selector, k)) {
-			printf("H%d_%d(w)=(abs(w)<=pi)?(" BIQUAD_PLOT_FMT "):0/0\n",
-				k, i, BIQUAD_PLOT_FMT_ARGS(&state[k]));
+			for (ssize_t i = 0; i < n; ++i)
+				oh_k[i] = ih_k[i] * biquad_freq_resp(&state[k], 2.0*M_PI*i*df/e->ostream.fs);
 		}
-		else
-			printf("H%d_%d(w)=1.0\n", k, i);
+		else memcpy(oh_k, ih_k, n * sizeof(double complex));
 	}
 }
 
 static void biquad_effect_destroy(struct effect *e)
 {
-	free(e->data);
+	effect_free(e->data);
 	free(e->channel_selector);
 }
 
@@ -375,6 +384,66 @@ static int biquad_effect_merge(struct effect *dest, struct effect *src)
 	return 0;
 }
 
+static int biquad_effect_scale(struct effect *e, const sample_t *gain)
+{
+	struct biquad_state *state = (struct biquad_state *) e->data;
+	for (int k = 0; k < e->ostream.channels; ++k)
+		if (gain[k] != 1.0 && !GET_BIT(e->channel_selector, k))
+			return 0;
+	for (int k = 0; k < e->ostream.channels; ++k) {
+		if (GET_BIT(e->channel_selector, k)) {
+			state[k].c0 *= gain[k];
+			state[k].c1 *= gain[k];
+			state[k].c2 *= gain[k];
+		}
+	}
+	return 1;
+}
+
+static double biquad_effect_cost(struct effect *e)
+{
+	return 9.0 * num_bits_set(e->channel_selector, e->ostream.channels);
+}
+
+static int biquad_effect_save(struct effect *e, struct snapshot_writer *w)
+{
+	snapshot_write_str(w, "biquad");
+	snapshot_write_selector(w, e->channel_selector, e->ostream.channels);
+	snapshot_write(w, e->data, e->ostream.channels * sizeof(struct biquad_state));
+	return w->err;
+}
+
+static struct effect * biquad_effect_new(const char *name, const struct stream_info *istream, const char *channel_selector)
+{
+	struct effect *e = effect_alloc(1, sizeof(struct effect));
+	if (check_alloc(name, e)) return NULL;
+	e->name = name;
+	e->istream.fs = e->ostream.fs = istream->fs;
+	e->istream.channels = e->ostream.channels = istream->channels;
+	e->channel_selector = NEW_SELECTOR(istream->channels);
+	if (check_alloc(name, e->channel_selector)) goto fail;
+	COPY_SELECTOR(e->channel_selector, channel_selector, istream->channels);
+	e->flags |= EFFECT_FLAG_OPT_REORDERABLE;
+	e->flags |= EFFECT_FLAG_CH_DEPS_IDENTITY;
+	e->flags |= EFFECT_FLAG_LTI;
+	biquad_effect_set_run_func(e);
+	e->reset = biquad_effect_reset;
+	e->plot = biquad_effect_plot;
+	e->destroy = biquad_effect_destroy;
+	e->merge = biquad_effect_merge;
+	e->scale = biquad_effect_scale;
+	e->cost = biquad_effect_cost;
+	e->save = biquad_effect_save;
+	e->data = effect_alloc(istream->channels, sizeof(struct biquad_state));
+	if (check_alloc(name, e->data)) goto fail;
+	return e;
+
+	fail:
+	biquad_effect_destroy(e);
+	effect_free(e);
+	return NULL;
+}
+
 struct biquad_effect_opts {
 	int reverse;
 	double thresh;
@@ -532,31 +601,33 @@ struct effect * biquad_effect_init(const struct effect_info *ei, const struct st
 	if (o.reverse)
 		return reverse_iir_effect_init_from_biquad(ei, istream, channel_selector, &b, o.thresh);
 
-	e = calloc(1, sizeof(struct effect));
-	if (check_alloc(ei->name, e)) goto fail;
-	e->name = ei->name;
-	e->istream.fs = e->ostream.fs = istream->fs;
-	e->istream.channels = e->ostream.channels = istream->channels;
-	e->channel_selector = NEW_SELECTOR(istream->channels);
-	if (check_alloc(ei->name, e->channel_selector)) goto fail;
-	COPY_SELECTOR(e->channel_selector, channel_selector, istream->channels);
-	e->flags |= EFFECT_FLAG_OPT_REORDERABLE;
-	e->flags |= EFFECT_FLAG_CH_DEPS_IDENTITY;
-	biquad_effect_set_run_func(e);
-	e->reset = biquad_effect_reset;
-	e->plot = biquad_effect_plot;
-	e->destroy = biquad_effect_destroy;
-	e->merge = biquad_effect_merge;
-	e->data = state = calloc(istream->channels, sizeof(struct biquad_state));
-	if (check_alloc(ei->name, state)) goto fail;
+	e = biquad_effect_new(ei->name, istream, channel_selector);
+	if (e == NULL) return NULL;
+	state = (struct biquad_state *) e->data;
 	for (int i = 0; i < istream->channels; ++i) {
 		if (GET_BIT(channel_selector, i))
 			memcpy(&state[i], &b, sizeof(struct biquad_state));
 	}
 	return e;
+}
 
-	fail:
-	if (e) biquad_effect_destroy(e);
-	free(e);
-	return NULL;
+struct effect * biquad_effect_load(const char *name, const struct stream_info *istream, struct snapshot_reader *r)
+{
+	char *channel_selector = NEW_SELECTOR(istream->channels);
+	if (check_alloc(name, channel_selector)) return NULL;
+	struct effect *e = NULL;
+	const struct biquad_state *s_state;
+	if (snapshot_read_selector(r, channel_selector, istream->channels)
+			|| (s_state = snapshot_read(r, istream->channels * sizeof(struct biquad_state))) == NULL)
+		goto done;
+	e = biquad_effect_new(name, istream, channel_selector);
+	if (e == NULL) goto done;
+	struct biquad_state *state = (struct biquad_state *) e->data;
+	memcpy(state, s_state, istream->channels * sizeof(struct biquad_state));
+	for (int i = 0; i < istream->channels; ++i)
+		biquad_reset(&state[i]);
+
+	done:
+	free(channel_selector);
+	return e;
 }
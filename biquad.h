@@ -71,7 +71,9 @@ struct biquad_state {
 void biquad_init(struct biquad_state *, double, double, double, double, double, double);
 void biquad_reset(struct biquad_state *);
 void biquad_init_using_type(struct biquad_state *, int, double, double, double, double, double, int);
+double _Complex biquad_freq_resp(const struct biquad_state *, double);  /* w in radians/sample; NaN if |w| > pi */
 struct effect * biquad_effect_init(const struct effect_info *, const struct stream_info *, const char *, const char *, int, const char *const *);
+struct effect * biquad_effect_load(const char *, const struct stream_info *, struct snapshot_reader *);
 
 static inline sample_t biquad(struct biquad_state *state, sample_t s)
 {
@@ -91,9 +93,6 @@ static inline sample_t biquad(struct biquad_state *state, sample_t s)
 	return r;
 }
 
-#define BIQUAD_PLOT_FMT "%.15e+%.15e*exp(-j*w)+%.15e*exp(-2.0*j*w))/(1.0+%.15e*exp(-j*w)+%.15e*exp(-2.0*j*w)"
-#define BIQUAD_PLOT_FMT_ARGS(s) (s)->c0, (s)->c1, (s)->c2, (s)->c3, (s)->c4
-
 #define BIQUAD_EFFECT_INFO \
 	{ "lowpass_1",          "[-r[thresh]] f0[k]",                             biquad_effect_init, BIQUAD_LOWPASS_1 }, \
 	{ "highpass_1",         "[-r[thresh]] f0[k]",                             biquad_effect_init, BIQUAD_HIGHPASS_1 }, \
@@ -19,7 +19,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "codec.h"
+#include "seek_index.h"
 #include "util.h"
 
 #include "null.h"
@@ -38,6 +40,10 @@ struct codec_info {
 	int modes;
 	struct codec * (*init)(const struct codec_params *);
 	void (*print_encodings)(const char *);
+	/* optional; keep shared resources (e.g. dynamically loaded libraries)
+	   loaded between reopens of a lazy codec */
+	void (*hold)(void);
+	void (*release)(void);
 };
 
 #ifdef HAVE_SNDFILE
@@ -107,7 +113,7 @@ struct codec_info codecs[] = {
 	{ "sf/mpeg", sf_mpeg_ext, CODEC_MODE_READ|CODEC_MODE_WRITE, sndfile_codec_init, sndfile_codec_print_encodings },
 #endif
 #ifdef HAVE_FFMPEG
-	{ "ffmpeg",  NULL,      CODEC_MODE_READ,                  ffmpeg_codec_init,  ffmpeg_codec_print_encodings },
+	{ "ffmpeg",  NULL,      CODEC_MODE_READ,                  ffmpeg_codec_init,  ffmpeg_codec_print_encodings, ffmpeg_codec_hold, ffmpeg_codec_release },
 #endif
 #ifdef HAVE_ALSA
 	{ "alsa",    NULL,      CODEC_MODE_READ|CODEC_MODE_WRITE, alsa_codec_init,    alsa_codec_print_encodings },
@@ -150,6 +156,31 @@ static const char *fallback_output_codecs[] = {
 #endif
 };
 
+/* Quieten codec init failures while probing. Inputs may be opened
+   concurrently, so the original loglevel is restored only once the last
+   concurrent probe finishes. */
+static pthread_mutex_t probe_quiet_lock = PTHREAD_MUTEX_INITIALIZER;
+static int probe_quiet_count, probe_quiet_loglevel;
+
+static void probe_quiet_begin(void)
+{
+	pthread_mutex_lock(&probe_quiet_lock);
+	if (probe_quiet_count++ == 0) {
+		probe_quiet_loglevel = dsp_globals.loglevel;
+		if (probe_quiet_loglevel == LL_NORMAL)
+			dsp_globals.loglevel = LL_ERROR;
+	}
+	pthread_mutex_unlock(&probe_quiet_lock);
+}
+
+static void probe_quiet_end(void)
+{
+	pthread_mutex_lock(&probe_quiet_lock);
+	if (--probe_quiet_count == 0)
+		dsp_globals.loglevel = probe_quiet_loglevel;
+	pthread_mutex_unlock(&probe_quiet_lock);
+}
+
 static struct codec_info * get_codec_info_by_type(const char *type)
 {
 	int i;
@@ -172,9 +203,10 @@ static struct codec_info * get_codec_info_by_ext(const char *ext)
 	return NULL;
 }
 
-struct codec * init_codec(const struct codec_params *p_in)
+/* on success, *r_type is set to the type of the codec that was opened */
+static struct codec * do_init_codec(const struct codec_params *p_in, const char **r_type)
 {
-	int i, old_loglevel;
+	int i;
 	struct codec_info *info;
 	struct codec *c = NULL;
 	const char *ext;
@@ -195,10 +227,10 @@ struct codec * init_codec(const struct codec_params *p_in)
 			return NULL;
 		}
 		p.type = info->type;
+		*r_type = info->type;
 		return info->init(&p);
 	}
-	if ((old_loglevel = dsp_globals.loglevel) == LL_NORMAL)
-		dsp_globals.loglevel = LL_ERROR;
+	probe_quiet_begin();
 	if (ext != NULL && (info = get_codec_info_by_ext(ext)) != NULL) {
 		if (info->modes & p.mode) {
 			p.type = info->type;
@@ -227,10 +259,180 @@ struct codec * init_codec(const struct codec_params *p_in)
 		}
 	}
 	done:
-	dsp_globals.loglevel = old_loglevel;
+	probe_quiet_end();
+	if (c) *r_type = info->type;
 	return c;
 }
 
+struct codec * init_codec(const struct codec_params *p)
+{
+	const char *type;
+	return do_init_codec(p, &type);
+}
+
+struct lazy_state {
+	struct codec_params p;
+	const struct codec_info *info;
+	struct seek_index index;
+	struct codec *c;
+	ssize_t pos;
+	int eof, failed;
+};
+
+static int lazy_open(struct codec *c)
+{
+	struct lazy_state *state = (struct lazy_state *) c->data;
+	if (state->c) return 0;
+	if (state->failed) return 1;
+	state->c = init_codec(&state->p);
+	if (state->c == NULL) {
+		LOG_FMT(LL_ERROR, "%s: error: failed to reopen input: %s", c->type, c->path);
+		goto fail;
+	}
+	if (state->c->fs != c->fs || state->c->channels != c->channels) {
+		LOG_FMT(LL_ERROR, "%s: error: input changed since it was opened: %s", c->type, c->path);
+		goto fail;
+	}
+	if (state->pos > 0 && state->c->seek(state->c, state->pos) < 0) {
+		dsp_perror(DSP_ESEEK, c->type, c->path);
+		goto fail;
+	}
+	LOG_FMT(LL_VERBOSE, "%s: info: opened input: %s", c->type, c->path);
+	return 0;
+
+	fail:
+	destroy_codec(state->c);
+	state->c = NULL;
+	state->failed = 1;
+	return 1;
+}
+
+static ssize_t lazy_read(struct codec *c, sample_t *buf, ssize_t frames)
+{
+	struct lazy_state *state = (struct lazy_state *) c->data;
+	if (state->eof || lazy_open(c)) return 0;
+	const ssize_t r = state->c->read(state->c, buf, frames);
+	if (r > 0) state->pos += r;
+	else state->eof = 1;
+	return r;
+}
+
+static ssize_t lazy_seek(struct codec *c, ssize_t pos)
+{
+	struct lazy_state *state = (struct lazy_state *) c->data;
+	if (state->c) {
+		if ((pos = state->c->seek(state->c, pos)) < 0) return pos;
+	}
+	else {
+		/* defer until the codec is opened */
+		if (pos < 0)
+			pos = 0;
+		else if (c->frames >= 0 && pos >= c->frames)
+			pos = c->frames - 1;
+	}
+	state->pos = pos;
+	state->eof = 0;
+	return pos;
+}
+
+static ssize_t lazy_delay(struct codec *c)
+{
+	struct lazy_state *state = (struct lazy_state *) c->data;
+	return (state->c) ? state->c->delay(state->c) : 0;
+}
+
+static void lazy_drop(struct codec *c)
+{
+	struct lazy_state *state = (struct lazy_state *) c->data;
+	if (state->c) state->c->drop(state->c);
+}
+
+static void lazy_pause(struct codec *c, int p)
+{
+	struct lazy_state *state = (struct lazy_state *) c->data;
+	if (state->c) state->c->pause(state->c, p);
+}
+
+static void lazy_destroy(struct codec *c)
+{
+	struct lazy_state *state = (struct lazy_state *) c->data;
+	destroy_codec(state->c);
+	if (state->info->release) state->info->release();
+	seek_index_free(&state->index);
+	free(state);
+	free((char *) c->type);
+	free((char *) c->enc);
+}
+
+struct codec * init_codec_lazy(const struct codec_params *p)
+{
+	const char *type;
+	struct codec *lc = NULL;
+	struct lazy_state *state = calloc(1, sizeof(struct lazy_state));
+	if (check_alloc(__func__, state)) return NULL;
+	state->index.frames = -1;
+	state->p = *p;
+	state->p.index = &state->index;
+	struct codec *c = do_init_codec(&state->p, &type);
+	if (c == NULL || p->mode != CODEC_MODE_READ
+			|| (c->hints & (CODEC_HINT_INTERACTIVE | CODEC_HINT_NO_BUF | CODEC_HINT_REALTIME))
+			|| c->seek == codec_seek_noop || strcmp(c->path, "-") == 0)
+		goto fail;
+	lc = calloc(1, sizeof(struct codec));
+	if (check_alloc(__func__, lc)) goto fail;
+	lc->path = c->path;
+	lc->type = strdup(c->type);
+	lc->enc = (c->enc) ? strdup(c->enc) : NULL;
+	if (check_alloc(__func__, (void *) lc->type) || (c->enc && check_alloc(__func__, (void *) lc->enc))) goto fail;
+	lc->fs = c->fs;
+	lc->channels = c->channels;
+	lc->prec = c->prec;
+	lc->hints = c->hints;
+	lc->buf_ratio = c->buf_ratio;
+	lc->frames = c->frames;
+	lc->read = lazy_read;
+	lc->seek = lazy_seek;
+	lc->delay = lazy_delay;
+	lc->drop = lazy_drop;
+	lc->pause = lazy_pause;
+	lc->destroy = lazy_destroy;
+	lc->data = state;
+	state->p.type = type;
+	state->info = get_codec_info_by_type(type);
+	/* the libraries stay loaded while the input is closed */
+	if (state->info->hold) state->info->hold();
+	destroy_codec(c);
+	return lc;
+
+	fail:
+	if (lc) {
+		free((char *) lc->type);
+		free((char *) lc->enc);
+	}
+	free(lc);
+	seek_index_free(&state->index);
+	free(state);
+	return c;  /* fall back to the fully opened codec */
+}
+
+void codec_lazy_open(struct codec *c)
+{
+	if (c && c->destroy == lazy_destroy)
+		lazy_open(c);
+}
+
+void codec_lazy_close(struct codec *c)
+{
+	if (c && c->destroy == lazy_destroy) {
+		struct lazy_state *state = (struct lazy_state *) c->data;
+		if (state->c) {
+			destroy_codec(state->c);
+			state->c = NULL;
+			LOG_FMT(LL_VERBOSE, "%s: info: closed input: %s", c->type, c->path);
+		}
+	}
+}
+
 void destroy_codec(struct codec *c)
 {
 	if (!c) return;
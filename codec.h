@@ -44,6 +44,7 @@ struct codec {
 	const char *path, *type, *enc;
 	int fs, channels, prec, hints, buf_ratio;
 	ssize_t frames;
+	ssize_t xruns;  /* incremented by real-time codecs on overrun/underrun */
 	ssize_t (*read)(struct codec *, sample_t *, ssize_t);   /* should be NULL if mode == CODEC_MODE_WRITE */
 	ssize_t (*write)(struct codec *, sample_t *, ssize_t);  /* should be NULL if mode == CODEC_MODE_READ */
 	ssize_t (*seek)(struct codec *, ssize_t);
@@ -54,9 +55,15 @@ struct codec {
 	void *data;
 };
 
+struct seek_index;
+
 struct codec_params {
 	const char *path, *type, *enc;
 	int fs, channels, endian, mode, block_frames, buf_ratio;
+	/* Optional; kept by lazy codecs so an input is scanned only once.
+	   Codecs which build a seek index use this one if its frames member
+	   is >= 0, and otherwise copy theirs into it. */
+	struct seek_index *index;
 };
 
 #define CODEC_PARAMS_AUTO(path_arg, mode_arg) { \
@@ -70,6 +77,13 @@ struct codec_params {
 #define CODEC_DEFAULT_DEVICE "default"
 
 struct codec * init_codec(const struct codec_params *);
+/* Probes the input and closes it again. The returned codec reopens the
+   underlying codec on first use (or on codec_lazy_open()). Inputs which
+   cannot be reopened (real-time, unseekable, stdin, etc.) are returned fully
+   opened. */
+struct codec * init_codec_lazy(const struct codec_params *);
+void codec_lazy_open(struct codec *);   /* no-op if not a lazy codec */
+void codec_lazy_close(struct codec *);  /* no-op if not a lazy codec */
 void destroy_codec(struct codec *);
 void print_all_codecs(void);
 
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <time.h>
@@ -29,6 +30,30 @@
 
 #define CMD_QUEUE_LEN 8
 
+/* lo > hi means that no fill level has been seen since the last reset */
+struct queue_watermarks {
+	int lo, hi;
+};
+
+static inline void queue_watermarks_init(struct queue_watermarks *wm)
+{
+	wm->lo = INT_MAX;
+	wm->hi = INT_MIN;
+}
+
+static inline void queue_watermarks_update(struct queue_watermarks *wm, int fill)
+{
+	if (fill < wm->lo) wm->lo = fill;
+	if (fill > wm->hi) wm->hi = fill;
+}
+
+static inline void queue_watermarks_get(struct queue_watermarks *wm, int fill, int reset, struct codec_buf_stats *st)
+{
+	st->lo = (wm->lo > wm->hi) ? fill : wm->lo;
+	st->hi = (wm->lo > wm->hi) ? fill : wm->hi;
+	if (reset) wm->lo = wm->hi = fill;
+}
+
 struct read_cmd {
 	enum codec_read_buf_cmd cc;
 	ssize_t arg;
@@ -43,6 +68,7 @@ struct read_block {
 
 struct read_state {
 	pthread_t thread;
+	int open_ahead;
 	struct {
 		pthread_mutex_t lock;
 		sem_t pending, sync;
@@ -59,6 +85,7 @@ struct read_state {
 			int front, back, len, slots;
 			int max_block_frames;
 			ssize_t last_delay;
+			struct queue_watermarks wm;
 			sem_t items;
 		} block;
 	} queue;
@@ -86,6 +113,7 @@ struct write_state {
 			int front, back, len, items;
 			int max_block_frames, channels;
 			ssize_t fill_frames, last_delay;
+			struct queue_watermarks wm;
 			sem_t slots;
 		} block;
 	} queue;
@@ -158,6 +186,7 @@ ssize_t codec_read_buf_pull(void *state_data, sample_t *data, ssize_t frames, co
 		if (block->frames == 0) {
 			state->queue.block.front = (state->queue.block.front+1 < state->queue.block.len) ? state->queue.block.front+1 : 0;
 			++state->queue.block.slots;
+			queue_watermarks_update(&state->queue.block.wm, state->queue.block.len - state->queue.block.slots);
 			if (!state->queue.block.suspended)
 				sem_post(&state->queue.pending);
 			/* restart block queue if waiting */
@@ -234,6 +263,7 @@ static struct read_buf_input * read_queue_skip(struct read_state *state, struct
 	read_queue_drop(state, state->queue.block.b[state->queue.block.front].input, 0);
 	if (state->queue.block.slots == state->queue.block.len) {  /* block queue is empty */
 		if (input && !state->queue.block.rt_wait) {
+			read_buf_input_transition(input, input->next, state->open_ahead);
 			input = input->next;
 			*pos = (input) ? input->start : 0;
 			*repeats = (input) ? input->repeats : 0;
@@ -252,6 +282,7 @@ static void * read_worker(void *arg)
 	ssize_t pos = input->start;
 	int repeats = input->repeats;
 	char done = 0;
+	read_buf_input_transition(NULL, input, state->open_ahead);
 	while (!done) {
 		while (sem_wait(&state->queue.pending) != 0);
 		pthread_mutex_lock(&state->queue.lock);
@@ -295,6 +326,7 @@ static void * read_worker(void *arg)
 		else if (!state->queue.block.suspended && state->queue.block.slots > 0) {
 			struct read_block *block = &state->queue.block.b[state->queue.block.back];
 			--state->queue.block.slots;
+			queue_watermarks_update(&state->queue.block.wm, state->queue.block.len - state->queue.block.slots);
 			state->queue.block.back = (state->queue.block.back+1 < state->queue.block.len) ? state->queue.block.back+1 : 0;
 			state->queue.block.last_delay = (input) ? input->codec->delay(input->codec) : 0;
 			pthread_mutex_unlock(&state->queue.lock);
@@ -324,6 +356,7 @@ static void * read_worker(void *arg)
 
 			/* note: a block with zero frames and a non-NULL codec field indicates the end of that codec */
 			if (r <= 0 && input) {
+				read_buf_input_transition(input, input->next, state->open_ahead);
 				input = input->next;
 				pos = (input) ? input->start : 0;
 				repeats = (input) ? input->repeats : 0;
@@ -363,6 +396,15 @@ ssize_t codec_read_buf_delay_nw(struct codec_read_buf *rb)
 	return fill_frames + codec_delay;
 }
 
+void codec_read_buf_get_stats_nw(struct codec_read_buf *rb, struct codec_buf_stats *st, int reset)
+{
+	struct read_state *state = (struct read_state *) rb->data;
+	pthread_mutex_lock(&state->queue.lock);
+	st->len = state->queue.block.len;
+	queue_watermarks_get(&state->queue.block.wm, state->queue.block.len - state->queue.block.slots, reset, st);
+	pthread_mutex_unlock(&state->queue.lock);
+}
+
 static void read_state_destroy(struct read_state *state)
 {
 	pthread_mutex_destroy(&state->queue.lock);
@@ -409,7 +451,16 @@ void read_buf_input_list_destroy(struct read_buf_input_list *list)
 	while (list->head) read_buf_input_list_destroy_head(list);
 }
 
-struct codec_read_buf * codec_read_buf_init(struct read_buf_input_list *list, int block_frames, int n_blocks, void (*error_cb)(int))
+/* closes the previous input (if lazily opened) and opens the next
+   open_ahead+1 inputs, starting with next */
+void read_buf_input_transition(struct read_buf_input *prev, struct read_buf_input *next, int open_ahead)
+{
+	if (prev) codec_lazy_close(prev->codec);
+	for (int i = 0; next && i <= open_ahead; ++i, next = next->next)
+		codec_lazy_open(next->codec);
+}
+
+struct codec_read_buf * codec_read_buf_init(struct read_buf_input_list *list, int block_frames, int n_blocks, int open_ahead, void (*error_cb)(int))
 {
 	int do_buf = 0, max_channels = 0;
 	struct codec_read_buf *rb = calloc(1, sizeof(struct codec_read_buf));
@@ -417,18 +468,23 @@ struct codec_read_buf * codec_read_buf_init(struct read_buf_input_list *list, in
 	rb->inputs = list;
 	rb->cur_input = list->head;
 	rb->error_cb = error_cb;
+	rb->open_ahead = open_ahead;
 	if (rb->cur_input) {
 		rb->pos = rb->cur_input->start;
 		rb->repeats = rb->cur_input->repeats;
 	}
 
-	if (n_blocks < CODEC_BUF_MIN_BLOCKS) return rb;
-	LIST_FOREACH(list, input) {
-		max_channels = MAXIMUM(max_channels, input->codec->channels);
-		if (!(input->codec->hints & CODEC_HINT_NO_BUF))
-			do_buf = 1;
+	if (n_blocks >= CODEC_BUF_MIN_BLOCKS) {
+		LIST_FOREACH(list, input) {
+			max_channels = MAXIMUM(max_channels, input->codec->channels);
+			if (!(input->codec->hints & CODEC_HINT_NO_BUF))
+				do_buf = 1;
+		}
+	}
+	if (!do_buf) {
+		read_buf_input_transition(NULL, rb->cur_input, open_ahead);
+		return rb;
 	}
-	if (!do_buf) return rb;
 
 	struct read_state *state = calloc(1, sizeof(struct read_state));
 	if (check_alloc(__func__, state)) goto fail;
@@ -436,6 +492,7 @@ struct codec_read_buf * codec_read_buf_init(struct read_buf_input_list *list, in
 	sem_init(&state->queue.pending, 0, n_blocks);
 	sem_init(&state->queue.sync, 0, 0);
 	sem_init(&state->queue.cmd.slots, 0, CMD_QUEUE_LEN);
+	state->open_ahead = open_ahead;
 	state->queue.block.len = n_blocks;
 	state->queue.block.max_block_frames = MAXIMUM(block_frames, 8);
 	state->queue.block.b = calloc(n_blocks, sizeof(struct read_block));
@@ -447,6 +504,7 @@ struct codec_read_buf * codec_read_buf_init(struct read_buf_input_list *list, in
 		state->queue.block.b[i].data = state->queue.block.b[0].data + (block_samples * i);
 	sem_init(&state->queue.block.items, 0, 0);
 	state->queue.block.slots = n_blocks;
+	queue_watermarks_init(&state->queue.block.wm);
 	rb->data = state;
 
 	if ((errno = pthread_create(&state->thread, NULL, read_worker, rb)) != 0) {
@@ -492,6 +550,7 @@ void codec_write_buf_push(void *state_data, sample_t *data, ssize_t frames)
 			state->queue.block.back = (state->queue.block.back+1 < state->queue.block.len) ? state->queue.block.back+1 : 0;
 			state->queue.block.fill_frames += block_frames;
 			++state->queue.block.items;
+			queue_watermarks_update(&state->queue.block.wm, state->queue.block.items);
 			state->queue.block.stopped = 0;
 			if (!state->queue.block.suspended)
 				sem_post(&state->queue.pending);
@@ -591,6 +650,7 @@ static void * write_worker(void *arg)
 			state->queue.block.front = (state->queue.block.front+1 < state->queue.block.len) ? state->queue.block.front+1 : 0;
 			state->queue.block.fill_frames -= block->frames;
 			--state->queue.block.items;
+			queue_watermarks_update(&state->queue.block.wm, state->queue.block.items);
 			const char stopped = state->queue.block.stopped = (state->queue.block.items == 0);
 			state->queue.block.last_delay = codec->delay(codec) + block->frames;
 			pthread_mutex_unlock(&state->queue.lock);
@@ -630,6 +690,15 @@ ssize_t codec_write_buf_delay_nw(struct codec_write_buf *wb)
 	return d;
 }
 
+void codec_write_buf_get_stats_nw(struct codec_write_buf *wb, struct codec_buf_stats *st, int reset)
+{
+	struct write_state *state = (struct write_state *) wb->data;
+	pthread_mutex_lock(&state->queue.lock);
+	st->len = state->queue.block.len;
+	queue_watermarks_get(&state->queue.block.wm, state->queue.block.items, reset, st);
+	pthread_mutex_unlock(&state->queue.lock);
+}
+
 static void write_state_destroy(struct write_state *state)
 {
 	pthread_mutex_destroy(&state->queue.lock);
@@ -680,6 +749,7 @@ struct codec_write_buf * codec_write_buf_init(struct codec *codec, int block_fra
 	for (int i = 1; i < n_blocks; ++i)
 		state->queue.block.b[i].data = state->queue.block.b[0].data + (block_samples * i);
 	sem_init(&state->queue.block.slots, 0, n_blocks);
+	queue_watermarks_init(&state->queue.block.wm);
 	wb->data = state;
 
 	if ((errno = pthread_create(&state->thread, NULL, write_worker, wb)) != 0) {
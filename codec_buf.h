@@ -42,6 +42,7 @@ struct codec_read_buf {
 	ssize_t pos;
 	int repeats;
 	int next;  /* at end of current input */
+	int open_ahead;  /* number of lazily opened inputs to open ahead of the current one */
 };
 
 enum codec_write_buf_cmd {
@@ -60,14 +61,21 @@ struct codec_write_buf {
 	void *data;
 };
 
+/* block queue fill watermarks (in blocks) */
+struct codec_buf_stats {
+	int len, lo, hi;
+};
+
 ssize_t codec_read_buf_cmd_push(void *, enum codec_read_buf_cmd, ssize_t);
 ssize_t codec_read_buf_pull(void *, sample_t *, ssize_t, const struct read_buf_input *, ssize_t *, int *, int *);
 ssize_t codec_read_buf_delay_nw(struct codec_read_buf *);
+void codec_read_buf_get_stats_nw(struct codec_read_buf *, struct codec_buf_stats *, int);
 void codec_read_buf_destroy_nw(struct codec_read_buf *);
 
 void codec_write_buf_cmd_push(void *, enum codec_write_buf_cmd);
 void codec_write_buf_push(void *, sample_t *, ssize_t);
 ssize_t codec_write_buf_delay_nw(struct codec_write_buf *);
+void codec_write_buf_get_stats_nw(struct codec_write_buf *, struct codec_buf_stats *, int);
 void codec_write_buf_destroy_nw(struct codec_write_buf *);
 
 /* Public API */
@@ -97,7 +105,8 @@ struct read_buf_input_list {
 struct read_buf_input * read_buf_input_list_add(struct read_buf_input_list *, struct codec *, ssize_t, ssize_t, int);
 void read_buf_input_list_destroy_head(struct read_buf_input_list *);
 void read_buf_input_list_destroy(struct read_buf_input_list *);
-struct codec_read_buf * codec_read_buf_init(struct read_buf_input_list *, int, int, void (*)(int));
+void read_buf_input_transition(struct read_buf_input *, struct read_buf_input *, int);
+struct codec_read_buf * codec_read_buf_init(struct read_buf_input_list *, int, int, int, void (*)(int));
 
 static inline ssize_t codec_read_buf_read(struct codec_read_buf *rb, sample_t *data, ssize_t frames)
 {
@@ -119,7 +128,10 @@ static inline ssize_t codec_read_buf_read(struct codec_read_buf *rb, sample_t *d
 			}
 			else LOG_FMT(LL_ERROR, "%s(): error: seek failed; can't do repeat", __func__);
 		}
-		if (r <= 0) rb->next = 1;
+		if (r <= 0) {
+			rb->next = 1;
+			codec_lazy_close(input->codec);
+		}
 		rb->pos += MAXIMUM(r, 0);
 	}
 	return r;
@@ -143,6 +155,13 @@ static inline ssize_t codec_read_buf_delay(struct codec_read_buf *rb)
 	return input->codec->delay(input->codec);
 }
 
+/* if reset is non-zero, the watermarks are reset to the current fill level */
+static inline void codec_read_buf_get_stats(struct codec_read_buf *rb, struct codec_buf_stats *st, int reset)
+{
+	if (rb->data) codec_read_buf_get_stats_nw(rb, st, reset);
+	else st->len = st->lo = st->hi = 0;
+}
+
 static inline ssize_t codec_read_buf_seek(struct codec_read_buf *rb, ssize_t pos)
 {
 	struct read_buf_input *input = rb->cur_input;
@@ -174,6 +193,7 @@ static inline struct read_buf_input * codec_read_buf_next(struct codec_read_buf
 {
 	if (rb->cur_input == NULL) return NULL;
 	if (rb->data && !rb->next) codec_read_buf_cmd_push(rb->data, CODEC_READ_BUF_CMD_SKIP, 0);
+	if (!rb->data) read_buf_input_transition(rb->cur_input, rb->cur_input->next, rb->open_ahead);
 	rb->cur_input = rb->cur_input->next;
 	rb->next = 0;
 	rb->pos = (rb->cur_input) ? rb->cur_input->start : 0;
@@ -206,6 +226,12 @@ static inline ssize_t codec_write_buf_delay(struct codec_write_buf *wb)
 	return wb->codec->delay(wb->codec);
 }
 
+static inline void codec_write_buf_get_stats(struct codec_write_buf *wb, struct codec_buf_stats *st, int reset)
+{
+	if (wb->data) codec_write_buf_get_stats_nw(wb, st, reset);
+	else st->len = st->lo = st->hi = 0;
+}
+
 static inline void codec_write_buf_drop(struct codec_write_buf *wb, int drop_all, int sync)
 {
 	if (wb->data) {
@@ -0,0 +1,278 @@
+/*
+ * This file is part of dsp.
+ *
+ * Copyright (c) 2026 Michael Barbour <barbour.michael.0@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "combine.h"
+#include "util.h"
+#include "list_util.h"
+
+#define COMBINE_MIN_BLOCKS 4
+
+typedef sample_t combine_vec __attribute__((vector_size(2*sizeof(sample_t)), aligned(sizeof(sample_t)), may_alias));
+
+struct combine_input {
+	struct read_buf_input_list list;
+	struct codec_read_buf *rb;
+	sample_t gain;
+	ssize_t frames;  /* length of one pass, or -1 if unknown */
+	int repeats;  /* as given; input->repeats holds the count for the current read buffer */
+	int channels, offset;  /* offset is the first output channel in merge mode */
+};
+
+struct combine_state {
+	struct combine_input *in;
+	sample_t *tmp;
+	ssize_t tmp_frames;
+	int n, mode, block_frames, n_blocks, open_ahead, paused;
+};
+
+static void combine_mix(sample_t *dest, const sample_t *src, sample_t g, ssize_t samples)
+{
+	const combine_vec gv = {g, g};
+	ssize_t i = 0;
+	for (; i+2 <= samples; i += 2)
+		*((combine_vec *) &dest[i]) += gv * *((const combine_vec *) &src[i]);
+	for (; i < samples; ++i)
+		dest[i] += g * src[i];
+}
+
+/* mono inputs are mixed into every output channel; others into the first in_ch channels */
+static void combine_mix_strided(sample_t *dest, const sample_t *src, sample_t g, ssize_t frames, int out_ch, int in_ch)
+{
+	if (in_ch == 1) {
+		for (ssize_t i = 0; i < frames; ++i, dest += out_ch)
+			for (int k = 0; k < out_ch; ++k)
+				dest[k] += g * src[i];
+	}
+	else {
+		for (ssize_t i = 0; i < frames; ++i, dest += out_ch, src += in_ch)
+			for (int k = 0; k < in_ch; ++k)
+				dest[k] += g * src[k];
+	}
+}
+
+static void combine_merge(sample_t *dest, const sample_t *src, sample_t g, ssize_t frames, int out_ch, int in_ch)
+{
+	if (in_ch == 1) {
+		for (ssize_t i = 0; i < frames; ++i, dest += out_ch)
+			*dest = g * src[i];
+	}
+	else if (in_ch == 2) {
+		const combine_vec gv = {g, g};
+		for (ssize_t i = 0; i < frames; ++i, dest += out_ch, src += 2)
+			*((combine_vec *) dest) = gv * *((const combine_vec *) src);
+	}
+	else {
+		for (ssize_t i = 0; i < frames; ++i, dest += out_ch, src += in_ch)
+			for (int k = 0; k < in_ch; ++k)
+				dest[k] = g * src[k];
+	}
+}
+
+static ssize_t combine_read(struct codec *c, sample_t *buf, ssize_t frames)
+{
+	struct combine_state *state = (struct combine_state *) c->data;
+	ssize_t max_r = 0;
+	if (frames > state->tmp_frames) frames = state->tmp_frames;
+	memset(buf, 0, frames * c->channels * sizeof(sample_t));
+	for (int k = 0; k < state->n; ++k) {
+		struct combine_input *in = &state->in[k];
+		ssize_t r = 0, rr;
+		while (r < frames && (rr = codec_read_buf_read(in->rb, &state->tmp[r * in->channels], frames - r)) > 0)
+			r += rr;
+		if (r == 0) continue;
+		if (state->mode == COMBINE_MODE_MERGE)
+			combine_merge(&buf[in->offset], state->tmp, in->gain, r, c->channels, in->channels);
+		else if (in->channels == c->channels)
+			combine_mix(buf, state->tmp, in->gain, r * c->channels);
+		else
+			combine_mix_strided(buf, state->tmp, in->gain, r, c->channels, in->channels);
+		max_r = MAXIMUM(max_r, r);
+	}
+	return max_r;
+}
+
+/* replaces the read buffer of an input which has ended or has a repeat count
+   to reset; the old one is kept if anything fails */
+static int combine_input_reset(struct combine_state *state, struct combine_input *in, int repeats, ssize_t pos)
+{
+	struct read_buf_input *input = in->list.head;
+	const int prev_repeats = input->repeats;
+	/* stop the old read thread from touching the codec */
+	codec_read_buf_pause(in->rb, 1, 1);
+	input->repeats = repeats;
+	struct codec_read_buf *rb = codec_read_buf_init(&in->list, state->block_frames, state->n_blocks, state->open_ahead, NULL);
+	if (rb == NULL || codec_read_buf_seek(rb, pos) < 0) {
+		codec_read_buf_destroy(rb);
+		input->repeats = prev_repeats;
+		codec_read_buf_pause(in->rb, state->paused, 0);
+		return -1;
+	}
+	codec_read_buf_destroy(in->rb);
+	in->rb = rb;
+	codec_read_buf_pause(in->rb, state->paused, 0);
+	return 0;
+}
+
+static ssize_t combine_seek(struct codec *c, ssize_t pos)
+{
+	struct combine_state *state = (struct combine_state *) c->data;
+	if (pos < 0) pos = 0;
+	for (int k = 0; k < state->n; ++k) {
+		struct combine_input *in = &state->in[k];
+		struct read_buf_input *input = in->list.head;
+		/* wrap pos into the right pass, as the read path does on repeat */
+		ssize_t in_pos = pos;
+		int repeats = in->repeats;
+		if (in->frames > 0) {
+			ssize_t pass = pos / in->frames;
+			in_pos = pos % in->frames;
+			if (in->repeats >= 0 && pass > in->repeats) {
+				pass = in->repeats;
+				in_pos = in->frames;  /* seek to the end */
+			}
+			if (in->repeats > 0) repeats = in->repeats - pass;
+		}
+		if (in->rb->next || in->rb->cur_input != input || in->repeats > 0) {
+			if (combine_input_reset(state, in, repeats, input->start + in_pos))
+				return -1;
+		}
+		else if (codec_read_buf_seek(in->rb, input->start + in_pos) < 0)
+			return -1;
+	}
+	return pos;
+}
+
+static ssize_t combine_delay(struct codec *c)
+{
+	struct combine_state *state = (struct combine_state *) c->data;
+	ssize_t delay = 0;
+	for (int k = 0; k < state->n; ++k)
+		delay = MAXIMUM(delay, codec_read_buf_delay(state->in[k].rb));
+	return delay;
+}
+
+static void combine_pause(struct codec *c, int p)
+{
+	struct combine_state *state = (struct combine_state *) c->data;
+	state->paused = p;
+	for (int k = 0; k < state->n; ++k)
+		codec_read_buf_pause(state->in[k].rb, p, 0);
+}
+
+static void combine_destroy(struct codec *c)
+{
+	struct combine_state *state = (struct combine_state *) c->data;
+	if (state) {
+		for (int k = 0; k < state->n; ++k) {
+			codec_read_buf_destroy(state->in[k].rb);
+			read_buf_input_list_destroy(&state->in[k].list);
+		}
+		free(state->in);
+		free(state->tmp);
+		free(state);
+	}
+	free((char *) c->path);
+}
+
+/* if all_passes is zero, the length of a single pass */
+static ssize_t input_frames(const struct read_buf_input *input, int all_passes)
+{
+	ssize_t frames = (input->end >= 0) ? input->end - input->start
+		: (input->codec->frames >= 0) ? input->codec->frames - input->start : -1;
+	if (frames < 0 || !all_passes) return frames;
+	if (input->repeats < 0) return -1;
+	return frames * (input->repeats + 1);
+}
+
+struct codec * combine_codec_init(struct read_buf_input_list *list, const double *gains, int mode, int block_frames, int n_blocks, int open_ahead)
+{
+	const char *type = (mode == COMBINE_MODE_MERGE) ? "merge" : "mix";
+	int n = 0, max_in_channels = 0, can_dither = 1;
+	struct combine_state *state = NULL;
+	struct codec *c = calloc(1, sizeof(struct codec));
+	if (check_alloc(type, c)) goto fail;
+	c->data = state = calloc(1, sizeof(struct combine_state));
+	if (check_alloc(type, state)) goto fail;
+	LIST_FOREACH(list, input) ++n;
+	if (n == 0) goto fail;
+	state->in = calloc(n, sizeof(struct combine_input));
+	if (check_alloc(type, state->in)) goto fail;
+	state->n = n;
+	state->mode = mode;
+	state->block_frames = block_frames;
+	state->n_blocks = MAXIMUM(n_blocks, COMBINE_MIN_BLOCKS);
+	state->open_ahead = open_ahead;
+
+	c->type = type;
+	c->enc = "sample_t";
+	c->fs = list->head->codec->fs;
+	for (int k = 0; k < n; ++k) {
+		struct combine_input *in = &state->in[k];
+		struct read_buf_input *input = list->head;
+		LIST_REMOVE(list, input);
+		LIST_APPEND(&in->list, input);
+		in->gain = gains[k];
+		in->frames = input_frames(input, 0);
+		in->repeats = input->repeats;
+		in->channels = input->codec->channels;
+		in->offset = (mode == COMBINE_MODE_MERGE) ? c->channels : 0;
+		if (input->codec->fs != c->fs) {
+			LOG_FMT(LL_ERROR, "%s: error: all inputs must have the same sample rate", type);
+			goto fail;
+		}
+		c->channels = (mode == COMBINE_MODE_MERGE) ? c->channels + in->channels : MAXIMUM(c->channels, in->channels);
+		c->prec = MAXIMUM(c->prec, input->codec->prec);
+		if (!(input->codec->hints & CODEC_HINT_CAN_DITHER)) can_dither = 0;
+		const ssize_t frames = input_frames(input, 1);
+		if (k == 0) c->frames = frames;
+		else if (c->frames >= 0) c->frames = (frames < 0) ? -1 : MAXIMUM(c->frames, frames);
+		max_in_channels = MAXIMUM(max_in_channels, in->channels);
+	}
+	/* the inputs are already buffered individually */
+	c->hints = CODEC_HINT_NO_BUF | ((can_dither) ? CODEC_HINT_CAN_DITHER : 0);
+	state->tmp_frames = MAXIMUM(block_frames, 8);
+	state->tmp = calloc(state->tmp_frames * max_in_channels, sizeof(sample_t));
+	if (check_alloc(type, state->tmp)) goto fail;
+	for (int k = 0; k < n; ++k) {
+		if ((state->in[k].rb = codec_read_buf_init(&state->in[k].list, block_frames, state->n_blocks, open_ahead, NULL)) == NULL)
+			goto fail;
+	}
+
+	const int len = 32;
+	c->path = calloc(len, sizeof(char));
+	if (check_alloc(type, (void *) c->path)) goto fail;
+	snprintf((char *) c->path, len, "[%d inputs]", n);
+	c->read = combine_read;
+	c->seek = combine_seek;
+	c->delay = combine_delay;
+	c->drop = codec_drop_noop;
+	c->pause = combine_pause;
+	c->destroy = combine_destroy;
+	return c;
+
+	fail:
+	if (c) {
+		/* inputs not yet moved to the state are left in the list */
+		combine_destroy(c);
+		free(c);
+	}
+	return NULL;
+}
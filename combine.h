@@ -0,0 +1,37 @@
+/*
+ * This file is part of dsp.
+ *
+ * Copyright (c) 2026 Michael Barbour <barbour.michael.0@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef DSP_COMBINE_H
+#define DSP_COMBINE_H
+
+#include "dsp.h"
+#include "codec.h"
+#include "codec_buf.h"
+
+enum {
+	COMBINE_MODE_MIX,    /* sum the inputs */
+	COMBINE_MODE_MERGE,  /* concatenate the channels of the inputs */
+};
+
+/* Combines all inputs in the list into a single codec. Each input is read
+   on its own thread through its own codec_read_buf. Ownership of the inputs
+   is taken and the list is left empty. gains holds a linear gain for each
+   input. */
+struct codec * combine_codec_init(struct read_buf_input_list *, const double *, int, int, int, int);
+
+#endif
@@ -0,0 +1,17 @@
+all:  dsp
+install:  install_dsp install_manual
+uninstall:  uninstall_dsp uninstall_manual
+
+PREFIX := /usr
+BINDIR := /bin
+LIBDIR := /lib
+DATADIR := /share
+MANDIR := /man
+DSP_OBJ +=  matrix4_mb.o resample.o fir.o fir_p.o fir_auto.o hilbert.o fir_util.o
+DSP_CPP_OBJ += 
+DSP_EXTRA_CFLAGS :=  -DHAVE_FFTW3 -I/tmp/stubs/include 
+DSP_EXTRA_LIBS :=  -L/tmp/stubs/lib -lfftw3 -lm 
+LADSPA_DSP_OBJ += 
+LADSPA_DSP_CPP_OBJ += 
+LADSPA_DSP_EXTRA_CFLAGS :=  
+LADSPA_DSP_EXTRA_LIBS :=  
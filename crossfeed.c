@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <complex.h>
 #include "crossfeed.h"
 #include "biquad.h"
 #include "util.h"
@@ -58,27 +59,18 @@ static void crossfeed_effect_reset(struct effect *e)
 	biquad_reset(&state->hp[1]);
 }
 
-static void crossfeed_plot_channel(struct crossfeed_state *state, int fs, int i, int c, int cc)
-{
-	printf("H%d_%d(w)=(abs(w)<=pi)?%.15e*Ht%d_%d(w*%d/2.0/pi)",
-		c, i, state->direct_gain, c, i, fs);
-	printf("+%.15e*Ht%d_%d(w*%d/2.0/pi)*(" BIQUAD_PLOT_FMT ")",
-		state->cross_gain, cc, i, fs, BIQUAD_PLOT_FMT_ARGS(&state->lp[0]));
-	printf("+%.15e*Ht%d_%d(w*%d/2.0/pi)*(" BIQUAD_PLOT_FMT ")",
-		state->cross_gain, c, i, fs, BIQUAD_PLOT_FMT_ARGS(&state->hp[0]));
-	puts(":0/0");
-}
-
-static void crossfeed_effect_plot(struct effect *e, int i)
+static void crossfeed_effect_plot(struct effect *e, ssize_t n, double df, const double complex *ih, double complex *oh)
 {
 	struct crossfeed_state *state = (struct crossfeed_state *) e->data;
-	for (int k = 0; k < e->ostream.channels; ++k) {
-		if (k == state->c0)
-			crossfeed_plot_channel(state, e->ostream.fs, i, state->c0, state->c1);
-		else if (k == state->c1)
-			crossfeed_plot_channel(state, e->ostream.fs, i, state->c1, state->c0);
-		else
-			printf("H%d_%d(w)=Ht%d_%d(w*%d/2.0/pi)\n", k, i, k, i, e->ostream.fs);
+	memcpy(oh, ih, n * e->ostream.channels * sizeof(double complex));
+	const double complex *ih_c0 = &ih[state->c0*n], *ih_c1 = &ih[state->c1*n];
+	double complex *oh_c0 = &oh[state->c0*n], *oh_c1 = &oh[state->c1*n];
+	for (ssize_t i = 0; i < n; ++i) {
+		const double w = 2.0*M_PI*i*df/e->ostream.fs;
+		const double complex h_lp = biquad_freq_resp(&state->lp[0], w) * state->cross_gain;
+		const double complex h_d = biquad_freq_resp(&state->hp[0], w) * state->cross_gain + state->direct_gain;
+		oh_c0[i] = ih_c0[i]*h_d + ih_c1[i]*h_lp;
+		oh_c1[i] = ih_c1[i]*h_d + ih_c0[i]*h_lp;
 	}
 }
 
@@ -121,7 +113,6 @@ struct effect * crossfeed_effect_init(const struct effect_info *ei, const struct
 	e->name = ei->name;
 	e->istream.fs = e->ostream.fs = istream->fs;
 	e->istream.channels = e->ostream.channels = istream->channels;
-	e->flags |= EFFECT_FLAG_PLOT_MIX;
 	e->run = crossfeed_effect_run;
 	e->reset = crossfeed_effect_reset;
 	e->plot = crossfeed_effect_plot;
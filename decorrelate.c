@@ -18,7 +18,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <complex.h>
 #include <pthread.h>
 #include "decorrelate.h"
 #include "util.h"
@@ -44,8 +46,8 @@ static int sch_ap_init(struct sch_ap_state *ap, int fs, ssize_t delay_samples, d
 {
 	ap->len = delay_samples+1;
 	ap->p = 0;
-	ap->mx = calloc(ap->len, sizeof(sample_t));
-	ap->my = calloc(ap->len, sizeof(sample_t));
+	ap->mx = effect_alloc(ap->len, sizeof(sample_t));
+	ap->my = effect_alloc(ap->len, sizeof(sample_t));
 	if (!ap->mx || !ap->my) return DSP_ENOMEM;
 
 	const double gain_lf = -60.0/(rt60_lf * fs) * delay_samples;
@@ -83,8 +85,8 @@ static void sch_ap_reset(struct sch_ap_state *ap)
 
 static void sch_ap_destroy(struct sch_ap_state *ap)
 {
-	free(ap->mx);
-	free(ap->my);
+	effect_free(ap->mx);
+	effect_free(ap->my);
 }
 
 static sample_t * decorrelate_effect_run(struct effect *e, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
@@ -108,21 +110,30 @@ static void decorrelate_effect_reset(struct effect *e)
 				sch_ap_reset(&state->ap[k][j]);
 }
 
-static void decorrelate_effect_plot(struct effect *e, int i)
+static void decorrelate_effect_plot(struct effect *e, ssize_t n, double df, const double complex *ih, double complex *oh)
 {
 	struct decorrelate_state *state = (struct decorrelate_state *) e->data;
 	for (int k = 0; k < e->ostream.channels; ++k) {
+		const double complex *ih_k = &ih[k*n];
+		double complex *oh_k = &oh[k*n];
 		if (state->ap[k]) {
-			printf("H%d_%d(w)=(abs(w)<=pi)?1.0", k, i);
-			for (int j = 0; j < state->n_stages; ++j) {
-				struct sch_ap_state *ap = &state->ap[k][j];
-				printf("*((%.15e+%.15e*exp(-j*w)+%.15e*exp(-j*w*%d)+%.15e*exp(-j*w*%d))/(1.0+%.15e*exp(-j*w)+%.15e*exp(-j*w*%d)+%.15e*exp(-j*w*%d)))",
-					ap->b1, ap->b0, ap->a1, ap->len-1, ap->a0, ap->len, ap->a1, ap->b0, ap->len-1, ap->b1, ap->len);
+			for (ssize_t i = 0; i < n; ++i) {
+				const double w = 2.0*M_PI*i*df/e->ostream.fs;
+				if (w > M_PI) {
+					oh_k[i] = NAN;
+					continue;
+				}
+				double complex h = ih_k[i];
+				const double complex z1 = cexp(-I*w);
+				for (int j = 0; j < state->n_stages; ++j) {
+					struct sch_ap_state *ap = &state->ap[k][j];
+					const double complex zl1 = cexp(-I*w*(ap->len-1)), zl = zl1*z1;
+					h *= (ap->b1 + ap->b0*z1 + ap->a1*zl1 + ap->a0*zl) / (1.0 + ap->a1*z1 + ap->b0*zl1 + ap->b1*zl);
+				}
+				oh_k[i] = h;
 			}
-			puts(":0/0");
 		}
-		else
-			printf("H%d_%d(w)=1.0\n", k, i);
+		else memcpy(oh_k, ih_k, n * sizeof(double complex));
 	}
 }
 
@@ -134,12 +145,12 @@ static void decorrelate_effect_destroy(struct effect *e)
 			if (state->ap[k]) {
 				for (int j = 0; j < state->n_stages; ++j)
 					sch_ap_destroy(&state->ap[k][j]);
-				free(state->ap[k]);
+				effect_free(state->ap[k]);
 			}
 		}
-		free(state->ap);
+		effect_free(state->ap);
 	}
-	free(state);
+	effect_free(state);
 }
 
 #define RANDOM_FILTER_DELAY lround((double)pm_rand1_r((opt_seed>0)?&opt_seed:&seed)/PM_RAND_MAX*(delay_max-delay_min) + delay_min)
@@ -213,25 +224,26 @@ struct effect * decorrelate_effect_init(const struct effect_info *ei, const stru
 		CHECK_RANGE(n_stages > 0 && n_stages <= 100, "stages", return NULL);
 	}
 
-	e = calloc(1, sizeof(struct effect));
+	e = effect_alloc(1, sizeof(struct effect));
 	if (check_alloc(ei->name, e)) goto fail;
 	e->name = ei->name;
 	e->istream.fs = e->ostream.fs = istream->fs;
 	e->istream.channels = e->ostream.channels = istream->channels;
 	e->flags |= EFFECT_FLAG_OPT_REORDERABLE;
 	e->flags |= EFFECT_FLAG_CH_DEPS_IDENTITY;
+	e->flags |= EFFECT_FLAG_LTI;
 	e->run = decorrelate_effect_run;
 	e->reset = decorrelate_effect_reset;
 	e->plot = decorrelate_effect_plot;
 	e->destroy = decorrelate_effect_destroy;
-	e->data = state = calloc(1, sizeof(struct decorrelate_state));
+	e->data = state = effect_alloc(1, sizeof(struct decorrelate_state));
 	if (check_alloc(ei->name, state)) goto fail;
 	state->n_stages = n_stages;
-	state->ap = calloc(istream->channels, sizeof(struct sch_ap_state *));
+	state->ap = effect_alloc(istream->channels, sizeof(struct sch_ap_state *));
 	if (check_alloc(ei->name, state->ap)) goto fail;
 	for (int k = 0; k < istream->channels; ++k) {
 		if (GET_BIT(channel_selector, k)) {
-			state->ap[k] = calloc(n_stages, sizeof(struct sch_ap_state));
+			state->ap[k] = effect_alloc(n_stages, sizeof(struct sch_ap_state));
 			if (check_alloc(ei->name, state->ap[k])) goto fail;
 		}
 	}
@@ -254,6 +266,6 @@ struct effect * decorrelate_effect_init(const struct effect_info *ei, const stru
 
 	fail:
 	if (state) decorrelate_effect_destroy(e);
-	free(e);
+	effect_free(e);
 	return NULL;
 }
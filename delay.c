@@ -18,8 +18,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 #include <float.h>
 #include <math.h>
+#include <complex.h>
 #include <pthread.h>
 #include "delay.h"
 #include "allpass.h"
@@ -81,25 +84,27 @@ static void delay_effect_reset(struct effect *e)
 	}
 }
 
-static void delay_effect_plot(struct effect *e, int i)
+static void delay_effect_plot(struct effect *e, ssize_t n, double df, const double complex *ih, double complex *oh)
 {
 	struct delay_state *state = (struct delay_state *) e->data;
 	for (int k = 0; k < e->istream.channels; ++k) {
 		struct delay_channel_state *cs = &state->cs[k];
-		printf("H%d_%d(w)=exp(-j*w*%zd)", k, i, cs->samples_int);
-		if (cs->fd_ap_n == 1) {
-			printf("*((abs(w)<=pi)?(%.15e+1.0*exp(-j*w))/(1.0+%.15e*exp(-j*w)):0/0)",
-				cs->fd_ap.first.c0, cs->fd_ap.first.c0);
-		}
-		else if (cs->fd_ap_n == 2) {
-			printf("*((abs(w)<=pi)?(%.15e+%.15e*exp(-j*w)+exp(-2*j*w))/(1.0+%.15e*exp(-j*w)+%.15e*exp(-2*j*w)):0/0)",
-				cs->fd_ap.second.c1, cs->fd_ap.second.c0, cs->fd_ap.second.c0, cs->fd_ap.second.c1);
-		}
-		else if (cs->fd_ap_n > 2) {
-			putchar('*');
-			thiran_ap_plot(cs->fd_ap.nth);
+		const double complex *ih_k = &ih[k*n];
+		double complex *oh_k = &oh[k*n];
+		for (ssize_t i = 0; i < n; ++i) {
+			const double w = 2.0*M_PI*i*df/e->ostream.fs;
+			const double complex z1 = cexp(-I*w);
+			double complex h = ih_k[i] * cexp(-I*w*cs->samples_int);
+			if (cs->fd_ap_n == 1)
+				h *= (fabs(w) <= M_PI) ? (cs->fd_ap.first.c0 + z1) / (1.0 + cs->fd_ap.first.c0*z1) : NAN;
+			else if (cs->fd_ap_n == 2) {
+				h *= (fabs(w) <= M_PI) ? (cs->fd_ap.second.c1 + cs->fd_ap.second.c0*z1 + z1*z1)
+					/ (1.0 + cs->fd_ap.second.c0*z1 + cs->fd_ap.second.c1*z1*z1) : NAN;
+			}
+			else if (cs->fd_ap_n > 2)
+				h *= thiran_ap_freq_resp(cs->fd_ap.nth, w);
+			oh_k[i] = h;
 		}
-		putchar('\n');
 	}
 }
 
@@ -118,9 +123,9 @@ static void delay_effect_destroy(struct effect *e)
 			struct delay_channel_state *cs = &state->cs[k];
 			if (cs->fd_ap_n > 2) free(cs->fd_ap.nth);
 		}
-		free(state->cs);
+		effect_free(state->cs);
 	}
-	free(state);
+	effect_free(state);
 }
 
 static int delay_effect_merge(struct effect *dest, struct effect *src)
@@ -146,10 +151,11 @@ static void delay_effect_channel_offsets(struct effect *e, ssize_t *latency, ssi
 		req_delay[k] += state->cs[k].samples_int;
 }
 
+static int delay_effect_setup(struct effect *);
+
 static int delay_effect_prepare(struct effect *e)
 {
 	struct delay_state *state = (struct delay_state *) e->data;
-	int is_noop = 1;
 	for (int k = 0; k < e->istream.channels; ++k) {
 		struct delay_channel_state *cs = &state->cs[k];
 		if (cs->fd_ap_n < 1)
@@ -166,6 +172,14 @@ static int delay_effect_prepare(struct effect *e)
 			cs->fd_ap_n = 0;
 		}
 	}
+	return delay_effect_setup(e);
+}
+
+/* sets up the allpass filters once the delays are final */
+static int delay_effect_setup(struct effect *e)
+{
+	struct delay_state *state = (struct delay_state *) e->data;
+	int is_noop = 1;
 	for (int k = 0; k < e->istream.channels; ++k) {
 		struct delay_channel_state *cs = &state->cs[k];
 		if (cs->fd_ap_n > 0) {
@@ -204,20 +218,33 @@ static int delay_effect_prepare(struct effect *e)
 	return 0;
 }
 
-static struct effect * delay_effect_init_common(const char *name, const struct stream_info *istream, const char *channel_selector, ssize_t samples_int, double samples_frac, int fd_ap_n)
+static int delay_effect_save(struct effect *e, struct snapshot_writer *w)
+{
+	struct delay_state *state = (struct delay_state *) e->data;
+	snapshot_write_str(w, "delay");
+	for (int k = 0; k < e->istream.channels; ++k) {
+		const struct delay_channel_state *cs = &state->cs[k];
+		const int64_t samples_int = cs->samples_int, fd_ap_n = cs->fd_ap_n;
+		SNAPSHOT_WRITE_VAL(w, samples_int);
+		SNAPSHOT_WRITE_VAL(w, cs->samples_frac);
+		SNAPSHOT_WRITE_VAL(w, fd_ap_n);
+	}
+	return w->err;
+}
+
+static struct effect * delay_effect_new(const char *name, const struct stream_info *istream)
 {
 	struct effect *e = NULL;
 	struct delay_state *state = NULL;
 
-	e = calloc(1, sizeof(struct effect));
+	e = effect_alloc(1, sizeof(struct effect));
 	if (check_alloc(name, e)) goto fail;
 	e->name = name;
-	if (samples_int == 0 && samples_frac == 0.0)
-		return e;  /* nothing to do */
 	e->istream.fs = e->ostream.fs = istream->fs;
 	e->istream.channels = e->ostream.channels = istream->channels;
 	e->flags |= EFFECT_FLAG_OPT_REORDERABLE;
 	e->flags |= EFFECT_FLAG_CH_DEPS_IDENTITY;
+	e->flags |= EFFECT_FLAG_LTI;
 	e->prepare = delay_effect_prepare;
 	e->run = delay_effect_run;
 	e->reset = delay_effect_reset;
@@ -226,11 +253,31 @@ static struct effect * delay_effect_init_common(const char *name, const struct s
 	e->destroy = delay_effect_destroy;
 	e->merge = delay_effect_merge;
 	e->channel_offsets = delay_effect_channel_offsets;
+	e->save = delay_effect_save;
 
-	e->data = state = calloc(1, sizeof(struct delay_state));
+	e->data = state = effect_alloc(1, sizeof(struct delay_state));
 	if (check_alloc(name, state)) goto fail;
-	state->cs = calloc(e->istream.channels, sizeof(struct delay_channel_state));
+	state->cs = effect_alloc(e->istream.channels, sizeof(struct delay_channel_state));
 	if (check_alloc(name, state->cs)) goto fail;
+	return e;
+
+	fail:
+	if (state) delay_effect_destroy(e);
+	effect_free(e);
+	return NULL;
+}
+
+static struct effect * delay_effect_init_common(const char *name, const struct stream_info *istream, const char *channel_selector, ssize_t samples_int, double samples_frac, int fd_ap_n)
+{
+	if (samples_int == 0 && samples_frac == 0.0) {
+		struct effect *e = effect_alloc(1, sizeof(struct effect));
+		if (check_alloc(name, e)) return NULL;
+		e->name = name;
+		return e;  /* nothing to do */
+	}
+	struct effect *e = delay_effect_new(name, istream);
+	if (e == NULL) return NULL;
+	struct delay_state *state = (struct delay_state *) e->data;
 	for (int k = 0; k < e->istream.channels; ++k) {
 		if (GET_BIT(channel_selector, k)) {
 			state->cs[k].samples_int = samples_int;
@@ -239,10 +286,29 @@ static struct effect * delay_effect_init_common(const char *name, const struct s
 		}
 	}
 	return e;
+}
+
+/* the saved delays are already prepared */
+struct effect * delay_effect_load(const char *name, const struct stream_info *istream, struct snapshot_reader *r)
+{
+	struct effect *e = delay_effect_new(name, istream);
+	if (e == NULL) return NULL;
+	struct delay_state *state = (struct delay_state *) e->data;
+	for (int k = 0; k < e->istream.channels; ++k) {
+		struct delay_channel_state *cs = &state->cs[k];
+		int64_t samples_int, fd_ap_n;
+		if (SNAPSHOT_READ_VAL(r, samples_int) || SNAPSHOT_READ_VAL(r, cs->samples_frac)
+				|| SNAPSHOT_READ_VAL(r, fd_ap_n) || fd_ap_n < 0 || fd_ap_n > INT_MAX)
+			goto fail;
+		cs->samples_int = samples_int;
+		cs->fd_ap_n = fd_ap_n;
+	}
+	e->prepare = NULL;
+	if (delay_effect_setup(e)) goto fail;
+	return e;
 
 	fail:
-	if (state) delay_effect_destroy(e);
-	free(e);
+	destroy_effect(e);
 	return NULL;
 }
 
@@ -615,10 +681,10 @@ static void mod_effect_destroy(struct effect *e)
 	struct mod_state *state = (struct mod_state *) e->data;
 	if (state->cs) {
 		for (int k = 0; k < e->istream.channels; ++k)
-			free(state->cs[k].buf);
-		free(state->cs);
+			effect_free(state->cs[k].buf);
+		effect_free(state->cs);
 	}
-	free(state);
+	effect_free(state);
 }
 
 static void mod_effect_channel_offsets(struct effect *e, ssize_t *latency, ssize_t *req_delay)
@@ -640,7 +706,7 @@ static struct effect * mod_effect_init(const char *name, const struct stream_inf
 		goto fail;
 	}
 
-	e = calloc(1, sizeof(struct effect));
+	e = effect_alloc(1, sizeof(struct effect));
 	if (check_alloc(name, e)) goto fail;
 	e->name = name;
 	e->istream.fs = e->ostream.fs = istream->fs;
@@ -653,9 +719,9 @@ static struct effect * mod_effect_init(const char *name, const struct stream_inf
 	e->destroy = mod_effect_destroy;
 	e->channel_offsets = mod_effect_channel_offsets;
 
-	e->data = state = calloc(1, sizeof(struct mod_state));
+	e->data = state = effect_alloc(1, sizeof(struct mod_state));
 	if (check_alloc(name, state)) goto fail;
-	state->cs = calloc(e->istream.channels, sizeof(struct mod_channel_state));
+	state->cs = effect_alloc(e->istream.channels, sizeof(struct mod_channel_state));
 	if (check_alloc(name, state->cs)) goto fail;
 	pthread_mutex_lock(&rand_lock);
 	state->seeds[0] = pm_rand2_r(&seed);
@@ -667,7 +733,7 @@ static struct effect * mod_effect_init(const char *name, const struct stream_inf
 			cs->q = qual;
 			cs->n = mod_interp_n[cs->q];
 			cs->len = lrint(ceil(samples))*2+cs->n;
-			cs->buf = calloc(state->cs[k].len+cs->n, sizeof(sample_t));
+			cs->buf = effect_alloc(state->cs[k].len+cs->n, sizeof(sample_t));
 			if (check_alloc(name, cs->buf)) goto fail;
 			if (is_mono) memcpy(cs->seeds, state->seeds, sizeof(cs->seeds));
 			mod_noise_state_init(&cs->ns, istream->fs, fc, (is_mono) ? cs->seeds : state->seeds);
@@ -678,7 +744,7 @@ static struct effect * mod_effect_init(const char *name, const struct stream_inf
 
 	fail:
 	if (state) mod_effect_destroy(e);
-	free(e);
+	effect_free(e);
 	return NULL;
 }
 
@@ -25,6 +25,7 @@
 struct effect * delay_effect_init_int(const char *, const struct stream_info *, const char *, ssize_t);
 struct effect * delay_effect_init_frac(const char *, const struct stream_info *, const char *, double, int);
 struct effect * delay_effect_init(const struct effect_info *, const struct stream_info *, const char *, const char *, int, const char *const *);
+struct effect * delay_effect_load(const char *, const struct stream_info *, struct snapshot_reader *);
 
 #define DELAY_EFFECT_INFO \
 	{ "delay", "[-f[order]] [-m|M depth[s|m|S|%]] [-b bw[k]] [-q quality] delay[s|m|S]", delay_effect_init, 0 }
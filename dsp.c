@@ -20,11 +20,14 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <sched.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <string.h>
 #include <math.h>
+#include <float.h>
 #include <signal.h>
 #include <pthread.h>
 #include <semaphore.h>
@@ -36,13 +39,14 @@
 #include "effects_chain.h"
 #include "codec.h"
 #include "codec_buf.h"
+#include "combine.h"
 #include "util.h"
 #include "list_util.h"
 
-#define CHOOSE_INPUT_FS(x) \
-	(((x) == 0) ? (input_list.head == NULL || input_mode == INPUT_MODE_SEQUENCE) ? DEFAULT_FS : input_list.head->codec->fs : (x))
-#define CHOOSE_INPUT_CHANNELS(x) \
-	(((x) == 0) ? (input_list.head == NULL || input_mode == INPUT_MODE_SEQUENCE) ? DEFAULT_CHANNELS : input_list.head->codec->channels : (x))
+#define CHOOSE_INPUT_FS(x, first) \
+	(((x) == 0) ? ((first) == NULL || input_mode == INPUT_MODE_SEQUENCE) ? DEFAULT_FS : (first)->fs : (x))
+#define CHOOSE_INPUT_CHANNELS(x, first) \
+	(((x) == 0) ? ((first) == NULL || input_mode == INPUT_MODE_SEQUENCE) ? DEFAULT_CHANNELS : (first)->channels : (x))
 #define SHOULD_DITHER(in, out, chain_needs_dither) \
 	(force_dither != -1 && ((out)->hints & CODEC_HINT_CAN_DITHER) && \
 		(force_dither == 1 || ((out)->prec < 24 && ((chain_needs_dither) || (in)->prec > (out)->prec || !((in)->hints & CODEC_HINT_CAN_DITHER)))))
@@ -61,6 +65,8 @@ enum input_mode {
 	INPUT_MODE_CONCAT,
 	INPUT_MODE_ABX,
 	INPUT_MODE_SEQUENCE,
+	INPUT_MODE_MIX,
+	INPUT_MODE_MERGE,
 };
 
 enum event_type {
@@ -117,6 +123,40 @@ static struct read_buf_input_list abx_inputs[2] = {
 };
 static struct codec_read_buf *abx_codec_bufs[2] = { NULL, NULL };
 
+#define RT_BUF_RATIO 2   /* two periods of one block each */
+#define RT_PRIORITY  70
+static int rt_mode = 0;
+
+#define OPEN_AHEAD_DEFAULT 2
+#define OPEN_MAX_THREADS   8
+static int open_ahead = OPEN_AHEAD_DEFAULT;
+static const char *ir_len_arg = NULL;
+static const char *chain_snapshot_path = NULL;
+static struct input_spec {
+	struct codec_params p;
+	const char *start_timespec;
+	ssize_t repeats;
+	double gain;
+	int req_blocks;
+	struct codec *c;
+} *input_specs = NULL;
+static int n_input_specs = 0;
+static struct {
+	pthread_mutex_t lock;
+	int next;
+} open_queue = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+#define TELEMETRY_INTERVAL 1.0  /* seconds */
+static struct {
+	FILE *f;
+	ssize_t blocks, misses, short_reads, short_writes;
+	double max_load;  /* over the whole run */
+	double audio_time, proc_time, proc_max, load_max;  /* since the last dump */
+#ifdef HAVE_CLOCK_GETTIME
+	struct timespec t0, start, last_dump;
+#endif
+} telemetry = {0};
+
 static const char help_text[] =
 	"Usage: %s [options] path ... [effect [args]] ...\n"
 	"\n"
@@ -133,9 +173,18 @@ static const char help_text[] =
 	"  -E         don't drain effects chain before rebuilding\n"
 	"  -p         plot effects chain magnitude response instead of processing audio\n"
 	"  -P         same as '-p', but also plot phase response\n"
+	"  -H         write effects chain frequency response as CSV instead of processing audio\n"
+	"  -m len     write effects chain impulse response to the output instead of processing audio\n"
+	"  -F opts    bake runs of linear time-invariant effects into one filter (opts: max_len[,tol_dB])\n"
+	"  -Z path    load the effects chain from a snapshot file if it is up to date; save it otherwise\n"
 	"  -V         verbose progress display\n"
 	"  -S         use \"sequence\" input combining mode\n"
+	"  -M         use \"mix\" input combining mode\n"
+	"  -C         use \"merge\" input combining mode\n"
 	"  -X[n]      run in ABX comparator mode\n"
+	"  -Y         run in real-time duplex mode\n"
+	"  -J path    write telemetry to path as JSON lines\n"
+	"  -A n       open inputs lazily, n ahead of the current one (-1: open all)\n"
 	"\n"
 	"Input/output options:\n"
 	"  -o               output\n"
@@ -147,6 +196,7 @@ static const char help_text[] =
 	"  -R ratio         buffer ratio\n"
 	"  -T time_range    set start and end positions (input only)\n"
 	"  -l[n]            repeat n times or indefinitely (input only)\n"
+	"  -g gain          gain in dB (input only; mix and merge modes)\n"
 	"  -n               equivalent to '-t null null'\n";
 
 static const char interactive_help[] =
@@ -179,6 +229,7 @@ static const char abx_interactive_help[] =
 struct dsp_globals dsp_globals = {
 	LL_NORMAL,              /* loglevel */
 	"dsp",                  /* prog_name */
+	DEFAULT_BLOCK_FRAMES,   /* block_frames */
 };
 
 static void statuslines_clear(void)
@@ -388,6 +439,9 @@ static void __attribute__((noreturn)) cleanup_and_exit(int s)
 	}
 	codec_read_buf_destroy(in_codec_buf);
 	read_buf_input_list_destroy(&input_list);
+	for (int i = 0; i < n_input_specs; ++i)
+		destroy_codec(input_specs[i].c);
+	free(input_specs);
 	for (int i = 0; i < 2; ++i) {
 		codec_read_buf_destroy(abx_codec_bufs[i]);
 		read_buf_input_list_destroy(&abx_inputs[i]);
@@ -403,6 +457,10 @@ static void __attribute__((noreturn)) cleanup_and_exit(int s)
 	free(buf2);
 	if (term_attrs_saved)
 		tcsetattr(term_fd, TCSANOW, &term_attrs);
+	if (rt_mode && telemetry.blocks > 0)
+		LOG_FMT(LL_NORMAL, "info: real-time: %zd periods; %zd deadline misses; max load %.1f%%",
+			telemetry.blocks, telemetry.misses, telemetry.max_load * 100.0);
+	if (telemetry.f) fclose(telemetry.f);
 	if (clip_count > 0)
 		LOG_FMT(LL_NORMAL, "warning: clipped %zd sample%s (%.2fdBFS peak)",
 			clip_count, (clip_count == 1) ? "" : "s", 20.0*log10(peak));
@@ -432,7 +490,7 @@ static void print_help(void)
 	print_all_effects();
 }
 
-static int parse_codec_params(struct dsp_getopt_state *g, int argc, const char *const *argv, struct codec_params *p, const char **r_timespan, ssize_t *r_repeats)
+static int parse_codec_params(struct dsp_getopt_state *g, int argc, const char *const *argv, struct codec_params *p, const char **r_timespan, ssize_t *r_repeats, double *r_gain)
 {
 	int opt;
 	char *endptr;
@@ -444,20 +502,22 @@ static int parse_codec_params(struct dsp_getopt_state *g, int argc, const char *
 	p->buf_ratio = 0;
 	*r_timespan = NULL;
 	*r_repeats = 0;
+	*r_gain = 1.0;
 
-	while ((opt = dsp_getopt(g, argc, argv, "hb:iIqsvdDEpPVSX::ot:e:BLNr:c:R:T:l::n")) != -1) {
+	while ((opt = dsp_getopt(g, argc, argv, "hb:iIqsvdDEpPHm:F:Z:VSMCX::YJ:A:ot:e:BLNr:c:R:T:l::g:n")) != -1) {
 		switch (opt) {
 		case 'h':
 			print_help();
 			cleanup_and_exit(0);
 		case 'b':
-			if (input_list.head == NULL) {
+			if (n_input_specs == 0) {
 				block_frames = strtol(g->arg, &endptr, 10);
 				if (check_endptr(NULL, g->arg, endptr, "block size")) return 1;
 				if (block_frames <= 1) {
 					LOG_S(LL_ERROR, "error: block size must be > 1");
 					return 1;
 				}
+				dsp_globals.block_frames = block_frames;
 			}
 			else
 				LOG_S(LL_ERROR, "warning: block size must be specified before the first input");
@@ -487,10 +547,22 @@ static int parse_codec_params(struct dsp_getopt_state *g, int argc, const char *
 			drain_effects = 0;
 			break;
 		case 'p':
-			plot = 1;
+			plot = PLOT_MODE_MAGNITUDE;
 			break;
 		case 'P':
-			plot = 2;
+			plot = PLOT_MODE_PHASE;
+			break;
+		case 'H':
+			plot = PLOT_MODE_TABLE;
+			break;
+		case 'm':
+			ir_len_arg = g->arg;
+			break;
+		case 'F':
+			if (effects_chain_set_bake_opts(g->arg)) return 1;
+			break;
+		case 'Z':
+			chain_snapshot_path = g->arg;
 			break;
 		case 'V':
 			verbose_progress = 1;
@@ -498,6 +570,12 @@ static int parse_codec_params(struct dsp_getopt_state *g, int argc, const char *
 		case 'S':
 			input_mode = INPUT_MODE_SEQUENCE;
 			break;
+		case 'M':
+			input_mode = INPUT_MODE_MIX;
+			break;
+		case 'C':
+			input_mode = INPUT_MODE_MERGE;
+			break;
 		case 'X':
 			input_mode = INPUT_MODE_ABX;
 			if (g->arg) {
@@ -510,6 +588,22 @@ static int parse_codec_params(struct dsp_getopt_state *g, int argc, const char *
 			}
 			else n_trials = ABX_TRIALS_DEFAULT;
 			break;
+		case 'Y':
+			rt_mode = 1;
+			break;
+		case 'J':
+			if (telemetry.f) fclose(telemetry.f);
+			if ((telemetry.f = fopen(g->arg, "w")) == NULL) {
+				LOG_FMT(LL_ERROR, "error: failed to open telemetry output: %s: %s", g->arg, strerror(errno));
+				return 1;
+			}
+			setvbuf(telemetry.f, NULL, _IOLBF, 0);
+			break;
+		case 'A':
+			open_ahead = strtol(g->arg, &endptr, 10);
+			if (check_endptr(NULL, g->arg, endptr, "open ahead")) return 1;
+			if (open_ahead < -1) open_ahead = -1;
+			break;
 		case 'o':
 			p->mode = CODEC_MODE_WRITE;
 			break;
@@ -565,6 +659,10 @@ static int parse_codec_params(struct dsp_getopt_state *g, int argc, const char *
 			}
 			else *r_repeats = READ_BUF_INPUT_REPEAT_INF;
 			break;
+		case 'g':
+			*r_gain = pow(10.0, strtod(g->arg, &endptr) / 20.0);
+			if (check_endptr(NULL, g->arg, endptr, "gain")) return 1;
+			break;
 		default:
 			dsp_getopt_print_error(g, opt, NULL);
 			return 1;
@@ -648,6 +746,12 @@ static void update_progress(ssize_t pos, ssize_t repeats, int is_paused, int for
 			pl += snprintf(progress_line + pl, LENGTH(progress_line) - pl, "  lat:%.2fms+%.2fms+%.2fms=%.2fms",
 				in_delay_s*1000.0, chain_delay_s*1000.0, out_delay_s*1000.0, (in_delay_s+chain_delay_s+out_delay_s)*1000.0);
 		}
+		if (pl < LENGTH(progress_line)-1 && verbose_progress) {
+			if (rt_mode) pl += snprintf(progress_line + pl, LENGTH(progress_line) - pl, "  miss:%zd", telemetry.misses);
+			if (pl < LENGTH(progress_line)-1)
+				pl += snprintf(progress_line + pl, LENGTH(progress_line) - pl, "  xrun:%zd  load:%.0f%%",
+					in->xruns + out_codec->xruns, telemetry.max_load * 100.0);
+		}
 		if (pl < LENGTH(progress_line)-1 && (verbose_progress || clip_count != 0)) {
 			pl += snprintf(progress_line + pl, LENGTH(progress_line) - pl, "  peak:%.2fdBFS  clip:%zd",
 				20.0*log10(peak), clip_count);
@@ -662,6 +766,7 @@ static void write_buf_error_cb(int error)
 {
 	switch (error) {
 	case CODEC_BUF_ERROR_SHORT_WRITE:
+		++telemetry.short_writes;
 		LOG_S(LL_ERROR, "error: short write");
 		break;
 	default:
@@ -738,6 +843,124 @@ static void do_pause(int pause_state, int sync)
 	codec_write_buf_pause(out_codec_buf, pause_state, sync);
 }
 
+#define IR_CHECK_SHIFT  1009   /* pre-roll and check shift (input frames); rounded up to a multiple of the resampling ratio denominator */
+#define IR_CHECK_THRESH -60.0  /* dB */
+
+/* peak deviation of b*scale from a relative to the peak of a (dB) */
+static double ir_deviation(const sample_t *a, const sample_t *b, sample_t scale, ssize_t samples)
+{
+	sample_t a_peak = 0.0, err = 0.0;
+	for (ssize_t i = 0; i < samples; ++i) {
+		a_peak = MAXIMUM(a_peak, fabs(a[i]));
+		err = MAXIMUM(err, fabs(a[i] - b[i]*scale));
+	}
+	if (err <= a_peak*DBL_EPSILON) return -HUGE_VAL;
+	return (a_peak > 0.0) ? 20.0*log10(err/a_peak) : HUGE_VAL;
+}
+
+static struct codec_write_buf * init_out_codec(struct codec_params *, struct stream_info *, ssize_t, int);
+
+/* builds the chain, going through the snapshot file if one was given */
+static int build_chain(int argc, const char *const *argv, struct effects_chain *c, struct stream_info *stream)
+{
+	if (chain_snapshot_path && effects_chain_load_snapshot(chain_snapshot_path, argc, argv, c, stream) == 0)
+		return 0;
+	if (build_effects_chain_from_argv(argc, argv, c, stream, NULL, NULL))
+		return 1;
+	if (chain_snapshot_path)
+		effects_chain_save_snapshot(c, chain_snapshot_path, argc, argv);  /* not fatal */
+	return 0;
+}
+
+/* Writes the impulse response from each input channel to each output
+   channel. If the chain does not mix channels, there is one output channel
+   per input channel, so the result can be loaded by the fir effect as-is.
+   Otherwise, output channel (i*out_channels + k) is the response from
+   input channel i to chain output channel k. */
+static int write_impulse_response(const char *len_arg, struct codec_params *out_p)
+{
+	char *endptr;
+	int r = 1;
+	const int in_ch = chain.istream.channels, out_ch = chain.ostream.channels;
+	const ssize_t frames = parse_len(len_arg, chain.ostream.fs, &endptr);
+	if (check_endptr(NULL, len_arg, endptr, "impulse response length")) return 1;
+	if (frames < 1) {
+		LOG_S(LL_ERROR, "error: impulse response length must be > 0");
+		return 1;
+	}
+	const ssize_t shift_in = ratio_mult_ceil(IR_CHECK_SHIFT, 1, chain.ratio.d) * chain.ratio.d;
+	const ssize_t shift_out = shift_in / chain.ratio.d * chain.ratio.n;
+	sample_t *ir = calloc(frames * out_ch * in_ch, sizeof(sample_t));
+	sample_t *tmp = calloc((frames + shift_out*2) * out_ch, sizeof(sample_t));
+	sample_t *obuf = NULL;
+	if (!ir || !tmp) {
+		dsp_perror(DSP_ENOMEM, __func__, NULL);
+		goto done;
+	}
+
+	/* Each impulse is preceded by shift_in frames of silence so effects
+	   which trim their startup latency (e.g. resample) are measured in
+	   their steady state. */
+	int diagonal = (in_ch == out_ch);
+	for (int c = 0; c < in_ch; ++c) {
+		sample_t *ir_c = &ir[c * frames * out_ch];
+		if (effects_chain_impulse_response(&chain, c, 1.0, shift_in, frames + shift_out, block_frames, tmp))
+			goto done;
+		memcpy(ir_c, &tmp[shift_out * out_ch], frames * out_ch * sizeof(sample_t));
+		for (ssize_t i = 0; i < frames * out_ch && diagonal; ++i)
+			if (i % out_ch != c && ir_c[i] != 0.0) diagonal = 0;
+
+		/* linearity and time invariance check */
+		if (effects_chain_impulse_response(&chain, c, 0.5, shift_in, frames + shift_out, block_frames, tmp))
+			goto done;
+		const double lin = ir_deviation(ir_c, &tmp[shift_out * out_ch], 2.0, frames * out_ch);
+		if (effects_chain_impulse_response(&chain, c, 1.0, shift_in*2, frames + shift_out*2, block_frames, tmp))
+			goto done;
+		const double tv = ir_deviation(ir_c, &tmp[shift_out*2 * out_ch], 1.0, frames * out_ch);
+		if (lin > IR_CHECK_THRESH || tv > IR_CHECK_THRESH)
+			LOG_FMT(LL_ERROR, "warning: input channel %d: effects chain is not linear and time-invariant (linearity error: %.1fdB; time variance: %.1fdB); impulse response is not exact",
+				c, lin, tv);
+		else LOG_FMT(LL_VERBOSE, "info: input channel %d: linearity error: %.1fdB; time variance: %.1fdB", c, lin, tv);
+	}
+
+	struct stream_info stream = {
+		.fs = chain.ostream.fs,
+		.channels = (diagonal) ? out_ch : in_ch * out_ch,
+	};
+	if (!diagonal)
+		LOG_FMT(LL_NORMAL, "info: effects chain mixes channels; output channel i*%d+k is the response from input i to output k", out_ch);
+	if (init_out_codec(out_p, &stream, frames, out_p->buf_ratio) == NULL)
+		goto done;
+	/* the response is written as-is; clipping it would make it wrong */
+	sample_t ir_peak = 0.0;
+	for (ssize_t i = 0; i < frames * out_ch * in_ch; ++i)
+		ir_peak = MAXIMUM(ir_peak, fabs(ir[i]));
+	if (ir_peak > 1.0 && (out_codec->hints & CODEC_HINT_CAN_DITHER)) {
+		LOG_FMT(LL_ERROR, "error: impulse response peak is %+.2fdBFS; use a floating-point output encoding", 20.0*log10(ir_peak));
+		goto done;
+	}
+	obuf = calloc(block_frames * stream.channels, sizeof(sample_t));
+	if (check_alloc(__func__, obuf)) goto done;
+	for (ssize_t pos = 0; pos < frames;) {
+		const ssize_t w = MINIMUM(block_frames, frames - pos);
+		for (ssize_t i = 0; i < w; ++i, ++pos) {
+			for (int c = 0; c < in_ch; ++c) {
+				const sample_t *ir_c = &ir[(c * frames + pos) * out_ch];
+				if (diagonal) obuf[i*stream.channels + c] = ir_c[c];
+				else memcpy(&obuf[i*stream.channels + c*out_ch], ir_c, out_ch * sizeof(sample_t));
+			}
+		}
+		codec_write_buf_write(out_codec_buf, obuf, w);
+	}
+	r = 0;
+
+	done:
+	free(ir);
+	free(tmp);
+	free(obuf);
+	return r;
+}
+
 static struct codec_write_buf * init_out_codec(struct codec_params *out_p, struct stream_info *stream, ssize_t frames, int write_buf_blocks)
 {
 	struct codec_params p = *out_p;
@@ -769,6 +992,128 @@ static struct codec_write_buf * init_out_codec(struct codec_params *out_p, struc
 	return out_codec_buf;
 }
 
+static void prepare_input_params(struct input_spec *spec, const struct codec *first)
+{
+	spec->p.fs = CHOOSE_INPUT_FS(spec->p.fs, first);
+	spec->p.channels = CHOOSE_INPUT_CHANNELS(spec->p.channels, first);
+	if (rt_mode) spec->p.buf_ratio = RT_BUF_RATIO;
+	spec->req_blocks = spec->p.buf_ratio;
+	if (spec->p.buf_ratio - CODEC_BUF_MIN_BLOCKS >= 2)
+		spec->p.buf_ratio = 2;
+}
+
+static void * open_input_worker(void *arg)
+{
+	for (;;) {
+		pthread_mutex_lock(&open_queue.lock);
+		const int i = open_queue.next++;
+		pthread_mutex_unlock(&open_queue.lock);
+		if (i >= n_input_specs) break;
+		struct input_spec *spec = &input_specs[i];
+		spec->c = (open_ahead >= 0) ? init_codec_lazy(&spec->p) : init_codec(&spec->p);
+	}
+	return NULL;
+}
+
+/* Opens (or probes, if opening lazily) all inputs, in parallel where
+   possible. The first input is opened alone because its sample rate and
+   number of channels are the defaults for the rest. */
+static void open_inputs(void)
+{
+	pthread_t threads[OPEN_MAX_THREADS-1];
+	int n_threads = 0;
+	if (n_input_specs == 0) return;
+	prepare_input_params(&input_specs[0], NULL);
+	open_queue.next = n_input_specs;
+	input_specs[0].c = (open_ahead >= 0) ? init_codec_lazy(&input_specs[0].p) : init_codec(&input_specs[0].p);
+	if (input_specs[0].c == NULL) return;
+	for (int i = 1; i < n_input_specs; ++i)
+		prepare_input_params(&input_specs[i], input_specs[0].c);
+
+	open_queue.next = 1;
+	const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	const int max_threads = MINIMUM(n_input_specs-1, MINIMUM(MAXIMUM(n_cpus, 1), OPEN_MAX_THREADS));
+	while (n_threads < max_threads-1 && pthread_create(&threads[n_threads], NULL, open_input_worker, NULL) == 0)
+		++n_threads;
+	open_input_worker(NULL);
+	for (int i = 0; i < n_threads; ++i)
+		pthread_join(threads[i], NULL);
+}
+
+static void rt_setup(void)
+{
+	int err;
+	struct sched_param param = {0};
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+		LOG_FMT(LL_ERROR, "warning: real-time: mlockall() failed: %s", strerror(errno));
+	param.sched_priority = MINIMUM(RT_PRIORITY, sched_get_priority_max(SCHED_FIFO));
+	if ((err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) != 0)
+		LOG_FMT(LL_ERROR, "warning: real-time: failed to set scheduling policy: %s", strerror(err));
+	LOG_FMT(LL_VERBOSE, "info: real-time: period: %d frames (%.2fms)", block_frames, (double) block_frames / out_codec->fs * 1000.0);
+}
+
+static inline void telemetry_block_begin(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+	clock_gettime(CLOCK_MONOTONIC, &telemetry.start);
+#endif
+}
+
+/* the time from the end of the read to the end of the write is compared
+   against the duration of the block; in real-time mode, exceeding it is a
+   missed deadline */
+static inline void telemetry_block_end(ssize_t frames, int fs)
+{
+#ifdef HAVE_CLOCK_GETTIME
+	if (frames <= 0) return;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	const double t = (now.tv_sec - telemetry.start.tv_sec) + (now.tv_nsec - telemetry.start.tv_nsec) / 1e9;
+	const double budget = (double) frames / fs, load = t / budget;
+	++telemetry.blocks;
+	telemetry.audio_time += budget;
+	telemetry.proc_time += t;
+	telemetry.proc_max = MAXIMUM(telemetry.proc_max, t);
+	telemetry.load_max = MAXIMUM(telemetry.load_max, load);
+	telemetry.max_load = MAXIMUM(telemetry.max_load, load);
+	if (rt_mode && t > budget) {
+		++telemetry.misses;
+		LOG_FMT(LL_VERBOSE, "warning: real-time: deadline missed in period %zd: %.3fms > %.3fms",
+			telemetry.blocks, t * 1000.0, budget * 1000.0);
+	}
+#endif
+}
+
+static void telemetry_dump(ssize_t pos, int force)
+{
+#ifdef HAVE_CLOCK_GETTIME
+	if (telemetry.f == NULL) return;
+	if (!has_elapsed(&telemetry.last_dump, TELEMETRY_INTERVAL)) {
+		if (!force) return;
+		clock_gettime(CLOCK_MONOTONIC, &telemetry.last_dump);
+	}
+	struct codec *in = input_list.head->codec;
+	struct codec_buf_stats in_st, out_st;
+	double chain_delay_s, out_delay_s;
+	codec_read_buf_get_stats(in_codec_buf, &in_st, 1);
+	codec_write_buf_get_stats(out_codec_buf, &out_st, 1);
+	get_delay_sec(&chain_delay_s, &out_delay_s, 0);
+	const double in_delay_s = (double) codec_read_buf_delay(in_codec_buf) / in->fs;
+	const double t = (telemetry.last_dump.tv_sec - telemetry.t0.tv_sec) + (telemetry.last_dump.tv_nsec - telemetry.t0.tv_nsec) / 1e9;
+	fprintf(telemetry.f, "{\"time\":%.3f,\"pos\":%zd,\"blocks\":%zd,\"overruns\":%zd,\"underruns\":%zd,"
+		"\"short_reads\":%zd,\"short_writes\":%zd,\"deadline_misses\":%zd,"
+		"\"in_queue\":{\"len\":%d,\"lo\":%d,\"hi\":%d},\"out_queue\":{\"len\":%d,\"lo\":%d,\"hi\":%d},"
+		"\"proc_max_ms\":%.3f,\"load_avg\":%.4f,\"load_max\":%.4f,"
+		"\"est_delay_ms\":{\"in\":%.3f,\"chain\":%.3f,\"out\":%.3f,\"total\":%.3f},\"clip\":%zd}\n",
+		t, pos, telemetry.blocks, in->xruns, out_codec->xruns,
+		telemetry.short_reads, telemetry.short_writes, telemetry.misses,
+		in_st.len, in_st.lo, in_st.hi, out_st.len, out_st.lo, out_st.hi,
+		telemetry.proc_max * 1000.0, (telemetry.audio_time > 0.0) ? telemetry.proc_time / telemetry.audio_time : 0.0, telemetry.load_max,
+		in_delay_s * 1000.0, chain_delay_s * 1000.0, out_delay_s * 1000.0, (in_delay_s + chain_delay_s + out_delay_s) * 1000.0, clip_count);
+	telemetry.audio_time = telemetry.proc_time = telemetry.proc_max = telemetry.load_max = 0.0;
+#endif
+}
+
 static void query_term_size(void)
 {
 #if defined(TIOCGWINSZ) || defined(TIOCGSIZE)
@@ -1048,7 +1393,7 @@ static void run_abx_loop(void)
 		destroy_effects_chain(&chain); \
 		stream.fs = input_list.head->codec->fs; \
 		stream.channels = input_list.head->codec->channels; \
-		if (build_effects_chain_from_argv(chain_argc, (const char *const *) &argv[chain_start], &chain, &stream, NULL, NULL)) \
+		if (build_chain(chain_argc, (const char *const *) &argv[chain_start], &chain, &stream)) \
 			cleanup_and_exit(1); \
 	} while (0)
 
@@ -1098,72 +1443,117 @@ int main(int argc, char *argv[])
 	while (g.ind < argc && !IS_EFFECTS_CHAIN_START(argv[g.ind])) {
 		const char *start_timespec;
 		ssize_t repeats;
-		if (parse_codec_params(&g, argc, (const char *const *) argv, &p, &start_timespec, &repeats))
+		double gain;
+		if (parse_codec_params(&g, argc, (const char *const *) argv, &p, &start_timespec, &repeats, &gain))
 			cleanup_and_exit(1);
 		if (p.mode == CODEC_MODE_WRITE) {
 			if (start_timespec) LOG_FMT(LL_ERROR, "warning: ignoring '-T' option for output: %s", p.path);
 			if (repeats) LOG_FMT(LL_ERROR, "warning: ignoring '-l' option for output: %s", p.path);
+			if (gain != 1.0) LOG_FMT(LL_ERROR, "warning: ignoring '-g' option for output: %s", p.path);
 			out_p = p;
 		}
 		else {
-			p.fs = CHOOSE_INPUT_FS(p.fs);
-			p.channels = CHOOSE_INPUT_CHANNELS(p.channels);
-			const int req_blocks = p.buf_ratio;
-			if (p.buf_ratio - CODEC_BUF_MIN_BLOCKS >= 2)
-				p.buf_ratio = 2;
-			struct codec *c = init_codec(&p);
-			if (c == NULL) {
-				LOG_FMT(LL_ERROR, "error: failed to open input: %s", p.path);
+			struct input_spec *specs = realloc(input_specs, (n_input_specs+1) * sizeof(struct input_spec));
+			if (check_alloc(dsp_globals.prog_name, specs))
 				cleanup_and_exit(1);
-			}
-			read_buf_blocks = MAXIMUM(read_buf_blocks, req_blocks - c->buf_ratio);
-			print_io_info(c, LL_VERBOSE, "input");
-			ssize_t c_frames = c->frames;
-			ssize_t start_pos = 0, end_pos = READ_BUF_INPUT_END_UNSPECIFIED;
-			if (start_timespec) {
-				char *endptr;
-				start_pos = parse_timespec(start_timespec, c->fs, &endptr);
-				int end_is_rel = (*endptr == '+');
-				if (endptr != start_timespec && (end_is_rel || *endptr == '-')) {
-					char *end_timespec = endptr+1;
-					end_pos = parse_timespec(end_timespec, c->fs, &endptr);
-					if (check_endptr(NULL, end_timespec, endptr, "end timespec"))
-						cleanup_and_exit(1);
-					if (end_pos < 0) {
-						if (end_is_rel) {
-							LOG_FMT(LL_ERROR, "error: %s: end timespec must be positive when relative to start timespec", c->path);
-							cleanup_and_exit(1);
-						}
-						end_pos = MAXIMUM(c_frames+end_pos, 0);
-					}
-				}
-				else if (check_endptr(NULL, start_timespec, endptr, "start timespec"))
+			input_specs = specs;
+			input_specs[n_input_specs++] = (struct input_spec) {
+				.p = p,
+				.start_timespec = start_timespec,
+				.repeats = repeats,
+				.gain = gain,
+			};
+		}
+	}
+	open_inputs();
+	for (int i = 0; i < n_input_specs; ++i) {
+		struct input_spec *spec = &input_specs[i];
+		const char *start_timespec = spec->start_timespec;
+		const ssize_t repeats = spec->repeats;
+		struct codec *c = spec->c;
+		if (c == NULL) {
+			LOG_FMT(LL_ERROR, "error: failed to open input: %s", spec->p.path);
+			cleanup_and_exit(1);
+		}
+		read_buf_blocks = MAXIMUM(read_buf_blocks, spec->req_blocks - c->buf_ratio);
+		print_io_info(c, LL_VERBOSE, "input");
+		ssize_t c_frames = c->frames;
+		ssize_t start_pos = 0, end_pos = READ_BUF_INPUT_END_UNSPECIFIED;
+		if (start_timespec) {
+			char *endptr;
+			start_pos = parse_timespec(start_timespec, c->fs, &endptr);
+			int end_is_rel = (*endptr == '+');
+			if (endptr != start_timespec && (end_is_rel || *endptr == '-')) {
+				char *end_timespec = endptr+1;
+				end_pos = parse_timespec(end_timespec, c->fs, &endptr);
+				if (check_endptr(NULL, end_timespec, endptr, "end timespec"))
 					cleanup_and_exit(1);
-				if (start_pos < 0) start_pos = MAXIMUM(c_frames+start_pos, 0);
-				if (start_pos > 0) {
-					start_pos = c->seek(c, start_pos);
-					if (start_pos < 0) {
-						dsp_perror(DSP_ESEEK, NULL, c->path);
+				if (end_pos < 0) {
+					if (end_is_rel) {
+						LOG_FMT(LL_ERROR, "error: %s: end timespec must be positive when relative to start timespec", c->path);
 						cleanup_and_exit(1);
 					}
+					end_pos = MAXIMUM(c_frames+end_pos, 0);
 				}
-				if (end_pos >= 0) {
-					end_pos = (end_is_rel) ? start_pos+end_pos : end_pos;
-					if (end_pos < start_pos) LOG_FMT(LL_ERROR, "warning: %s: end timespec precedes start timespec", c->path);
-					c_frames = MINIMUM(c_frames, MAXIMUM(end_pos-start_pos, 0));
+			}
+			else if (check_endptr(NULL, start_timespec, endptr, "start timespec"))
+				cleanup_and_exit(1);
+			if (start_pos < 0) start_pos = MAXIMUM(c_frames+start_pos, 0);
+			if (start_pos > 0) {
+				start_pos = c->seek(c, start_pos);
+				if (start_pos < 0) {
+					dsp_perror(DSP_ESEEK, NULL, c->path);
+					cleanup_and_exit(1);
 				}
-				else if (c_frames >= start_pos) c_frames -= start_pos;
 			}
-			if (c_frames > 0 && repeats > 0)
-				c_frames *= repeats+1;
-			else if (repeats < 0)
-				c_frames = -1;
-			if (c_frames == -1 || in_time < 0.0)
-				in_time = -1.0;
-			else in_time += (double) c_frames / c->fs;
-			read_buf_input_list_add(&input_list, c, start_pos, end_pos, repeats);
+			if (end_pos >= 0) {
+				end_pos = (end_is_rel) ? start_pos+end_pos : end_pos;
+				if (end_pos < start_pos) LOG_FMT(LL_ERROR, "warning: %s: end timespec precedes start timespec", c->path);
+				c_frames = MINIMUM(c_frames, MAXIMUM(end_pos-start_pos, 0));
+			}
+			else if (c_frames >= start_pos) c_frames -= start_pos;
+		}
+		if (c_frames > 0 && repeats > 0)
+			c_frames *= repeats+1;
+		else if (repeats < 0)
+			c_frames = -1;
+		if (c_frames == -1 || in_time < 0.0)
+			in_time = -1.0;
+		else in_time += (double) c_frames / c->fs;
+		if (read_buf_input_list_add(&input_list, c, start_pos, end_pos, repeats) == NULL)
+			cleanup_and_exit(1);
+		spec->c = NULL;
+	}
+	if (input_mode == INPUT_MODE_MIX || input_mode == INPUT_MODE_MERGE) {
+		double *gains = calloc(MAXIMUM(n_input_specs, 1), sizeof(double));
+		if (check_alloc(dsp_globals.prog_name, gains))
+			cleanup_and_exit(1);
+		for (int i = 0; i < n_input_specs; ++i)
+			gains[i] = input_specs[i].gain;
+		struct codec *c = (input_list.head) ? combine_codec_init(&input_list, gains,
+			(input_mode == INPUT_MODE_MERGE) ? COMBINE_MODE_MERGE : COMBINE_MODE_MIX,
+			block_frames, read_buf_blocks, open_ahead) : NULL;
+		free(gains);
+		if (c) {
+			print_io_info(c, LL_VERBOSE, "input");
+			in_time = (c->frames < 0) ? -1.0 : (double) c->frames / c->fs;
+			if (read_buf_input_list_add(&input_list, c, 0, READ_BUF_INPUT_END_UNSPECIFIED, 0) == NULL) {
+				destroy_codec(c);
+				cleanup_and_exit(1);
+			}
 		}
+		else if (n_input_specs > 0)
+			cleanup_and_exit(1);
 	}
+	else {
+		for (int i = 0; i < n_input_specs; ++i) {
+			if (input_specs[i].gain != 1.0)
+				LOG_FMT(LL_ERROR, "warning: ignoring '-g' option for input: %s", input_specs[i].p.path);
+		}
+	}
+	free(input_specs);
+	input_specs = NULL;
+	n_input_specs = 0;
 	if (input_mode != INPUT_MODE_SEQUENCE) {
 		LIST_FOREACH(&input_list, input) {
 			if (input_list.head != NULL && input->codec->fs != input_list.head->codec->fs) {
@@ -1183,6 +1573,17 @@ int main(int argc, char *argv[])
 		LOG_S(LL_ERROR, "error: no inputs");
 		cleanup_and_exit(1);
 	}
+	if (rt_mode) {
+		if (input_mode != INPUT_MODE_CONCAT || input_list.head->next != NULL) {
+			LOG_S(LL_ERROR, "error: real-time mode requires exactly one input");
+			cleanup_and_exit(1);
+		}
+		if (!(input_list.head->codec->hints & CODEC_HINT_REALTIME)) {
+			LOG_S(LL_ERROR, "error: real-time mode requires a real-time input");
+			cleanup_and_exit(1);
+		}
+		read_buf_blocks = 0;  /* read directly from the codec */
+	}
 
 	const int chain_start = g.ind, chain_argc = argc-g.ind;
 	struct stream_info stream = {
@@ -1191,9 +1592,14 @@ int main(int argc, char *argv[])
 	};
 
 	if (plot) {
-		if (build_effects_chain_from_argv(chain_argc, (const char *const *) &argv[chain_start], &chain, &stream, NULL, NULL))
+		if (build_chain(chain_argc, (const char *const *) &argv[chain_start], &chain, &stream))
+			cleanup_and_exit(1);
+		plot_effects_chain(&chain, plot);
+	}
+	else if (ir_len_arg) {
+		if (build_chain(chain_argc, (const char *const *) &argv[chain_start], &chain, &stream))
 			cleanup_and_exit(1);
-		plot_effects_chain(&chain, (plot > 1));
+		cleanup_and_exit(write_impulse_response(ir_len_arg, &out_p));
 	}
 	else {
 		sem_init(&ev_queue.slots, 0, LENGTH(ev_queue.ev));
@@ -1220,7 +1626,7 @@ int main(int argc, char *argv[])
 		have_sig_thread = 1;
 		query_term_size();
 
-		if (build_effects_chain_from_argv(chain_argc, (const char *const *) &argv[chain_start], &chain, &stream, NULL, NULL))
+		if (build_chain(chain_argc, (const char *const *) &argv[chain_start], &chain, &stream))
 			cleanup_and_exit(1);
 
 		if (input_mode == INPUT_MODE_ABX) {
@@ -1250,20 +1656,26 @@ int main(int argc, char *argv[])
 			}
 			in_time = -1.0;
 			for (int i = 0; i < 2; ++i) {
-				if ((abx_codec_bufs[i] = codec_read_buf_init(&abx_inputs[i], block_frames, read_buf_blocks, NULL)) == NULL)
+				if ((abx_codec_bufs[i] = codec_read_buf_init(&abx_inputs[i], block_frames, read_buf_blocks, open_ahead, NULL)) == NULL)
 					cleanup_and_exit(1);
 			}
 		}
-		else if ((in_codec_buf = codec_read_buf_init(&input_list, block_frames, read_buf_blocks, NULL)) == NULL)
+		else if ((in_codec_buf = codec_read_buf_init(&input_list, block_frames, read_buf_blocks, open_ahead, NULL)) == NULL)
 			cleanup_and_exit(1);
 
 		ssize_t out_frames = (in_time < 0.0) ? -1 : (ssize_t) llround(in_time * stream.fs);
-		const int write_buf_blocks = out_p.buf_ratio;
-		if (out_p.buf_ratio - CODEC_BUF_MIN_BLOCKS >= 2)
+		const int write_buf_blocks = (rt_mode) ? 0 : out_p.buf_ratio;
+		if (rt_mode)
+			out_p.buf_ratio = RT_BUF_RATIO;
+		else if (out_p.buf_ratio - CODEC_BUF_MIN_BLOCKS >= 2)
 			out_p.buf_ratio = 2;
 		if (init_out_codec(&out_p, &stream, out_frames, write_buf_blocks) == NULL)
 			cleanup_and_exit(1);
 		dither_mult = tpdf_dither_get_mult(out_codec->prec);
+		if (rt_mode && !(out_codec->hints & CODEC_HINT_REALTIME)) {
+			LOG_S(LL_ERROR, "error: real-time mode requires a real-time output");
+			cleanup_and_exit(1);
+		}
 
 		if (interactive == -1)
 			interactive = (out_codec->hints & CODEC_HINT_INTERACTIVE) ? 1 : 0;
@@ -1284,6 +1696,20 @@ int main(int argc, char *argv[])
 
 		ssize_t buf_len = 0;
 		REALLOC_BUFS(&chain);
+		if (telemetry.f) {
+#ifdef HAVE_CLOCK_GETTIME
+			clock_gettime(CLOCK_MONOTONIC, &telemetry.t0);
+			telemetry.last_dump = telemetry.t0;
+#else
+			LOG_S(LL_ERROR, "warning: telemetry requires clock_gettime()");
+#endif
+		}
+		if (rt_mode) {
+			rt_setup();
+			/* prime the output with one period of silence so that playback
+			   starts once the first processed period is written */
+			codec_write_buf_write(out_codec_buf, buf1, block_frames);
+		}
 
 		while (input_list.head != NULL) {
 			ssize_t r, pos = input_list.head->start;
@@ -1358,7 +1784,7 @@ int main(int argc, char *argv[])
 								stream.fs = input_list.head->codec->fs;
 								stream.channels = input_list.head->codec->channels;
 								xfade_state.chain[0] = chain;
-								if (build_effects_chain_from_argv(chain_argc, (const char *const *) &argv[chain_start], &xfade_state.chain[1], &stream, NULL, NULL))
+								if (build_chain(chain_argc, (const char *const *) &argv[chain_start], &xfade_state.chain[1], &stream))
 									cleanup_and_exit(1);
 								xfade_state.frames = lround((EFFECTS_CHAIN_XFADE_TIME)/1000.0 * stream.fs);
 								xfade_state.pos = xfade_state.frames;
@@ -1416,6 +1842,9 @@ int main(int argc, char *argv[])
 					status_ctrl(STATUS_CTRL_DRAW);
 				}
 				ssize_t w = r = codec_read_buf_read(in_codec_buf, buf1, block_frames);
+				telemetry_block_begin();
+				if (r > 0 && r < block_frames && (input_list.head->codec->hints & CODEC_HINT_REALTIME))
+					++telemetry.short_reads;
 				pos = codec_read_buf_get_pos(in_codec_buf);
 				const int prev_repeats = repeats;
 				repeats = codec_read_buf_get_repeats(in_codec_buf);
@@ -1429,6 +1858,8 @@ int main(int argc, char *argv[])
 				}
 				else obuf = run_effects_chain(&chain, &w, buf1, buf2);
 				write_out(w, obuf, add_dither);
+				telemetry_block_end(r, input_list.head->codec->fs);
+				telemetry_dump(pos, 0);
 				k += w;
 				if (k >= out_codec->fs || did_repeat) {
 					update_progress(pos, repeats, is_paused, did_repeat);
@@ -1437,6 +1868,7 @@ int main(int argc, char *argv[])
 				status_ctrl(STATUS_CTRL_DRAW);
 			} while (r > 0);
 			next_input:
+			telemetry_dump(pos, 1);
 			stream.fs = input_list.head->codec->fs;
 			stream.channels = input_list.head->codec->channels;
 			codec_read_buf_next(in_codec_buf);
@@ -44,6 +44,7 @@ typedef double sample_t;
 struct dsp_globals {
 	int loglevel;
 	const char *prog_name;
+	int block_frames;  /* block size of the main chain, if known */
 };
 
 struct stream_info {
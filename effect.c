@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <complex.h>
 #include "effect.h"
 #include "util.h"
 
@@ -33,6 +34,7 @@
 #include "resample.h"
 #include "fir.h"
 #include "fir_p.h"
+#include "fir_auto.h"
 #include "zita_convolver.h"
 #include "hilbert.h"
 #include "decorrelate.h"
@@ -55,6 +57,7 @@ static const struct effect_info effects[] = {
 	RESAMPLE_EFFECT_INFO,
 	FIR_EFFECT_INFO,
 	FIR_P_EFFECT_INFO,
+	FIR_AUTO_EFFECT_INFO,
 	ZITA_CONVOLVER_EFFECT_INFO,
 	HILBERT_EFFECT_INFO,
 	DECORRELATE_EFFECT_INFO,
@@ -75,13 +78,79 @@ const struct effect_info * get_effect_info(const char *name)
 	return NULL;
 }
 
+static __thread struct arena *current_arena = NULL;
+
+struct arena * effect_arena_set(struct arena *a)
+{
+	struct arena *prev = current_arena;
+	current_arena = a;
+	return prev;
+}
+
+/* Without an arena, memory is still zeroed and aligned to ARENA_ALIGN so
+   that FFT buffers meet the alignment of the arrays their plans were made
+   with. */
+void * effect_alloc(size_t n, size_t size)
+{
+	if (current_arena == NULL) {
+		void *p;
+		if (size != 0 && n > SIZE_MAX / size) return NULL;
+		const size_t len = (n * size > 0) ? n * size : 1;
+		if (posix_memalign(&p, ARENA_ALIGN, len)) return NULL;
+		memset(p, 0, len);
+		return p;
+	}
+	return arena_alloc(current_arena, n, size);
+}
+
+void effect_free(void *p)
+{
+	if (!arena_owns(current_arena, p))
+		free(p);
+}
+
+static __thread struct effect_deps *current_deps = NULL;
+
+struct effect_deps * effect_deps_set(struct effect_deps *deps)
+{
+	struct effect_deps *prev = current_deps;
+	current_deps = deps;
+	return prev;
+}
+
+void effect_add_dep(const char *path)
+{
+	struct effect_deps *deps = current_deps;
+	if (deps == NULL || path == NULL) return;
+	for (int i = 0; i < deps->n; ++i)
+		if (strcmp(deps->paths[i], path) == 0) return;
+	char **paths = realloc(deps->paths, (deps->n + 1) * sizeof(char *));
+	if (check_alloc(__func__, paths)) return;
+	deps->paths = paths;
+	if ((deps->paths[deps->n] = strdup(path)) == NULL) {
+		dsp_perror(DSP_ENOMEM, __func__, NULL);
+		return;
+	}
+	++deps->n;
+}
+
+void effect_deps_free(struct effect_deps *deps)
+{
+	for (int i = 0; i < deps->n; ++i)
+		free(deps->paths[i]);
+	free(deps->paths);
+	deps->paths = NULL;
+	deps->n = 0;
+}
+
 void destroy_effect(struct effect *e)
 {
 	if (e == NULL)
 		return;
 	if (e->destroy != NULL)
 		e->destroy(e);
-	free(e);
+	effect_free(e->init_args);
+	effect_free(e);
 }
 
 void effect_list_append(struct effect *list, struct effect *e)
@@ -95,10 +164,9 @@ void effect_list_append(struct effect *list, struct effect *e)
 	}
 }
 
-void effect_plot_noop(struct effect *e, int i)
+void effect_plot_noop(struct effect *e, ssize_t n, double df, const double complex *ih, double complex *oh)
 {
-	for (int k = 0; k < e->istream.channels; ++k)
-		printf("H%d_%d(f)=1.0\n", k, i);
+	memcpy(oh, ih, n * e->istream.channels * sizeof(double complex));
 }
 
 void print_all_effects(void)
@@ -20,6 +20,8 @@
 #define DSP_EFFECT_H
 
 #include "dsp.h"
+#include "arena.h"
+#include "snapshot.h"
 
 struct effect_info {
 	const char *name;
@@ -29,11 +31,21 @@ struct effect_info {
 };
 
 enum {
-	EFFECT_FLAG_PLOT_MIX         = 1<<0,  /* needs Ht*(f) for plotting */
-	EFFECT_FLAG_OPT_REORDERABLE  = 1<<1,  /* may be reordered for optimization */
-	EFFECT_FLAG_NO_DITHER        = 1<<2,  /* does not modify the signal such that dither is useful */
-	EFFECT_FLAG_CH_DEPS_IDENTITY = 1<<3,  /* does not mix or reorder channels */
-	EFFECT_FLAG_ALIGN_BARRIER    = 1<<4,  /* all input channels must be aligned */
+	EFFECT_FLAG_OPT_REORDERABLE  = 1<<0,  /* may be reordered for optimization */
+	EFFECT_FLAG_NO_DITHER        = 1<<1,  /* does not modify the signal such that dither is useful */
+	EFFECT_FLAG_CH_DEPS_IDENTITY = 1<<2,  /* does not mix or reorder channels */
+	EFFECT_FLAG_ALIGN_BARRIER    = 1<<3,  /* all input channels must be aligned */
+	EFFECT_FLAG_LTI              = 1<<4,  /* linear and time-invariant; may be replaced by its impulse response */
+};
+
+/* Arguments an effect was created with. Kept in a single effect_alloc()
+   block so the effect can be recreated when a chain snapshot is loaded. */
+struct effect_init_args {
+	const struct effect_info *ei;
+	struct stream_info istream;
+	const char *channel_selector, *dir;
+	int argc;
+	const char *const *argv;
 };
 
 struct effect {
@@ -47,21 +59,53 @@ struct effect {
 	sample_t * (*run)(struct effect *, ssize_t *, sample_t *, sample_t *);  /* if NULL, the effect will not be used */
 	void (*reset)(struct effect *);
 	void (*signal)(struct effect *);
-	void (*plot)(struct effect *, int);
+	void (*plot)(struct effect *, ssize_t, double, const double _Complex *, double _Complex *);  /* frequency response; see below */
 	void (*drain_samples)(struct effect *, ssize_t *);  /* cumulative drain samples for each output channel */
 	sample_t * (*drain2)(struct effect *, ssize_t *, sample_t *, sample_t *);
 	void (*destroy)(struct effect *);
 	int (*merge)(struct effect *, struct effect *);  /* may not be called after prepare(); returns 1 if merged, 0 otherwise */
+	void (*matrix)(struct effect *, sample_t *);  /* effect is a constant mixing matrix; writes ostream.channels rows of istream.channels coefficients */
+	int (*scale)(struct effect *, const sample_t *);  /* may not be called after prepare(); applies a gain to each output channel; returns 1 if applied, 0 otherwise */
+	double (*cost)(struct effect *);  /* estimated arithmetic operations per frame */
+	int (*save)(struct effect *, struct snapshot_writer *);  /* writes the state for a snapshot loader; see effects_chain.c */
 	ssize_t (*buffer_frames)(struct effect *, ssize_t);
 	void (*channel_deps)(struct effect *, char **);  /* input channel dependencies for each output channel */
 	void (*channel_offsets)(struct effect *, ssize_t *, ssize_t *);  /* cumulative latency and requested delay samples for each output channel */
 	void *data;
+	struct effect_init_args *init_args;  /* set by the effects chain parser if the effect can be recreated from its arguments */
 };
 
 const struct effect_info * get_effect_info(const char *);
 void destroy_effect(struct effect *);
 void effect_list_append(struct effect *, struct effect *);
-void effect_plot_noop(struct effect *e, int);
+void effect_plot_noop(struct effect *, ssize_t, double, const double _Complex *, double _Complex *);
+
+/* Frequency response evaluation. plot(e, n, df, ih, oh) is given the
+   cumulative response of the chain up to e at the n frequencies k*df Hz
+   (k = 0..n-1) as istream.channels rows of n points in ih. It must write
+   ostream.channels rows to oh. Points above the Nyquist frequency of an
+   effect may be set to NaN. */
+
+/* Effect state allocation. While an effects chain is being built or
+   destroyed, effect_alloc() takes memory from the chain's arena and
+   effect_free() ignores pointers into it. Otherwise they behave like
+   calloc() and free(). Memory that is resized later (realloc()) or handed
+   to a library must not come from effect_alloc(). */
+struct arena * effect_arena_set(struct arena *);  /* returns the previous arena */
+void * effect_alloc(size_t, size_t);
+void effect_free(void *);
+
+/* Files an effects chain depends on (effects files, filters, plugins).
+   Effects call effect_add_dep() for each file they read during init; the
+   path is added to the set of the chain currently being built, if any. */
+struct effect_deps {
+	char **paths;
+	int n;
+};
+
+struct effect_deps * effect_deps_set(struct effect_deps *);  /* returns the previous set */
+void effect_add_dep(const char *);
+void effect_deps_free(struct effect_deps *);
 void print_all_effects(void);
 void print_effect_usage(const struct effect_info *);
 
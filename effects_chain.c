@@ -22,11 +22,24 @@
 #include <ctype.h>
 #include <math.h>
 #include <errno.h>
+#include <complex.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "effects_chain.h"
 #include "util.h"
 #include "list_util.h"
 #include "align.h"
 #include "dither.h"
+#include "remix.h"
+#include "biquad.h"
+#include "gain.h"
+#include "delay.h"
+#include "fir.h"
+#include "fir_p.h"
 
 void effects_chain_append(struct effects_chain *chain, struct effect *e)
 {
@@ -340,6 +353,7 @@ static int ec_parse_file(const char *path, const char *dir, struct effects_chain
 	char *p = NULL, *c = NULL, *d = NULL;
 	p = construct_full_path(dir, path, stream->fs, num_bits_set(ch_mask, stream->channels));
 	if (!p) goto fail_nomem;
+	effect_add_dep(p);
 	if (!(c = get_file_contents(p))) {
 		LOG_FMT(LL_ERROR, "error: failed to load effects file: %s: %s", p, strerror(errno));
 		goto fail;
@@ -420,6 +434,41 @@ static int ec_parse_argv(int argc, const char *const *argv, const char *dir, str
 	goto done;
 }
 
+static struct effect_init_args * effect_init_args_new(const struct effect_info *ei, const struct stream_info *istream,
+	const char *channel_selector, const char *dir, int argc, const char *const *argv)
+{
+	size_t size = sizeof(struct effect_init_args) + argc * sizeof(char *) + istream->channels;
+	if (dir) size += strlen(dir) + 1;
+	for (int i = 0; i < argc; ++i)
+		size += strlen(argv[i]) + 1;
+	struct effect_init_args *a = effect_alloc(1, size);
+	if (check_alloc(ei->name, a)) return NULL;
+	const char **a_argv = (const char **) (a + 1);
+	char *p = (char *) (a_argv + argc);
+	a->ei = ei;
+	a->istream = *istream;
+	a->argc = argc;
+	a->argv = a_argv;
+	COPY_SELECTOR(p, channel_selector, istream->channels);
+	a->channel_selector = p;
+	p += istream->channels;
+	if (dir) {
+		a->dir = strcpy(p, dir);
+		p += strlen(dir) + 1;
+	}
+	for (int i = 0; i < argc; ++i) {
+		a_argv[i] = strcpy(p, argv[i]);
+		p += strlen(argv[i]) + 1;
+	}
+	return a;
+}
+
+static void effect_clear_init_args(struct effect *e)
+{
+	effect_free(e->init_args);
+	e->init_args = NULL;  /* state no longer follows from the arguments */
+}
+
 #define ec_parse_print_line(reason, state, msg, line, col, len) \
 	ec_print_line(reason, (state)->path, msg, (state)->line_strs[line], line, col, len)
 #define ec_parse_hl_token(reason, state, msg, tok) \
@@ -574,7 +623,15 @@ static struct ec_token * ec_parse(struct ec_parser_state *state, struct ec_token
 				dsp_log_printf("] fs=%d\n", state->stream->fs);
 				dsp_log_release();
 			}
+			const struct stream_info istream = *state->stream;
 			struct effect *e = ei->init(ei, state->stream, state->ch_sel, state->dir, argc, (const char *const *) argv);
+			if (e && e->next == NULL && e->run) {
+				e->init_args = effect_init_args_new(ei, &istream, state->ch_sel, state->dir, argc, (const char *const *) argv);
+				if (e->init_args == NULL) {
+					destroy_effect(e);
+					e = NULL;
+				}
+			}
 			for (int i = 0; i < argc; ++i) free(argv[i]);
 			free(argv);
 			if (e == NULL) {
@@ -602,42 +659,217 @@ static struct ec_token * ec_parse(struct ec_parser_state *state, struct ec_token
 	return NULL;
 }
 
-static void effects_chain_optimize(struct effects_chain *chain)
+static int effect_matrix_nnz(const sample_t *m, int rows, int cols)
+{
+	int n = 0;
+	for (int i = 0; i < rows * cols; ++i)
+		if (m[i] != 0.0) ++n;
+	return n;
+}
+
+static int effect_matrix_is_diagonal(const sample_t *m, int n, int identity)
+{
+	for (int i = 0; i < n; ++i) {
+		for (int k = 0; k < n; ++k) {
+			const sample_t v = m[i*n + k];
+			if (i != k && v != 0.0) return 0;
+			if (identity && i == k && v != 1.0) return 0;
+		}
+	}
+	return 1;
+}
+
+/* estimated arithmetic operations per frame; effects without an estimate
+   count as one pass over the data */
+static double effect_cost(struct effect *e)
+{
+	if (e->cost) return e->cost(e);
+	if (e->matrix) {
+		sample_t *m = calloc(e->ostream.channels * e->istream.channels, sizeof(sample_t));
+		if (m) {
+			e->matrix(e, m);
+			const int nnz = effect_matrix_nnz(m, e->ostream.channels, e->istream.channels);
+			free(m);
+			return MAXIMUM(nnz, 1);
+		}
+	}
+	return e->ostream.channels;
+}
+
+static double effects_chain_cost(struct effects_chain *chain)
+{
+	double cost = 0.0;
+	LIST_FOREACH(chain, e) cost += effect_cost(e);
+	return cost;
+}
+
+static int effects_can_swap(struct effect *a, struct effect *b)
+{
+	return (a->flags & EFFECT_FLAG_OPT_REORDERABLE) && (b->flags & EFFECT_FLAG_OPT_REORDERABLE);
+}
+
+static int effects_same_streams(struct effect *a, struct effect *b)
+{
+	return a->istream.fs == b->istream.fs && a->istream.channels == b->istream.channels
+		&& a->ostream.fs == b->ostream.fs && a->ostream.channels == b->ostream.channels;
+}
+
+/* merge effects of the same kind, looking past effects they commute with */
+static void effects_chain_merge(struct effects_chain *chain)
 {
-	ssize_t chain_len = 0, chain_len_opt = 0;
-	LIST_FOREACH(chain, e) ++chain_len;
 	struct effect *m_dest = chain->head;
 	while (m_dest) {
 		if (m_dest->merge) {
 			struct effect *m_src = m_dest->next;
 			while (m_src) {
-				if (m_src->istream.fs != m_dest->istream.fs
-					|| m_src->istream.channels != m_dest->istream.channels
-					|| m_src->ostream.fs != m_dest->ostream.fs
-					|| m_src->ostream.channels != m_dest->ostream.channels
-					) break;
-				if (m_src->merge == NULL) {
-					if (m_src->flags & EFFECT_FLAG_OPT_REORDERABLE) goto skip;
-					break;
-				}
-				if (m_dest->merge(m_dest, m_src)) {
+				if (!effects_same_streams(m_src, m_dest)) break;
+				if (m_src->merge && m_dest->merge(m_dest, m_src)) {
 					/* LOG_FMT(LL_VERBOSE, "optimize: merged effect: %s <- %s", m_dest->name, m_src->name); */
+					effect_clear_init_args(m_dest);
 					struct effect *tmp = m_src;
 					m_src = m_src->next;
 					LIST_REMOVE(chain, tmp);
 					destroy_effect(tmp);
 				}
-				else {
-					skip:
-					m_src = m_src->next;
-				}
+				else if (effects_can_swap(m_dest, m_src)) m_src = m_src->next;
+				else break;
 			}
 		}
 		m_dest = m_dest->next;
 	}
+}
+
+/* replace runs of constant mixing matrices (gain, mult, remix, st2ms, ...)
+   with their product, and drop runs that amount to the identity */
+static int effects_chain_collapse_matrices(struct effects_chain *chain)
+{
+	struct effect *e = chain->head;
+	while (e) {
+		if (e->matrix == NULL) {
+			e = e->next;
+			continue;
+		}
+		struct effect *last = e;
+		int n = 1, max_ch = MAXIMUM(e->istream.channels, e->ostream.channels);
+		double cost = effect_cost(e);
+		while (last->next && last->next->matrix && last->next->istream.fs == e->istream.fs) {
+			last = last->next;
+			max_ch = MAXIMUM(max_ch, last->ostream.channels);
+			cost += effect_cost(last);
+			++n;
+		}
+		struct effect *next = last->next;
+		const int in_ch = e->istream.channels, out_ch = last->ostream.channels;
+		sample_t *m = calloc(max_ch * in_ch, sizeof(sample_t));
+		sample_t *m_e = calloc(max_ch * max_ch, sizeof(sample_t));
+		sample_t *tmp = calloc(max_ch * in_ch, sizeof(sample_t));
+		if (!m || !m_e || !tmp) {
+			free(m);
+			free(m_e);
+			free(tmp);
+			dsp_perror(DSP_ENOMEM, __func__, NULL);
+			return 1;
+		}
+		e->matrix(e, m);
+		for (struct effect *f = e->next; f != next; f = f->next) {
+			f->matrix(f, m_e);
+			for (int i = 0; i < f->ostream.channels; ++i) {
+				for (int k = 0; k < in_ch; ++k) {
+					sample_t v = 0.0;
+					for (int j = 0; j < f->istream.channels; ++j)
+						v += m_e[i*f->istream.channels + j] * m[j*in_ch + k];
+					tmp[i*in_ch + k] = v;
+				}
+			}
+			memcpy(m, tmp, f->ostream.channels * in_ch * sizeof(sample_t));
+		}
+		struct effect *m_eff = NULL;
+		const int is_identity = (in_ch == out_ch && effect_matrix_is_diagonal(m, in_ch, 1));
+		if (!is_identity && n > 1 && effect_matrix_nnz(m, out_ch, in_ch) <= cost) {
+			m_eff = remix_effect_init_matrix("remix", &e->istream, out_ch, m);
+			if (m_eff == NULL) {
+				free(m);
+				free(m_e);
+				free(tmp);
+				return 1;
+			}
+		}
+		free(m);
+		free(m_e);
+		free(tmp);
+		if (is_identity || m_eff) {
+			if (m_eff) LIST_INSERT(chain, m_eff, last);
+			for (struct effect *f = e, *f_next; f != NULL; f = f_next) {
+				f_next = (f == last) ? NULL : f->next;
+				LIST_REMOVE(chain, f);
+				destroy_effect(f);
+			}
+			LOG_FMT(LL_VERBOSE, "optimize: info: %s %d mixing effect%s", (m_eff) ? "combined" : "removed", n, (n > 1) ? "s" : "");
+		}
+		e = next;
+	}
+	return 0;
+}
+
+/* fold per-channel gains into a nearby effect that can apply them for free */
+static int effects_chain_fold_gains(struct effects_chain *chain)
+{
+	struct effect *e = chain->head;
+	while (e) {
+		struct effect *next = e->next;
+		const int n = e->istream.channels;
+		if (e->matrix && n == e->ostream.channels) {
+			sample_t *m = calloc(n * n, sizeof(sample_t)), *gain = calloc(n, sizeof(sample_t));
+			if (!m || !gain) {
+				free(m);
+				free(gain);
+				dsp_perror(DSP_ENOMEM, __func__, NULL);
+				return 1;
+			}
+			e->matrix(e, m);
+			if (effect_matrix_is_diagonal(m, n, 0)) {
+				for (int k = 0; k < n; ++k)
+					gain[k] = m[k*n + k];
+				struct effect *f = NULL;
+				for (int dir = 0; dir < 2 && f == NULL; ++dir) {
+					for (f = (dir == 0) ? e->next : e->prev; f; f = (dir == 0) ? f->next : f->prev) {
+						if (!effects_same_streams(e, f)) { f = NULL; break; }
+						if (f->scale && f->scale(f, gain)) break;
+						if (!(f->flags & EFFECT_FLAG_OPT_REORDERABLE)) { f = NULL; break; }
+					}
+				}
+				if (f) {
+					LOG_FMT(LL_VERBOSE, "optimize: info: folded %s into %s", e->name, f->name);
+					effect_clear_init_args(f);
+					LIST_REMOVE(chain, e);
+					destroy_effect(e);
+				}
+			}
+			free(m);
+			free(gain);
+		}
+		e = next;
+	}
+	return 0;
+}
+
+static int effects_chain_optimize(struct effects_chain *chain)
+{
+	ssize_t chain_len = 0, chain_len_opt = 0;
+	LIST_FOREACH(chain, e) ++chain_len;
+	const double cost = effects_chain_cost(chain);
+	effects_chain_merge(chain);
+	if (effects_chain_collapse_matrices(chain)) return 1;
+	if (effects_chain_fold_gains(chain)) return 1;
+	effects_chain_merge(chain);
 	LIST_FOREACH(chain, e) ++chain_len_opt;
 	if (chain_len_opt < chain_len)
 		LOG_FMT(LL_VERBOSE, "optimize: info: reduced number of effects from %zd to %zd", chain_len, chain_len_opt);
+	const double cost_opt = effects_chain_cost(chain);
+	if (cost_opt < cost)
+		LOG_FMT(LL_VERBOSE, "optimize: info: estimated cost reduced from %.1f to %.1f operations per frame (%.0f%% saved)",
+			cost, cost_opt, (cost - cost_opt) / cost * 100.0);
+	return 0;
 }
 
 struct effects_chain_postproc_state {
@@ -931,14 +1163,258 @@ static int effects_chain_prepare(struct effects_chain *chain)
 	return 0;
 }
 
-static int build_effects_chain_start(struct effects_chain *chain, struct stream_info *istream)
+#ifdef HAVE_FFTW3
+#define BAKE_TOL_DEFAULT -100.0  /* dB */
+#define BAKE_BLOCK_FRAMES 1024
+
+static struct {
+	char *len_arg;  /* NULL if disabled */
+	double tol;
+} bake_opts = { NULL, BAKE_TOL_DEFAULT };
+#endif
+
+int effects_chain_set_bake_opts(const char *arg)
+{
+#ifdef HAVE_FFTW3
+	char *endptr;
+	if (arg == NULL) {
+		free(bake_opts.len_arg);
+		bake_opts.len_arg = NULL;
+		return 0;
+	}
+	const char *tol_arg = strchr(arg, ',');
+	char *len_arg = (tol_arg) ? strndup(arg, tol_arg - arg) : strdup(arg);
+	if (check_alloc(__func__, len_arg)) return 1;
+	const double len = parse_len_frac(len_arg, 1.0, &endptr);
+	if (check_endptr(NULL, len_arg, endptr, "bake max_len")) goto fail;
+	if (len <= 0.0) {
+		LOG_S(LL_ERROR, "error: bake: max_len must be > 0");
+		goto fail;
+	}
+	double tol = BAKE_TOL_DEFAULT;
+	if (tol_arg) {
+		tol = strtod(tol_arg+1, &endptr);
+		if (check_endptr(NULL, tol_arg+1, endptr, "bake tolerance")) goto fail;
+		if (tol >= 0.0) {
+			LOG_S(LL_ERROR, "error: bake: tolerance must be < 0dB");
+			goto fail;
+		}
+	}
+	free(bake_opts.len_arg);
+	bake_opts.len_arg = len_arg;
+	bake_opts.tol = tol;
+	return 0;
+
+	fail:
+	free(len_arg);
+	return 1;
+#else
+	if (arg == NULL) return 0;
+	LOG_S(LL_ERROR, "error: bake: not available (built without FFTW)");
+	return 1;
+#endif
+}
+
+#ifdef HAVE_FFTW3
+static int effect_is_bakeable(struct effect *e)
+{
+	return (e->flags & EFFECT_FLAG_LTI) && (e->flags & EFFECT_FLAG_CH_DEPS_IDENTITY) && e->run != NULL
+		&& e->istream.fs == e->ostream.fs && e->istream.channels == e->ostream.channels;
+}
+
+/* Measures the impulse response of the effects from first to last (which
+   must be prepared) and replaces them with a single fir_p instance if the
+   response decays below the tolerance within max_len frames and the
+   estimated cost is lower. The latency and requested delay of each channel
+   are folded into the filter, so only the relative timing of the channels
+   is preserved; latency of the original effects is removed. The baked
+   effect drains as many frames as the original effects did. */
+static int effects_chain_bake_segment(struct effects_chain *chain, struct effect *first, struct effect *last, int n)
+{
+	int r = 1, n_sel = 0, filter_channels = 1;
+	const int ch = first->istream.channels;
+	const ssize_t max_len = parse_len(bake_opts.len_arg, first->istream.fs, NULL);
+	/* the response past max_len must also decay, so measure a bit further */
+	const ssize_t frames = max_len + MAXIMUM(max_len/4, BAKE_BLOCK_FRAMES);
+	struct effect *next = last->next, *b_eff = NULL;
+	struct effects_chain seg = EFFECTS_CHAIN_INITIALIZER;
+	sample_t *h = NULL, *filter = NULL;
+	char *selector = NEW_SELECTOR(ch);
+	ssize_t *offsets = calloc(ch * 4, sizeof(ssize_t));
+	if (!selector || !offsets) {
+		dsp_perror(DSP_ENOMEM, __func__, NULL);
+		goto done;
+	}
+	ssize_t *latency = offsets, *req_delay = offsets + ch, *d = offsets + ch*2, *drain = offsets + ch*3;
+	double cost = 0.0;
+	for (struct effect *e = first; e != next; e = e->next) {
+		if (e->channel_offsets) e->channel_offsets(e, latency, req_delay);
+		if (e->drain_samples) e->drain_samples(e, drain);
+		cost += effect_cost(e);
+	}
+	ssize_t max_latency = 0;
+	for (int k = 0; k < ch; ++k)
+		max_latency = MAXIMUM(max_latency, latency[k]);
+	const ssize_t h_frames = frames + max_latency;
+	h = calloc(h_frames * ch, sizeof(sample_t));
+	if (check_alloc(__func__, h)) goto done;
+
+	seg.head = first;
+	seg.tail = last;
+	seg.istream = first->istream;
+	seg.ostream = last->ostream;
+	seg.ratio.n = seg.ratio.d = 1;
+	last->next = NULL;
+	const int m_err = effects_chain_impulse_response(&seg, -1, 1.0, 0, h_frames, BAKE_BLOCK_FRAMES, h);
+	last->next = next;
+	if (m_err) goto done;
+
+	/* channels with a unit impulse response and no offset are left out */
+	ssize_t s_min = 0, trim = 0;
+	for (int k = 0; k < ch; ++k) {
+		int is_identity = (latency[k] == 0 && req_delay[k] == 0 && h[k] == 1.0);
+		for (ssize_t i = 1; i < h_frames && is_identity; ++i)
+			if (h[i*ch + k] != 0.0) is_identity = 0;
+		if (!is_identity) {
+			SET_BIT(selector, k);
+			const ssize_t s = req_delay[k] - latency[k];
+			s_min = (n_sel == 0) ? s : MINIMUM(s_min, s);
+			++n_sel;
+		}
+	}
+	if (n_sel == 0) {
+		LOG_FMT(LL_VERBOSE, "optimize: info: removed %d effects (identity)", n);
+		goto replace;
+	}
+	for (int k = 0, first_sel = 1; k < ch; ++k) {
+		if (GET_BIT(selector, k)) {
+			d[k] = req_delay[k] - latency[k] - s_min;
+			trim = (first_sel) ? latency[k] + d[k] : MINIMUM(trim, latency[k] + d[k]);
+			first_sel = 0;
+		}
+	}
+	filter = calloc(frames * n_sel, sizeof(sample_t));
+	if (check_alloc(__func__, filter)) goto done;
+	for (int k = 0, l = 0; k < ch; ++k) {
+		if (GET_BIT(selector, k)) {
+			for (ssize_t i = 0; i < frames; ++i) {
+				const ssize_t j = i + trim - d[k];
+				const sample_t v = (j >= 0 && j < h_frames) ? h[j*ch + k] : 0.0;
+				filter[i*n_sel + l] = v;
+				if (v != filter[i*n_sel]) filter_channels = n_sel;
+			}
+			++l;
+		}
+	}
+	/* truncate where the sum of the remaining magnitudes (the worst-case
+	   error for a full-scale input) drops below the tolerance */
+	const sample_t thresh = pow(10.0, bake_opts.tol / 20.0);
+	ssize_t len = 1;
+	for (int l = 0; l < n_sel; ++l) {
+		sample_t tail = 0.0;
+		ssize_t i = frames;
+		for (; i > 0 && tail + fabs(filter[(i-1)*n_sel + l]) <= thresh; --i)
+			tail += fabs(filter[(i-1)*n_sel + l]);
+		len = MAXIMUM(len, i);
+	}
+	if (len > max_len) {
+		LOG_FMT(LL_VERBOSE, "optimize: info: not baking %d effects: impulse response longer than %zd frames", n, max_len);
+		r = 0;
+		goto done;
+	}
+	if (filter_channels == 1) {
+		for (ssize_t i = 1; i < len; ++i)
+			filter[i] = filter[i*n_sel];
+	}
+	b_eff = fir_p_effect_init_with_filter(get_effect_info("fir_p"), &first->istream, selector,
+		filter, filter_channels, len, -s_min - trim, 0);
+	if (b_eff == NULL) goto done;
+	const double b_cost = effect_cost(b_eff);
+	if (b_cost >= cost) {
+		LOG_FMT(LL_VERBOSE, "optimize: info: not baking %d effects: estimated cost %.1f >= %.1f", n, b_cost, cost);
+		destroy_effect(b_eff);
+		r = 0;
+		goto done;
+	}
+	if (fir_p_effect_set_drain_samples(b_eff, drain) || (b_eff->prepare && b_eff->prepare(b_eff))) {
+		destroy_effect(b_eff);
+		goto done;
+	}
+	LOG_FMT(LL_VERBOSE, "optimize: info: baked %d effects into %s (%zd frames); estimated cost reduced from %.1f to %.1f operations per frame",
+		n, b_eff->name, len, cost, b_cost);
+	LIST_INSERT(chain, b_eff, last);
+
+	replace:
+	for (struct effect *e = first, *e_next; n > 0; e = e_next, --n) {
+		e_next = e->next;
+		LIST_REMOVE(chain, e);
+		destroy_effect(e);
+	}
+	r = 0;
+
+	done:
+	free(selector);
+	free(offsets);
+	free(h);
+	free(filter);
+	return r;
+}
+#endif
+
+/* Replaces maximal runs of linear time-invariant effects with their impulse
+   response (see effects_chain_set_bake_opts()). Unlike the other passes,
+   this runs after prepare() since the effects must be run. */
+static int effects_chain_bake(struct effects_chain *chain)
+{
+#ifdef HAVE_FFTW3
+	if (bake_opts.len_arg == NULL) return 0;
+	struct effect *e = chain->head;
+	while (e) {
+		struct effect *last = e;
+		int n = 1;
+		if (effect_is_bakeable(e)) {
+			while (last->next && effect_is_bakeable(last->next) && effects_same_streams(e, last->next)) {
+				last = last->next;
+				++n;
+			}
+		}
+		struct effect *next = last->next;
+		if (n > 1 && effects_chain_bake_segment(chain, e, last, n))
+			return 1;
+		e = next;
+	}
+#endif
+	return 0;
+}
+
+struct build_state {
+	struct arena *arena;
+	struct effect_deps *deps;
+};
+
+static int build_effects_chain_start(struct effects_chain *chain, struct stream_info *istream, struct build_state *prev)
 {
 	memcpy(&chain->istream, istream, sizeof(struct stream_info));
 	memcpy(&chain->ostream, istream, sizeof(struct stream_info));
 	chain->ratio.d = chain->ratio.n = 1;
+	if (chain->arena == NULL) {
+		chain->arena = arena_new();
+		if (check_alloc(__func__, chain->arena)) return 1;
+	}
+	prev->arena = effect_arena_set(chain->arena);
+	prev->deps = effect_deps_set(&chain->deps);
 	return 0;
 }
 
+static int build_effects_chain_end(struct effects_chain *chain, struct build_state *prev, int r)
+{
+	effect_arena_set(prev->arena);
+	effect_deps_set(prev->deps);
+	if (r == 0 && chain->head)
+		LOG_FMT(LL_VERBOSE, "info: effect state: %zu bytes", arena_size(chain->arena));
+	return r;
+}
+
 static int build_effects_chain_finish(struct effects_chain *chain)
 {
 	if (chain->head == NULL) return 0;
@@ -948,8 +1424,10 @@ static int build_effects_chain_finish(struct effects_chain *chain)
 	const int gcd = find_gcd(chain->ostream.fs, chain->istream.fs);
 	chain->ratio.n = chain->ostream.fs / gcd;
 	chain->ratio.d = chain->istream.fs / gcd;
-	effects_chain_optimize(chain);
+	if (effects_chain_optimize(chain)) return 1;
+	if (chain->head == NULL) return 0;  /* everything was optimized away */
 	if (effects_chain_prepare(chain)) return 1;
+	if (effects_chain_bake(chain)) return 1;
 	if (effects_chain_postproc_state_init(&state, chain)) return 1;
 	if (effects_chain_align_channels(&state, chain)) {
 		effects_chain_postproc_state_cleanup(&state);
@@ -963,31 +1441,37 @@ static int build_effects_chain_finish(struct effects_chain *chain)
 int build_effects_chain_from_argv(int argc, const char *const *argv, struct effects_chain *chain,
 	struct stream_info *stream, const char *ch_mask, const char *dir)
 {
-	if (build_effects_chain_start(chain, stream)) return 1;
-	if (ec_parse_argv(argc, argv, dir, chain, stream, ch_mask)) return 1;
-	return build_effects_chain_finish(chain);
+	struct build_state prev;
+	if (build_effects_chain_start(chain, stream, &prev)) return 1;
+	int r = ec_parse_argv(argc, argv, dir, chain, stream, ch_mask);
+	if (r == 0) r = build_effects_chain_finish(chain);
+	return build_effects_chain_end(chain, &prev, r);
 }
 
 int build_effects_chain_from_string(const char *cs, const char *path, struct effects_chain *chain,
 	struct stream_info *stream, const char *ch_mask, const char *dir)
 {
+	struct build_state prev;
 	char *s = strdup(cs);
 	if (check_alloc(__func__, s)) return 1;
-	if (build_effects_chain_start(chain, stream)) return 1;
-	if (ec_parse_string(s, path, dir, chain, stream, ch_mask, 0)) {
+	if (build_effects_chain_start(chain, stream, &prev)) {
 		free(s);
 		return 1;
 	}
+	int r = ec_parse_string(s, path, dir, chain, stream, ch_mask, 0);
 	free(s);
-	return build_effects_chain_finish(chain);
+	if (r == 0) r = build_effects_chain_finish(chain);
+	return build_effects_chain_end(chain, &prev, r);
 }
 
 int build_effects_chain_from_file(const char *path, struct effects_chain *chain,
 	struct stream_info *stream, const char *ch_mask, const char *dir, int enforce_eof_marker)
 {
-	if (build_effects_chain_start(chain, stream)) return 1;
-	if (ec_parse_file(path, dir, chain, stream, ch_mask, enforce_eof_marker, 0)) return 1;
-	return build_effects_chain_finish(chain);
+	struct build_state prev;
+	if (build_effects_chain_start(chain, stream, &prev)) return 1;
+	int r = ec_parse_file(path, dir, chain, stream, ch_mask, enforce_eof_marker, 0);
+	if (r == 0) r = build_effects_chain_finish(chain);
+	return build_effects_chain_end(chain, &prev, r);
 }
 
 static ssize_t effect_max_out_frames(struct effect *e, ssize_t in_frames)
@@ -1102,17 +1586,19 @@ void signal_effects_chain(struct effects_chain *chain)
 		if (e->signal != NULL) e->signal(e);
 }
 
+#define PLOT_POINTS            ((1<<16)+1)
+#define PLOT_POINTS_PER_OCTAVE 96
+
 static const char gnuplot_header[] =
 	"set xlabel 'Frequency (Hz)'\n"
 	"set ylabel 'Magnitude (dB)'\n"
 	"set logscale x\n"
 	/* "set format x '10^{%L}'\n" */  /* problematic when zooming */
-	"set samples 500\n"
 	"set mxtics\n"
 	"set mytics\n"
 	"set grid xtics ytics mxtics mytics lw 0.8, lw 0.3\n"
 	"set key on\n"
-	"j={0,1}\n"
+	"set datafile separator ','\n"
 	"\n"
 	"set yrange [-30:20]\n";
 
@@ -1121,66 +1607,76 @@ static const char gnuplot_header_phase[] =
 	"set y2tics -180,90,180 format '%g°'\n"
 	"set y2range [-180:720]\n";
 
-void plot_effects_chain(struct effects_chain *chain, int plot_phase)
+/* Writes one row per output frequency: frequency (Hz), then magnitude (dB),
+   phase (degrees), and group delay (ms) for each channel. Rows are thinned
+   to roughly PLOT_POINTS_PER_OCTAVE per octave. */
+static void print_response_table(const double complex *h, int channels, ssize_t n, double df)
 {
-	struct stream_info stream;
-	struct effect *e = chain->head;
-	memcpy(&stream, &chain->istream, sizeof(struct stream_info));
-	while (e != NULL) {
+	const double min_ratio = exp2(1.0 / PLOT_POINTS_PER_OCTAVE);
+	double last_f = 0.0;
+	for (ssize_t i = 1; i < n; ++i) {
+		const double f = i*df;
+		if (i != n-1 && f < last_f*min_ratio) continue;
+		last_f = f;
+		printf("%.7g", f);
+		const ssize_t i0 = i-1, i1 = (i == n-1) ? i : i+1;
+		for (int k = 0; k < channels; ++k) {
+			const double complex *h_k = &h[k*n];
+			const double gd = -carg(h_k[i1] * conj(h_k[i0])) / (2.0*M_PI*df*(i1-i0));
+			printf(",%.7g,%.7g,%.7g", 20.0*log10(cabs(h_k[i])), carg(h_k[i])*180.0/M_PI, gd*1000.0);
+		}
+		putchar('\n');
+	}
+}
+
+void plot_effects_chain(struct effects_chain *chain, int mode)
+{
+	int fs = chain->istream.fs, max_channels = chain->istream.channels, channels = chain->istream.channels;
+	LIST_FOREACH(chain, e) {
 		if (e->plot == NULL) {
 			LOG_FMT(LL_ERROR, "plot: error: effect '%s' does not support plotting", e->name);
 			return;
 		}
-		if (e->istream.channels != e->ostream.channels && !(e->flags & EFFECT_FLAG_PLOT_MIX)) {
-			LOG_FMT(LL_ERROR, "plot: BUG: effect '%s' changed the number of channels but does not have EFFECT_FLAG_PLOT_MIX set!", e->name);
-			return;
-		}
-		stream.fs = e->ostream.fs;
-		e = e->next;
+		fs = e->ostream.fs;
+		channels = e->ostream.channels;
+		max_channels = MAXIMUM(max_channels, e->ostream.channels);
 	}
-	printf("%sset xrange [10:%d/2]\n%s\n",
-		gnuplot_header, stream.fs, (plot_phase)?gnuplot_header_phase:"");
-	struct effect *start_e = e = chain->head;
-	int start_idx = 0;
-	for (int i = 0; e != NULL; ++i) {
-		if (e->flags & EFFECT_FLAG_PLOT_MIX) {
-			for (int k = 0; k < e->istream.channels; ++k) {
-				printf("Ht%d_%d(f)=1.0", k, i);
-				struct effect *e2 = start_e;
-				for (int j = start_idx; e2 != NULL && e2 != e; ++j) {
-					printf("*H%d_%d(2.0*pi*f/%d)", k, j, e2->ostream.fs);
-					e2 = e2->next;
-				}
-				putchar('\n');
-			}
-			start_idx = i;
-			start_e = e;
-			stream.channels = e->ostream.channels;
-		}
-		e->plot(e, i);
-		e = e->next;
+	const ssize_t n = PLOT_POINTS;
+	const double df = fs / 2.0 / (n-1);
+	double complex *h = calloc(n * max_channels, sizeof(double complex));
+	double complex *tmp = calloc(n * max_channels, sizeof(double complex));
+	if (check_alloc("plot", h) || check_alloc("plot", tmp)) goto done;
+	for (ssize_t i = 0; i < n * chain->istream.channels; ++i)
+		h[i] = 1.0;
+	LIST_FOREACH(chain, e) {
+		e->plot(e, n, df, h, tmp);
+		double complex *t = h; h = tmp; tmp = t;
 	}
-	for (int k = 0; k < stream.channels; ++k) {
-		printf("Ht%d(f)=1.0", k);
-		e = start_e;
-		for (int i = start_idx; e != NULL; ++i) {
-			printf("*H%d_%d(2.0*pi*f/%d)", k, i, e->ostream.fs);
-			e = e->next;
-		}
+
+	if (mode == PLOT_MODE_TABLE) {
+		printf("frequency");
+		for (int k = 0; k < channels; ++k)
+			printf(",magnitude_%d,phase_%d,group_delay_%d", k, k, k);
 		putchar('\n');
-		printf("Ht%d_mag(f)=abs(Ht%d(f))\n", k, k);
-		printf("Ht%d_mag_dB(f)=20*log10(Ht%d_mag(f))\n", k, k);
-		printf("Ht%d_phase(f)=arg(Ht%d(f))\n", k, k);
-		printf("Ht%d_phase_deg(f)=Ht%d_phase(f)*180/pi\n", k, k);
-		printf("Hsum%d(f)=Ht%d_mag_dB(f)\n", k, k);
+		print_response_table(h, channels, n, df);
+		goto done;
 	}
+	printf("%sset xrange [10:%d/2]\n%s\n",
+		gnuplot_header, fs, (mode == PLOT_MODE_PHASE)?gnuplot_header_phase:"");
+	puts("$H << EOD");
+	print_response_table(h, channels, n, df);
+	puts("EOD");
 	printf("\nplot ");
-	for (int k = 0; k < stream.channels; ++k) {
-		printf("%sHt%d_mag_dB(x) lt %d lw 2 title 'Channel %d'", (k==0)?"":", ", k, k+1, k);
-		if (plot_phase)
-			printf(", Ht%d_phase_deg(x) axes x1y2 lt %d lw 1 dt '-' notitle", k, k+1);
+	for (int k = 0; k < channels; ++k) {
+		printf("%s$H using 1:%d with lines lt %d lw 2 title 'Channel %d'", (k==0)?"":", ", 2+k*3, k+1, k);
+		if (mode == PLOT_MODE_PHASE)
+			printf(", $H using 1:%d axes x1y2 with lines lt %d lw 1 dt '-' notitle", 3+k*3, k+1);
 	}
 	puts("\npause mouse close");
+
+	done:
+	free(h);
+	free(tmp);
 }
 
 sample_t * drain_effects_chain(struct effects_chain *chain, ssize_t *frames, sample_t *buf1, sample_t *buf2)
@@ -1217,13 +1713,401 @@ sample_t * drain_effects_chain(struct effects_chain *chain, ssize_t *frames, sam
 	return run_effect_list(e, frames, buf1, buf2);
 }
 
+int effects_chain_impulse_response(struct effects_chain *chain, int c, sample_t amp, ssize_t offset, ssize_t frames, ssize_t block_frames, sample_t *ir)
+{
+	const int in_ch = chain->istream.channels, out_ch = chain->ostream.channels;
+	const ssize_t buf_len = get_effects_chain_buffer_len(chain, block_frames, in_ch);
+	sample_t *buf1 = calloc(buf_len, sizeof(sample_t));
+	sample_t *buf2 = calloc(buf_len, sizeof(sample_t));
+	if (check_alloc(__func__, buf1) || check_alloc(__func__, buf2)) {
+		free(buf1);
+		free(buf2);
+		return 1;
+	}
+	const ssize_t drain_frames = chain->drain_frames;
+	reset_effects_chain(chain);
+	const ssize_t in_frames = MAXIMUM(ratio_mult_ceil(frames, chain->ratio.d, chain->ratio.n), offset+1);
+	ssize_t pos = 0, opos = 0;
+	memset(ir, 0, frames * out_ch * sizeof(sample_t));
+	while (opos < frames) {
+		ssize_t w = MINIMUM(block_frames, in_frames - pos);
+		sample_t *obuf;
+		if (w > 0) {
+			memset(buf1, 0, w * in_ch * sizeof(sample_t));
+			if (offset >= pos && offset < pos + w) {
+				for (int k = 0; k < in_ch; ++k)
+					if (c < 0 || k == c) buf1[(offset - pos) * in_ch + k] = amp;
+			}
+			pos += w;
+			obuf = run_effects_chain(chain, &w, buf1, buf2);
+		}
+		else {
+			/* collect the tail */
+			w = block_frames;
+			obuf = drain_effects_chain(chain, &w, buf1, buf2);
+			if (w < 0) break;
+		}
+		w = MINIMUM(w, frames - opos);
+		memcpy(&ir[opos * out_ch], obuf, w * out_ch * sizeof(sample_t));
+		opos += w;
+	}
+	reset_effects_chain(chain);
+	chain->drain_frames = drain_frames;
+	free(buf1);
+	free(buf2);
+	return 0;
+}
+
+/* Effects chain snapshots. The file holds a header, a key (working
+   directory, bake options, input stream and chain arguments) that must
+   match exactly, the dependencies with their size and mtime, the chain
+   parameters, and one record per effect. An effect record is the name,
+   streams and a loader tag followed by the data for that loader:
+     - "args": the effect is recreated from its arguments and prepared
+     - "matrix": a constant mixing matrix, loaded as remix
+     - anything else: written by effect.save() and read by the loader in
+       snapshot_loaders[]
+   Bump the magic when the layout changes. */
+#define CHAIN_SNAPSHOT_MAGIC "DSPCHSN1"
+#define CHAIN_SNAPSHOT_BOM   0x0102030405060708ULL
+
+struct chain_snapshot_header {
+	char magic[8];
+	uint64_t bom;
+	int32_t sample_size, ssize_size;
+};
+
+static const struct {
+	const char *tag;
+	struct effect * (*load)(const char *, const struct stream_info *, struct snapshot_reader *);
+} snapshot_loaders[] = {
+	{ "biquad", biquad_effect_load },
+	{ "gain",   gain_effect_load },
+	{ "delay",  delay_effect_load },
+	{ "align",  align_effect_load },
+#ifdef HAVE_FFTW3
+	{ "fir",    fir_effect_load },
+	{ "fir_p",  fir_p_effect_load },
+#endif
+};
+
+static void chain_snapshot_fill_header(struct chain_snapshot_header *hdr)
+{
+	memset(hdr, 0, sizeof(struct chain_snapshot_header));
+	memcpy(hdr->magic, CHAIN_SNAPSHOT_MAGIC, sizeof(hdr->magic));
+	hdr->bom = CHAIN_SNAPSHOT_BOM;
+	hdr->sample_size = sizeof(sample_t);
+	hdr->ssize_size = sizeof(ssize_t);
+}
+
+/* returns the key as a malloc()'d buffer */
+static char * chain_snapshot_key(const struct stream_info *istream, int argc, const char *const *argv, size_t *r_len)
+{
+	char *key = NULL, cwd[PATH_MAX];
+	const int64_t n_args = argc;
+	struct snapshot_writer w = {0};
+	if ((w.f = open_memstream(&key, r_len)) == NULL) {
+		dsp_perror(DSP_ENOMEM, __func__, NULL);
+		return NULL;
+	}
+	snapshot_write_str(&w, (getcwd(cwd, sizeof(cwd))) ? cwd : NULL);
+#ifdef HAVE_FFTW3
+	snapshot_write_str(&w, bake_opts.len_arg);
+	SNAPSHOT_WRITE_VAL(&w, bake_opts.tol);
+#endif
+	SNAPSHOT_WRITE_VAL(&w, *istream);
+	SNAPSHOT_WRITE_VAL(&w, n_args);
+	for (int i = 0; i < argc; ++i)
+		snapshot_write_str(&w, argv[i]);
+	if (fclose(w.f) || w.err) {
+		dsp_perror(DSP_ENOMEM, __func__, NULL);
+		free(key);
+		return NULL;
+	}
+	return key;
+}
+
+static int chain_snapshot_save_effect(struct effect *e, struct snapshot_writer *w)
+{
+	snapshot_write_str(w, e->name);
+	SNAPSHOT_WRITE_VAL(w, e->istream);
+	SNAPSHOT_WRITE_VAL(w, e->ostream);
+	if (e->save) return e->save(e, w);
+	if (e->init_args) {
+		const struct effect_init_args *a = e->init_args;
+		const int64_t argc = a->argc;
+		snapshot_write_str(w, "args");
+		snapshot_write_str(w, a->ei->name);
+		SNAPSHOT_WRITE_VAL(w, a->istream);
+		snapshot_write_selector(w, a->channel_selector, a->istream.channels);
+		snapshot_write_str(w, a->dir);
+		SNAPSHOT_WRITE_VAL(w, argc);
+		for (int i = 0; i < a->argc; ++i)
+			snapshot_write_str(w, a->argv[i]);
+		return w->err;
+	}
+	if (e->matrix) {
+		sample_t *m = calloc(e->ostream.channels * e->istream.channels, sizeof(sample_t));
+		if (check_alloc(__func__, m)) return 1;
+		e->matrix(e, m);
+		snapshot_write_str(w, "matrix");
+		snapshot_write(w, m, e->ostream.channels * e->istream.channels * sizeof(sample_t));
+		free(m);
+		return w->err;
+	}
+	return -1;
+}
+
+int effects_chain_save_snapshot(struct effects_chain *chain, const char *path, int argc, const char *const *argv)
+{
+	struct chain_snapshot_header hdr;
+	struct snapshot_writer w = {0};
+	size_t key_len;
+	char *key = NULL, *tmp = NULL;
+	int r = 1;
+
+	LIST_FOREACH(chain, e) {
+		if (!e->save && !e->init_args && !e->matrix) {
+			LOG_FMT(LL_NORMAL, "warning: cannot save effects chain snapshot: not supported by effect: %s", e->name);
+			return 1;
+		}
+	}
+	if ((key = chain_snapshot_key(&chain->istream, argc, argv, &key_len)) == NULL) return 1;
+
+	/* write to a temporary file and rename so readers never see a partial snapshot */
+	const int len = strlen(path) + 32;
+	tmp = calloc(len, sizeof(char));
+	if (check_alloc(__func__, tmp)) goto done;
+	snprintf(tmp, len, "%s.%ld.tmp", path, (long) getpid());
+	if ((w.f = fopen(tmp, "wb")) == NULL) goto fail;
+
+	chain_snapshot_fill_header(&hdr);
+	SNAPSHOT_WRITE_VAL(&w, hdr);
+	const int64_t key_len64 = key_len;
+	SNAPSHOT_WRITE_VAL(&w, key_len64);
+	snapshot_write(&w, key, key_len);
+
+	const int64_t n_deps = chain->deps.n;
+	SNAPSHOT_WRITE_VAL(&w, n_deps);
+	for (int i = 0; i < chain->deps.n; ++i) {
+		struct stat st;
+		if (stat(chain->deps.paths[i], &st) < 0) goto fail;
+		const int64_t dep[] = { st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec, st.st_ino };
+		snapshot_write_str(&w, chain->deps.paths[i]);
+		SNAPSHOT_WRITE_VAL(&w, dep);
+	}
+
+	int64_t n_effects = 0;
+	LIST_FOREACH(chain, e) ++n_effects;
+	const int64_t params[] = { chain->ratio.n, chain->ratio.d, chain->drain_frames, chain->zero_ref, n_effects };
+	SNAPSHOT_WRITE_VAL(&w, chain->ostream);
+	SNAPSHOT_WRITE_VAL(&w, params);
+	LIST_FOREACH(chain, e) {
+		if (chain_snapshot_save_effect(e, &w)) goto fail;
+	}
+
+	const int err = w.err;
+	w.err = fclose(w.f);
+	w.f = NULL;
+	if (err || w.err || rename(tmp, path)) goto fail;
+	LOG_FMT(LL_VERBOSE, "info: saved effects chain snapshot: %s", path);
+	r = 0;
+
+	done:
+	free(key);
+	free(tmp);
+	return r;
+
+	fail:
+	LOG_FMT(LL_NORMAL, "warning: failed to save effects chain snapshot: %s", path);
+	if (w.f) fclose(w.f);
+	if (tmp) unlink(tmp);
+	goto done;
+}
+
+static struct effect * chain_snapshot_load_args(const char *name, struct snapshot_reader *r)
+{
+	struct stream_info istream;
+	const char *ei_name = snapshot_read_str(r);
+	const struct effect_info *ei = (ei_name) ? get_effect_info(ei_name) : NULL;
+	if (ei == NULL || ei->init == NULL || SNAPSHOT_READ_VAL(r, istream) || istream.channels < 1)
+		return NULL;
+	struct effect *e = NULL;
+	const char **argv = NULL;
+	char *channel_selector = NEW_SELECTOR(istream.channels);
+	if (check_alloc(name, channel_selector)) return NULL;
+	if (snapshot_read_selector(r, channel_selector, istream.channels)) goto done;
+	const char *dir = snapshot_read_str(r);
+	int64_t argc;
+	if (r->err || SNAPSHOT_READ_VAL(r, argc) || argc < 1 || argc > (r->end - r->p) / SNAPSHOT_ALIGN) goto done;
+	argv = calloc(argc, sizeof(char *));
+	if (check_alloc(name, argv)) goto done;
+	for (int i = 0; i < argc; ++i)
+		if ((argv[i] = snapshot_read_str(r)) == NULL) goto done;
+
+	struct stream_info stream = istream;
+	e = ei->init(ei, &stream, channel_selector, dir, argc, argv);
+	if (e == NULL) goto done;
+	if (e->next || e->run == NULL) {
+		/* unexpected; not the effect that was saved */
+		while (e) {
+			struct effect *e_n = e->next;
+			destroy_effect(e);
+			e = e_n;
+		}
+		goto done;
+	}
+	e->init_args = effect_init_args_new(ei, &istream, channel_selector, dir, argc, argv);
+	if (e->init_args == NULL || (e->prepare && e->prepare(e))) {
+		destroy_effect(e);
+		e = NULL;
+	}
+
+	done:
+	free(channel_selector);
+	free(argv);
+	return e;
+}
+
+static struct effect * chain_snapshot_load_effect(struct snapshot_reader *r)
+{
+	struct stream_info istream, ostream;
+	const char *s_name = snapshot_read_str(r);
+	if (s_name == NULL || SNAPSHOT_READ_VAL(r, istream) || SNAPSHOT_READ_VAL(r, ostream)
+			|| istream.channels < 1 || ostream.channels < 1)
+		return NULL;
+	const char *tag = snapshot_read_str(r);
+	char *name = effect_alloc(strlen(s_name) + 1, sizeof(char));
+	if (tag == NULL || check_alloc(__func__, name)) return NULL;
+	strcpy(name, s_name);
+
+	struct effect *e = NULL;
+	if (strcmp(tag, "args") == 0)
+		e = chain_snapshot_load_args(name, r);
+	else if (strcmp(tag, "matrix") == 0) {
+		const sample_t *m = snapshot_read(r, ostream.channels * istream.channels * sizeof(sample_t));
+		if (m) e = remix_effect_init_matrix(name, &istream, ostream.channels, m);
+	}
+	else {
+		for (size_t i = 0; i < LENGTH(snapshot_loaders); ++i) {
+			if (strcmp(tag, snapshot_loaders[i].tag) == 0) {
+				e = snapshot_loaders[i].load(name, &istream, r);
+				break;
+			}
+		}
+	}
+	if (e && (memcmp(&e->istream, &istream, sizeof(istream)) != 0 || memcmp(&e->ostream, &ostream, sizeof(ostream)) != 0)) {
+		destroy_effect(e);
+		e = NULL;
+	}
+	if (e == NULL) LOG_FMT(LL_VERBOSE, "info: effects chain snapshot: failed to load effect: %s (%s)", name, tag);
+	return e;
+}
+
+int effects_chain_load_snapshot(const char *path, int argc, const char *const *argv, struct effects_chain *chain, struct stream_info *stream)
+{
+	struct chain_snapshot_header hdr, f_hdr;
+	struct build_state prev;
+	struct stat st;
+	void *map = MAP_FAILED;
+	char *key = NULL;
+	size_t key_len;
+	int r = 1, fd = -1;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		LOG_FMT(LL_VERBOSE, "info: failed to open effects chain snapshot: %s: %s", path, strerror(errno));
+		return 1;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size == 0) goto invalid;
+	if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) goto invalid;
+	struct snapshot_reader rd = { .p = map, .end = (const unsigned char *) map + st.st_size };
+
+	chain_snapshot_fill_header(&hdr);
+	if (SNAPSHOT_READ_VAL(&rd, f_hdr) || memcmp(&hdr, &f_hdr, sizeof(hdr)) != 0) goto invalid;
+	if ((key = chain_snapshot_key(stream, argc, argv, &key_len)) == NULL) goto done;
+	int64_t f_key_len;
+	const void *f_key;
+	if (SNAPSHOT_READ_VAL(&rd, f_key_len) || f_key_len < 0 || (f_key = snapshot_read(&rd, f_key_len)) == NULL)
+		goto invalid;
+	if ((size_t) f_key_len != key_len || memcmp(f_key, key, key_len) != 0) {
+		LOG_FMT(LL_VERBOSE, "info: effects chain snapshot does not match the effects chain: %s", path);
+		goto done;
+	}
+
+	int64_t n_deps;
+	if (SNAPSHOT_READ_VAL(&rd, n_deps) || n_deps < 0) goto invalid;
+	const unsigned char *deps_p = rd.p;
+	for (int64_t i = 0; i < n_deps; ++i) {
+		struct stat dep_st;
+		int64_t dep[4];
+		const char *dep_path = snapshot_read_str(&rd);
+		if (dep_path == NULL || SNAPSHOT_READ_VAL(&rd, dep)) goto invalid;
+		if (stat(dep_path, &dep_st) < 0 || dep[0] != dep_st.st_size || dep[1] != dep_st.st_mtim.tv_sec
+				|| dep[2] != dep_st.st_mtim.tv_nsec || dep[3] != (int64_t) dep_st.st_ino) {
+			LOG_FMT(LL_VERBOSE, "info: effects chain snapshot is out of date: %s: changed: %s", path, dep_path);
+			goto done;
+		}
+	}
+
+	struct stream_info ostream;
+	int64_t params[5];
+	if (SNAPSHOT_READ_VAL(&rd, ostream) || SNAPSHOT_READ_VAL(&rd, params)
+			|| params[0] < 1 || params[1] < 1 || params[4] < 0)
+		goto invalid;
+
+	if (build_effects_chain_start(chain, stream, &prev)) goto done;
+	int err = 0;
+	for (int64_t i = 0; i < params[4] && !err; ++i) {
+		struct effect *e = chain_snapshot_load_effect(&rd);
+		if (e) effects_chain_append(chain, e);
+		else err = 1;
+	}
+	if (!err && rd.p != rd.end) err = 1;
+	if (!err) {
+		/* effects files are not read again, but the chain still depends on them */
+		struct snapshot_reader dep_rd = { .p = deps_p, .end = rd.end };
+		for (int64_t i = 0; i < n_deps; ++i) {
+			effect_add_dep(snapshot_read_str(&dep_rd));
+			snapshot_read(&dep_rd, 4 * sizeof(int64_t));
+		}
+		chain->ostream = ostream;
+		chain->ratio.n = params[0];
+		chain->ratio.d = params[1];
+		chain->drain_frames = params[2];
+		chain->zero_ref = params[3];
+	}
+	build_effects_chain_end(chain, &prev, err);
+	if (err) {
+		destroy_effects_chain(chain);
+		goto invalid;
+	}
+	*stream = chain->ostream;
+	LOG_FMT(LL_VERBOSE, "info: loaded effects chain snapshot: %s", path);
+	r = 0;
+
+	done:
+	free(key);
+	if (map != MAP_FAILED) munmap(map, st.st_size);
+	close(fd);
+	return r;
+
+	invalid:
+	LOG_FMT(LL_NORMAL, "warning: invalid effects chain snapshot: %s", path);
+	goto done;
+}
+
 void destroy_effects_chain(struct effects_chain *chain)
 {
+	struct arena *prev_arena = effect_arena_set(chain->arena);
 	while (chain->head) {
 		struct effect *e = chain->head;
 		LIST_REMOVE(chain, e);
 		destroy_effect(e);
 	}
+	effect_arena_set(prev_arena);
+	arena_destroy(chain->arena);
+	chain->arena = NULL;
+	effect_deps_free(&chain->deps);
 }
 
 void effects_chain_xfade_reset(struct effects_chain_xfade_state *state)
@@ -1238,11 +2122,35 @@ static inline double xfade_mult(ssize_t pos, ssize_t n)
 	return (double) (n-pos) / n;
 }
 
+sample_t * effects_chain_xfade_mix(sample_t *rbuf0, ssize_t *frames, const sample_t *rbuf1, ssize_t frames1,
+	int has_output, int channels, ssize_t *pos, ssize_t xf_frames)
+{
+	const ssize_t min_f = MINIMUM(*frames, frames1);
+	ssize_t offset_s = 0, adj_xf_f = xf_frames;
+	if (!has_output) offset_s = (*frames-min_f)*channels;
+	else if (*frames != frames1) {
+		if (min_f < *pos) {
+			adj_xf_f = lround((double)min_f / *pos * xf_frames);
+			/* LOG_FMT(LL_VERBOSE, "%s(): truncated crossfade: %zd -> %zd", __func__, xf_frames, adj_xf_f); */
+			*pos = min_f;
+		}
+		*frames = frames1;
+	}
+
+	const ssize_t end_s = min_f*channels;
+	for (ssize_t i = 0; i < end_s; i += channels) {
+		const double m = (*pos > 0) ? xfade_mult((*pos)--, adj_xf_f) : 1.0;
+		for (int k = 0; k < channels; ++k)
+			rbuf0[i+offset_s+k] = rbuf1[i+k]*m + rbuf0[i+offset_s+k]*(1.0-m);
+	}
+	return rbuf0;
+}
+
 sample_t * effects_chain_xfade_run(struct effects_chain_xfade_state *state, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
 {
 	if (*frames < 1) return ibuf;
 	sample_t *rbuf[2];
-	ssize_t tmp_f = *frames, adj_xf_f = state->frames;
+	ssize_t tmp_f = *frames;
 	const int in_ch = state->chain[0].istream.channels, out_ch = state->chain[0].ostream.channels;
 	const int has_output = (state->chain[1].oframes > 0);
 
@@ -1251,24 +2159,5 @@ sample_t * effects_chain_xfade_run(struct effects_chain_xfade_state *state, ssiz
 	rbuf[1] = (rbuf[0] == obuf) ? ibuf : obuf;
 	rbuf[1] = run_effects_chain(&state->chain[1], &tmp_f, state->buf, rbuf[1]);
 	if (state->chain[1].oframes <= 0) return rbuf[0];
-
-	const ssize_t min_f = MINIMUM(*frames, tmp_f);
-	ssize_t offset_s = 0;
-	if (!has_output) offset_s = (*frames-min_f)*out_ch;
-	else if (*frames != tmp_f) {
-		if (min_f < state->pos) {
-			adj_xf_f = lround((double)min_f/state->pos*state->frames);
-			/* LOG_FMT(LL_VERBOSE, "%s(): truncated crossfade: %zd -> %zd", __func__, state->frames, adj_xf_f); */
-			state->pos = min_f;
-		}
-		*frames = tmp_f;
-	}
-
-	const ssize_t end_s = min_f*out_ch;
-	for (ssize_t i = 0; i < end_s; i += out_ch) {
-		const double m = (state->pos > 0) ? xfade_mult(state->pos--, adj_xf_f) : 1.0;
-		for (int k = 0; k < out_ch; ++k)
-			rbuf[0][i+offset_s+k] = rbuf[1][i+k]*m + rbuf[0][i+offset_s+k]*(1.0-m);
-	}
-	return rbuf[0];
+	return effects_chain_xfade_mix(rbuf[0], frames, rbuf[1], tmp_f, has_output, out_ch, &state->pos, state->frames);
 }
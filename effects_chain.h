@@ -29,6 +29,8 @@ struct effects_chain {
 	ssize_t drain_frames, iframes, oframes;
 	ssize_t zero_ref;
 	int delay, frac;
+	struct arena *arena;  /* effect state; see effect_alloc() */
+	struct effect_deps deps;
 };
 
 #define EFFECTS_CHAIN_INITIALIZER {0}
@@ -48,9 +50,33 @@ sample_t * run_effects_chain(struct effects_chain *, ssize_t *, sample_t *, samp
 double get_effects_chain_delay(struct effects_chain *, int);
 void reset_effects_chain(struct effects_chain *);
 void signal_effects_chain(struct effects_chain *);
+enum {
+	PLOT_MODE_MAGNITUDE = 1,
+	PLOT_MODE_PHASE,  /* magnitude and phase */
+	PLOT_MODE_TABLE,  /* CSV instead of a gnuplot script */
+};
 void plot_effects_chain(struct effects_chain *, int);
 sample_t * drain_effects_chain(struct effects_chain *, ssize_t *, sample_t *, sample_t *);
+/* Resets the chain, feeds an impulse of the given amplitude to one input
+   channel (or every channel if c < 0) at the given input frame offset, and
+   writes the first frames output frames (interleaved) to the buffer. The
+   chain is reset again afterward. */
+int effects_chain_impulse_response(struct effects_chain *, int, sample_t, ssize_t, ssize_t, ssize_t, sample_t *);
 void destroy_effects_chain(struct effects_chain *);
+/* Enables replacing runs of linear time-invariant effects with a single
+   fir_p instance when chains are built. The argument is
+   "max_len[,tolerance]", where tolerance is the maximum truncation error in
+   dB relative to full scale. NULL disables. Returns nonzero on error. */
+int effects_chain_set_bake_opts(const char *);
+/* Saves a built chain to a snapshot file. The arguments are the ones the
+   chain was built from; they are part of the key checked on load. Returns
+   nonzero if the chain cannot be saved. */
+int effects_chain_save_snapshot(struct effects_chain *, const char *, int, const char *const *);
+/* Loads a chain from a snapshot file if the key matches and none of the
+   files it depends on have changed. On success, the stream is updated like
+   build_effects_chain_from_argv() does. Returns nonzero if the snapshot
+   cannot be used; the chain is left empty in that case. */
+int effects_chain_load_snapshot(const char *, int, const char *const *, struct effects_chain *, struct stream_info *);
 
 struct effects_chain_xfade_state {
 	sample_t *buf;
@@ -66,5 +92,9 @@ struct effects_chain_xfade_state {
 
 void effects_chain_xfade_reset(struct effects_chain_xfade_state *);
 sample_t * effects_chain_xfade_run(struct effects_chain_xfade_state *, ssize_t *, sample_t *, sample_t *);
+/* Mixes the output of a new chain into that of the old chain. Used by
+   effects_chain_xfade_run(), but may be called directly when the chains
+   are run some other way. */
+sample_t * effects_chain_xfade_mix(sample_t *, ssize_t *, const sample_t *, ssize_t, int, int, ssize_t *, ssize_t);
 
 #endif
@@ -19,25 +19,44 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/mathematics.h>
 #include <libavutil/version.h>
 #include <pthread.h>
+#include <time.h>
 #include "ffmpeg.h"
 #include "sampleconv.h"
 #include "dlsym.h"
 #include "util.h"
 
+#if _POSIX_TIMERS && defined(_POSIX_MONOTONIC_CLOCK)
+#define HAVE_CLOCK_GETTIME
+#endif
+
+/* number of decoded frames buffered ahead of ffmpeg_read() */
+#define FRAME_QUEUE_LEN 4
+
 struct ffmpeg_state {
 	AVFormatContext *container;
 	AVCodecContext *cc;
-	AVFrame *frame;
+	AVFrame *frame[FRAME_QUEUE_LEN];
 	void (*read_func)(void *, sample_t *, ssize_t);
 	void (*readp_func)(void **, sample_t *, int, ssize_t, ssize_t);
-	int planar, bytes, stream_index, got_frame;
+	int planar, bytes, stream_index;
 	ssize_t frame_pos;
 	int64_t last_ts;
+	struct {
+		pthread_t thread;
+		pthread_mutex_t lock;
+		pthread_cond_t cond;
+		int front, items, running, stop, eof, error;
+	} queue;
+	ssize_t n_frames;
+	double decode_time;
 };
 
 static pthread_mutex_t ffmpeg_init_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -81,60 +100,55 @@ static DLSYM_PROTOTYPE(av_frame_unref);
 static void read_buf_u8p(void **in, sample_t *out, int channels, ssize_t start, ssize_t s)
 {
 	uint8_t **inn = (uint8_t **) in;
-	int c = channels;
-	ssize_t out_s = s * channels;
-	while (s-- > 0) {
-		while (c-- > 0)
-			out[--out_s] = U8_TO_SAMPLE(inn[c][start + s]);
-		c = channels;
+	for (int c = 0; c < channels; ++c) {
+		const uint8_t *inc = &inn[c][start];
+		sample_t *outc = &out[c];
+		for (ssize_t i = 0; i < s; ++i)
+			outc[i*channels] = U8_TO_SAMPLE(inc[i]);
 	}
 }
 
 static void read_buf_s16p(void **in, sample_t *out, int channels, ssize_t start, ssize_t s)
 {
 	int16_t **inn = (int16_t **) in;
-	int c = channels;
-	ssize_t out_s = s * channels;
-	while (s-- > 0) {
-		while (c-- > 0)
-			out[--out_s] = S16_TO_SAMPLE(inn[c][start + s]);
-		c = channels;
+	for (int c = 0; c < channels; ++c) {
+		const int16_t *inc = &inn[c][start];
+		sample_t *outc = &out[c];
+		for (ssize_t i = 0; i < s; ++i)
+			outc[i*channels] = S16_TO_SAMPLE(inc[i]);
 	}
 }
 
 static void read_buf_s32p(void **in, sample_t *out, int channels, ssize_t start, ssize_t s)
 {
 	int32_t **inn = (int32_t **) in;
-	int c = channels;
-	ssize_t out_s = s * channels;
-	while (s-- > 0) {
-		while (c-- > 0)
-			out[--out_s] = S32_TO_SAMPLE(inn[c][start + s]);
-		c = channels;
+	for (int c = 0; c < channels; ++c) {
+		const int32_t *inc = &inn[c][start];
+		sample_t *outc = &out[c];
+		for (ssize_t i = 0; i < s; ++i)
+			outc[i*channels] = S32_TO_SAMPLE(inc[i]);
 	}
 }
 
 static void read_buf_floatp(void **in, sample_t *out, int channels, ssize_t start, ssize_t s)
 {
 	float **inn = (float **) in;
-	int c = channels;
-	ssize_t out_s = s * channels;
-	while (s-- > 0) {
-		while (c-- > 0)
-			out[--out_s] = FLOAT_TO_SAMPLE(inn[c][start + s]);
-		c = channels;
+	for (int c = 0; c < channels; ++c) {
+		const float *inc = &inn[c][start];
+		sample_t *outc = &out[c];
+		for (ssize_t i = 0; i < s; ++i)
+			outc[i*channels] = FLOAT_TO_SAMPLE(inc[i]);
 	}
 }
 
 static void read_buf_doublep(void **in, sample_t *out, int channels, ssize_t start, ssize_t s)
 {
 	double **inn = (double **) in;
-	int c = channels;
-	ssize_t out_s = s * channels;
-	while (s-- > 0) {
-		while (c-- > 0)
-			out[--out_s] = DOUBLE_TO_SAMPLE(inn[c][start + s]);
-		c = channels;
+	for (int c = 0; c < channels; ++c) {
+		const double *inc = &inn[c][start];
+		sample_t *outc = &out[c];
+		for (ssize_t i = 0; i < s; ++i)
+			outc[i*channels] = DOUBLE_TO_SAMPLE(inc[i]);
 	}
 }
 
@@ -146,17 +160,13 @@ static char * ffmpeg_get_err_str(int err, char *err_buf)
 
 #define FFMPEG_ERRSTR(err) ffmpeg_get_err_str(err, (char [AV_ERROR_MAX_STRING_SIZE]){0})
 
-static int get_new_frame(struct codec *c)
+static int get_new_frame(struct codec *c, AVFrame *frame)
 {
 	struct ffmpeg_state *state = (struct ffmpeg_state *) c->data;
 	AVPacket packet;
 	int err;
-	if (state->got_frame)
-		sym_av_frame_unref(state->frame);
-	state->got_frame = 0;
-	state->frame_pos = 0;
 	retry:
-	if ((err = sym_avcodec_receive_frame(state->cc, state->frame)) < 0) {
+	if ((err = sym_avcodec_receive_frame(state->cc, frame)) < 0) {
 		switch (err) {
 		case AVERROR_EOF:
 			return -1;
@@ -187,38 +197,133 @@ static int get_new_frame(struct codec *c)
 			return 1;
 		}
 	}
-	state->got_frame = 1;
+	/* with frame threading, the last packet sent may be well ahead of the
+	   frame received */
+	if (frame->pts != AV_NOPTS_VALUE)
+		state->last_ts = frame->pts;
+	return 0;
+}
+
+/* demuxes and decodes into the frame queue */
+static void * decode_worker(void *arg)
+{
+	struct codec *c = (struct codec *) arg;
+	struct ffmpeg_state *state = (struct ffmpeg_state *) c->data;
+#ifdef HAVE_CLOCK_GETTIME
+	struct timespec t0, t1;
+#endif
+	pthread_mutex_lock(&state->queue.lock);
+	for (;;) {
+		while (state->queue.items == FRAME_QUEUE_LEN && !state->queue.stop)
+			pthread_cond_wait(&state->queue.cond, &state->queue.lock);
+		if (state->queue.stop) break;
+		AVFrame *frame = state->frame[(state->queue.front + state->queue.items) % FRAME_QUEUE_LEN];
+		pthread_mutex_unlock(&state->queue.lock);
+
+	#ifdef HAVE_CLOCK_GETTIME
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+	#endif
+		const int r = get_new_frame(c, frame);
+	#ifdef HAVE_CLOCK_GETTIME
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+	#endif
+
+		pthread_mutex_lock(&state->queue.lock);
+	#ifdef HAVE_CLOCK_GETTIME
+		state->decode_time += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	#endif
+		if (r == 0) {
+			++state->queue.items;
+			++state->n_frames;
+		}
+		else if (r < 0) state->queue.eof = 1;
+		else state->queue.error = 1;
+		pthread_cond_broadcast(&state->queue.cond);
+		if (r != 0) break;
+	}
+	pthread_mutex_unlock(&state->queue.lock);
+	return NULL;
+}
+
+static int decode_worker_start(struct codec *c)
+{
+	struct ffmpeg_state *state = (struct ffmpeg_state *) c->data;
+	state->queue.stop = state->queue.eof = state->queue.error = 0;
+	if ((errno = pthread_create(&state->queue.thread, NULL, decode_worker, c)) != 0) {
+		LOG_FMT(LL_ERROR, "%s: error: pthread_create() failed: %s", c->type, strerror(errno));
+		state->queue.error = 1;  /* so ffmpeg_read() does not wait for frames */
+		return 1;
+	}
+	state->queue.running = 1;
 	return 0;
 }
 
+/* stops the decode thread; queued frames are kept */
+static void decode_worker_pause(struct codec *c)
+{
+	struct ffmpeg_state *state = (struct ffmpeg_state *) c->data;
+	if (state->queue.running) {
+		pthread_mutex_lock(&state->queue.lock);
+		state->queue.stop = 1;
+		pthread_cond_broadcast(&state->queue.cond);
+		pthread_mutex_unlock(&state->queue.lock);
+		pthread_join(state->queue.thread, NULL);
+		state->queue.running = 0;
+	}
+}
+
+/* discards all queued frames; the decode thread must be stopped */
+static void decode_queue_flush(struct codec *c)
+{
+	struct ffmpeg_state *state = (struct ffmpeg_state *) c->data;
+	for (; state->queue.items > 0; --state->queue.items) {
+		sym_av_frame_unref(state->frame[state->queue.front]);
+		state->queue.front = (state->queue.front+1) % FRAME_QUEUE_LEN;
+	}
+	state->queue.front = 0;
+	state->frame_pos = 0;
+}
+
+/* stops the decode thread and discards all queued frames */
+static void decode_worker_stop(struct codec *c)
+{
+	decode_worker_pause(c);
+	decode_queue_flush(c);
+}
+
 static ssize_t ffmpeg_read(struct codec *c, sample_t *buf, ssize_t frames)
 {
 	struct ffmpeg_state *state = (struct ffmpeg_state *) c->data;
-	int r, done = 0;  /* set to 1 at EOF */
-	ssize_t buf_pos = 0, avail = 0;
-	if (state->got_frame)
-		avail = state->frame->nb_samples - state->frame_pos;
-	while (buf_pos < frames && !(done && avail == 0)) {
-		if (avail == 0) {
-			r = get_new_frame(c);
-			if (r < 0) {
-				done = 1;
-				continue;
-			}
-			else if (r > 0)
-				return 0;
+	ssize_t buf_pos = 0;
+	while (buf_pos < frames) {
+		pthread_mutex_lock(&state->queue.lock);
+		while (state->queue.items == 0 && !state->queue.eof && !state->queue.error)
+			pthread_cond_wait(&state->queue.cond, &state->queue.lock);
+		if (state->queue.items == 0) {
+			const int error = state->queue.error;
+			pthread_mutex_unlock(&state->queue.lock);
+			return (error) ? 0 : buf_pos;
 		}
-		if (state->got_frame) {
-			avail = (avail > frames - buf_pos) ? frames - buf_pos : avail;
-			if (state->planar)
-				state->readp_func((void **) state->frame->extended_data, &buf[buf_pos * c->channels],
-					c->channels, state->frame_pos, avail);
-			else
-				state->read_func(&state->frame->extended_data[0][state->frame_pos * state->bytes * c->channels],
-					&buf[buf_pos * c->channels], avail * c->channels);
-			buf_pos += avail;
-			state->frame_pos += avail;
-			avail = state->frame->nb_samples - state->frame_pos;
+		AVFrame *frame = state->frame[state->queue.front];
+		pthread_mutex_unlock(&state->queue.lock);
+
+		const ssize_t avail = MINIMUM(frame->nb_samples - state->frame_pos, frames - buf_pos);
+		if (state->planar)
+			state->readp_func((void **) frame->extended_data, &buf[buf_pos * c->channels],
+				c->channels, state->frame_pos, avail);
+		else
+			state->read_func(&frame->extended_data[0][state->frame_pos * state->bytes * c->channels],
+				&buf[buf_pos * c->channels], avail * c->channels);
+		buf_pos += avail;
+		state->frame_pos += avail;
+		if (state->frame_pos >= frame->nb_samples) {
+			sym_av_frame_unref(frame);
+			state->frame_pos = 0;
+			pthread_mutex_lock(&state->queue.lock);
+			state->queue.front = (state->queue.front+1) % FRAME_QUEUE_LEN;
+			--state->queue.items;
+			pthread_cond_broadcast(&state->queue.cond);
+			pthread_mutex_unlock(&state->queue.lock);
 		}
 	}
 	return buf_pos;
@@ -237,11 +342,44 @@ static ssize_t ffmpeg_seek(struct codec *c, ssize_t pos)
 		pos = c->frames - 1;
 	st = state->container->streams[state->stream_index];
 	seek_ts = sym_av_rescale(pos, st->time_base.den, st->time_base.num) / c->fs;
-	if (sym_avformat_seek_file(state->container, state->stream_index, INT64_MIN, seek_ts, INT64_MAX, 0) < 0)
+	/* the demuxer belongs to the decode thread, but keep the queued frames
+	   until the seek succeeds so a failed seek leaves the stream intact */
+	decode_worker_pause(c);
+	/* land at or before the target, then decode and discard up to it */
+	if (sym_avformat_seek_file(state->container, state->stream_index, INT64_MIN, seek_ts, seek_ts, 0) < 0
+			&& sym_avformat_seek_file(state->container, state->stream_index, INT64_MIN, seek_ts, INT64_MAX, 0) < 0) {
+		decode_worker_start(c);  /* resume where we were */
 		return -1;
+	}
+	decode_queue_flush(c);
 	sym_avcodec_flush_buffers(state->cc);
-	get_new_frame(c);
-	pos = sym_av_rescale(state->last_ts, st->time_base.num * c->fs, st->time_base.den);
+	AVFrame *frame = state->frame[0];
+	ssize_t end_pos = -1;
+	int r;
+	while ((r = get_new_frame(c, frame)) == 0) {
+		++state->n_frames;
+		const ssize_t frame_pos = sym_av_rescale(state->last_ts, st->time_base.num * c->fs, st->time_base.den);
+		if (frame->pts == AV_NOPTS_VALUE || frame_pos >= pos) {
+			/* Either the frame has no timestamp, so frame_pos comes from the
+			   last packet timestamp and is only an estimate, or the demuxer
+			   landed after the target. The seek is not sample-accurate;
+			   report frame_pos as the position. */
+			pos = frame_pos;
+			state->queue.items = 1;
+			break;
+		}
+		if (frame_pos + frame->nb_samples > pos) {
+			state->frame_pos = pos - frame_pos;
+			state->queue.items = 1;
+			break;
+		}
+		end_pos = frame_pos + frame->nb_samples;
+		sym_av_frame_unref(frame);
+	}
+	/* at EOF, the position is the end of the last frame decoded; if there
+	   was none (or on error), the position is unknown */
+	if (r != 0) pos = (r < 0) ? end_pos : -1;
+	if (decode_worker_start(c)) return -1;
 	return pos;
 }
 
@@ -257,13 +395,33 @@ static void ffmpeg_destroy(struct codec *c)
 	if (c) {
 		struct ffmpeg_state *state = (struct ffmpeg_state *) c->data;
 		if (state) {
-			if (state->frame) sym_av_frame_free(&state->frame);
+			decode_worker_stop(c);
+			if (state->n_frames > 0 && state->decode_time > 0.0)
+				LOG_FMT(LL_VERBOSE, "%s: info: decoded %zd frames in %.3fs (%.1f frames/s)",
+					c->type, state->n_frames, state->decode_time, state->n_frames / state->decode_time);
+			for (int i = 0; i < FRAME_QUEUE_LEN; ++i)
+				if (state->frame[i]) sym_av_frame_free(&state->frame[i]);
 			if (state->cc) sym_avcodec_free_context(&state->cc);
 			if (state->container) sym_avformat_close_input(&state->container);
+			pthread_mutex_destroy(&state->queue.lock);
+			pthread_cond_destroy(&state->queue.cond);
 			free(state);
 		}
 		free((char *) c->type);
 	}
+	ffmpeg_codec_release();
+}
+
+/* only valid while an ffmpeg codec is open (the libraries are loaded) */
+void ffmpeg_codec_hold(void)
+{
+	pthread_mutex_lock(&ffmpeg_init_lock);
+	++ffmpeg_open_count;
+	pthread_mutex_unlock(&ffmpeg_init_lock);
+}
+
+void ffmpeg_codec_release(void)
+{
 	pthread_mutex_lock(&ffmpeg_init_lock);
 	--ffmpeg_open_count;
 	if (ffmpeg_open_count == 0)
@@ -323,17 +481,21 @@ struct codec * ffmpeg_codec_init(const struct codec_params *p)
 
 		if (dl_fail) goto dl_failed;
 
-		++ffmpeg_open_count;
 		if (LOGLEVEL(LL_VERBOSE))
 			sym_av_log_set_level(AV_LOG_VERBOSE);
 		else if (LOGLEVEL(LL_SILENT))
 			sym_av_log_set_level(AV_LOG_QUIET);
 	}
+	/* each codec holds a reference until ffmpeg_destroy(), including on
+	   the fail path below */
+	++ffmpeg_open_count;
 	pthread_mutex_unlock(&ffmpeg_init_lock);
 
 	/* open input and find stream info */
 	state = calloc(1, sizeof(struct ffmpeg_state));
 	if (check_alloc(p->type, state)) goto fail;
+	pthread_mutex_init(&state->queue.lock, NULL);
+	pthread_cond_init(&state->queue.cond, NULL);
 	if ((err = sym_avformat_open_input(&state->container, p->path, NULL, NULL)) < 0) {
 		LOG_FMT(LL_OPEN_ERROR, "%s: error: failed to open input: %s: %s", p->type, p->path, FFMPEG_ERRSTR(err));
 		goto fail;
@@ -366,15 +528,23 @@ struct codec * ffmpeg_codec_init(const struct codec_params *p)
 		LOG_FMT(LL_ERROR, "%s: error: failed to copy codec parameters to decoder context: %s", p->type, FFMPEG_ERRSTR(err));
 		goto fail;
 	}
+	/* use frame and/or slice threading if the decoder supports it */
+	state->cc->thread_count = 0;
+	state->cc->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
 	if ((err = sym_avcodec_open2(state->cc, codec, NULL)) < 0) {
 		LOG_FMT(LL_ERROR, "%s: error: could not open required decoder: %s", p->type, FFMPEG_ERRSTR(err));
 		goto fail;
 	}
-
-	state->frame = sym_av_frame_alloc();
-	if (state->frame == NULL) {
-		LOG_FMT(LL_ERROR, "%s: error: failed to allocate frame", p->type);
-		goto fail;
+	if (state->cc->active_thread_type)
+		LOG_FMT(LL_VERBOSE, "%s: info: %s threading enabled; threads: %d", p->type,
+			(state->cc->active_thread_type & FF_THREAD_FRAME) ? "frame" : "slice", state->cc->thread_count);
+
+	for (i = 0; i < FRAME_QUEUE_LEN; ++i) {
+		state->frame[i] = sym_av_frame_alloc();
+		if (state->frame[i] == NULL) {
+			LOG_FMT(LL_ERROR, "%s: error: failed to allocate frame", p->type);
+			goto fail;
+		}
 	}
 	state->planar = sym_av_sample_fmt_is_planar(state->cc->sample_fmt);
 	state->bytes = sym_av_get_bytes_per_sample(state->cc->sample_fmt);
@@ -444,6 +614,7 @@ struct codec * ffmpeg_codec_init(const struct codec_params *p)
 	c->pause = codec_pause_noop;
 	c->destroy = ffmpeg_destroy;
 	c->data = state;
+	if (decode_worker_start(c)) goto fail;
 
 	return c;
 
@@ -24,5 +24,8 @@
 
 struct codec * ffmpeg_codec_init(const struct codec_params *);
 void ffmpeg_codec_print_encodings(const char *);
+/* keep the libav* libraries loaded even when no ffmpeg codec is open */
+void ffmpeg_codec_hold(void);
+void ffmpeg_codec_release(void);
 
 #endif
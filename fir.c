@@ -20,24 +20,38 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
 #include <complex.h>
 #include <fftw3.h>
 #include "fir.h"
+#include "shared_data.h"
 #include "util.h"
 #include "codec.h"
 
-#define MAX_DIRECT_LEN (1<<4)
-
 struct fir_direct_state {
 	ssize_t len, mask, p, filter_frames, ref;
 	sample_t *lbuf, **filter, **buf;
+	int filter_channels, forced;
 };
 
 struct fir_state {
 	ssize_t len, fr_len, p, filter_frames, ref;
-	fftw_complex **filter_fr, *tmp_fr, *filter_fr_1ch;
-	sample_t **buf, **olap;
+	fftw_complex **filter_fr, *tmp_fr, *filter_fr_shared;
+	sample_t **buf, **olap, *out_norm;
 	fftw_plan r2c_plan, c2r_plan;
+	int filter_channels;
+};
+
+struct fir_filter_fr_key {
+	ssize_t len, filter_frames, filter_channels;  /* no padding; compared bytewise */
+};
+
+struct fir_filter_fr_init_arg {
+	struct fir_state *state;
+	sample_t *tmp_buf;
+	const sample_t *filter_data;
+	const fftw_complex *filter_fr;  /* precomputed spectra (from a snapshot) */
+	int filter_channels;
 };
 
 static sample_t * fir_direct_effect_run(struct effect *e, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
@@ -69,17 +83,13 @@ static void fir_direct_effect_reset(struct effect *e)
 		if (state->buf[k]) memset(state->buf[k], 0, state->len * sizeof(sample_t));
 }
 
-static void fir_direct_effect_plot(struct effect *e, int i)
+static void fir_direct_effect_plot(struct effect *e, ssize_t n, double df, const double complex *ih, double complex *oh)
 {
 	struct fir_direct_state *state = (struct fir_direct_state *) e->data;
 	for (int k = 0; k < e->ostream.channels; ++k) {
-		if (state->buf[k]) {
-			printf("H%d_%d(w)=(abs(w)<=pi)?exp(-j*w*%zd)*(0.0", k, i, -state->ref);
-			for (ssize_t j = 0; j < state->len; ++j)
-				printf("+exp(-j*w*%zd)*%.15e", j, state->filter[k][j]);
-			puts("):0/0");
-		}
-		else printf("H%d_%d(w)=1.0\n", k, i);
+		if (state->buf[k])
+			fir_plot(state->filter[k], state->len, state->ref, e->ostream.fs, n, df, &ih[k*n], &oh[k*n]);
+		else memcpy(&oh[k*n], &ih[k*n], n * sizeof(double complex));
 	}
 }
 
@@ -93,10 +103,10 @@ static void fir_direct_effect_drain_samples(struct effect *e, ssize_t *drain_sam
 static void fir_direct_effect_destroy(struct effect *e)
 {
 	struct fir_direct_state *state = (struct fir_direct_state *) e->data;
-	free(state->lbuf);
-	free(state->filter);
-	free(state->buf);
-	free(state);
+	effect_free(state->lbuf);
+	effect_free(state->filter);
+	effect_free(state->buf);
+	effect_free(state);
 }
 
 static void fir_direct_effect_channel_offsets(struct effect *e, ssize_t *latency, ssize_t *req_delay)
@@ -119,9 +129,9 @@ static sample_t * fir_effect_run(struct effect *e, ssize_t *frames, sample_t *ib
 		}
 		++state->p;
 		if (state->p == state->len) {
-			const sample_t out_norm = 1.0 / (state->len * 2.0);
 			for (int k = 0; k < e->ostream.channels; ++k) {
 				if (state->buf[k]) {
+					const sample_t out_norm = state->out_norm[k];
 					fftw_complex *filter_fr_p = state->filter_fr[k];
 					sample_t *buf_p = state->buf[k], *olap_p = state->olap[k];
 					fftw_execute_dft_r2c(state->r2c_plan, state->buf[k], state->tmp_fr);
@@ -160,7 +170,7 @@ static void fir_effect_reset(struct effect *e)
 	}
 }
 
-static void fir_effect_plot(struct effect *e, int i)
+static void fir_effect_plot(struct effect *e, ssize_t n, double df, const double complex *ih, double complex *oh)
 {
 	struct fir_state *state = (struct fir_state *) e->data;
 	for (int k = 0; k < e->ostream.channels; ++k) {
@@ -168,12 +178,11 @@ static void fir_effect_plot(struct effect *e, int i)
 			for (ssize_t j = 0; j < state->fr_len; ++j)
 				state->tmp_fr[j] = state->filter_fr[k][j];
 			fftw_execute_dft_c2r(state->c2r_plan, state->tmp_fr, state->buf[k]);
-			printf("H%d_%d(w)=(abs(w)<=pi)?exp(-j*w*%zd)*(0.0", k, i, -state->ref);
 			for (ssize_t j = 0; j < state->len; ++j)
-				printf("+exp(-j*w*%zd)*%.15e", j, state->buf[k][j] / (state->len * 2));
-			puts("):0/0");
+				state->buf[k][j] *= state->out_norm[k];
+			fir_plot(state->buf[k], state->len, state->ref, e->ostream.fs, n, df, &ih[k*n], &oh[k*n]);
 		}
-		else printf("H%d_%d(w)=1.0\n", k, i);
+		else memcpy(&oh[k*n], &ih[k*n], n * sizeof(double complex));
 	}
 }
 
@@ -190,19 +199,18 @@ static void fir_effect_destroy(struct effect *e)
 {
 	struct fir_state *state = (struct fir_state *) e->data;
 	for (int k = 0; k < e->ostream.channels; ++k) {
-		if (!state->filter_fr_1ch && state->filter_fr)
-			fftw_free(state->filter_fr[k]);
-		if (state->buf) fftw_free(state->buf[k]);
-		if (state->olap) fftw_free(state->olap[k]);
+		if (state->buf) effect_free(state->buf[k]);
+		if (state->olap) effect_free(state->olap[k]);
 	}
-	free(state->buf);
-	free(state->olap);
-	free(state->filter_fr);
-	fftw_free(state->filter_fr_1ch);
-	fftw_free(state->tmp_fr);
+	effect_free(state->buf);
+	effect_free(state->olap);
+	effect_free(state->filter_fr);
+	effect_free(state->out_norm);
+	shared_data_release(state->filter_fr_shared);
+	effect_free(state->tmp_fr);
 	if (state->r2c_plan) fftw_destroy_plan(state->r2c_plan);
 	if (state->c2r_plan) fftw_destroy_plan(state->c2r_plan);
-	free(state);
+	effect_free(state);
 }
 
 static void fir_effect_channel_offsets(struct effect *e, ssize_t *latency, ssize_t *req_delay)
@@ -216,7 +224,265 @@ static void fir_effect_channel_offsets(struct effect *e, ssize_t *latency, ssize
 	}
 }
 
-struct effect * fir_effect_init_with_filter(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, sample_t *filter_data, int filter_channels, ssize_t filter_frames, ssize_t ref, int force_direct)
+/* fills the filter spectrum for each filter channel using the plan and
+   buffers of the instance that creates the shared entry */
+static int fir_filter_fr_init(void *data, void *arg)
+{
+	struct fir_filter_fr_init_arg *a = (struct fir_filter_fr_init_arg *) arg;
+	struct fir_state *state = a->state;
+	fftw_complex *filter_fr = (fftw_complex *) data;
+	if (a->filter_fr) {
+		memcpy(filter_fr, a->filter_fr, state->fr_len * a->filter_channels * sizeof(fftw_complex));
+		return 0;
+	}
+	for (int l = 0; l < a->filter_channels; ++l) {
+		memset(a->tmp_buf, 0, state->len * 2 * sizeof(sample_t));
+		for (ssize_t j = 0; j < state->filter_frames; ++j)
+			a->tmp_buf[j] = a->filter_data[j*a->filter_channels + l];
+		fftw_execute(state->r2c_plan);
+		memcpy(&filter_fr[l*state->fr_len], state->tmp_fr, state->fr_len * sizeof(fftw_complex));
+	}
+	memset(a->tmp_buf, 0, state->len * 2 * sizeof(sample_t));
+	return 0;
+}
+
+/* estimated operations per frame for one channel */
+static double fir_cost(ssize_t filter_frames)
+{
+	if (filter_frames <= FIR_MAX_DIRECT_LEN) {
+		ssize_t len = 1;
+		while (len < filter_frames) len <<= 1;
+		return 2.0 * len;
+	}
+	/* r2c and c2r transforms of length 2*len per len frames, plus the
+	   spectrum multiply and overlap-add */
+	return 10.0 * log2(2.0 * next_fast_fftw_len(filter_frames)) + 8.0;
+}
+
+static int fir_effect_is_direct(struct effect *e)
+{
+	return (e->run == fir_direct_effect_run);
+}
+
+static int fir_effect_has_channel(struct effect *e, int k)
+{
+	if (fir_effect_is_direct(e))
+		return ((struct fir_direct_state *) e->data)->buf[k] != NULL;
+	return ((struct fir_state *) e->data)->buf[k] != NULL;
+}
+
+static double fir_effect_cost(struct effect *e)
+{
+	int n = 0;
+	for (int k = 0; k < e->ostream.channels; ++k)
+		if (fir_effect_has_channel(e, k)) ++n;
+	if (fir_effect_is_direct(e))
+		return 2.0 * ((struct fir_direct_state *) e->data)->len * n;
+	return fir_cost(((struct fir_state *) e->data)->filter_frames) * n;
+}
+
+static int fir_effect_scale(struct effect *e, const sample_t *gain)
+{
+	int k0 = -1;
+	for (int k = 0; k < e->ostream.channels; ++k) {
+		if (fir_effect_has_channel(e, k)) {
+			if (k0 < 0) k0 = k;
+			else if (fir_effect_is_direct(e) && gain[k] != gain[k0]
+					&& ((struct fir_direct_state *) e->data)->filter_channels == 1)
+				return 0;  /* filter is shared between channels */
+		}
+		else if (gain[k] != 1.0) return 0;
+	}
+	if (fir_effect_is_direct(e)) {
+		struct fir_direct_state *state = (struct fir_direct_state *) e->data;
+		for (int k = 0; k < e->ostream.channels; ++k) {
+			if (state->buf[k] && (k == k0 || state->filter_channels > 1)) {
+				for (ssize_t j = 0; j < state->filter_frames; ++j)
+					state->filter[k][j] *= gain[k];
+			}
+		}
+	}
+	else {
+		/* the spectra may be shared, so the gain goes into the output scaling */
+		struct fir_state *state = (struct fir_state *) e->data;
+		for (int k = 0; k < e->ostream.channels; ++k)
+			if (state->buf[k]) state->out_norm[k] *= gain[k];
+	}
+	return 1;
+}
+
+/* writes the impulse response (including any applied gain) of channel k */
+static void fir_effect_get_filter(struct effect *e, int k, sample_t *dest)
+{
+	if (fir_effect_is_direct(e)) {
+		struct fir_direct_state *state = (struct fir_direct_state *) e->data;
+		memcpy(dest, state->filter[k], state->filter_frames * sizeof(sample_t));
+	}
+	else {
+		struct fir_state *state = (struct fir_state *) e->data;
+		memcpy(state->tmp_fr, state->filter_fr[k], state->fr_len * sizeof(fftw_complex));
+		fftw_execute_dft_c2r(state->c2r_plan, state->tmp_fr, state->buf[k]);
+		for (ssize_t j = 0; j < state->filter_frames; ++j)
+			dest[j] = state->buf[k][j] * state->out_norm[k];
+		memset(state->buf[k], 0, state->len * 2 * sizeof(sample_t));
+	}
+}
+
+/* linear convolution of a and b; out must hold la+lb-1 samples */
+static int fir_convolve(const sample_t *a, ssize_t la, const sample_t *b, ssize_t lb, sample_t *out)
+{
+	const ssize_t len = la + lb - 1;
+	if (la * lb <= 1<<16) {
+		memset(out, 0, len * sizeof(sample_t));
+		for (ssize_t i = 0; i < la; ++i)
+			for (ssize_t j = 0; j < lb; ++j)
+				out[i+j] += a[i] * b[j];
+		return 0;
+	}
+	const ssize_t fft_len = next_fast_fftw_len(len), fr_len = fft_len/2 + 1;
+	sample_t *buf_a = fftw_malloc(fft_len * sizeof(sample_t));
+	sample_t *buf_b = fftw_malloc(fft_len * sizeof(sample_t));
+	fftw_complex *fr_a = fftw_malloc(fr_len * sizeof(fftw_complex));
+	fftw_complex *fr_b = fftw_malloc(fr_len * sizeof(fftw_complex));
+	fftw_plan r2c_plan = NULL, c2r_plan = NULL;
+	int r = 1;
+	if (!buf_a || !buf_b || !fr_a || !fr_b) goto done;
+	dsp_fftw_acquire();
+	r2c_plan = fftw_plan_dft_r2c_1d(fft_len, buf_a, fr_a, FFTW_ESTIMATE);
+	c2r_plan = fftw_plan_dft_c2r_1d(fft_len, fr_a, buf_a, FFTW_ESTIMATE);
+	dsp_fftw_release();
+	if (!r2c_plan || !c2r_plan) goto done;
+	memset(buf_a, 0, fft_len * sizeof(sample_t));
+	memset(buf_b, 0, fft_len * sizeof(sample_t));
+	memcpy(buf_a, a, la * sizeof(sample_t));
+	memcpy(buf_b, b, lb * sizeof(sample_t));
+	fftw_execute_dft_r2c(r2c_plan, buf_a, fr_a);
+	fftw_execute_dft_r2c(r2c_plan, buf_b, fr_b);
+	for (ssize_t j = 0; j < fr_len; ++j)
+		fr_a[j] *= fr_b[j] / fft_len;
+	fftw_execute_dft_c2r(c2r_plan, fr_a, buf_a);
+	memcpy(out, buf_a, len * sizeof(sample_t));
+	r = 0;
+
+	done:
+	dsp_fftw_acquire();
+	if (r2c_plan) fftw_destroy_plan(r2c_plan);
+	if (c2r_plan) fftw_destroy_plan(c2r_plan);
+	dsp_fftw_release();
+	fftw_free(buf_a);
+	fftw_free(buf_b);
+	fftw_free(fr_a);
+	fftw_free(fr_b);
+	return r;
+}
+
+/* merges two filters on the same channels into one when a single
+   convolution of the combined length is estimated to be cheaper */
+static int fir_effect_merge(struct effect *dest, struct effect *src)
+{
+	if (dest->merge != src->merge) return 0;
+	if ((fir_effect_is_direct(dest) && ((struct fir_direct_state *) dest->data)->forced)
+			|| (fir_effect_is_direct(src) && ((struct fir_direct_state *) src->data)->forced))
+		return 0;  /* zero-latency part of fir_p */
+	int n_channels = 0;
+	for (int k = 0; k < dest->ostream.channels; ++k) {
+		if (fir_effect_has_channel(dest, k) != fir_effect_has_channel(src, k)) return 0;
+		if (fir_effect_has_channel(dest, k)) ++n_channels;
+	}
+	const ssize_t la = (fir_effect_is_direct(dest)) ? ((struct fir_direct_state *) dest->data)->filter_frames : ((struct fir_state *) dest->data)->filter_frames;
+	const ssize_t lb = (fir_effect_is_direct(src)) ? ((struct fir_direct_state *) src->data)->filter_frames : ((struct fir_state *) src->data)->filter_frames;
+	const ssize_t ref_a = (fir_effect_is_direct(dest)) ? ((struct fir_direct_state *) dest->data)->ref : ((struct fir_state *) dest->data)->ref;
+	const ssize_t ref_b = (fir_effect_is_direct(src)) ? ((struct fir_direct_state *) src->data)->ref : ((struct fir_state *) src->data)->ref;
+	const ssize_t len = la + lb - 1;
+	if (fir_cost(len) * n_channels >= fir_effect_cost(dest) + fir_effect_cost(src))
+		return 0;
+
+	int r = 0, filter_channels = 1;
+	char *selector = NEW_SELECTOR(dest->ostream.channels);
+	sample_t *fa = calloc(la, sizeof(sample_t)), *fb = calloc(lb, sizeof(sample_t));
+	sample_t *fc = calloc(len, sizeof(sample_t)), *filter = calloc(len * n_channels, sizeof(sample_t));
+	if (!selector || !fa || !fb || !fc || !filter) {
+		dsp_perror(DSP_ENOMEM, dest->name, NULL);
+		goto done;
+	}
+	for (int k = 0, l = 0; k < dest->ostream.channels; ++k) {
+		if (fir_effect_has_channel(dest, k)) {
+			SET_BIT(selector, k);
+			fir_effect_get_filter(dest, k, fa);
+			fir_effect_get_filter(src, k, fb);
+			if (fir_convolve(fa, la, fb, lb, fc)) {
+				dsp_perror(DSP_ENOMEM, dest->name, NULL);
+				goto done;
+			}
+			for (ssize_t j = 0; j < len; ++j) {
+				filter[j*n_channels + l] = fc[j];
+				if (fc[j] != filter[j*n_channels]) filter_channels = n_channels;
+			}
+			++l;
+		}
+	}
+	if (filter_channels == 1) {
+		for (ssize_t j = 0; j < len; ++j)
+			filter[j] = filter[j*n_channels];
+	}
+
+	const struct effect_info ei = { dest->name, NULL, NULL, 0 };
+	struct effect *e = fir_effect_init_with_filter(&ei, &dest->istream, selector, filter, filter_channels, len, ref_a + ref_b, 0);
+	if (e) {
+		LOG_FMT(LL_VERBOSE, "%s: info: merged filters: %zd + %zd -> %zd frames", dest->name, la, lb, len);
+		struct effect old = *dest;
+		e->prev = dest->prev;
+		e->next = dest->next;
+		*dest = *e;
+		effect_free(e);
+		old.destroy(&old);
+		r = 1;
+	}
+
+	done:
+	free(selector);
+	free(fa);
+	free(fb);
+	free(fc);
+	free(filter);
+	return r;
+}
+
+static int fir_effect_save(struct effect *e, struct snapshot_writer *w)
+{
+	const int64_t direct = fir_effect_is_direct(e);
+	char *channel_selector = NEW_SELECTOR(e->ostream.channels);
+	if (check_alloc(e->name, channel_selector)) return 1;
+	for (int k = 0; k < e->ostream.channels; ++k)
+		if (fir_effect_has_channel(e, k)) SET_BIT(channel_selector, k);
+	snapshot_write_str(w, "fir");
+	snapshot_write_selector(w, channel_selector, e->ostream.channels);
+	free(channel_selector);
+	SNAPSHOT_WRITE_VAL(w, direct);
+	if (direct) {
+		struct fir_direct_state *state = (struct fir_direct_state *) e->data;
+		const int64_t hdr[] = { state->filter_frames, state->ref, state->filter_channels, state->forced };
+		SNAPSHOT_WRITE_VAL(w, hdr);
+		for (int k = 0, l = 0; k < e->ostream.channels && l < state->filter_channels; ++k) {
+			if (state->buf[k]) {
+				snapshot_write(w, state->filter[k], state->filter_frames * sizeof(sample_t));
+				++l;
+			}
+		}
+	}
+	else {
+		struct fir_state *state = (struct fir_state *) e->data;
+		const int64_t hdr[] = { state->filter_frames, state->ref, state->filter_channels, state->len };
+		SNAPSHOT_WRITE_VAL(w, hdr);
+		snapshot_write(w, state->out_norm, e->ostream.channels * sizeof(sample_t));
+		snapshot_write(w, state->filter_fr_shared, state->fr_len * state->filter_channels * sizeof(fftw_complex));
+	}
+	return w->err;
+}
+
+/* filter_fr, if not NULL, holds the spectra for the FFT convolution and
+   filter_data is not used */
+static struct effect * fir_effect_new(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, const sample_t *filter_data, const fftw_complex *filter_fr, int filter_channels, ssize_t filter_frames, ssize_t ref, int force_direct)
 {
 	const int n_channels = num_bits_set(channel_selector, istream->channels);
 	if (filter_channels != 1 && filter_channels != n_channels) {
@@ -228,37 +494,44 @@ struct effect * fir_effect_init_with_filter(const struct effect_info *ei, const
 		return NULL;
 	}
 
-	struct effect *e = calloc(1, sizeof(struct effect));
+	struct effect *e = effect_alloc(1, sizeof(struct effect));
 	if (check_alloc(ei->name, e)) return NULL;
 	e->name = ei->name;
 	e->istream.fs = e->ostream.fs = istream->fs;
 	e->istream.channels = e->ostream.channels = istream->channels;
 	e->flags |= EFFECT_FLAG_OPT_REORDERABLE;
 	e->flags |= EFFECT_FLAG_CH_DEPS_IDENTITY;
+	e->flags |= EFFECT_FLAG_LTI;
 
-	if (filter_frames <= MAX_DIRECT_LEN || force_direct) {
+	if (filter_frames <= FIR_MAX_DIRECT_LEN || force_direct) {
 		e->run = fir_direct_effect_run;
 		e->reset = fir_direct_effect_reset;
 		e->plot = fir_direct_effect_plot;
 		e->drain_samples = fir_direct_effect_drain_samples;
 		e->destroy = fir_direct_effect_destroy;
 		e->channel_offsets = fir_direct_effect_channel_offsets;
+		e->merge = fir_effect_merge;
+		e->scale = fir_effect_scale;
+		e->cost = fir_effect_cost;
+		e->save = fir_effect_save;
 
-		struct fir_direct_state *state = calloc(1, sizeof(struct fir_direct_state));
+		struct fir_direct_state *state = effect_alloc(1, sizeof(struct fir_direct_state));
 		if (check_alloc(ei->name, state)) goto fail;
 		e->data = state;
 
 		state->filter_frames = filter_frames;
 		state->ref = ref;
+		state->filter_channels = filter_channels;
+		state->forced = force_direct;
 		state->len = 1;
 		while (state->len < filter_frames)
 			state->len <<= 1;
 		state->mask = state->len - 1;
 		LOG_FMT(LL_VERBOSE, "%s: info: filter_frames=%zd direct_len=%zd", ei->name, filter_frames, state->len);
-		sample_t *l_filter_p = state->lbuf = calloc(state->len * (filter_channels + n_channels), sizeof(sample_t));
+		sample_t *l_filter_p = state->lbuf = effect_alloc(state->len * (filter_channels + n_channels), sizeof(sample_t));
 		sample_t *l_buf_p = l_filter_p + (state->len * filter_channels);
-		state->filter = calloc(e->ostream.channels, sizeof(sample_t *));
-		state->buf = calloc(e->ostream.channels, sizeof(sample_t *));
+		state->filter = effect_alloc(e->ostream.channels, sizeof(sample_t *));
+		state->buf = effect_alloc(e->ostream.channels, sizeof(sample_t *));
 		if (!state->lbuf || !state->filter || !state->buf) {
 			fir_direct_effect_destroy(e);
 			dsp_perror(DSP_ENOMEM, ei->name, NULL);
@@ -288,36 +561,38 @@ struct effect * fir_effect_init_with_filter(const struct effect_info *ei, const
 		e->drain_samples = fir_effect_drain_samples;
 		e->destroy = fir_effect_destroy;
 		e->channel_offsets = fir_effect_channel_offsets;
+		e->merge = fir_effect_merge;
+		e->scale = fir_effect_scale;
+		e->cost = fir_effect_cost;
+		e->save = fir_effect_save;
 
-		struct fir_state *state = calloc(1, sizeof(struct fir_state));
+		struct fir_state *state = effect_alloc(1, sizeof(struct fir_state));
 		if (check_alloc(ei->name, state)) goto fail;
 		e->data = state;
 
 		state->filter_frames = filter_frames;
 		state->ref = ref;
+		state->filter_channels = filter_channels;
 		state->len = next_fast_fftw_len(filter_frames);
 		LOG_FMT(LL_VERBOSE, "%s: info: filter_frames=%zd fft_len=%zd", ei->name, filter_frames, state->len);
 		state->fr_len = state->len + ((state->len&1)?1:2);
-		state->tmp_fr = fftw_malloc(state->fr_len * sizeof(fftw_complex));
-		state->buf = calloc(e->ostream.channels, sizeof(sample_t *));
-		state->olap = calloc(e->ostream.channels, sizeof(sample_t *));
-		state->filter_fr = calloc(e->ostream.channels, sizeof(fftw_complex *));
-		if (!state->tmp_fr || !state->buf || !state->olap || !state->filter_fr) {
+		state->tmp_fr = effect_alloc(state->fr_len, sizeof(fftw_complex));
+		state->buf = effect_alloc(e->ostream.channels, sizeof(sample_t *));
+		state->olap = effect_alloc(e->ostream.channels, sizeof(sample_t *));
+		state->filter_fr = effect_alloc(e->ostream.channels, sizeof(fftw_complex *));
+		state->out_norm = effect_alloc(e->ostream.channels, sizeof(sample_t));
+		if (!state->tmp_fr || !state->buf || !state->olap || !state->filter_fr || !state->out_norm) {
 			dsp_perror(DSP_ENOMEM, ei->name, NULL);
 			goto fail_fft;
 		}
 
-		if (filter_channels == 1)
-			state->filter_fr_1ch = fftw_malloc(state->fr_len * sizeof(fftw_complex));
 		sample_t *tmp_buf = NULL;
 		for (int k = 0; k < e->ostream.channels; ++k) {
 			if (GET_BIT(channel_selector, k)) {
-				state->buf[k] = fftw_malloc(state->len * 2 * sizeof(sample_t));
+				state->buf[k] = effect_alloc(state->len * 2, sizeof(sample_t));
 				if (!tmp_buf) tmp_buf = state->buf[k];
-				state->olap[k] = fftw_malloc(state->len * sizeof(sample_t));
-				state->filter_fr[k] = (filter_channels == 1) ?
-					state->filter_fr_1ch : fftw_malloc(state->fr_len * sizeof(fftw_complex));
-				if (!state->buf[k] || !state->olap[k] || !state->filter_fr[k]) {
+				state->olap[k] = effect_alloc(state->len, sizeof(sample_t));
+				if (!state->buf[k] || !state->olap[k]) {
 					dsp_perror(DSP_ENOMEM, ei->name, NULL);
 					goto fail_fft;
 				}
@@ -339,33 +614,90 @@ struct effect * fir_effect_init_with_filter(const struct effect_info *ei, const
 				memset(state->olap[k], 0, state->len * sizeof(sample_t));
 			}
 		}
-		if (filter_channels == 1) {
-			memcpy(tmp_buf, filter_data, filter_frames * sizeof(sample_t));
-			fftw_execute(state->r2c_plan);
-			memcpy(state->filter_fr_1ch, state->tmp_fr, state->fr_len * sizeof(fftw_complex));
-		}
-		else {
-			for (int k = 0, l = 0; k < e->ostream.channels; ++k) {
-				if (GET_BIT(channel_selector, k)) {
-					for (ssize_t j = 0; j < filter_frames; ++j)
-						tmp_buf[j] = filter_data[j*filter_channels + l];
-					fftw_execute(state->r2c_plan);
-					memcpy(state->filter_fr[k], state->tmp_fr, state->fr_len * sizeof(fftw_complex));
-					++l;
-				}
+		/* the filter spectra are immutable, so identical filters share them */
+		const struct fir_filter_fr_key fr_key = { state->len, filter_frames, filter_channels };
+		const struct shared_data_key key[] = {
+			{ &fr_key, sizeof(fr_key) },
+			(filter_fr) ? (struct shared_data_key) { filter_fr, state->fr_len * filter_channels * sizeof(fftw_complex) }
+				: (struct shared_data_key) { filter_data, filter_frames * filter_channels * sizeof(sample_t) },
+		};
+		struct fir_filter_fr_init_arg fr_arg = { state, tmp_buf, filter_data, filter_fr, filter_channels };
+		state->filter_fr_shared = shared_data_get("fir", key, LENGTH(key),
+			state->fr_len * filter_channels * sizeof(fftw_complex), fir_filter_fr_init, &fr_arg);
+		if (!state->filter_fr_shared) goto fail_fft;
+		for (int k = 0, l = 0; k < e->ostream.channels; ++k) {
+			if (GET_BIT(channel_selector, k)) {
+				state->filter_fr[k] = &state->filter_fr_shared[l*state->fr_len];
+				state->out_norm[k] = 1.0 / (state->len * 2.0);
+				if (filter_channels > 1) ++l;
 			}
 		}
-		memset(tmp_buf, 0, state->len * 2 * sizeof(sample_t));
 		return e;
 
 		fail_fft:
 		fir_effect_destroy(e);
 	}
 	fail:
-	free(e);
+	effect_free(e);
 	return NULL;
 }
 
+struct effect * fir_effect_init_with_filter(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, sample_t *filter_data, int filter_channels, ssize_t filter_frames, ssize_t ref, int force_direct)
+{
+	return fir_effect_new(ei, istream, channel_selector, filter_data, NULL, filter_channels, filter_frames, ref, force_direct);
+}
+
+struct effect * fir_effect_load(const char *name, const struct stream_info *istream, struct snapshot_reader *r)
+{
+	const struct effect_info ei = { name, NULL, NULL, 0 };
+	struct effect *e = NULL;
+	sample_t *filter_data = NULL;
+	int64_t direct, hdr[4];
+	char *channel_selector = NEW_SELECTOR(istream->channels);
+	if (check_alloc(name, channel_selector)) return NULL;
+	if (snapshot_read_selector(r, channel_selector, istream->channels)
+			|| SNAPSHOT_READ_VAL(r, direct) || SNAPSHOT_READ_VAL(r, hdr))
+		goto done;
+	const ssize_t filter_frames = hdr[0], ref = hdr[1];
+	const int filter_channels = hdr[2], n_channels = num_bits_set(channel_selector, istream->channels);
+	if (filter_frames < 1 || filter_frames > (r->end - r->p) / (ssize_t) sizeof(sample_t)
+			|| (filter_channels != 1 && filter_channels != n_channels))
+		goto done;
+	if (direct) {
+		filter_data = calloc(filter_frames * filter_channels, sizeof(sample_t));
+		if (check_alloc(name, filter_data)) goto done;
+		for (int l = 0; l < filter_channels; ++l) {
+			const sample_t *f = snapshot_read(r, filter_frames * sizeof(sample_t));
+			if (f == NULL) goto done;
+			for (ssize_t j = 0; j < filter_frames; ++j)
+				filter_data[j*filter_channels + l] = f[j];
+		}
+		e = fir_effect_new(&ei, istream, channel_selector, filter_data, NULL, filter_channels, filter_frames, ref, hdr[3] != 0);
+		if (e && !fir_effect_is_direct(e)) {
+			destroy_effect(e);
+			e = NULL;
+		}
+	}
+	else {
+		const ssize_t len = next_fast_fftw_len(filter_frames);
+		const ssize_t fr_len = len + ((len&1)?1:2);
+		const sample_t *out_norm = snapshot_read(r, istream->channels * sizeof(sample_t));
+		const fftw_complex *filter_fr = snapshot_read(r, fr_len * filter_channels * sizeof(fftw_complex));
+		if (filter_frames <= FIR_MAX_DIRECT_LEN || hdr[3] != len || out_norm == NULL || filter_fr == NULL)
+			goto done;  /* FFT length may differ between builds */
+		e = fir_effect_new(&ei, istream, channel_selector, NULL, filter_fr, filter_channels, filter_frames, ref, 0);
+		if (e) {
+			struct fir_state *state = (struct fir_state *) e->data;
+			memcpy(state->out_norm, out_norm, istream->channels * sizeof(sample_t));
+		}
+	}
+
+	done:
+	free(channel_selector);
+	free(filter_data);
+	return e;
+}
+
 struct effect * fir_effect_init(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, const char *dir, int argc, const char *const *argv)
 {
 	int filter_channels;
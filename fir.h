@@ -24,8 +24,11 @@
 #include "effect.h"
 #include "fir_util.h"
 
+#define FIR_MAX_DIRECT_LEN (1<<4)  /* filters up to this length use direct convolution */
+
 struct effect * fir_effect_init_with_filter(const struct effect_info *, const struct stream_info *, const char *, sample_t *, int, ssize_t, ssize_t, int);
 struct effect * fir_effect_init(const struct effect_info *, const struct stream_info *, const char *, const char *, int, const char *const *);
+struct effect * fir_effect_load(const char *, const struct stream_info *, struct snapshot_reader *);
 
 #define FIR_EFFECT_INFO \
 	{ "fir", FIR_USAGE_OPTS " " FIR_USAGE_FILTER, fir_effect_init, 0 }
@@ -0,0 +1,273 @@
+/*
+ * This file is part of dsp.
+ *
+ * Copyright (c) 2026 Michael Barbour <barbour.michael.0@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "fir_auto.h"
+#include "fir.h"
+#include "fir_p.h"
+#include "zita_convolver.h"
+#include "util.h"
+
+#if _POSIX_TIMERS && defined(_POSIX_MONOTONIC_CLOCK)
+#define HAVE_CLOCK_GETTIME
+#endif
+
+#define ZITA_LATENCY        64       /* Convproc::MINPART */
+#define BENCH_MIN_BLOCKS    16
+#define BENCH_MAX_FRAMES    (1<<21)
+#define CACHE_SUFFIX        ".fir_auto"
+
+enum {
+	ENGINE_FIR = 0,
+	ENGINE_FIR_P,
+	ENGINE_ZITA,
+};
+
+static const char *const engine_names[] = { "fir", "fir_p", "zita_convolver" };
+
+struct candidate {
+	int engine, part_len;
+	ssize_t latency;
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct effect * candidate_init(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector,
+	sample_t *filter_data, int filter_channels, ssize_t filter_frames, ssize_t ref, const struct candidate *c)
+{
+	switch (c->engine) {
+	case ENGINE_FIR:
+		return fir_effect_init_with_filter(ei, istream, channel_selector, filter_data, filter_channels, filter_frames, ref, 0);
+	case ENGINE_FIR_P:
+		return fir_p_effect_init_with_filter(ei, istream, channel_selector, filter_data, filter_channels, filter_frames, ref, c->part_len);
+	#ifdef HAVE_ZITA_CONVOLVER
+	case ENGINE_ZITA:
+		return zita_convolver_effect_init_with_filter(ei, istream, channel_selector, filter_data, filter_channels, filter_frames, ref, 0, 0);
+	#endif
+	}
+	return NULL;
+}
+
+/* Candidates are in order of preference for when nothing has been measured:
+   a single FFT (fir) is cheapest if the latency is acceptable,
+   zita_convolver is usually faster than fir_p otherwise, and fir_p is the
+   zero-latency fallback. */
+static int get_candidates(struct candidate *c, ssize_t filter_frames, ssize_t max_latency)
+{
+	int n = 0;
+	const ssize_t fir_latency = (filter_frames <= FIR_MAX_DIRECT_LEN) ? 0 : next_fast_fftw_len(filter_frames);
+	if (max_latency < 0 || fir_latency <= max_latency)
+		c[n++] = (struct candidate) { ENGINE_FIR, 0, fir_latency };
+	#ifdef HAVE_ZITA_CONVOLVER
+		if (max_latency < 0 || ZITA_LATENCY <= max_latency)
+			c[n++] = (struct candidate) { ENGINE_ZITA, 0, ZITA_LATENCY };
+	#endif
+	/* zero latency; try a few maximum partition lengths */
+	c[n++] = (struct candidate) { ENGINE_FIR_P, 1<<14, 0 };
+	if (filter_frames > 1<<13) c[n++] = (struct candidate) { ENGINE_FIR_P, 1<<12, 0 };
+	if (filter_frames > 1<<17) c[n++] = (struct candidate) { ENGINE_FIR_P, 1<<16, 0 };
+	return n;
+}
+
+#ifdef HAVE_CLOCK_GETTIME
+/* returns the time per frame in ns, or a negative value on error */
+static double benchmark_candidate(struct effect *e, ssize_t filter_frames, ssize_t block_frames)
+{
+	const int channels = e->istream.channels;
+	ssize_t frames = MAXIMUM(filter_frames * 4, BENCH_MIN_BLOCKS * block_frames);
+	frames = MINIMUM(frames, BENCH_MAX_FRAMES);
+	sample_t *src = calloc(block_frames * channels, sizeof(sample_t));
+	sample_t *ibuf = calloc(block_frames * channels, sizeof(sample_t));
+	sample_t *obuf = calloc(block_frames * channels, sizeof(sample_t));
+	double r = -1.0;
+	if (!src || !ibuf || !obuf) goto done;
+	uint32_t seed = 1;
+	for (ssize_t i = 0; i < block_frames * channels; ++i)
+		src[i] = (double) pm_rand1_r(&seed) / PM_RAND_MAX - 0.5;
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (ssize_t done = 0; done < frames; done += block_frames) {
+		ssize_t w = block_frames;
+		memcpy(ibuf, src, block_frames * channels * sizeof(sample_t));
+		e->run(e, &w, ibuf, obuf);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	r = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / frames;
+
+	done:
+	free(src);
+	free(ibuf);
+	free(obuf);
+	return r;
+}
+#endif
+
+/* The cache holds one line per decision:
+     filter_frames channels fs block_frames max_latency engine part_len */
+static char * get_cache_path(void)
+{
+	dsp_fftw_acquire();
+	const int have_path = dsp_fftw_load_wisdom();
+	const char *wisdom_path = dsp_fftw_wisdom_path();
+	char *path = NULL;
+	if (have_path && wisdom_path) {
+		const size_t len = strlen(wisdom_path);
+		path = calloc(len + sizeof(CACHE_SUFFIX), sizeof(char));
+		if (path) {
+			memcpy(path, wisdom_path, len);
+			memcpy(path + len, CACHE_SUFFIX, sizeof(CACHE_SUFFIX));
+		}
+	}
+	dsp_fftw_release();
+	return path;
+}
+
+static int cache_lookup(const char *path, const ssize_t *key, struct candidate *r)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL) return 1;
+	ssize_t v[5];
+	int engine, part_len, found = 0;
+	char name[32];
+	while (fscanf(f, "%zd %zd %zd %zd %zd %31s %d", &v[0], &v[1], &v[2], &v[3], &v[4], name, &part_len) == 7) {
+		if (memcmp(v, key, sizeof(v)) != 0) continue;
+		for (engine = 0; engine < LENGTH(engine_names); ++engine) {
+			if (strcmp(name, engine_names[engine]) == 0) {
+				r->engine = engine;
+				r->part_len = part_len;
+				found = 1;  /* keep going; the last entry wins */
+			}
+		}
+	}
+	fclose(f);
+	return !found;
+}
+
+static void cache_store(const char *path, const ssize_t *key, const struct candidate *c)
+{
+	FILE *f = fopen(path, "a");
+	if (f == NULL) {
+		LOG_FMT(LL_VERBOSE, "fir_auto: warning: failed to open cache: %s", path);
+		return;
+	}
+	fprintf(f, "%zd %zd %zd %zd %zd %s %d\n", key[0], key[1], key[2], key[3], key[4],
+		engine_names[c->engine], c->part_len);
+	fclose(f);
+}
+
+struct effect * fir_auto_effect_init_with_filter(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, sample_t *filter_data, int filter_channels, ssize_t filter_frames, ssize_t ref, ssize_t max_latency)
+{
+	struct candidate c[8];
+	const int n = get_candidates(c, filter_frames, max_latency);
+	int best = 0;
+	const char *how = "model";
+	const ssize_t block_frames = dsp_globals.block_frames;
+	const ssize_t key[5] = {
+		filter_frames, num_bits_set(channel_selector, istream->channels), istream->fs, block_frames, max_latency
+	};
+
+	char *cache_path = get_cache_path();
+	if (cache_path && n > 1) {
+		pthread_mutex_lock(&cache_lock);
+		struct candidate cached;
+		if (cache_lookup(cache_path, key, &cached) == 0) {
+			for (int i = 0; i < n; ++i) {
+				if (c[i].engine == cached.engine && c[i].part_len == cached.part_len) {
+					best = i;
+					how = "cache";
+					break;
+				}
+			}
+		}
+		#ifdef HAVE_CLOCK_GETTIME
+			if (strcmp(how, "cache") != 0) {
+				/* measure each candidate outside of the chain's arena so
+				   the losers can actually be freed */
+				struct arena *arena = effect_arena_set(NULL);
+				double best_time = -1.0;
+				for (int i = 0; i < n; ++i) {
+					struct effect *e = candidate_init(ei, istream, channel_selector, filter_data, filter_channels, filter_frames, ref, &c[i]);
+					if (e == NULL) continue;
+					const double t = benchmark_candidate(e, filter_frames, block_frames);
+					destroy_effect(e);
+					LOG_FMT(LL_VERBOSE, "%s: info: %s (part_len=%d latency=%zd): %.2f ns/frame",
+						ei->name, engine_names[c[i].engine], c[i].part_len, c[i].latency, t);
+					if (t >= 0.0 && (best_time < 0.0 || t < best_time)) {
+						best_time = t;
+						best = i;
+					}
+				}
+				effect_arena_set(arena);
+				if (best_time >= 0.0) {
+					how = "measured";
+					cache_store(cache_path, key, &c[best]);
+				}
+			}
+		#endif
+		pthread_mutex_unlock(&cache_lock);
+	}
+	free(cache_path);
+
+	LOG_FMT(LL_VERBOSE, "%s: info: using %s (part_len=%d latency=%zd; %s)",
+		ei->name, engine_names[c[best].engine], c[best].part_len, c[best].latency, how);
+	return candidate_init(ei, istream, channel_selector, filter_data, filter_channels, filter_frames, ref, &c[best]);
+}
+
+static int fir_auto_parse_opts(const struct effect_info *ei, const struct stream_info *istream, const struct fir_config *config, int opt, const char *arg, void *data)
+{
+	char *endptr;
+	ssize_t *max_latency = (ssize_t *) data;
+	switch (opt) {
+	case 'l':
+		*max_latency = parse_len(arg, istream->fs, &endptr);
+		if (check_endptr(ei->name, arg, endptr, "max_latency")) return 1;
+		if (*max_latency < 0) {
+			LOG_FMT(LL_ERROR, "%s: error: max_latency must be >= 0", ei->name);
+			return 1;
+		}
+		return 0;
+	}
+	return 1;
+}
+
+struct effect * fir_auto_effect_init(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, const char *dir, int argc, const char *const *argv)
+{
+	int filter_channels;
+	ssize_t filter_frames, max_latency = -1;
+	struct fir_config config;
+	struct dsp_getopt_state g = DSP_GETOPT_STATE_INITIALIZER;
+
+	int err = fir_parse_opts(ei, istream, &config, &g, argc, argv, FIR_DEFAULT_OPTSTR "l:", fir_auto_parse_opts, &max_latency);
+	if (err || g.ind != argc-1) {
+		print_effect_usage(ei);
+		return NULL;
+	}
+	config.p.path = argv[g.ind];
+	sample_t *filter_data = fir_read_filter(ei, istream, channel_selector, dir, &config.p, &filter_channels, &filter_frames);
+	if (!filter_data) return NULL;
+	const ssize_t offset_frames = fir_get_offset(&config, filter_data, filter_channels, filter_frames);
+	struct effect *e = fir_auto_effect_init_with_filter(ei, istream, channel_selector, filter_data, filter_channels, filter_frames, offset_frames, max_latency);
+	free(filter_data);
+	return e;
+}
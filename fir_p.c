@@ -22,12 +22,14 @@
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#include <stdint.h>
 #include <complex.h>
 #include <fftw3.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include "fir_p.h"
 #include "fir.h"
+#include "shared_data.h"
 #include "util.h"
 #include "codec.h"
 
@@ -37,6 +39,7 @@
 #define MAX_PART_LEN_LIMIT   INT_MAX
 #define MAX_PART_LEN_DEFAULT (1<<14)
 #define FORCE_SINGLE_THREAD  0  /* for testing */
+#define USE_SINGLE_THREAD(filter_frames) ((filter_frames) < 4096 || FORCE_SINGLE_THREAD)
 
 struct direct_part {
 	sample_t *lbuf, **filter, **buf;
@@ -44,7 +47,7 @@ struct direct_part {
 };
 
 struct fft_part_group {
-	fftw_complex **filter_fr, **fdl, *tmp_fr, *filter_fr_1ch;
+	fftw_complex **filter_fr, **fdl, *tmp_fr, *filter_fr_shared;
 	fftw_plan r2c_plan, c2r_plan;
 	sample_t **fft_buf, **fft_olap;
 	sample_t **ibuf, **obuf;
@@ -54,11 +57,24 @@ struct fft_part_group {
 	sem_t start, sync;
 };
 
+struct fft_part_group_fr_key {
+	ssize_t len, n, filter_pos, filter_frames, filter_channels;  /* no padding; compared bytewise */
+};
+
+struct fft_part_group_fr_init_arg {
+	struct fft_part_group *group;
+	const sample_t *filter_data;
+	const fftw_complex *filter_fr;  /* precomputed spectra (from a snapshot) */
+	ssize_t filter_pos, filter_frames;
+	int filter_channels;
+};
+
 struct fir_p_state {
 	struct direct_part part0;
 	struct fft_part_group group[MAX_FFT_GROUPS];
 	ssize_t filter_frames, ref;
-	int n;
+	ssize_t *drain;  /* if non-NULL, replaces the drain samples of each channel */
+	int n, filter_channels, max_part_len;
 };
 
 static inline void fft_part_group_compute(struct fft_part_group *group)
@@ -206,37 +222,58 @@ static void fir_p_effect_reset(struct effect *e)
 	}
 }
 
-static void fir_p_effect_plot(struct effect *e, int i)
+static void fir_p_effect_plot(struct effect *e, ssize_t n, double df, const double complex *ih, double complex *oh)
 {
 	struct fir_p_state *state = (struct fir_p_state *) e->data;
-	for (int k = 0, n = 0; k < e->istream.channels; ++k) {
+	ssize_t len = DIRECT_LEN;
+	for (int j = 0; j < state->n; ++j)
+		len += state->group[j].n * state->group[j].len;
+	sample_t *filter = calloc(len, sizeof(sample_t));
+	for (int k = 0, c = 0; k < e->istream.channels; ++k) {
+		const double complex *ih_k = &ih[k*n];
+		double complex *oh_k = &oh[k*n];
 		if (state->part0.buf[k]) {
-			printf("H%d_%d(w)=(abs(w)<=pi)?exp(-j*w*%zd)*(0.0", k, i, -state->ref);
-			for (int m = 0; m < DIRECT_LEN; ++m)
-				printf("+exp(-j*w*%d)*%.15e", m, state->part0.filter[k][m]);
+			if (check_alloc(e->name, filter)) {
+				for (ssize_t i = 0; i < n; ++i) oh_k[i] = NAN;
+				continue;
+			}
+			memcpy(filter, state->part0.filter[k], DIRECT_LEN * sizeof(sample_t));
 			ssize_t z = DIRECT_LEN;
 			for (int j = 0; j < state->n; ++j) {
 				struct fft_part_group *group = &state->group[j];
 				for (int q = 0; q < group->n; ++q) {
-					memcpy(group->tmp_fr, &group->filter_fr[n][q*group->fr_len], group->fr_len * sizeof(fftw_complex));
+					memcpy(group->tmp_fr, &group->filter_fr[c][q*group->fr_len], group->fr_len * sizeof(fftw_complex));
 					fftw_execute(group->c2r_plan);  /* output is fft_buf[0] */
 					for (int l = 0; l < group->len; ++l, ++z)
-						printf("+exp(-j*w*%zd)*%.15e", z, group->fft_buf[0][l] / (group->len * 2));
+						filter[z] = group->fft_buf[0][l] / (group->len * 2);
 				}
 			}
-			puts("):0/0");
-			++n;
+			fir_plot(filter, len, state->ref, e->ostream.fs, n, df, ih_k, oh_k);
+			++c;
 		}
-		else
-			printf("H%d_%d(w)=1.0\n", k, i);
+		else memcpy(oh_k, ih_k, n * sizeof(double complex));
 	}
+	free(filter);
 }
 
 static void fir_p_effect_drain_samples(struct effect *e, ssize_t *drain_samples)
 {
 	struct fir_p_state *state = (struct fir_p_state *) e->data;
-	for (int k = 0; k < e->ostream.channels; ++k)
-		if (state->part0.buf[k]) drain_samples[k] += state->filter_frames-1;
+	for (int k = 0; k < e->ostream.channels; ++k) {
+		if (state->drain) drain_samples[k] += state->drain[k];
+		else if (state->part0.buf[k]) drain_samples[k] += state->filter_frames-1;
+	}
+}
+
+int fir_p_effect_set_drain_samples(struct effect *e, const ssize_t *drain_samples)
+{
+	struct fir_p_state *state = (struct fir_p_state *) e->data;
+	if (state->drain == NULL) {
+		state->drain = calloc(e->ostream.channels, sizeof(ssize_t));
+		if (check_alloc(e->name, state->drain)) return 1;
+	}
+	memcpy(state->drain, drain_samples, e->ostream.channels * sizeof(ssize_t));
+	return 0;
 }
 
 static void fir_p_effect_destroy(struct effect *e)
@@ -251,14 +288,12 @@ static void fir_p_effect_destroy(struct effect *e)
 			sem_destroy(&group->sync);
 		}
 		for (int i = 0; i < group->fft_channels; ++i) {
-			if (!group->filter_fr_1ch && group->filter_fr)
-				fftw_free(group->filter_fr[i]);
 			if (group->fdl) fftw_free(group->fdl[i]);
 			if (group->fft_buf) fftw_free(group->fft_buf[i]);
 			if (group->fft_olap) fftw_free(group->fft_olap[i]);
 		}
 		fftw_free(group->tmp_fr);
-		fftw_free(group->filter_fr_1ch);
+		shared_data_release(group->filter_fr_shared);
 		free(group->filter_fr);
 		free(group->fdl);
 		free(group->fft_buf);
@@ -277,6 +312,7 @@ static void fir_p_effect_destroy(struct effect *e)
 	free(state->part0.lbuf);
 	free(state->part0.filter);
 	free(state->part0.buf);
+	free(state->drain);
 	free(state);
 }
 
@@ -287,6 +323,20 @@ static void fir_p_effect_channel_offsets(struct effect *e, ssize_t *latency, ssi
 		if (state->part0.buf[k]) req_delay[k] -= state->ref;
 }
 
+/* estimated operations per frame: the direct part, plus one r2c/c2r pair
+   and one spectrum multiply-accumulate per partition for each group */
+static double fir_p_effect_cost(struct effect *e)
+{
+	struct fir_p_state *state = (struct fir_p_state *) e->data;
+	int n = 0;
+	for (int k = 0; k < e->istream.channels; ++k)
+		if (state->part0.buf[k]) ++n;
+	double cost = 2.0 * DIRECT_LEN;
+	for (int k = 0; k < state->n; ++k)
+		cost += 10.0 * log2(2.0 * state->group[k].len) + 8.0 * state->group[k].n;
+	return cost * n;
+}
+
 static void find_partitions(struct fir_p_state *state, int max_part_len, int single_thread)
 {
 	const int delay_fact = (single_thread) ? 1 : 2;
@@ -359,11 +409,62 @@ static int verify_and_print_partitions(const struct effect_info *ei, struct fir_
 	return 0;
 }
 
-struct effect * fir_p_effect_init_with_filter(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, sample_t *filter_data, int filter_channels, ssize_t filter_frames, ssize_t ref, int max_part_len)
+/* fills the spectra of each partition in the group using the group's plan
+   and buffers; fft_buf[0] is left zeroed */
+static int fft_part_group_fr_init(void *data, void *arg)
 {
-	if (filter_frames <= DIRECT_LEN)
-		return fir_effect_init_with_filter(ei, istream, channel_selector, filter_data, filter_channels, filter_frames, ref, 1);
+	struct fft_part_group_fr_init_arg *a = (struct fft_part_group_fr_init_arg *) arg;
+	struct fft_part_group *group = a->group;
+	fftw_complex *filter_fr = (fftw_complex *) data;
+	ssize_t filter_pos = a->filter_pos;
+	if (a->filter_fr) {
+		memcpy(filter_fr, a->filter_fr, group->fr_len * group->n * a->filter_channels * sizeof(fftw_complex));
+		return 0;
+	}
+	for (int q = 0; q < group->n; ++q) {
+		for (int i = 0; i < a->filter_channels; ++i) {
+			for (int l = 0; l < group->len && l + filter_pos < a->filter_frames; ++l)
+				group->fft_buf[0][l] = a->filter_data[(filter_pos+l)*a->filter_channels + i];
+			fftw_execute(group->r2c_plan);
+			memcpy(&filter_fr[(i*group->n + q) * group->fr_len], group->tmp_fr, group->fr_len * sizeof(fftw_complex));
+			memset(group->fft_buf[0], 0, group->len * 2 * sizeof(sample_t));
+		}
+		filter_pos += group->len;
+	}
+	return 0;
+}
 
+static int fir_p_effect_save(struct effect *e, struct snapshot_writer *w)
+{
+	struct fir_p_state *state = (struct fir_p_state *) e->data;
+	char *channel_selector = NEW_SELECTOR(e->istream.channels);
+	if (check_alloc(e->name, channel_selector)) return 1;
+	for (int k = 0; k < e->istream.channels; ++k)
+		if (state->part0.buf[k]) SET_BIT(channel_selector, k);
+	const int64_t hdr[] = { state->filter_frames, state->ref, state->filter_channels, state->max_part_len, state->n };
+	snapshot_write_str(w, "fir_p");
+	snapshot_write_selector(w, channel_selector, e->istream.channels);
+	free(channel_selector);
+	SNAPSHOT_WRITE_VAL(w, hdr);
+	for (int k = 0, l = 0; k < e->istream.channels && l < state->filter_channels; ++k) {
+		if (state->part0.buf[k]) {
+			snapshot_write(w, state->part0.filter[k], DIRECT_LEN * sizeof(sample_t));
+			++l;
+		}
+	}
+	for (int j = 0; j < state->n; ++j) {
+		const struct fft_part_group *group = &state->group[j];
+		const int64_t g_hdr[] = { group->len, group->n };
+		SNAPSHOT_WRITE_VAL(w, g_hdr);
+		snapshot_write(w, group->filter_fr_shared, group->fr_len * group->n * state->filter_channels * sizeof(fftw_complex));
+	}
+	return w->err;
+}
+
+/* If group_fr is not NULL, it holds the partition spectra for each group
+   and filter_data holds only the first DIRECT_LEN frames. */
+static struct effect * fir_p_effect_new(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, const sample_t *filter_data, const fftw_complex *const *group_fr, int filter_channels, ssize_t filter_frames, ssize_t ref, int max_part_len)
+{
 	const int n_channels = num_bits_set(channel_selector, istream->channels);
 	if (filter_channels != 1 && filter_channels != n_channels) {
 		LOG_FMT(LL_ERROR, "%s: error: channels mismatch: channels=%d filter_channels=%d", ei->name, n_channels, filter_channels);
@@ -391,12 +492,15 @@ struct effect * fir_p_effect_init_with_filter(const struct effect_info *ei, cons
 	e->istream.channels = e->ostream.channels = istream->channels;
 	e->flags |= EFFECT_FLAG_OPT_REORDERABLE;
 	e->flags |= EFFECT_FLAG_CH_DEPS_IDENTITY;
+	e->flags |= EFFECT_FLAG_LTI;
 	e->run = fir_p_effect_run;
 	e->reset = fir_p_effect_reset;
 	e->plot = fir_p_effect_plot;
 	e->drain_samples = fir_p_effect_drain_samples;
 	e->destroy = fir_p_effect_destroy;
 	e->channel_offsets = fir_p_effect_channel_offsets;
+	e->cost = fir_p_effect_cost;
+	e->save = fir_p_effect_save;
 
 	struct fir_p_state *state = calloc(1, sizeof(struct fir_p_state));
 	if (check_alloc(ei->name, state)) goto fail;
@@ -404,7 +508,9 @@ struct effect * fir_p_effect_init_with_filter(const struct effect_info *ei, cons
 
 	state->filter_frames = filter_frames;
 	state->ref = ref;
-	const int use_single_thread = (filter_frames < 4096 || FORCE_SINGLE_THREAD);
+	state->filter_channels = filter_channels;
+	state->max_part_len = max_part_len;
+	const int use_single_thread = USE_SINGLE_THREAD(filter_frames);
 	find_partitions(state, max_part_len, use_single_thread);
 	if (verify_and_print_partitions(ei, state, use_single_thread)) goto fail;
 
@@ -451,15 +557,11 @@ struct effect * fir_p_effect_init_with_filter(const struct effect_info *ei, cons
 			dsp_perror(DSP_ENOMEM, ei->name, NULL);
 			goto fail;
 		}
-		if (filter_channels == 1)
-			group->filter_fr_1ch = fftw_malloc(group->fr_len * group->n * sizeof(fftw_complex));
 		for (int i = 0; i < n_channels; ++i) {
-			group->filter_fr[i] = (filter_channels == 1) ?
-				group->filter_fr_1ch : fftw_malloc(group->fr_len * group->n * sizeof(fftw_complex));
 			group->fdl[i] = fftw_malloc(group->fr_len * group->n * sizeof(fftw_complex));
 			group->fft_buf[i] = fftw_malloc(group->len * 2 * sizeof(sample_t));
 			group->fft_olap[i] = fftw_malloc(group->len * sizeof(sample_t));
-			if (!group->filter_fr[i] || !group->fdl[i] || !group->fft_buf[i] || !group->fft_olap[i]) {
+			if (!group->fdl[i] || !group->fft_buf[i] || !group->fft_olap[i]) {
 				dsp_perror(DSP_ENOMEM, ei->name, NULL);
 				goto fail;
 			}
@@ -479,23 +581,21 @@ struct effect * fir_p_effect_init_with_filter(const struct effect_info *ei, cons
 			memset(group->fft_olap[i], 0, group->len * sizeof(sample_t));
 		}
 
-		for (int q = 0; q < group->n; ++q) {
-			if (filter_channels == 1) {
-				memcpy(group->fft_buf[0], &filter_data[filter_pos], MINIMUM(filter_frames-filter_pos, group->len) * sizeof(sample_t));
-				fftw_execute(group->r2c_plan);
-				memcpy(&group->filter_fr_1ch[q*group->fr_len], group->tmp_fr, group->fr_len * sizeof(fftw_complex));
-			}
-			else {
-				for (int i = 0; i < n_channels; ++i) {
-					for (int l = 0; l < group->len && l + filter_pos < filter_frames; ++l)
-						group->fft_buf[0][l] = filter_data[(filter_pos+l)*filter_channels + i];
-					fftw_execute(group->r2c_plan);
-					memcpy(&group->filter_fr[i][q*group->fr_len], group->tmp_fr, group->fr_len * sizeof(fftw_complex));
-				}
-			}
-			filter_pos += group->len;
-			memset(group->fft_buf[0], 0, group->len * 2 * sizeof(sample_t));
-		}
+		/* the partition spectra are immutable, so identical filters share them */
+		const ssize_t part_frames = MAXIMUM(MINIMUM(filter_pos + (ssize_t) group->len * group->n, filter_frames) - filter_pos, 0);
+		const struct fft_part_group_fr_key fr_key = { group->len, group->n, filter_pos, filter_frames, filter_channels };
+		const struct shared_data_key key[] = {
+			{ &fr_key, sizeof(fr_key) },
+			(group_fr) ? (struct shared_data_key) { group_fr[k], group->fr_len * group->n * filter_channels * sizeof(fftw_complex) }
+				: (struct shared_data_key) { &filter_data[filter_pos*filter_channels], part_frames * filter_channels * sizeof(sample_t) },
+		};
+		struct fft_part_group_fr_init_arg fr_arg = { group, filter_data, (group_fr) ? group_fr[k] : NULL, filter_pos, filter_frames, filter_channels };
+		group->filter_fr_shared = shared_data_get("fir_p", key, LENGTH(key),
+			group->fr_len * group->n * filter_channels * sizeof(fftw_complex), fft_part_group_fr_init, &fr_arg);
+		if (!group->filter_fr_shared) goto fail;
+		for (int i = 0; i < n_channels; ++i)
+			group->filter_fr[i] = &group->filter_fr_shared[((filter_channels == 1) ? 0 : i) * group->fr_len * group->n];
+		filter_pos += group->len * group->n;
 		if (group->delay > 0) {
 			for (int i = 0; i < e->istream.channels; ++i) {
 				if (GET_BIT(channel_selector, i)) {
@@ -538,6 +638,59 @@ struct effect * fir_p_effect_init_with_filter(const struct effect_info *ei, cons
 	return NULL;
 }
 
+struct effect * fir_p_effect_init_with_filter(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, sample_t *filter_data, int filter_channels, ssize_t filter_frames, ssize_t ref, int max_part_len)
+{
+	if (filter_frames <= DIRECT_LEN)
+		return fir_effect_init_with_filter(ei, istream, channel_selector, filter_data, filter_channels, filter_frames, ref, 1);
+	return fir_p_effect_new(ei, istream, channel_selector, filter_data, NULL, filter_channels, filter_frames, ref, max_part_len);
+}
+
+struct effect * fir_p_effect_load(const char *name, const struct stream_info *istream, struct snapshot_reader *r)
+{
+	const struct effect_info ei = { name, NULL, NULL, 0 };
+	const fftw_complex *group_fr[MAX_FFT_GROUPS];
+	struct fir_p_state tmp = {0};
+	struct effect *e = NULL;
+	sample_t *filter_data = NULL;
+	int64_t hdr[5];
+	char *channel_selector = NEW_SELECTOR(istream->channels);
+	if (check_alloc(name, channel_selector)) return NULL;
+	if (snapshot_read_selector(r, channel_selector, istream->channels) || SNAPSHOT_READ_VAL(r, hdr))
+		goto done;
+	const ssize_t filter_frames = hdr[0], ref = hdr[1];
+	const int filter_channels = hdr[2], n_channels = num_bits_set(channel_selector, istream->channels);
+	if (filter_frames <= DIRECT_LEN || filter_frames > (r->end - r->p) / (ssize_t) sizeof(sample_t)
+			|| (filter_channels != 1 && filter_channels != n_channels)
+			|| hdr[3] < DIRECT_LEN || hdr[3] > MAX_PART_LEN_LIMIT || !IS_POWER_OF_2(hdr[3]))
+		goto done;
+	filter_data = calloc(DIRECT_LEN * filter_channels, sizeof(sample_t));
+	if (check_alloc(name, filter_data)) goto done;
+	for (int l = 0; l < filter_channels; ++l) {
+		const sample_t *f = snapshot_read(r, DIRECT_LEN * sizeof(sample_t));
+		if (f == NULL) goto done;
+		for (int j = 0; j < DIRECT_LEN; ++j)
+			filter_data[j*filter_channels + l] = f[j];
+	}
+	/* the partitioning must match the saved spectra */
+	tmp.filter_frames = filter_frames;
+	find_partitions(&tmp, hdr[3], USE_SINGLE_THREAD(filter_frames));
+	if (hdr[4] != tmp.n) goto done;
+	for (int j = 0; j < tmp.n; ++j) {
+		const struct fft_part_group *group = &tmp.group[j];
+		int64_t g_hdr[2];
+		if (SNAPSHOT_READ_VAL(r, g_hdr) || g_hdr[0] != group->len || g_hdr[1] != group->n)
+			goto done;
+		group_fr[j] = snapshot_read(r, group->fr_len * group->n * filter_channels * sizeof(fftw_complex));
+		if (group_fr[j] == NULL) goto done;
+	}
+	e = fir_p_effect_new(&ei, istream, channel_selector, filter_data, group_fr, filter_channels, filter_frames, ref, hdr[3]);
+
+	done:
+	free(channel_selector);
+	free(filter_data);
+	return e;
+}
+
 struct effect * fir_p_effect_init(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, const char *dir, int argc, const char *const *argv)
 {
 	int filter_channels;
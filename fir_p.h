@@ -25,7 +25,10 @@
 #include "fir_util.h"
 
 struct effect * fir_p_effect_init_with_filter(const struct effect_info *, const struct stream_info *, const char *, sample_t *, int, ssize_t, ssize_t, int);
+/* replaces the per-channel drain length reported by the effect */
+int fir_p_effect_set_drain_samples(struct effect *, const ssize_t *);
 struct effect * fir_p_effect_init(const struct effect_info *, const struct stream_info *, const char *, const char *, int, const char *const *);
+struct effect * fir_p_effect_load(const char *, const struct stream_info *, struct snapshot_reader *);
 
 #define FIR_P_EFFECT_INFO \
 	{ "fir_p", FIR_USAGE_OPTS " [max_part_len] " FIR_USAGE_FILTER, fir_p_effect_init, 0 }
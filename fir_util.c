@@ -20,8 +20,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <complex.h>
+#ifdef HAVE_FFTW3
+	#include <fftw3.h>
+#endif
 #include "fir_util.h"
 
+#define FIR_PLOT_MAX_FFT_LEN (1<<24)
+
 sample_t * fir_read_filter(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, const char *dir, const struct codec_params *p, int *channels, ssize_t *frames)
 {
 	static const char coefs_str_prefix[] = "coefs:";
@@ -84,6 +90,7 @@ sample_t * fir_read_filter(const struct effect_info *ei, const struct stream_inf
 			path += LENGTH(file_str_prefix)-1;
 		char *fp = construct_full_path(dir, path, istream->fs, num_bits_set(channel_selector, istream->channels));
 		if (!fp) return NULL;
+		effect_add_dep(fp);
 		struct codec_params c_params = *p;
 		c_params.path = fp;
 		c_params.mode = CODEC_MODE_READ;
@@ -203,3 +210,78 @@ ssize_t fir_get_offset(const struct fir_config *config, const sample_t *filter_d
 	}
 	return offset;
 }
+
+#ifdef HAVE_FFTW3
+/* If the frequencies k*df are bins of a DFT of length len at fs, the
+   response can be calculated exactly by folding the filter modulo len
+   and doing a single FFT. Returns the bin step, or 0 if no such DFT
+   length was found. */
+static int fir_plot_fft_len(int fs, double df, ssize_t *len)
+{
+	const double r = fs / df;
+	for (int step = 1; step <= 64; ++step) {
+		const double m = r * step;
+		if (m > FIR_PLOT_MAX_FFT_LEN) break;
+		if (fabs(m - nearbyint(m)) < 1e-9 * m) {
+			*len = lrint(m);
+			return step;
+		}
+	}
+	return 0;
+}
+
+static int fir_plot_fft(const sample_t *filter, ssize_t filter_frames, ssize_t ref, int fs, ssize_t n, double df, const double complex *ih, double complex *oh)
+{
+	ssize_t len;
+	const int step = fir_plot_fft_len(fs, df, &len);
+	if (step == 0) return 1;
+	double *buf = fftw_malloc(len * sizeof(double));
+	fftw_complex *fr = fftw_malloc((len/2+1) * sizeof(fftw_complex));
+	if (buf == NULL || fr == NULL) goto fail;
+	dsp_fftw_acquire();
+	fftw_plan plan = fftw_plan_dft_r2c_1d(len, buf, fr, FFTW_ESTIMATE);
+	dsp_fftw_release();
+	if (plan == NULL) goto fail;
+	memset(buf, 0, len * sizeof(double));
+	for (ssize_t j = 0, p = ((-ref % len) + len) % len; j < filter_frames; ++j) {
+		buf[p] += filter[j];
+		if (++p == len) p = 0;
+	}
+	fftw_execute(plan);
+	for (ssize_t i = 0; i < n; ++i) {
+		const ssize_t bin = i * step;
+		oh[i] = (bin <= len/2) ? ih[i] * fr[bin] : NAN;
+	}
+	dsp_fftw_acquire();
+	fftw_destroy_plan(plan);
+	dsp_fftw_release();
+	fftw_free(buf);
+	fftw_free(fr);
+	return 0;
+
+	fail:
+	fftw_free(buf);
+	fftw_free(fr);
+	return 1;
+}
+#endif
+
+void fir_plot(const sample_t *filter, ssize_t filter_frames, ssize_t ref, int fs, ssize_t n, double df, const double complex *ih, double complex *oh)
+{
+#ifdef HAVE_FFTW3
+	if (fir_plot_fft(filter, filter_frames, ref, fs, n, df, ih, oh) == 0)
+		return;
+#endif
+	for (ssize_t i = 0; i < n; ++i) {
+		const double w = 2.0*M_PI*i*df/fs;
+		if (w > M_PI) {
+			oh[i] = NAN;
+			continue;
+		}
+		const double complex z1 = cexp(-I*w);
+		double complex h = 0.0, z = cexp(I*w*ref);
+		for (ssize_t j = 0; j < filter_frames; ++j, z *= z1)
+			h += filter[j] * z;
+		oh[i] = ih[i] * h;
+	}
+}
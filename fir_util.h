@@ -38,5 +38,8 @@ sample_t * fir_read_filter(const struct effect_info *, const struct stream_info
 int fir_parse_opts(const struct effect_info *, const struct stream_info *, struct fir_config *, struct dsp_getopt_state *, int, const char *const *, const char *,
 	int (*)(const struct effect_info *, const struct stream_info *, const struct fir_config *, int, const char *, void *), void *);
 ssize_t fir_get_offset(const struct fir_config *, const sample_t *, int, ssize_t);
+/* Multiplies n points of ih by the frequency response of filter (first tap
+   at -ref) at k*df Hz and writes the result to oh. */
+void fir_plot(const sample_t *, ssize_t, ssize_t, int, ssize_t, double, const double _Complex *, double _Complex *);
 
 #endif
@@ -19,6 +19,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <complex.h>
+#include <stdint.h>
 #include "gain.h"
 #include "util.h"
 
@@ -42,11 +45,12 @@ static sample_t * add_effect_run(struct effect *e, ssize_t *frames, sample_t *ib
 	return ibuf;
 }
 
-static void gain_effect_plot(struct effect *e, int i)
+static void gain_effect_plot(struct effect *e, ssize_t n, double df, const double complex *ih, double complex *oh)
 {
 	sample_t *state = (sample_t *) e->data;
 	for (int k = 0; k < e->ostream.channels; ++k)
-		printf("H%d_%d(w)=%.15e\n", k, i, state[k]);
+		for (ssize_t i = 0; i < n; ++i)
+			oh[k*n + i] = ih[k*n + i] * state[k];
 }
 
 static void gain_effect_destroy(struct effect *e)
@@ -54,6 +58,14 @@ static void gain_effect_destroy(struct effect *e)
 	free(e->data);
 }
 
+static void gain_effect_matrix(struct effect *e, sample_t *m)
+{
+	sample_t *state = (sample_t *) e->data;
+	memset(m, 0, e->ostream.channels * e->istream.channels * sizeof(sample_t));
+	for (int k = 0; k < e->ostream.channels; ++k)
+		m[k * e->istream.channels + k] = state[k];
+}
+
 static int gain_effect_merge(struct effect *dest, struct effect *src)
 {
 	if (dest->merge == src->merge) {
@@ -78,6 +90,46 @@ static int add_effect_merge(struct effect *dest, struct effect *src)
 	return 0;
 }
 
+static int gain_effect_save(struct effect *e, struct snapshot_writer *w)
+{
+	const int64_t is_add = (e->run == add_effect_run);
+	snapshot_write_str(w, "gain");
+	SNAPSHOT_WRITE_VAL(w, is_add);
+	snapshot_write(w, e->data, e->ostream.channels * sizeof(sample_t));
+	return w->err;
+}
+
+static struct effect * gain_effect_new(const char *name, const struct stream_info *istream, int is_add)
+{
+	struct effect *e = calloc(1, sizeof(struct effect));
+	if (check_alloc(name, e)) return NULL;
+	e->name = name;
+	e->istream.fs = e->ostream.fs = istream->fs;
+	e->istream.channels = e->ostream.channels = istream->channels;
+	e->flags |= EFFECT_FLAG_CH_DEPS_IDENTITY;
+	if (is_add) {
+		e->run = add_effect_run;
+		e->plot = effect_plot_noop;
+		e->merge = add_effect_merge;
+	}
+	else {
+		e->flags |= EFFECT_FLAG_OPT_REORDERABLE;
+		e->flags |= EFFECT_FLAG_LTI;
+		e->run = gain_effect_run;
+		e->plot = gain_effect_plot;
+		e->merge = gain_effect_merge;
+		e->matrix = gain_effect_matrix;
+	}
+	e->destroy = gain_effect_destroy;
+	e->save = gain_effect_save;
+	e->data = calloc(istream->channels, sizeof(sample_t));
+	if (check_alloc(name, e->data)) {
+		free(e);
+		return NULL;
+	}
+	return e;
+}
+
 struct effect * gain_effect_init(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, const char *dir, int argc, const char *const *argv)
 {
 	struct effect *e = NULL;
@@ -109,33 +161,24 @@ struct effect * gain_effect_init(const struct effect_info *ei, const struct stre
 		return NULL;
 	}
 
-	e = calloc(1, sizeof(struct effect));
-	if (check_alloc(ei->name, e)) return NULL;
-	e->name = ei->name;
-	e->istream.fs = e->ostream.fs = istream->fs;
-	e->istream.channels = e->ostream.channels = istream->channels;
-	e->flags |= EFFECT_FLAG_CH_DEPS_IDENTITY;
-	sample_t v_noop;
-	if (ei->effect_number == GAIN_EFFECT_NUMBER_ADD) {
-		v_noop = 0.0;
-		e->run = add_effect_run;
-		e->plot = effect_plot_noop;
-		e->merge = add_effect_merge;
-	}
-	else {
-		v_noop = 1.0;
-		e->flags |= EFFECT_FLAG_OPT_REORDERABLE;
-		e->run = gain_effect_run;
-		e->plot = gain_effect_plot;
-		e->merge = gain_effect_merge;
-	}
-	e->destroy = gain_effect_destroy;
-	e->data = state = calloc(istream->channels, sizeof(sample_t));
-	if (check_alloc(ei->name, state)) {
-		free(e);
-		return NULL;
-	}
+	const int is_add = (ei->effect_number == GAIN_EFFECT_NUMBER_ADD);
+	const sample_t v_noop = (is_add) ? 0.0 : 1.0;
+	e = gain_effect_new(ei->name, istream, is_add);
+	if (e == NULL) return NULL;
+	state = (sample_t *) e->data;
 	for (int k = 0; k < istream->channels; ++k)
 		state[k] = (GET_BIT(channel_selector, k)) ? v : v_noop;
 	return e;
 }
+
+struct effect * gain_effect_load(const char *name, const struct stream_info *istream, struct snapshot_reader *r)
+{
+	int64_t is_add;
+	const sample_t *s_state;
+	if (SNAPSHOT_READ_VAL(r, is_add) || (s_state = snapshot_read(r, istream->channels * sizeof(sample_t))) == NULL)
+		return NULL;
+	struct effect *e = gain_effect_new(name, istream, is_add != 0);
+	if (e == NULL) return NULL;
+	memcpy(e->data, s_state, istream->channels * sizeof(sample_t));
+	return e;
+}
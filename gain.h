@@ -29,6 +29,7 @@ enum {
 };
 
 struct effect * gain_effect_init(const struct effect_info *, const struct stream_info *, const char *, const char *, int, const char *const *);
+struct effect * gain_effect_load(const char *, const struct stream_info *, struct snapshot_reader *);
 
 #define GAIN_EFFECT_INFO \
 	{ "gain", "gain_dB",    gain_effect_init, GAIN_EFFECT_NUMBER_GAIN }, \
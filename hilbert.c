@@ -22,6 +22,7 @@
 #include "hilbert.h"
 #include "fir.h"
 #include "fir_p.h"
+#include "fir_auto.h"
 #include "zita_convolver.h"
 #include "util.h"
 
@@ -33,10 +34,11 @@ struct effect * hilbert_effect_init(const struct effect_info *ei, const struct s
 	int conv = 0, do_align = 0, opt;
 	double angle = -M_PI_2;
 
-	while ((opt = dsp_getopt(&g, argc-1, argv, "pzca:")) != -1) {
+	while ((opt = dsp_getopt(&g, argc-1, argv, "pzAca:")) != -1) {
 		switch (opt) {
 		case 'p': conv = 1; break;
 		case 'z': conv = 2; break;
+		case 'A': conv = 3; break;
 		case 'c': do_align = 1; break;
 		case 'a':
 			angle = strtod(g.arg, &endptr)/180.0*M_PI;
@@ -86,6 +88,8 @@ struct effect * hilbert_effect_init(const struct effect_info *ei, const struct s
 			e = fir_p_effect_init_with_filter(ei, istream, channel_selector, h, 1, taps, ref, 0);
 		#endif
 	}
+	else if (conv == 3)
+		e = fir_auto_effect_init_with_filter(ei, istream, channel_selector, h, 1, taps, ref, -1);
 	else e = fir_effect_init_with_filter(ei, istream, channel_selector, h, 1, taps, ref, 0);
 	free(h);
 	return e;
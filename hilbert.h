@@ -26,7 +26,7 @@
 struct effect * hilbert_effect_init(const struct effect_info *, const struct stream_info *, const char *, const char *, int, const char *const *);
 
 #define HILBERT_EFFECT_INFO \
-	{ "hilbert", "[-pzc] [-a angle] taps", hilbert_effect_init, 0 }
+	{ "hilbert", "[-pzAc] [-a angle] taps", hilbert_effect_init, 0 }
 #else
 #define HILBERT_EFFECT_INFO \
 	{ "hilbert", NULL, NULL, 0 }
@@ -31,12 +31,16 @@
 #include "dsp.h"
 #include "effect.h"
 #include "effects_chain.h"
+#include "ladspa_dsp.h"
 #include "util.h"
 
 #define DEFAULT_CONFIG_DIR     "/ladspa_dsp"
 #define DEFAULT_XDG_CONFIG_DIR "/.config"
 #define GLOBAL_CONFIG_DIR      "/etc"DEFAULT_CONFIG_DIR
 #define DEFAULT_LOGLEVEL       LL_OPEN_ERROR
+#define DEFAULT_MAX_FRAMES     8192
+
+typedef sample_t ladspa_dsp_vec __attribute__((vector_size(2*sizeof(sample_t)), aligned(sizeof(sample_t)), may_alias));
 
 struct ladspa_dsp {
 	sample_t *buf1, *buf2;
@@ -46,18 +50,14 @@ struct ladspa_dsp {
 	LADSPA_Data **ports;
 };
 
-struct ladspa_dsp_config {
-	int input_channels, output_channels;
-	char *name, *dir_path, *lc_n, *chain_str;
-};
-
 static const char default_name[] = "ladspa_dsp";
 struct dsp_globals dsp_globals = {
 	DEFAULT_LOGLEVEL,       /* loglevel */
 	default_name,           /* prog_name */
+	DEFAULT_BLOCK_FRAMES,   /* block_frames */
 };
 
-static int n_configs = 0, is_init = 0;
+static int n_configs = 0, is_init = 0, is_fallback = 0;
 static struct ladspa_dsp_config *configs = NULL;
 static LADSPA_Descriptor *descriptors = NULL;
 static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -72,22 +72,36 @@ void dsp_log_release(void)
 	pthread_mutex_unlock(&log_lock);
 }
 
-static void destroy_config(struct ladspa_dsp_config *config)
+void ladspa_dsp_destroy_config(struct ladspa_dsp_config *config)
 {
 	free(config->name);
+	free(config->label);
 	free(config->dir_path);
+	free(config->path);
 	free(config->lc_n);
 	free(config->chain_str);
 }
 
-static int init_config(struct ladspa_dsp_config *config, const char *file_name, const char *dir_path)
+static int init_config(struct ladspa_dsp_config *config, const char *name, const char *dir_path, const char *path)
 {
 	memset(config, 0, sizeof(struct ladspa_dsp_config));
 	config->input_channels = 1;
 	config->output_channels = 1;
-	if (strcmp(file_name, "config") != 0) {
-		config->name = strdup(&file_name[7]);
-		if (!config->name) goto fail;
+	config->max_frames = DEFAULT_MAX_FRAMES;
+	if (name) {
+		const int i = LENGTH(default_name) + strlen(name) + 1;
+		config->name = strdup(name);
+		config->label = calloc(i, sizeof(char));
+		if (!config->name || !config->label) goto fail;
+		snprintf(config->label, i, "%s:%s", default_name, name);
+	}
+	else {
+		config->label = strdup(default_name);
+		if (!config->label) goto fail;
+	}
+	if (path) {
+		config->path = strdup(path);
+		if (!config->path) goto fail;
 	}
 	config->dir_path = strdup(dir_path);
 	config->lc_n = strdup("C");
@@ -95,7 +109,7 @@ static int init_config(struct ladspa_dsp_config *config, const char *file_name,
 	return 0;
 
 	fail:
-	destroy_config(config);
+	ladspa_dsp_destroy_config(config);
 	dsp_perror(DSP_ENOMEM, __func__, NULL);
 	return 1;
 }
@@ -132,6 +146,14 @@ static int read_config(struct ladspa_dsp_config *config, const char *path)
 					goto fail_parse;
 				}
 			}
+			else if (strcmp(key, "max_frames") == 0) {
+				config->max_frames = strtol(value, &endptr, 10);
+				if (check_endptr(path, value, endptr, "max_frames")) goto fail_parse;
+				if (config->max_frames <= 0) {
+					LOG_FMT(LL_ERROR, "%s: error: max_frames must be > 0", path);
+					goto fail_parse;
+				}
+			}
 			else if (strcmp(key, "LC_NUMERIC") == 0) {
 				free(config->lc_n);
 				if (strcmp(value, "none") == 0) config->lc_n = NULL;
@@ -159,6 +181,7 @@ static int read_config(struct ladspa_dsp_config *config, const char *path)
 	return 0;
 
 	fail_parse:
+	config->chain_str = NULL;  /* points into c until duplicated */
 	free(c);
 	return 1;
 
@@ -190,12 +213,13 @@ static int load_configs_in_path(char *path)
 					char *c_path = calloc(i, sizeof(char));
 					if (check_alloc(__func__, c_path)) goto fail;
 					snprintf(c_path, i, "%s/%s", path, d_ent->d_name);
-					if (init_config(&configs[n_configs], d_ent->d_name, path)) {
+					const char *name = (strcmp(d_ent->d_name, "config") == 0) ? NULL : &d_ent->d_name[7];
+					if (init_config(&configs[n_configs], name, path, c_path)) {
 						free(c_path);
 						goto fail;
 					}
 					if ((err = read_config(&configs[n_configs], c_path))) {
-						destroy_config(&configs[n_configs]);
+						ladspa_dsp_destroy_config(&configs[n_configs]);
 						if (err == 2) LOG_FMT(LL_ERROR, "warning: failed to read config file: %s: %s", c_path, strerror(errno));
 						else if (err == 1) LOG_FMT(LL_ERROR, "warning: failed to parse config file: %s", c_path);
 						else {
@@ -247,40 +271,52 @@ static int load_configs(void)
 	return ret;
 }
 
-static LADSPA_Handle instantiate_dsp(const LADSPA_Descriptor *desc, unsigned long fs)
+int ladspa_dsp_get_configs(struct ladspa_dsp_config **c)
+{
+	*c = configs;
+	return (is_init && !is_fallback) ? n_configs : 0;
+}
+
+int ladspa_dsp_reload_config(const struct ladspa_dsp_config *old, struct ladspa_dsp_config *config)
+{
+	if (!old->path) return 1;
+	if (init_config(config, old->name, old->dir_path, old->path)) return 1;
+	const int err = read_config(config, config->path);
+	if (err) {
+		if (err == 2) LOG_FMT(LL_ERROR, "error: failed to read config file: %s: %s", config->path, strerror(errno));
+		else if (err == 1) LOG_FMT(LL_ERROR, "error: failed to parse config file: %s", config->path);
+		ladspa_dsp_destroy_config(config);
+		return 1;
+	}
+	return 0;
+}
+
+int ladspa_dsp_build_chain(const struct ladspa_dsp_config *config, struct effects_chain *chain, int fs)
 {
 	locale_t old_locale = 0, new_locale = 0;
 	struct stream_info stream;
-	struct ladspa_dsp_config *config = (struct ladspa_dsp_config *) desc->ImplementationData;
-	struct ladspa_dsp *d = calloc(1, sizeof(struct ladspa_dsp));
-	if (check_alloc(__func__, d)) return NULL;
 
-	LOG_FMT(LL_VERBOSE, "info: using label: %s", desc->Label);
-	d->input_channels = config->input_channels;
-	d->output_channels = config->output_channels;
-	d->chain = (struct effects_chain) EFFECTS_CHAIN_INITIALIZER;
-	d->ports = calloc(d->input_channels + d->output_channels, sizeof(LADSPA_Data *));
-	if (check_alloc(__func__, d->ports)) goto fail;
+	*chain = (struct effects_chain) EFFECTS_CHAIN_INITIALIZER;
 	stream.fs = fs;
-	stream.channels = d->input_channels;
+	stream.channels = config->input_channels;
 	LOG_S(LL_VERBOSE, "info: begin effects chain");
 	if (config->lc_n != NULL) {
 		LOG_FMT(LL_VERBOSE, "info: setting LC_NUMERIC to \"%s\"", config->lc_n);
 		new_locale = duplocale(uselocale((locale_t) 0));
 		if (new_locale == (locale_t) 0) {
 			LOG_FMT(LL_ERROR, "error: duplocale() failed: %s", strerror(errno));
-			goto fail;
+			return 1;
 		}
 		new_locale = newlocale(LC_NUMERIC_MASK, config->lc_n, new_locale);
 		if (new_locale == (locale_t) 0) {
 			LOG_FMT(LL_ERROR, "error: newlocale() failed: %s", strerror(errno));
-			goto fail;
+			return 1;
 		}
 		old_locale = uselocale(new_locale);
 	}
 	int r = 0;
 	if (config->chain_str)
-		r = build_effects_chain_from_string(config->chain_str, config->name, &d->chain, &stream, NULL, config->dir_path);
+		r = build_effects_chain_from_string(config->chain_str, config->name, chain, &stream, NULL, config->dir_path);
 	if (old_locale != (locale_t) 0) {
 		LOG_S(LL_VERBOSE, "info: resetting locale");
 		uselocale(old_locale);
@@ -288,7 +324,7 @@ static LADSPA_Handle instantiate_dsp(const LADSPA_Descriptor *desc, unsigned lon
 	if (new_locale != (locale_t) 0) freelocale(new_locale);
 	if (r) goto fail;
 	LOG_S(LL_VERBOSE, "info: end effects chain");
-	if (stream.channels != d->output_channels) {
+	if (stream.channels != config->output_channels) {
 		LOG_S(LL_ERROR, "error: output channels mismatch");
 		goto fail;
 	}
@@ -296,11 +332,40 @@ static LADSPA_Handle instantiate_dsp(const LADSPA_Descriptor *desc, unsigned lon
 		LOG_S(LL_ERROR, "error: sample rate mismatch");
 		goto fail;
 	}
-	effects_chain_set_dither_params(&d->chain, 0, 0);  /* disable auto dither */
+	effects_chain_set_dither_params(chain, 0, 0);  /* disable auto dither */
+	return 0;
+
+	fail:
+	destroy_effects_chain(chain);
+	return 1;
+}
+
+static LADSPA_Handle instantiate_dsp(const LADSPA_Descriptor *desc, unsigned long fs)
+{
+	struct ladspa_dsp_config *config = (struct ladspa_dsp_config *) desc->ImplementationData;
+	struct ladspa_dsp *d = calloc(1, sizeof(struct ladspa_dsp));
+	if (check_alloc(__func__, d)) return NULL;
+
+	LOG_FMT(LL_VERBOSE, "info: using label: %s", desc->Label);
+	d->input_channels = config->input_channels;
+	d->output_channels = config->output_channels;
+	d->chain = (struct effects_chain) EFFECTS_CHAIN_INITIALIZER;
+	d->ports = calloc(d->input_channels + d->output_channels, sizeof(LADSPA_Data *));
+	if (check_alloc(__func__, d->ports)) goto fail;
+	if (ladspa_dsp_build_chain(config, &d->chain, fs)) goto fail;
+	/* allocate here so run_dsp() never has to; larger blocks are split */
+	d->frames = config->max_frames;
+	const ssize_t buf_len = get_effects_chain_buffer_len(&d->chain, d->frames, d->input_channels);
+	LOG_FMT(LL_VERBOSE, "info: max_frames=%zd; buffer length=%zd", d->frames, buf_len);
+	d->buf1 = calloc(buf_len, sizeof(sample_t));
+	d->buf2 = calloc(buf_len, sizeof(sample_t));
+	if (check_alloc(__func__, d->buf1) || check_alloc(__func__, d->buf2)) goto fail;
 	return d;
 
 	fail:
 	destroy_effects_chain(&d->chain);
+	free(d->buf1);
+	free(d->buf2);
 	free(d->ports);
 	free(d);
 	return NULL;
@@ -313,45 +378,69 @@ static void connect_port_to_dsp(LADSPA_Handle inst, unsigned long port, LADSPA_D
 		d->ports[port] = data;
 }
 
-static void run_dsp(LADSPA_Handle inst, unsigned long s)
+void ladspa_dsp_ports_to_buf(sample_t *buf, const float *const *ports, int channels, size_t offset, size_t frames)
 {
-	struct ladspa_dsp *d = (struct ladspa_dsp *) inst;
-	ssize_t w = s;
-
-	if (s == 0) return;
-	if (s > d->frames) {
-		LOG_FMT(LL_VERBOSE, "info: frames=%zd", s);
-		ssize_t buf_len = get_effects_chain_buffer_len(&d->chain, s, d->input_channels);
-		sample_t *buf1_tmp = realloc(d->buf1, buf_len * sizeof(sample_t));
-		sample_t *buf2_tmp = realloc(d->buf2, buf_len * sizeof(sample_t));
-		if (!buf1_tmp || !buf2_tmp) {
-			free((buf1_tmp) ? buf1_tmp : d->buf1);
-			free((buf2_tmp) ? buf2_tmp : d->buf2);
-			d->buf1 = d->buf2 = NULL;
-			dsp_perror(DSP_ENOMEM, __func__, NULL);
+	size_t i = 0;
+	if (channels == 1) {
+		const float *p0 = &ports[0][offset];
+		for (; i + 1 < frames; i += 2)
+			*((ladspa_dsp_vec *) &buf[i]) = (ladspa_dsp_vec) { p0[i], p0[i+1] };
+		for (; i < frames; ++i)
+			buf[i] = (sample_t) p0[i];
+	}
+	else if (channels == 2) {
+		const float *p0 = &ports[0][offset], *p1 = &ports[1][offset];
+		for (; i < frames; ++i, buf += 2)
+			*((ladspa_dsp_vec *) buf) = (ladspa_dsp_vec) { p0[i], p1[i] };
+	}
+	else {
+		for (; i < frames; ++i)
+			for (int k = 0; k < channels; ++k)
+				*(buf++) = (sample_t) ports[k][offset+i];
+	}
+}
+
+void ladspa_dsp_buf_to_ports(float *const *ports, const sample_t *buf, int channels, size_t offset, size_t frames)
+{
+	size_t i = 0;
+	if (channels == 1) {
+		float *p0 = &ports[0][offset];
+		for (; i + 1 < frames; i += 2) {
+			const ladspa_dsp_vec v = *((const ladspa_dsp_vec *) &buf[i]);
+			p0[i] = (float) v[0];
+			p0[i+1] = (float) v[1];
 		}
-		else {
-			d->buf1 = buf1_tmp;
-			d->buf2 = buf2_tmp;
+		for (; i < frames; ++i)
+			p0[i] = (float) buf[i];
+	}
+	else if (channels == 2) {
+		float *p0 = &ports[0][offset], *p1 = &ports[1][offset];
+		for (; i < frames; ++i, buf += 2) {
+			const ladspa_dsp_vec v = *((const ladspa_dsp_vec *) buf);
+			p0[i] = (float) v[0];
+			p1[i] = (float) v[1];
 		}
-		d->frames = s;
 	}
-	if (!d->buf1 || !d->buf2) {
-		/* failed to allocate buffer(s); output silence */
-		for (unsigned long k = d->input_channels; k < d->input_channels + d->output_channels; ++k)
-			memset(d->ports[k], 0, s * sizeof(LADSPA_Data));
-		return;
+	else {
+		for (; i < frames; ++i)
+			for (int k = 0; k < channels; ++k)
+				ports[k][offset+i] = (float) *(buf++);
 	}
+}
 
-	for (unsigned long i = 0, j = 0; i < s; ++i)
-		for (unsigned long k = 0; k < d->input_channels; ++k)
-			d->buf1[j++] = (sample_t) d->ports[k][i];
-
-	sample_t *obuf = run_effects_chain(&d->chain, &w, d->buf1, d->buf2);
-
-	for (unsigned long i = 0, j = 0; i < s; ++i)
-		for (unsigned long k = d->input_channels; k < d->input_channels + d->output_channels; ++k)
-			d->ports[k][i] = (LADSPA_Data) obuf[j++];
+static void run_dsp(LADSPA_Handle inst, unsigned long s)
+{
+	struct ladspa_dsp *d = (struct ladspa_dsp *) inst;
+	float *const *out_ports = &d->ports[d->input_channels];
+
+	for (size_t offset = 0; offset < s;) {
+		const size_t frames = MINIMUM(s - offset, d->frames);
+		ssize_t w = frames;
+		ladspa_dsp_ports_to_buf(d->buf1, (const float *const *) d->ports, d->input_channels, offset, frames);
+		sample_t *obuf = run_effects_chain(&d->chain, &w, d->buf1, d->buf2);
+		ladspa_dsp_buf_to_ports(out_ports, obuf, d->output_channels, offset, frames);
+		offset += frames;
+	}
 }
 
 static void run_null(LADSPA_Handle inst, unsigned long s)
@@ -383,7 +472,6 @@ static char * make_port_name(const char *prefix, int idx)
 
 void __attribute__((constructor)) ladspa_dsp_so_init()
 {
-	int is_fallback = 0;
 	char *env = getenv("LADSPA_DSP_LOGLEVEL");
 	if (env != NULL) {
 		if (env[0] == '\0')
@@ -404,21 +492,14 @@ void __attribute__((constructor)) ladspa_dsp_so_init()
 		free(configs);
 		configs = calloc(1, sizeof(struct ladspa_dsp_config));
 		if (check_alloc(__func__, configs)) return;
-		if (init_config(&configs[0], "config_null", GLOBAL_CONFIG_DIR)) return;
+		if (init_config(&configs[0], "null", GLOBAL_CONFIG_DIR, NULL)) return;
 		n_configs = is_fallback = 1;
 	}
 	descriptors = calloc(n_configs, sizeof(LADSPA_Descriptor));
 	if (check_alloc(__func__, descriptors)) return;
 	for (int k = 0; k < n_configs; ++k) {
 		descriptors[k].UniqueID = 2378 + k;
-		if (configs[k].name) {
-			int i = LENGTH(default_name) + strlen(configs[k].name) + 1;
-			char *tmp = calloc(i, sizeof(char));
-			if (check_alloc(__func__, tmp)) return;
-			snprintf(tmp, i, "%s:%s", default_name, configs[k].name);
-			descriptors[k].Label = tmp;
-		}
-		else descriptors[k].Label = default_name;
+		descriptors[k].Label = configs[k].label;
 		descriptors[k].Properties = 0;
 		descriptors[k].Name = descriptors[k].Label;
 		descriptors[k].Maker = "Michael Barbour";
@@ -460,8 +541,6 @@ void __attribute__((destructor)) ladspa_dsp_so_fini()
 {
 	if (descriptors) {
 		for (int k = 0; k < n_configs; ++k) {
-			if (descriptors[k].Label != default_name)
-				free((char *) descriptors[k].Label); /* note: dsp_descriptor->Name is the same data */
 			free((LADSPA_PortDescriptor *) descriptors[k].PortDescriptors);
 			if (descriptors[k].PortNames) {
 				for (int i = 0; i < configs[k].input_channels + configs[k].output_channels; ++i)
@@ -474,7 +553,7 @@ void __attribute__((destructor)) ladspa_dsp_so_fini()
 	}
 	if (configs) {
 		for (int k = 0; k < n_configs; ++k)
-			destroy_config(&configs[k]);
+			ladspa_dsp_destroy_config(&configs[k]);
 		free(configs);
 	}
 }
@@ -0,0 +1,47 @@
+/*
+ * This file is part of dsp.
+ *
+ * Copyright (c) 2026 Michael Barbour <barbour.michael.0@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef DSP_LADSPA_DSP_H
+#define DSP_LADSPA_DSP_H
+
+#include <sys/types.h>
+#include "dsp.h"
+#include "effects_chain.h"
+
+/* Shared between the LADSPA and LV2 frontends. */
+
+struct ladspa_dsp_config {
+	int input_channels, output_channels;
+	ssize_t max_frames;
+	char *name, *label, *dir_path, *path, *lc_n, *chain_str;
+};
+
+/* Returns the number of configs loaded when the library was initialized
+   and sets *configs. Returns 0 if initialization failed. */
+int ladspa_dsp_get_configs(struct ladspa_dsp_config **);
+/* Reads the config file at config->path into a new config. Returns 0 on
+   success. */
+int ladspa_dsp_reload_config(const struct ladspa_dsp_config *, struct ladspa_dsp_config *);
+void ladspa_dsp_destroy_config(struct ladspa_dsp_config *);
+/* Builds the effects chain for a config with LC_NUMERIC set as requested
+   and checks that its output matches the config. Returns 0 on success. */
+int ladspa_dsp_build_chain(const struct ladspa_dsp_config *, struct effects_chain *, int);
+void ladspa_dsp_ports_to_buf(sample_t *, const float *const *, int, size_t, size_t);
+void ladspa_dsp_buf_to_ports(float *const *, const sample_t *, int, size_t, size_t);
+
+#endif
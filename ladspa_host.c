@@ -20,6 +20,9 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <ladspa.h>
 #include <dlfcn.h>
 #include "ladspa_host.h"
@@ -27,11 +30,21 @@
 
 #define DEBUG_CHANNEL_MAPPING 0
 #if DEBUG_CHANNEL_MAPPING
-	#define CM_DEBUG(...) do { if (!state->cm_printed) fprintf(stderr, __VA_ARGS__); } while(0)
+	#define CM_DEBUG(...) fprintf(stderr, __VA_ARGS__)
 #else
 	#define CM_DEBUG(...)
 #endif
 
+typedef sample_t ladspa_host_vec __attribute__((vector_size(2*sizeof(sample_t)), aligned(sizeof(sample_t)), may_alias));
+
+struct ladspa_host_worker {
+	struct ladspa_host_state *state;
+	int first_handle, has_thread;
+	unsigned long len;
+	pthread_t thread;
+	sem_t start, sync;
+};
+
 struct ladspa_host_state {
 	void *dl;
 	const LADSPA_Descriptor *desc;
@@ -40,54 +53,123 @@ struct ladspa_host_state {
 	LADSPA_Data **in, **out, *control;
 	int n_in, n_out;
 	ssize_t buf_size;
-	#if DEBUG_CHANNEL_MAPPING
-		int cm_printed;
-	#endif
+	int *in_map;   /* input port -> input channel */
+	int *out_map;  /* output channel -> output port (>= 0) or input channel (-1 - ch) */
+	struct ladspa_host_worker *workers;
+	int n_workers;
 };
 
-static sample_t * ladspa_host_effect_run(struct effect *e, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
+/* Runs every n_workers-th handle starting at first_handle */
+static void ladspa_host_worker_run(struct ladspa_host_worker *w)
 {
-	ssize_t f = 0, len;
-	struct ladspa_host_state *state = (struct ladspa_host_state *) e->data;
+	struct ladspa_host_state *state = w->state;
+	for (int i = w->first_handle; i < state->n_handles; i += state->n_workers)
+		state->desc->run(state->handles[i], w->len);
+}
 
-	while (f < *frames) {
-		len = (*frames - f > state->buf_size) ? state->buf_size : *frames - f;
-		CM_DEBUG("\n%s: %s: info: begin channel map\n", dsp_globals.prog_name, e->name);
-		for (int ch = 0, in_port = 0; ch < e->istream.channels; ++ch) {
-			if (GET_BIT(e->channel_selector, ch)) {
-				CM_DEBUG("%s: %s: info: channel map: in_port[%d] <- ibuf[%d]\n", dsp_globals.prog_name, e->name, in_port, ch);
-				for (ssize_t i = 0; i < len; ++i)
-					state->in[in_port][i] = (LADSPA_Data) ibuf[(f + i) * e->istream.channels + ch];
-				++in_port;
-			}
+static void * ladspa_host_worker_thread(void *arg)
+{
+	struct ladspa_host_worker *w = (struct ladspa_host_worker *) arg;
+	for (;;) {
+		while (sem_wait(&w->start) != 0);
+		ladspa_host_worker_run(w);
+		sem_post(&w->sync);
+	}
+	return NULL;
+}
+
+static void ladspa_host_run_handles(struct ladspa_host_state *state, unsigned long len)
+{
+	if (state->n_workers > 1) {
+		for (int k = 1; k < state->n_workers; ++k) {
+			state->workers[k].len = len;
+			sem_post(&state->workers[k].start);
 		}
+		state->workers[0].len = len;
+		ladspa_host_worker_run(&state->workers[0]);
+		for (int k = 1; k < state->n_workers; ++k)
+			while (sem_wait(&state->workers[k].sync) != 0);
+	}
+	else {
 		for (int i = 0; i < state->n_handles; ++i)
-			state->desc->run(state->handles[i], (unsigned long) len);
-		for (int out_ch = 0, out_port = 0, in_ch = 0; out_ch < e->ostream.channels; ++out_ch, ++in_ch) {
-			if (in_ch >= e->istream.channels || GET_BIT(e->channel_selector, in_ch)) {
-				if (out_port < state->n_out) {
-					CM_DEBUG("%s: %s: info: channel map: obuf[%d] <- out_port[%d]\n", dsp_globals.prog_name, e->name, out_ch, out_port);
-					for (ssize_t i = 0; i < len; ++i)
-						obuf[(f + i) * e->ostream.channels + out_ch] = (sample_t) state->out[out_port][i];
-					++out_port;
-				}
-				else {
-					while (in_ch < e->istream.channels && GET_BIT(e->channel_selector, in_ch)) ++in_ch;
-					if (in_ch < e->istream.channels) goto copy_ibuf;
-				}
+			state->desc->run(state->handles[i], len);
+	}
+}
+
+static void ladspa_host_read_input(struct ladspa_host_state *state, const sample_t *ibuf, int channels, ssize_t len)
+{
+	int p = 0;
+	for (; p + 1 < state->n_in; p += 2) {
+		const int ch = state->in_map[p];
+		LADSPA_Data *p0 = state->in[p], *p1 = state->in[p+1];
+		if (state->in_map[p+1] == ch + 1) {
+			const sample_t *s = &ibuf[ch];
+			for (ssize_t i = 0; i < len; ++i, s += channels) {
+				const ladspa_host_vec v = *((const ladspa_host_vec *) s);
+				p0[i] = (LADSPA_Data) v[0];
+				p1[i] = (LADSPA_Data) v[1];
 			}
-			else {
-				copy_ibuf:
-				CM_DEBUG("%s: %s: info: channel map: obuf[%d] <- ibuf[%d]\n", dsp_globals.prog_name, e->name, out_ch, in_ch);
-				for (ssize_t i = 0; i < len; ++i)
-					obuf[(f + i) * e->ostream.channels + out_ch] = ibuf[(f + i) * e->istream.channels + in_ch];
+		}
+		else {
+			const int ch1 = state->in_map[p+1];
+			for (ssize_t i = 0; i < len; ++i) {
+				p0[i] = (LADSPA_Data) ibuf[i * channels + ch];
+				p1[i] = (LADSPA_Data) ibuf[i * channels + ch1];
 			}
 		}
-		CM_DEBUG("%s: %s: info: end channel map\n", dsp_globals.prog_name, e->name);
+	}
+	if (p < state->n_in) {
+		const int ch = state->in_map[p];
+		LADSPA_Data *p0 = state->in[p];
+		for (ssize_t i = 0; i < len; ++i)
+			p0[i] = (LADSPA_Data) ibuf[i * channels + ch];
+	}
+}
+
+static void ladspa_host_write_output(struct ladspa_host_state *state, sample_t *obuf, int ochannels, const sample_t *ibuf, int ichannels, ssize_t len)
+{
+	for (int ch = 0; ch < ochannels;) {
+		const int m0 = state->out_map[ch], m1 = (ch + 1 < ochannels) ? state->out_map[ch+1] : 0;
+		sample_t *d = &obuf[ch];
+		if (ch + 1 < ochannels && m0 >= 0 && m1 >= 0) {
+			const LADSPA_Data *p0 = state->out[m0], *p1 = state->out[m1];
+			for (ssize_t i = 0; i < len; ++i, d += ochannels)
+				*((ladspa_host_vec *) d) = (ladspa_host_vec) { p0[i], p1[i] };
+			ch += 2;
+		}
+		else if (ch + 1 < ochannels && m0 < 0 && m1 == m0 - 1) {
+			const sample_t *s = &ibuf[-1 - m0];
+			for (ssize_t i = 0; i < len; ++i, d += ochannels, s += ichannels)
+				*((ladspa_host_vec *) d) = *((const ladspa_host_vec *) s);
+			ch += 2;
+		}
+		else if (m0 >= 0) {
+			const LADSPA_Data *p0 = state->out[m0];
+			for (ssize_t i = 0; i < len; ++i, d += ochannels)
+				*d = (sample_t) p0[i];
+			++ch;
+		}
+		else {
+			const sample_t *s = &ibuf[-1 - m0];
+			for (ssize_t i = 0; i < len; ++i, d += ochannels, s += ichannels)
+				*d = *s;
+			++ch;
+		}
+	}
+}
+
+static sample_t * ladspa_host_effect_run(struct effect *e, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
+{
+	ssize_t f = 0, len;
+	struct ladspa_host_state *state = (struct ladspa_host_state *) e->data;
+
+	while (f < *frames) {
+		len = (*frames - f > state->buf_size) ? state->buf_size : *frames - f;
+		const sample_t *ib = &ibuf[f * e->istream.channels];
+		ladspa_host_read_input(state, ib, e->istream.channels, len);
+		ladspa_host_run_handles(state, (unsigned long) len);
+		ladspa_host_write_output(state, &obuf[f * e->ostream.channels], e->ostream.channels, ib, e->istream.channels, len);
 		f += len;
-		#if DEBUG_CHANNEL_MAPPING
-			state->cm_printed = 1;
-		#endif
 	}
 	return obuf;
 }
@@ -95,6 +177,18 @@ static sample_t * ladspa_host_effect_run(struct effect *e, ssize_t *frames, samp
 static void ladspa_host_effect_destroy(struct effect *e)
 {
 	struct ladspa_host_state *state = (struct ladspa_host_state *) e->data;
+	if (state->workers) {
+		for (int k = 1; k < state->n_workers; ++k) {
+			struct ladspa_host_worker *w = &state->workers[k];
+			if (w->has_thread) {
+				pthread_cancel(w->thread);
+				pthread_join(w->thread, NULL);
+				sem_destroy(&w->start);
+				sem_destroy(&w->sync);
+			}
+		}
+		free(state->workers);
+	}
 	if (state->handles) {
 		for (int i = 0; i < state->n_handles; ++i) {
 			if (state->handles[i]) {
@@ -109,6 +203,8 @@ static void ladspa_host_effect_destroy(struct effect *e)
 	if (state->out) for (int i = 0; i < state->n_out; ++i) free(state->out[i]);
 	free(state->out);
 	free(state->control);
+	free(state->in_map);
+	free(state->out_map);
 	if (state->dl) dlclose(state->dl);
 	free(state);
 	free(e->channel_selector);
@@ -152,10 +248,27 @@ struct effect * ladspa_host_effect_init(const struct effect_info *ei, const stru
 	const LADSPA_Descriptor *desc;
 	struct effect *e;
 	struct ladspa_host_state *state;
-	int in_control_port_count = 0, out_control_port_count = 0;
+	int in_control_port_count = 0, out_control_port_count = 0, n_threads = 1, opt;
 	const int dlopen_flags = RTLD_NOW|RTLD_LOCAL;
+	struct dsp_getopt_state g = DSP_GETOPT_STATE_INITIALIZER;
 
-	if (argc < 3) {
+	while ((opt = dsp_getopt(&g, argc, argv, "p::")) != -1) {
+		switch (opt) {
+		case 'p':
+			if (g.arg) {
+				n_threads = strtol(g.arg, &endptr, 10);
+				CHECK_ENDPTR(g.arg, endptr, "threads", return NULL);
+				CHECK_RANGE(n_threads > 0, "threads", return NULL);
+			}
+			else n_threads = -1;
+			break;
+		default:
+			dsp_getopt_print_error(&g, opt, argv[0]);
+			goto print_usage;
+		}
+	}
+	if (argc - g.ind < 2) {
+		print_usage:
 		print_effect_usage(ei);
 		return NULL;
 	}
@@ -168,10 +281,11 @@ struct effect * ladspa_host_effect_init(const struct effect_info *ei, const stru
 	e->data = state;
 
 	/* Build paths and dlopen() the plugin */
-	if ((argv[1][0] == '.' || argv[1][0] == '~') && argv[1][1] == '/') {
-		char *full_path = construct_full_path(dir, argv[1], istream->fs, selected_channel_count);
+	if ((argv[g.ind][0] == '.' || argv[g.ind][0] == '~') && argv[g.ind][1] == '/') {
+		char *full_path = construct_full_path(dir, argv[g.ind], istream->fs, selected_channel_count);
 		if (!full_path) goto fail;
 		state->dl = dlopen(full_path, dlopen_flags);
+		if (state->dl) effect_add_dep(full_path);
 		free(full_path);
 	}
 	else {
@@ -185,18 +299,18 @@ struct effect * ladspa_host_effect_init(const struct effect_info *ei, const stru
 		}
 
 		/* Add .so extension, if needed */
-		const char *plugin_basename = strrchr(argv[1], '/');
-		plugin_basename = (plugin_basename) ? plugin_basename+1 : argv[1];
+		const char *plugin_basename = strrchr(argv[g.ind], '/');
+		plugin_basename = (plugin_basename) ? plugin_basename+1 : argv[g.ind];
 		char *plugin_soname;
 		if (strstr(plugin_basename, ".so") == NULL) {
-			const size_t len = strlen(argv[1]);
+			const size_t len = strlen(argv[g.ind]);
 			plugin_soname = calloc(len + 4, sizeof(char));
 			if (plugin_soname) {
-				memcpy(plugin_soname, argv[1], len);
+				memcpy(plugin_soname, argv[g.ind], len);
 				memcpy(plugin_soname+len, ".so", 4);
 			}
 		}
-		else plugin_soname = strdup(argv[1]);
+		else plugin_soname = strdup(argv[g.ind]);
 		if (check_alloc(ei->name, plugin_soname)) {
 			free(search_path);
 			goto fail;
@@ -212,6 +326,7 @@ struct effect * ladspa_host_effect_init(const struct effect_info *ei, const stru
 				goto fail;
 			}
 			state->dl = dlopen(full_path, dlopen_flags);
+			if (state->dl) effect_add_dep(full_path);
 			free(full_path);
 			if (state->dl) break;
 			dir = next_dir;
@@ -226,19 +341,19 @@ struct effect * ladspa_host_effect_init(const struct effect_info *ei, const stru
 
 	/* Get address of ladspa_descriptor() */
 	if ((descriptor_fn = dlsym(state->dl, "ladspa_descriptor")) == NULL) {
-		LOG_FMT(LL_ERROR, "%s: %s: error: could not find ladspa_descriptor()", argv[0], argv[1]);
+		LOG_FMT(LL_ERROR, "%s: %s: error: could not find ladspa_descriptor()", argv[0], argv[g.ind]);
 		goto fail;
 	}
 
 	/* Find correct descriptor by its label */
 	for (unsigned long plugin_idx = 0; (desc = descriptor_fn(plugin_idx)) != NULL; ++plugin_idx) {
-		if (strcmp(desc->Label, argv[2]) == 0) {
+		if (strcmp(desc->Label, argv[g.ind+1]) == 0) {
 			state->desc = desc;
 			break;
 		}
 	}
 	if (state->desc == NULL) {
-		LOG_FMT(LL_ERROR, "%s: %s: error: could not find plugin: %s", argv[0], argv[1], argv[2]);
+		LOG_FMT(LL_ERROR, "%s: %s: error: could not find plugin: %s", argv[0], argv[g.ind], argv[g.ind+1]);
 		goto fail;
 	}
 	desc = state->desc;
@@ -247,11 +362,11 @@ struct effect * ladspa_host_effect_init(const struct effect_info *ei, const stru
 	for (unsigned long i = 0; i < desc->PortCount; ++i) {
 		LADSPA_PortDescriptor pd = desc->PortDescriptors[i];
 		if (LADSPA_IS_PORT_INPUT(pd) && LADSPA_IS_PORT_OUTPUT(pd)) {
-			LOG_FMT(LL_ERROR, "%s: %s: %s: error: port '%s' (%lu) is both an input and an output", argv[0], argv[1], argv[2], desc->PortNames[i], i);
+			LOG_FMT(LL_ERROR, "%s: %s: %s: error: port '%s' (%lu) is both an input and an output", argv[0], argv[g.ind], argv[g.ind+1], desc->PortNames[i], i);
 			goto fail;
 		}
 		if (LADSPA_IS_PORT_AUDIO(pd) && LADSPA_IS_PORT_CONTROL(pd)) {
-			LOG_FMT(LL_ERROR, "%s: %s: %s: error: port '%s' (%lu) is both audio and control", argv[0], argv[1], argv[2], desc->PortNames[i], i);
+			LOG_FMT(LL_ERROR, "%s: %s: %s: error: port '%s' (%lu) is both audio and control", argv[0], argv[g.ind], argv[g.ind+1], desc->PortNames[i], i);
 			goto fail;
 		}
 		if (LADSPA_IS_PORT_INPUT(pd) && LADSPA_IS_PORT_AUDIO(pd)) ++state->n_in;
@@ -261,12 +376,12 @@ struct effect * ladspa_host_effect_init(const struct effect_info *ei, const stru
 	}
 
 	if (state->n_out < 1) {
-		LOG_FMT(LL_ERROR, "%s: %s: %s: error: plugin has no audio outputs", argv[0], argv[1], argv[2]);
+		LOG_FMT(LL_ERROR, "%s: %s: %s: error: plugin has no audio outputs", argv[0], argv[g.ind], argv[g.ind+1]);
 		goto fail;
 	}
 	if (state->n_in > 1) {
 		if (state->n_in != selected_channel_count) {
-			LOG_FMT(LL_ERROR, "%s: %s: %s: error: expected %d input channels, got %d", argv[0], argv[1], argv[2], state->n_in, selected_channel_count);
+			LOG_FMT(LL_ERROR, "%s: %s: %s: error: expected %d input channels, got %d", argv[0], argv[g.ind], argv[g.ind+1], state->n_in, selected_channel_count);
 			goto fail;
 		}
 		state->n_handles = 1;
@@ -301,12 +416,12 @@ struct effect * ladspa_host_effect_init(const struct effect_info *ei, const stru
 	const int total_output_channels = istream->channels + state->n_out - ((state->n_in == 0) ? state->n_handles : state->n_in);
 
 	/* Set input control port values */
-	if (argc > 3 + in_control_port_count) {
-		LOG_FMT(LL_ERROR, "%s: %s: %s: error: plugin expects %d controls, got %d", argv[0], argv[1], argv[2], in_control_port_count, argc - 3);
+	if (argc - g.ind - 2 > in_control_port_count) {
+		LOG_FMT(LL_ERROR, "%s: %s: %s: error: plugin expects %d controls, got %d", argv[0], argv[g.ind], argv[g.ind+1], in_control_port_count, argc - g.ind - 2);
 		goto fail;
 	}
 	if (in_control_port_count > 0) {
-		int cport = 0, k = 3;
+		int cport = 0, k = g.ind + 2;
 		for (unsigned long i = 0; i < desc->PortCount; ++i) {
 			LADSPA_PortDescriptor pd = desc->PortDescriptors[i];
 			const LADSPA_PortRangeHint *pr = &desc->PortRangeHints[i];
@@ -343,7 +458,7 @@ struct effect * ladspa_host_effect_init(const struct effect_info *ei, const stru
 							state->control[cport] = 440.0;
 					}
 					else {
-						LOG_FMT(LL_ERROR, "%s: %s: %s: error: control \"%s\" has no default value and is not set", argv[0], argv[1], argv[2], desc->PortNames[i]);
+						LOG_FMT(LL_ERROR, "%s: %s: %s: error: control \"%s\" has no default value and is not set", argv[0], argv[g.ind], argv[g.ind+1], desc->PortNames[i]);
 						goto fail;
 					}
 					if (LADSPA_IS_HINT_INTEGER(pr->HintDescriptor))
@@ -362,7 +477,7 @@ struct effect * ladspa_host_effect_init(const struct effect_info *ei, const stru
 	/* Instantiate plugins, connect ports, and activate plugins (if required) */
 	for (int i = 0, iport = 0, oport = 0; i < state->n_handles; ++i) {
 		if ((state->handles[i] = desc->instantiate(desc, istream->fs)) == NULL) {
-			LOG_FMT(LL_ERROR, "%s: %s: %s: error: instantiate() failed", argv[0], argv[1], argv[2]);
+			LOG_FMT(LL_ERROR, "%s: %s: %s: error: instantiate() failed", argv[0], argv[g.ind], argv[g.ind+1]);
 			goto fail;
 		}
 		int cport = 0;
@@ -378,10 +493,67 @@ struct effect * ladspa_host_effect_init(const struct effect_info *ei, const stru
 		if (desc->activate != NULL) desc->activate(state->handles[i]);
 	}
 
+	/* Build channel maps */
+	if (state->n_in > 0) {
+		state->in_map = calloc(state->n_in, sizeof(int));
+		if (check_alloc(ei->name, state->in_map)) goto fail;
+	}
+	state->out_map = calloc(total_output_channels, sizeof(int));
+	if (check_alloc(ei->name, state->out_map)) goto fail;
+	CM_DEBUG("%s: %s: info: begin channel map\n", dsp_globals.prog_name, argv[0]);
+	for (int ch = 0, in_port = 0; ch < istream->channels && in_port < state->n_in; ++ch) {
+		if (GET_BIT(channel_selector, ch)) {
+			CM_DEBUG("%s: %s: info: channel map: in_port[%d] <- ibuf[%d]\n", dsp_globals.prog_name, argv[0], in_port, ch);
+			state->in_map[in_port++] = ch;
+		}
+	}
+	for (int out_ch = 0, out_port = 0, in_ch = 0; out_ch < total_output_channels; ++out_ch, ++in_ch) {
+		if (in_ch >= istream->channels || GET_BIT(channel_selector, in_ch)) {
+			if (out_port < state->n_out) {
+				CM_DEBUG("%s: %s: info: channel map: obuf[%d] <- out_port[%d]\n", dsp_globals.prog_name, argv[0], out_ch, out_port);
+				state->out_map[out_ch] = out_port++;
+			}
+			else {
+				while (in_ch < istream->channels && GET_BIT(channel_selector, in_ch)) ++in_ch;
+				if (in_ch < istream->channels) goto copy_ibuf;
+			}
+		}
+		else {
+			copy_ibuf:
+			CM_DEBUG("%s: %s: info: channel map: obuf[%d] <- ibuf[%d]\n", dsp_globals.prog_name, argv[0], out_ch, in_ch);
+			state->out_map[out_ch] = -1 - in_ch;
+		}
+	}
+	CM_DEBUG("%s: %s: info: end channel map\n", dsp_globals.prog_name, argv[0]);
+
+	/* Start worker threads for independent instances */
+	if (n_threads < 0 || n_threads > state->n_handles) n_threads = state->n_handles;
+	if (n_threads > 1) {
+		state->workers = calloc(n_threads, sizeof(struct ladspa_host_worker));
+		if (check_alloc(ei->name, state->workers)) goto fail;
+		state->n_workers = n_threads;
+		for (int k = 0; k < n_threads; ++k) {
+			struct ladspa_host_worker *w = &state->workers[k];
+			w->state = state;
+			w->first_handle = k;
+			if (k == 0) continue;  /* runs on the caller's thread */
+			sem_init(&w->start, 0, 0);
+			sem_init(&w->sync, 0, 0);
+			if ((errno = pthread_create(&w->thread, NULL, ladspa_host_worker_thread, w)) != 0) {
+				LOG_FMT(LL_ERROR, "%s(): error: pthread_create() failed: %s", __func__, strerror(errno));
+				sem_destroy(&w->start);
+				sem_destroy(&w->sync);
+				goto fail;
+			}
+			w->has_thread = 1;
+		}
+		LOG_FMT(LL_VERBOSE, "%s: %s: %s: info: running %d instances on %d threads", argv[0], argv[g.ind], argv[g.ind+1], state->n_handles, n_threads);
+	}
+
 	/* Print input control port names and values */
 	if (in_control_port_count > 0 && LOGLEVEL(LL_VERBOSE)) {
 		int cport = 0;
-		fprintf(stderr, "%s: %s: %s: %s: info: controls:", dsp_globals.prog_name, argv[0], argv[1], argv[2]);
+		fprintf(stderr, "%s: %s: %s: %s: info: controls:", dsp_globals.prog_name, argv[0], argv[g.ind], argv[g.ind+1]);
 		for (unsigned long i = 0; i < desc->PortCount; ++i) {
 			LADSPA_PortDescriptor pd = desc->PortDescriptors[i];
 			if (LADSPA_IS_PORT_CONTROL(pd)) {
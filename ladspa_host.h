@@ -26,7 +26,7 @@
 struct effect * ladspa_host_effect_init(const struct effect_info *, const struct stream_info *, const char *, const char *, int, const char *const *);
 
 #define LADSPA_HOST_EFFECT_INFO \
-	{ "ladspa_host", "module_path plugin_label [control ...]", ladspa_host_effect_init, 0 }
+	{ "ladspa_host", "[-p[threads]] module_path plugin_label [control ...]", ladspa_host_effect_init, 0 }
 #else
 #define LADSPA_HOST_EFFECT_INFO \
 	{ "ladspa_host", NULL, NULL, 0 }
@@ -23,6 +23,9 @@
 #include "ewma.h"
 #include "util.h"
 
+typedef double levels_vec __attribute__((vector_size(2*sizeof(double))));
+typedef long long levels_mask __attribute__((vector_size(2*sizeof(long long))));
+
 struct levels_ch_state {
 	double block_peak;
 	struct ewma_state avg, peak;
@@ -53,16 +56,41 @@ static sample_t * levels_effect_run(struct effect *e, ssize_t *frames, sample_t
 	struct levels_state *state = (struct levels_state *) e->data;
 	const int stride = e->istream.channels;
 	sample_t *const ibuf_end = ibuf + *frames*stride;
-	for (sample_t *ibuf_p = ibuf; ibuf_p < ibuf_end; ibuf_p += stride) {
-		for (int k = 0; k < stride; ++k) {
-			if (state->cs[k]) {
-				struct levels_ch_state *cs = state->cs[k];
-				const double s2 = ibuf_p[k]*ibuf_p[k];
+	/* channels are processed in pairs using vector lanes */
+	for (int k0 = 0, k1; k0 < stride; k0 = k1+1) {
+		for (; k0 < stride && !state->cs[k0]; ++k0);
+		for (k1 = k0+1; k1 < stride && !state->cs[k1]; ++k1);
+		if (k0 >= stride) break;
+		if (k1 >= stride) {
+			struct levels_ch_state *cs = state->cs[k0];
+			for (sample_t *ibuf_p = ibuf + k0; ibuf_p < ibuf_end; ibuf_p += stride) {
+				const double s2 = ibuf_p[0]*ibuf_p[0];
 				ewma_run(&cs->avg, s2);
 				const double peak = ewma_run_set_min(&cs->peak, s2);
 				if (cs->block_peak < peak) cs->block_peak = peak;
 			}
+			break;
+		}
+		struct levels_ch_state *cs0 = state->cs[k0], *cs1 = state->cs[k1];
+		const levels_vec avg_g0 = { cs0->avg.g0, cs1->avg.g0 }, peak_g0 = { cs0->peak.g0, cs1->peak.g0 };
+		levels_vec avg = { cs0->avg.m0, cs1->avg.m0 }, peak = { cs0->peak.m0, cs1->peak.m0 };
+		levels_vec block_peak = { cs0->block_peak, cs1->block_peak };
+		for (sample_t *ibuf_p = ibuf; ibuf_p < ibuf_end; ibuf_p += stride) {
+			const levels_vec s = { ibuf_p[k0], ibuf_p[k1] }, s2 = s*s;
+			avg = avg_g0*(s2 - avg) + avg;
+			/* same as ewma_run_set_min() */
+			const levels_mask m = (s2 <= peak);
+			const levels_vec peak_r = peak_g0*(s2 - peak) + peak;
+			peak = (levels_vec) (((levels_mask) peak_r & m) | ((levels_mask) s2 & ~m));
+			const levels_mask bm = (block_peak < peak);
+			block_peak = (levels_vec) (((levels_mask) peak & bm) | ((levels_mask) block_peak & ~bm));
 		}
+		cs0->avg.m0 = avg[0];
+		cs1->avg.m0 = avg[1];
+		cs0->peak.m0 = peak[0];
+		cs1->peak.m0 = peak[1];
+		cs0->block_peak = block_peak[0];
+		cs1->block_peak = block_peak[1];
 	}
 	dsp_statuslines_acquire();
 	if (!state->statuslines_registered) {
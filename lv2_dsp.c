@@ -0,0 +1,412 @@
+/*
+ * This file is part of dsp.
+ *
+ * Copyright (c) 2026 Michael Barbour <barbour.michael.0@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <lv2/core/lv2.h>
+#include <lv2/worker/worker.h>
+
+#include "dsp.h"
+#include "effect.h"
+#include "effects_chain.h"
+#include "ladspa_dsp.h"
+#include "util.h"
+
+/* Plugin URIs are LV2_DSP_URI_PREFIX followed by the LADSPA label. Keep in
+   sync with scripts/lv2_dsp_bundle.sh. */
+#define LV2_DSP_URI_PREFIX "https://github.com/bmc0/dsp/lv2#"
+#define CHECK_INTERVAL     1000  /* milliseconds between checks for changed files */
+
+enum {
+	LV2_DSP_WORK_CHECK,    /* check dependencies and rebuild the chain if needed */
+	LV2_DSP_WORK_DESTROY,  /* destroy a retired chain */
+};
+
+enum {
+	LV2_DSP_RESPONSE_NONE,
+	LV2_DSP_RESPONSE_CHAIN,
+};
+
+struct lv2_dsp_msg {
+	int type;
+	struct effects_chain chain;
+};
+
+struct lv2_dsp_dep {
+	char *path;
+	struct timespec mtime, seen;
+};
+
+struct lv2_dsp {
+	const struct ladspa_dsp_config *config;
+	int fs, input_channels, output_channels;
+	ssize_t frames, buf_len;
+	sample_t *buf1, *buf2;
+	struct effects_chain_xfade_state xf;  /* chain[0] is current; chain[1] is the incoming chain while fading */
+	struct effects_chain retired;
+	int has_retired, check_pending;
+	ssize_t check_frames, check_pos;
+	float latency;
+	const float **in_ports;
+	float **out_ports;
+	float *latency_port;
+	const LV2_Worker_Schedule *schedule;
+	/* owned by the worker */
+	struct lv2_dsp_dep *deps;
+	int n_deps;
+};
+
+static LV2_Descriptor *descriptors = NULL;
+static int n_descriptors = 0;
+static pthread_once_t descriptors_once = PTHREAD_ONCE_INIT;
+
+static void get_mtime(const char *path, struct timespec *ts)
+{
+	struct stat st;
+	if (stat(path, &st) == 0) *ts = st.st_mtim;
+	else ts->tv_sec = ts->tv_nsec = 0;
+}
+
+static int ts_equal(const struct timespec *a, const struct timespec *b)
+{
+	return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+static void deps_free(struct lv2_dsp_dep *deps, int n)
+{
+	for (int i = 0; i < n; ++i)
+		free(deps[i].path);
+	free(deps);
+}
+
+/* replaces the dependency list with the config file plus the files read
+   while building chain */
+static int deps_update(struct lv2_dsp *d, const struct effects_chain *chain)
+{
+	struct lv2_dsp_dep *deps = calloc(chain->deps.n + 1, sizeof(struct lv2_dsp_dep));
+	int n = 0;
+	if (check_alloc(__func__, deps)) return 1;
+	if (d->config->path && (deps[n++].path = strdup(d->config->path)) == NULL) goto fail;
+	for (int i = 0; i < chain->deps.n; ++i)
+		if ((deps[n++].path = strdup(chain->deps.paths[i])) == NULL) goto fail;
+	for (int i = 0; i < n; ++i) {
+		get_mtime(deps[i].path, &deps[i].mtime);
+		deps[i].seen = deps[i].mtime;
+	}
+	deps_free(d->deps, d->n_deps);
+	d->deps = deps;
+	d->n_deps = n;
+	return 0;
+
+	fail:
+	deps_free(deps, n);
+	dsp_perror(DSP_ENOMEM, __func__, NULL);
+	return 1;
+}
+
+/* Returns nonzero if any dependency has changed and has not been modified
+   since the previous check. */
+static int deps_changed(struct lv2_dsp *d)
+{
+	int changed = 0, settled = 1;
+	for (int i = 0; i < d->n_deps; ++i) {
+		struct timespec ts;
+		get_mtime(d->deps[i].path, &ts);
+		if (!ts_equal(&ts, &d->deps[i].mtime)) changed = 1;
+		if (!ts_equal(&ts, &d->deps[i].seen)) settled = 0;
+		d->deps[i].seen = ts;
+	}
+	return changed && settled;
+}
+
+static void deps_accept(struct lv2_dsp *d)
+{
+	for (int i = 0; i < d->n_deps; ++i)
+		d->deps[i].mtime = d->deps[i].seen;
+}
+
+static int rebuild_chain(struct lv2_dsp *d, struct effects_chain *chain)
+{
+	struct ladspa_dsp_config config;
+	LOG_FMT(LL_NORMAL, "info: %s: reloading", d->config->label);
+	if (ladspa_dsp_reload_config(d->config, &config)) return 1;
+	int r = 1;
+	if (config.input_channels != d->input_channels || config.output_channels != d->output_channels) {
+		LOG_FMT(LL_ERROR, "error: %s: the number of input or output channels cannot be changed without reinstantiating the plugin", config.label);
+		goto done;
+	}
+	if (ladspa_dsp_build_chain(&config, chain, d->fs)) goto done;
+	const ssize_t buf_len = get_effects_chain_buffer_len(chain, d->frames, d->input_channels);
+	if (buf_len > d->buf_len) {
+		LOG_FMT(LL_ERROR, "error: %s: new effects chain requires larger buffers; reinstantiate the plugin to use it", config.label);
+		destroy_effects_chain(chain);
+		goto done;
+	}
+	r = 0;
+
+	done:
+	ladspa_dsp_destroy_config(&config);
+	return r;
+}
+
+static LV2_Worker_Status work_dsp(LV2_Handle inst, LV2_Worker_Respond_Function respond, LV2_Worker_Respond_Handle handle, uint32_t size, const void *data)
+{
+	struct lv2_dsp *d = (struct lv2_dsp *) inst;
+	struct lv2_dsp_msg msg;
+	if (size != sizeof(msg)) return LV2_WORKER_ERR_UNKNOWN;
+	memcpy(&msg, data, sizeof(msg));
+	switch (msg.type) {
+	case LV2_DSP_WORK_CHECK:
+		msg.type = LV2_DSP_RESPONSE_NONE;
+		if (deps_changed(d)) {
+			deps_accept(d);  /* don't retry a failed build until something changes again */
+			if (rebuild_chain(d, &msg.chain) == 0) {
+				deps_update(d, &msg.chain);
+				msg.type = LV2_DSP_RESPONSE_CHAIN;
+			}
+		}
+		if (respond(handle, sizeof(msg), &msg) != LV2_WORKER_SUCCESS && msg.type == LV2_DSP_RESPONSE_CHAIN)
+			destroy_effects_chain(&msg.chain);
+		break;
+	case LV2_DSP_WORK_DESTROY:
+		destroy_effects_chain(&msg.chain);
+		break;
+	default:
+		return LV2_WORKER_ERR_UNKNOWN;
+	}
+	return LV2_WORKER_SUCCESS;
+}
+
+static double chain_latency(struct lv2_dsp *d, struct effects_chain *chain)
+{
+	return rint(get_effects_chain_delay(chain, 0) * d->fs);
+}
+
+static void retire_chain(struct lv2_dsp *d)
+{
+	const struct lv2_dsp_msg msg = { LV2_DSP_WORK_DESTROY, d->retired };
+	if (d->schedule->schedule_work(d->schedule->handle, sizeof(msg), &msg) == LV2_WORKER_SUCCESS)
+		d->has_retired = 0;
+}
+
+static void finish_xfade(struct lv2_dsp *d)
+{
+	d->retired = d->xf.chain[0];
+	d->has_retired = 1;
+	d->xf.chain[0] = d->xf.chain[1];
+	d->xf.chain[1] = (struct effects_chain) EFFECTS_CHAIN_INITIALIZER;
+	d->xf.pos = 0;
+	retire_chain(d);
+}
+
+static LV2_Worker_Status work_response_dsp(LV2_Handle inst, uint32_t size, const void *data)
+{
+	struct lv2_dsp *d = (struct lv2_dsp *) inst;
+	struct lv2_dsp_msg msg;
+	if (size != sizeof(msg)) return LV2_WORKER_ERR_UNKNOWN;
+	memcpy(&msg, data, sizeof(msg));
+	d->check_pending = 0;
+	if (msg.type == LV2_DSP_RESPONSE_CHAIN) {
+		/* checks are not scheduled while fading, so chain[1] is free */
+		d->xf.chain[1] = msg.chain;
+		d->xf.frames = lround(EFFECTS_CHAIN_XFADE_TIME/1000.0 * d->fs);
+		d->xf.pos = d->xf.frames;
+		d->latency = chain_latency(d, &d->xf.chain[1]);
+		if (d->xf.pos == 0) finish_xfade(d);  /* no crossfade */
+	}
+	return LV2_WORKER_SUCCESS;
+}
+
+static LV2_Handle instantiate_dsp(const LV2_Descriptor *desc, double fs, const char *bundle_path, const LV2_Feature *const *features)
+{
+	struct ladspa_dsp_config *configs;
+	const int n = ladspa_dsp_get_configs(&configs);
+	const int k = desc - descriptors;
+	if (k < 0 || k >= n) return NULL;
+	struct lv2_dsp *d = calloc(1, sizeof(struct lv2_dsp));
+	if (check_alloc(__func__, d)) return NULL;
+
+	LOG_FMT(LL_VERBOSE, "info: using URI: %s", desc->URI);
+	d->config = &configs[k];
+	d->fs = lround(fs);
+	d->input_channels = d->config->input_channels;
+	d->output_channels = d->config->output_channels;
+	d->xf = (struct effects_chain_xfade_state) EFFECTS_CHAIN_XFADE_STATE_INITIALIZER;
+	for (int i = 0; features && features[i]; ++i)
+		if (strcmp(features[i]->URI, LV2_WORKER__schedule) == 0)
+			d->schedule = (const LV2_Worker_Schedule *) features[i]->data;
+	if (!d->schedule) LOG_FMT(LL_VERBOSE, "info: %s: host does not support the worker extension; automatic reloading disabled", d->config->label);
+	d->in_ports = calloc(d->input_channels, sizeof(float *));
+	d->out_ports = calloc(d->output_channels, sizeof(float *));
+	if (check_alloc(__func__, d->in_ports) || check_alloc(__func__, d->out_ports)) goto fail;
+	if (ladspa_dsp_build_chain(d->config, &d->xf.chain[0], d->fs)) goto fail;
+	if (deps_update(d, &d->xf.chain[0])) goto fail;
+	d->frames = d->config->max_frames;
+	d->buf_len = get_effects_chain_buffer_len(&d->xf.chain[0], d->frames, d->input_channels);
+	LOG_FMT(LL_VERBOSE, "info: max_frames=%zd; buffer length=%zd", d->frames, d->buf_len);
+	d->buf1 = calloc(d->buf_len, sizeof(sample_t));
+	d->buf2 = calloc(d->buf_len, sizeof(sample_t));
+	d->xf.buf = calloc(d->buf_len, sizeof(sample_t));
+	if (check_alloc(__func__, d->buf1) || check_alloc(__func__, d->buf2) || check_alloc(__func__, d->xf.buf)) goto fail;
+	d->check_frames = lround(CHECK_INTERVAL/1000.0 * d->fs);
+	d->latency = chain_latency(d, &d->xf.chain[0]);
+	return d;
+
+	fail:
+	destroy_effects_chain(&d->xf.chain[0]);
+	deps_free(d->deps, d->n_deps);
+	free(d->buf1);
+	free(d->buf2);
+	free(d->xf.buf);
+	free(d->in_ports);
+	free(d->out_ports);
+	free(d);
+	return NULL;
+}
+
+static void connect_port_dsp(LV2_Handle inst, uint32_t port, void *data)
+{
+	struct lv2_dsp *d = (struct lv2_dsp *) inst;
+	if (port < d->input_channels)
+		d->in_ports[port] = (const float *) data;
+	else if (port < d->input_channels + d->output_channels)
+		d->out_ports[port - d->input_channels] = (float *) data;
+	else if (port == d->input_channels + d->output_channels)
+		d->latency_port = (float *) data;
+}
+
+static void activate_dsp(LV2_Handle inst)
+{
+	/* not called from the audio thread, so chains can be destroyed here */
+	struct lv2_dsp *d = (struct lv2_dsp *) inst;
+	if (d->xf.pos > 0) {
+		destroy_effects_chain(&d->xf.chain[0]);
+		d->xf.chain[0] = d->xf.chain[1];
+		d->xf.chain[1] = (struct effects_chain) EFFECTS_CHAIN_INITIALIZER;
+		d->xf.pos = 0;
+	}
+	if (d->has_retired) {
+		destroy_effects_chain(&d->retired);
+		d->has_retired = 0;
+	}
+	reset_effects_chain(&d->xf.chain[0]);
+	d->check_pos = 0;
+}
+
+static void run_dsp(LV2_Handle inst, uint32_t s)
+{
+	struct lv2_dsp *d = (struct lv2_dsp *) inst;
+
+	if (d->schedule) {
+		if (d->has_retired) retire_chain(d);
+		d->check_pos += s;
+		if (d->check_pos >= d->check_frames && !d->check_pending && !d->has_retired && d->xf.pos == 0) {
+			const struct lv2_dsp_msg msg = { LV2_DSP_WORK_CHECK, EFFECTS_CHAIN_INITIALIZER };
+			if (d->schedule->schedule_work(d->schedule->handle, sizeof(msg), &msg) == LV2_WORKER_SUCCESS)
+				d->check_pending = 1;
+			d->check_pos = 0;
+		}
+	}
+	for (size_t offset = 0; offset < s;) {
+		const size_t frames = MINIMUM(s - offset, d->frames);
+		ssize_t w = frames;
+		sample_t *obuf;
+		ladspa_dsp_ports_to_buf(d->buf1, d->in_ports, d->input_channels, offset, frames);
+		if (d->xf.pos > 0) {
+			obuf = effects_chain_xfade_run(&d->xf, &w, d->buf1, d->buf2);
+			if (d->xf.pos == 0) finish_xfade(d);
+		}
+		else obuf = run_effects_chain(&d->xf.chain[0], &w, d->buf1, d->buf2);
+		ladspa_dsp_buf_to_ports(d->out_ports, obuf, d->output_channels, offset, frames);
+		offset += frames;
+	}
+	if (d->latency_port) *d->latency_port = d->latency;
+}
+
+static void cleanup_dsp(LV2_Handle inst)
+{
+	struct lv2_dsp *d = (struct lv2_dsp *) inst;
+	LOG_S(LL_VERBOSE, "info: cleaning up...");
+	destroy_effects_chain(&d->xf.chain[0]);
+	destroy_effects_chain(&d->xf.chain[1]);
+	if (d->has_retired) destroy_effects_chain(&d->retired);
+	#ifdef HAVE_FFTW3
+		dsp_fftw_save_wisdom();
+	#endif
+	deps_free(d->deps, d->n_deps);
+	free(d->buf1);
+	free(d->buf2);
+	free(d->xf.buf);
+	free(d->in_ports);
+	free(d->out_ports);
+	free(d);
+}
+
+static const LV2_Worker_Interface worker_interface = {
+	work_dsp,
+	work_response_dsp,
+	NULL,
+};
+
+static const void * extension_data_dsp(const char *uri)
+{
+	if (strcmp(uri, LV2_WORKER__interface) == 0) return &worker_interface;
+	return NULL;
+}
+
+static void init_descriptors(void)
+{
+	struct ladspa_dsp_config *configs;
+	const int n = ladspa_dsp_get_configs(&configs);
+	if (n < 1) return;
+	descriptors = calloc(n, sizeof(LV2_Descriptor));
+	if (check_alloc(__func__, descriptors)) return;
+	for (int k = 0; k < n; ++k) {
+		const int i = strlen(LV2_DSP_URI_PREFIX) + strlen(configs[k].label) + 1;
+		char *uri = calloc(i, sizeof(char));
+		if (check_alloc(__func__, uri)) return;
+		snprintf(uri, i, "%s%s", LV2_DSP_URI_PREFIX, configs[k].label);
+		descriptors[k].URI = uri;
+		descriptors[k].instantiate = instantiate_dsp;
+		descriptors[k].connect_port = connect_port_dsp;
+		descriptors[k].activate = activate_dsp;
+		descriptors[k].run = run_dsp;
+		descriptors[k].deactivate = NULL;
+		descriptors[k].cleanup = cleanup_dsp;
+		descriptors[k].extension_data = extension_data_dsp;
+		n_descriptors = k + 1;
+	}
+}
+
+void __attribute__((destructor)) lv2_dsp_so_fini()
+{
+	for (int k = 0; k < n_descriptors; ++k)
+		free((char *) descriptors[k].URI);
+	free(descriptors);
+}
+
+LV2_SYMBOL_EXPORT const LV2_Descriptor * lv2_descriptor(uint32_t i)
+{
+	pthread_once(&descriptors_once, init_descriptors);
+	if (i < n_descriptors) return &descriptors[i];
+	else return NULL;
+}
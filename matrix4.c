@@ -27,7 +27,6 @@
 #include "allpass.h"
 #include "util.h"
 
-#define DOWNSAMPLE_FACTOR 32
 #include "matrix4_common.h"
 
 #define BASE_ORD_NOTCH_SCALE 0.7
@@ -38,21 +37,21 @@ struct dyn_shelf_state {
 };
 
 struct matrix4_state {
-	int s, c0, c1;
+	int c0, c1;
 	char disable, do_phase_flip, do_direct_path, do_dpwr_decouple;
 	enum status_type status_type;
 	sample_t *bufs[2];
 	struct biquad_state in_hp[2], in_lp[2];
 	struct dyn_shelf_state surr_shelf[2], surr_lp[2], front_shelf[2], front_lp[2];
+	struct ctl_clock clk;
 	struct smooth_state sm;
 	struct event_state ev;
 	struct event_config evc;
 	struct axes ax, ax_ev, ax_dpwr;
 	struct smf_state bg_cs;
 	struct {
-		struct cs_interp_state ll, lr, rl, rr;
-		struct cs_interp_state lsl, lsr, rsl, rsr;
-		struct cs_interp_state g_surr_shelf, g_surr_lp, g_front_shelf, g_front_lp;
+		struct cs_interp2_state l, r, ls, rs;  /* matrix rows: {ll, lr}, {rl, rr}, etc. */
+		struct cs_interp2_state g_shelf, g_lp;  /* {surr, front} */
 	} m_interp;
 	struct cs_interp_state pf_ap_c0[2];
 	struct ap1_state pf_ap[2];
@@ -116,12 +115,8 @@ static sample_t * matrix4_effect_run(struct effect *e, ssize_t *frames, sample_t
 		struct envs env, pwr_env;
 		calc_input_envs(&state->sm, s0_bp, s1_bp, &env, &pwr_env);
 
-		#if DOWNSAMPLE_FACTOR > 1
-		state->s = (state->s + 1 >= DOWNSAMPLE_FACTOR) ? 0 : state->s + 1;
-		if (state->s == 0) {
-		#else
-		if (1) {
-		#endif
+		const int ctl_update = ctl_clock_tick(&state->clk);
+		if (ctl_update) {
 			process_events(&state->ev, &state->evc, &env, &pwr_env, 1.0, &state->ax, &state->ax_ev, &state->ax_dpwr);
 
 			const double w_step = smoothstep(state->ax.cs*(-2/M_PI_4));
@@ -141,20 +136,19 @@ static sample_t * matrix4_effect_run(struct effect *e, ssize_t *frames, sample_t
 			state->calc_matrix_coefs(&state->ax, (state->do_dpwr_decouple) ? &state->ax_dpwr : &state->ax,
 				surr_mult, state->surr_mult[1]*cur_fade_mult, state->cmc_param, &m, r_shelf_mult, LENGTH(r_shelf_mult));
 
-			cs_interp_insert(&state->m_interp.ll, m.ll);
-			cs_interp_insert(&state->m_interp.lr, m.lr);
-			cs_interp_insert(&state->m_interp.rl, m.rl);
-			cs_interp_insert(&state->m_interp.rr, m.rr);
+			cs_interp2_insert(&state->m_interp.l, (cs_vec2) { m.ll, m.lr });
+			cs_interp2_insert(&state->m_interp.r, (cs_vec2) { m.rl, m.rr });
+			cs_interp2_insert(&state->m_interp.ls, (cs_vec2) { m.lsl, m.lsr });
+			cs_interp2_insert(&state->m_interp.rs, (cs_vec2) { m.rsl, m.rsr });
 
-			cs_interp_insert(&state->m_interp.lsl, m.lsl);
-			cs_interp_insert(&state->m_interp.lsr, m.lsr);
-			cs_interp_insert(&state->m_interp.rsl, m.rsl);
-			cs_interp_insert(&state->m_interp.rsr, m.rsr);
-
-			cs_interp_insert(&state->m_interp.g_surr_shelf, shelf_ct0/shelf_ct1*r_shelf_mult[0].ret.surr);
-			cs_interp_insert(&state->m_interp.g_surr_lp, lp_ct0/lp_ct1*r_shelf_mult[1].ret.surr/MAXIMUM(r_shelf_mult[0].ret.surr, DBL_MIN));
-			cs_interp_insert(&state->m_interp.g_front_shelf, r_shelf_mult[0].ret.front);
-			cs_interp_insert(&state->m_interp.g_front_lp, r_shelf_mult[1].ret.front/r_shelf_mult[0].ret.front);
+			cs_interp2_insert(&state->m_interp.g_shelf, (cs_vec2) {
+				shelf_ct0/shelf_ct1*r_shelf_mult[0].ret.surr,
+				r_shelf_mult[0].ret.front,
+			});
+			cs_interp2_insert(&state->m_interp.g_lp, (cs_vec2) {
+				lp_ct0/lp_ct1*r_shelf_mult[1].ret.surr/MAXIMUM(r_shelf_mult[0].ret.surr, DBL_MIN),
+				r_shelf_mult[1].ret.front/r_shelf_mult[0].ret.front,
+			});
 
 			if (state->do_phase_flip) {
 				const double pf_pos_rs = phase_flip_pos_rs(&state->ax);
@@ -169,24 +163,29 @@ static sample_t * matrix4_effect_run(struct effect *e, ssize_t *frames, sample_t
 			}
 		}
 
+		const double t = CTL_CLOCK_T(&state->clk);
 		const sample_t s0_d = state->bufs[0][state->p];
 		const sample_t s1_d = state->bufs[1][state->p];
-		sample_t out_l = s0_d*cs_interp(&state->m_interp.ll, state->s) + s1_d*cs_interp(&state->m_interp.lr, state->s);
-		sample_t out_r = s0_d*cs_interp(&state->m_interp.rl, state->s) + s1_d*cs_interp(&state->m_interp.rr, state->s);
-		sample_t out_ls = s0_d*cs_interp(&state->m_interp.lsl, state->s) + s1_d*cs_interp(&state->m_interp.lsr, state->s) + 1e-15;
-		sample_t out_rs = s0_d*cs_interp(&state->m_interp.rsl, state->s) + s1_d*cs_interp(&state->m_interp.rsr, state->s) + 1e-15;
+		const cs_vec2 m_l = cs_interp2(&state->m_interp.l, t), m_r = cs_interp2(&state->m_interp.r, t);
+		const cs_vec2 m_ls = cs_interp2(&state->m_interp.ls, t), m_rs = cs_interp2(&state->m_interp.rs, t);
+		sample_t out_l = s0_d*m_l[0] + s1_d*m_l[1];
+		sample_t out_r = s0_d*m_r[0] + s1_d*m_r[1];
+		sample_t out_ls = s0_d*m_ls[0] + s1_d*m_ls[1] + 1e-15;
+		sample_t out_rs = s0_d*m_rs[0] + s1_d*m_rs[1] + 1e-15;
 
 		if (state->shelf_mult != 1.0) {
-			const sample_t g_surr_shelf = cs_interp(&state->m_interp.g_surr_shelf, state->s);
-			const sample_t g_front_shelf = cs_interp(&state->m_interp.g_front_shelf, state->s);
+			const cs_vec2 g_shelf = cs_interp2(&state->m_interp.g_shelf, t);
+			const sample_t g_surr_shelf = g_shelf[0];
+			const sample_t g_front_shelf = g_shelf[1];
 			out_l = dyn_shelf_run(&state->front_shelf[0], out_l, g_front_shelf);
 			out_r = dyn_shelf_run(&state->front_shelf[1], out_r, g_front_shelf);
 			out_ls = dyn_shelf_run(&state->surr_shelf[0], out_ls, g_surr_shelf);
 			out_rs = dyn_shelf_run(&state->surr_shelf[1], out_rs, g_surr_shelf);
 		}
 		if (state->lowpass_mult != 1.0) {
-			const sample_t g_surr_lp = cs_interp(&state->m_interp.g_surr_lp, state->s);
-			const sample_t g_front_lp = cs_interp(&state->m_interp.g_front_lp, state->s);
+			const cs_vec2 g_lp = cs_interp2(&state->m_interp.g_lp, t);
+			const sample_t g_surr_lp = g_lp[0];
+			const sample_t g_front_lp = g_lp[1];
 			out_l = dyn_shelf_run(&state->front_lp[0], out_l, g_front_lp);
 			out_r = dyn_shelf_run(&state->front_lp[1], out_r, g_front_lp);
 			out_ls = dyn_shelf_run(&state->surr_lp[0], out_ls, g_surr_lp);
@@ -194,8 +193,8 @@ static sample_t * matrix4_effect_run(struct effect *e, ssize_t *frames, sample_t
 		}
 		sample_t out_ls_pf = out_ls, out_rs_pf = out_rs;
 		if (state->do_phase_flip) {
-			state->pf_ap[0].c0 = cs_interp(&state->pf_ap_c0[0], state->s);
-			state->pf_ap[1].c0 = cs_interp(&state->pf_ap_c0[1], state->s);
+			state->pf_ap[0].c0 = cs_interp(&state->pf_ap_c0[0], t);
+			state->pf_ap[1].c0 = cs_interp(&state->pf_ap_c0[1], t);
 			out_ls_pf = ap1_run(&state->pf_ap[0], out_ls_pf);
 			out_rs_pf = ap1_run(&state->pf_ap[1], out_rs_pf);
 		}
@@ -216,7 +215,7 @@ static sample_t * matrix4_effect_run(struct effect *e, ssize_t *frames, sample_t
 			const double pe_out = ewma_run(&state->pwr_err[1], pe_l_out*pe_l_out + pe_r_out*pe_r_out + pe_ls_out*pe_ls_out + pe_rs_out*pe_rs_out);
 			const double pe_ratio = MAXIMUM(pe_out, DBL_MIN)/MAXIMUM(pe_in, DBL_MIN);
 			const double pe_ratio_sm = smf_run(&state->pwr_err_sm, MINIMUM(pe_ratio, 10.0));
-			if (state->s == 0 && state->pwr_err_file)
+			if (ctl_update && state->pwr_err_file)
 				fprintf(state->pwr_err_file, "%.15e\n", pe_ratio_sm);
 		}
 	#endif
@@ -229,8 +228,8 @@ static sample_t * matrix4_effect_run(struct effect *e, ssize_t *frames, sample_t
 		}
 		obuf_p += e->istream.channels;
 		if (state->do_direct_path) {
-			const sample_t m_surr_amb = cs_interp(&state->m_surr_amb, state->s);
-			const sample_t m_surr_dir = cs_interp(&state->m_surr_dir, state->s);
+			const sample_t m_surr_amb = cs_interp(&state->m_surr_amb, t);
+			const sample_t m_surr_dir = cs_interp(&state->m_surr_dir, t);
 			obuf_p[0] = (out_ls_pf-1e-15)*m_surr_amb;
 			obuf_p[1] = (out_rs_pf-1e-15)*m_surr_amb;
 			obuf_p[2] = (out_ls-1e-15)*m_surr_dir;
@@ -406,7 +405,8 @@ struct effect * matrix4_effect_init(const struct effect_info *ei, const struct s
 		dyn_shelf_init(&state->front_shelf[i], istream->fs, config.shelf_f0);
 		dyn_shelf_init(&state->front_lp[i],    istream->fs, config.lowpass_f0);
 	}
-	smf_asym_init(&state->bg_cs, DOWNSAMPLED_FS(istream->fs), SMF_RISE_TIME(ACCOM_TIME*2.0), 0.01, 1e-6);
+	ctl_clock_init(&state->clk, config.ds_factor);
+	smf_asym_init(&state->bg_cs, DOWNSAMPLED_FS(istream->fs, config.ds_factor), SMF_RISE_TIME(ACCOM_TIME*2.0), 0.01, 1e-6);
 	smf_set(&state->bg_cs, 1.0);
 	phase_flip_init_params(&state->pf_params, istream->fs);
 	const double pf_pos_rs = phase_flip_pos_rs(&state->ax);
@@ -417,7 +417,7 @@ struct effect * matrix4_effect_init(const struct effect_info *ei, const struct s
 	cs_interp_set(&state->m_surr_amb, 1.0);
 	cs_interp_set(&state->m_surr_dir, 0.0);
 	smooth_state_init(&state->sm, istream);
-	if (event_state_init(&state->ev, istream, 1.0, BASE_ORD_NOTCH_SCALE)) goto fail;
+	if (event_state_init(&state->ev, istream, config.ds_factor, 1.0, BASE_ORD_NOTCH_SCALE)) goto fail;
 #if DEBUG_POWER_ERROR
 	for (int i = 0; i < 6; ++i) {
 		biquad_init_using_type(&state->pwr_err_bp.lp[i], BIQUAD_LOWPASS, istream->fs, 14000.0, 0.5, 0, 0, BIQUAD_WIDTH_Q);
@@ -428,10 +428,7 @@ struct effect * matrix4_effect_init(const struct effect_info *ei, const struct s
 	smf_init(&state->pwr_err_sm, istream->fs, SMF_RISE_TIME(300.0), 0.1);
 #endif
 
-	state->len = config.lookahead_frames;
-#if DOWNSAMPLE_FACTOR > 1
-	state->len += CS_INTERP_DELAY_FRAMES;
-#endif
+	state->len = config.lookahead_frames + CS_INTERP_DELAY_FRAMES(config.ds_factor);
 	state->bufs[0] = calloc(state->len, sizeof(sample_t));
 	if (check_alloc(ei->name, state->bufs[0])) goto fail;
 	state->bufs[1] = calloc(state->len, sizeof(sample_t));
@@ -446,7 +443,7 @@ struct effect * matrix4_effect_init(const struct effect_info *ei, const struct s
 	}
 	else state->lowpass_mult = 1.0;
 	state->fade_frames = TIME_TO_FRAMES(FADE_TIME, istream->fs);
-	event_config_init(&state->evc, istream, config.rear_ev_mask);
+	event_config_init(&state->evc, istream, config.ds_factor, config.rear_ev_mask);
 
 	return e;
 
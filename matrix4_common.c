@@ -90,6 +90,7 @@ int matrix4_config_init(const struct effect_info *ei, const struct stream_info *
 	config->status_type = LOGLEVEL(LL_VERBOSE) ? STATUS_TYPE_BARS : STATUS_TYPE_NONE;
 	config->surr_delay_frames = TIME_TO_FRAMES(SURR_DELAY_DEFAULT, istream->fs);
 	config->lookahead_frames = CALC_LOOKAHEAD_FRAMES((is_mb)?LOOKAHEAD_MB_DEFAULT:LOOKAHEAD_DEFAULT, istream->fs);
+	config->ds_factor = DOWNSAMPLE_FACTOR_DEFAULT;
 	config->shelf_mult = SHELF_MULT_DEFAULT;
 	config->shelf_f0 = SHELF_F0_DEFAULT;
 	config->contour_pwrcmp = (is_mb) ? CONTOUR_PWRCMP_MB_DEFAULT : CONTOUR_PWRCMP_DEFAULT;
@@ -238,6 +239,14 @@ int matrix4_config_init(const struct effect_info *ei, const struct stream_info *
 					config->surr_delay_frames = parse_len(opt_arg, istream->fs, &endptr);
 					CHECK_ENDPTR(opt_arg, endptr, opt, goto opt_fail);
 				}
+				else if (is_opt(opt, "control_ds=")) {
+					char *opt_arg = isolate(opt, '=');
+					if (*opt_arg == '\0') goto needs_arg;
+					const long v = strtol(opt_arg, &endptr, 10);
+					CHECK_ENDPTR(opt_arg, endptr, opt, goto opt_fail);
+					CHECK_RANGE(v >= 1 && v <= DOWNSAMPLE_FACTOR_MAX, opt, goto opt_fail);
+					config->ds_factor = (int) v;
+				}
 				else if (is_opt(opt, "filter_type=")) {
 					char *opt_arg = isolate(opt, '=');
 					if (!is_mb) goto mb_only;
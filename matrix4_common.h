@@ -82,9 +82,11 @@
 /* 1 = linear; 2 = quarter sine; 3 = half sine; 4 = double-exponential sigmoid */
 #define FADE_TYPE 3
 
-#ifndef DOWNSAMPLE_FACTOR
-	#define DOWNSAMPLE_FACTOR 1
+/* steering analysis runs once every ds_factor frames (control_ds option) */
+#ifndef DOWNSAMPLE_FACTOR_DEFAULT
+	#define DOWNSAMPLE_FACTOR_DEFAULT 32
 #endif
+#define DOWNSAMPLE_FACTOR_MAX 64
 #ifndef NORM_ACCOM_FACTOR
 	#define NORM_ACCOM_FACTOR 0.9
 #endif
@@ -92,14 +94,10 @@
 	#define DIFF_OVERSHOOT 1.001
 #endif
 
-/* 1 = linear; 2 = parabolic 2x; 3 = cubic B-spline; 4 = cubic Hermite; 5 = polyphase FIR (Blackman window) */
+/* 1 = linear; 2 = parabolic 2x; 3 = cubic B-spline; 4 = cubic Hermite */
 #ifndef CS_INTERP_TYPE
-#if DOWNSAMPLE_FACTOR == 4 || DOWNSAMPLE_FACTOR == 2
-	#define CS_INTERP_TYPE 5
-#else
 	#define CS_INTERP_TYPE 2
 #endif
-#endif
 
 #define ENABLE_LOOKBACK 1
 #define DEBUG_PRINT_MIN_RISE_TIME 0
@@ -186,6 +184,7 @@ struct matrix4_config {
 	double surr_mult[2], shelf_mult, shelf_f0, lowpass_f0, contour_pwrcmp, rear_ev_mask;
 	double fb_stop[2], freq_mask;
 	ssize_t lookahead_frames, surr_delay_frames;
+	int ds_factor;
 	enum status_type status_type;
 	enum filter_bank_type fb_type;
 	calc_matrix_coefs_func calc_matrix_coefs;
@@ -206,7 +205,7 @@ struct phase_flip_params {
 #define ANGLE(n, d, expr) ((NEAR_POS_ZERO(n) && NEAR_POS_ZERO(d)) ? M_PI_4 : (NEAR_POS_ZERO(d)) ? M_PI_2 : atan(expr))
 #define CALC_LR(n, d, expr) (ANGLE(n, d, expr) - M_PI_4)
 #define CALC_CS(n, d, expr) (ANGLE(n, d, expr) - M_PI_4)
-#define DOWNSAMPLED_FS(fs) (((double) (fs)) / DOWNSAMPLE_FACTOR)
+#define DOWNSAMPLED_FS(fs, ds) (((double) (fs)) / (ds))
 #define CBUF_NEXT(x, len) (((x)+1<(len))?(x)+1:0)
 #define CBUF_PREV(x, len) (((x)>0)?(x)-1:(len)-1)
 
@@ -245,15 +244,15 @@ static inline double smoothstep(double x)
 
 #ifndef DSP_MATRIX4_COMMON_H_NO_STATIC_FUNCTIONS
 /* note: must call event_state_cleanup() even on failure */
-static int event_state_init(struct event_state *ev, const struct stream_info *istream,
+static int event_state_init(struct event_state *ev, const struct stream_info *istream, int ds_factor,
 	double base_thresh_scale, double base_ord_notch_scale)
 {
-	return event_state_init_priv(ev, DOWNSAMPLED_FS(istream->fs), base_thresh_scale, base_ord_notch_scale);
+	return event_state_init_priv(ev, DOWNSAMPLED_FS(istream->fs, ds_factor), base_thresh_scale, base_ord_notch_scale);
 }
 
-static void event_config_init(struct event_config *evc, const struct stream_info *istream, double rear_ev_mask)
+static void event_config_init(struct event_config *evc, const struct stream_info *istream, int ds_factor, double rear_ev_mask)
 {
-	event_config_init_priv(evc, DOWNSAMPLED_FS(istream->fs), rear_ev_mask, DIFF_OVERSHOOT);
+	event_config_init_priv(evc, DOWNSAMPLED_FS(istream->fs, ds_factor), rear_ev_mask, DIFF_OVERSHOOT);
 }
 
 static void process_events(struct event_state *ev, const struct event_config *evc, const struct envs *env,
@@ -323,220 +322,140 @@ static inline void surr_direct_pan(struct axes *ax, double r[2])
 	}
 }
 
-#if DOWNSAMPLE_FACTOR > 1
-#if CS_INTERP_TYPE == 1
-/* linear */
-#define CS_INTERP_PEEK(s) ((s)->y[1])
-#define CS_INTERP_DELAY_FRAMES (1*DOWNSAMPLE_FACTOR)
-struct cs_interp_state {
-	double c0, y[2];
+/* control-rate clock; tick() returns nonzero once every ds_factor frames */
+struct ctl_clock {
+	int s, n;
+	double t_mult;
 };
 
-static inline void cs_interp_insert(struct cs_interp_state *s, double x)
+static inline void ctl_clock_init(struct ctl_clock *c, int ds_factor)
 {
-	double *y = s->y;
-	y[0] = y[1];
-	y[1] = x;
-	s->c0 = y[1]-y[0];
+	c->s = 0;
+	c->n = ds_factor;
+	c->t_mult = 1.0 / ds_factor;
 }
 
-static inline double cs_interp(const struct cs_interp_state *s, int x)
+static inline int ctl_clock_tick(struct ctl_clock *c)
 {
-	const double t = x * (1.0/DOWNSAMPLE_FACTOR);
-	return s->y[0] + t*s->c0;
+	c->s = (c->s + 1 >= c->n) ? 0 : c->s + 1;
+	return c->s == 0;
 }
+
+/* interpolation position within the current control period */
+#define CTL_CLOCK_T(c) ((c)->s * (c)->t_mult)
+
+/*
+ * Interpolators for control signals. Each is defined for a scalar
+ * (cs_interp) and for a pair of signals (cs_interp2) so that related
+ * coefficients (e.g. a row of the matrix) can be evaluated together. The
+ * argument t is the position within the control period [0, 1).
+*/
+typedef double cs_vec2 __attribute__((vector_size(2*sizeof(double)), aligned(sizeof(double))));
+
+#if CS_INTERP_TYPE == 1
+/* linear */
+#define CS_INTERP_PEEK(s) ((s)->y[1])
+#define CS_INTERP_DELAY_FRAMES(ds) (1*(ds))
+#define CS_INTERP_DEFINE(N, T) \
+	struct N##_state { \
+		T c0, y[2]; \
+	}; \
+	static inline void N##_insert(struct N##_state *s, T x) \
+	{ \
+		T *y = s->y; \
+		y[0] = y[1]; \
+		y[1] = x; \
+		s->c0 = y[1]-y[0]; \
+	} \
+	static inline T N(const struct N##_state *s, double t) \
+	{ \
+		return s->y[0] + t*s->c0; \
+	}
 #elif CS_INTERP_TYPE == 2
 /* parabolic 2x -- Niemitalo, Olli, "Polynomial Interpolators for
  * High-Quality Resampling of Oversampled Audio," October 2001. */
 #define CS_INTERP_PEEK(s) ((s)->y[2])
-#define CS_INTERP_DELAY_FRAMES (3*DOWNSAMPLE_FACTOR)
-struct cs_interp_state {
-	double c[3];
-	double y[4];
-};
-
-static void cs_interp_insert(struct cs_interp_state *s, double x)
-{
-	double *y = s->y, *c = s->c;
-	memmove(y, y+1, sizeof(double)*3);
-	y[3] = x;
-	const double a = y[2]-y[0];
-	c[0] = (1.0/2.0)*y[1] + (1.0/4.0)*(y[0]+y[2]);
-	c[1] = (1.0/2.0)*a;
-	c[2] = (1.0/4.0)*(y[3]-y[1]-a);
-}
-
-static inline double cs_interp(const struct cs_interp_state *s, int x)
-{
-	const double *c = s->c, t = x * (1.0/DOWNSAMPLE_FACTOR);
-	return (c[2]*t+c[1])*t+c[0];
-}
+#define CS_INTERP_DELAY_FRAMES(ds) (3*(ds))
+#define CS_INTERP_DEFINE(N, T) \
+	struct N##_state { \
+		T c[3]; \
+		T y[4]; \
+	}; \
+	static inline void N##_insert(struct N##_state *s, T x) \
+	{ \
+		T *y = s->y, *c = s->c; \
+		memmove(y, y+1, sizeof(T)*3); \
+		y[3] = x; \
+		const T a = y[2]-y[0]; \
+		c[0] = (1.0/2.0)*y[1] + (1.0/4.0)*(y[0]+y[2]); \
+		c[1] = (1.0/2.0)*a; \
+		c[2] = (1.0/4.0)*(y[3]-y[1]-a); \
+	} \
+	static inline T N(const struct N##_state *s, double t) \
+	{ \
+		const T *c = s->c; \
+		return (c[2]*t+c[1])*t+c[0]; \
+	}
 #elif CS_INTERP_TYPE == 3
 /* cubic B-spline */
 #define CS_INTERP_PEEK(s) ((s)->y[2])
-#define CS_INTERP_DELAY_FRAMES (3*DOWNSAMPLE_FACTOR)
-struct cs_interp_state {
-	double c[4];
-	double y[4];
-};
-
-static void cs_interp_insert(struct cs_interp_state *s, double x)
-{
-	double *y = s->y, *c = s->c;
-	memmove(y, y+1, sizeof(double)*3);
-	y[3] = x;
-	const double a = y[0]+y[2];
-	c[0] = (1.0/6.0)*a + (2.0/3.0)*y[1];
-	c[1] = (1.0/2.0)*(y[2]-y[0]);
-	c[2] = (1.0/2.0)*a - y[1];
-	c[3] = (1.0/2.0)*(y[1]-y[2]) + (1.0/6.0)*(y[3]-y[0]);
-}
-
-static inline double cs_interp(const struct cs_interp_state *s, int x)
-{
-	const double *c = s->c, t = x * (1.0/DOWNSAMPLE_FACTOR);
-	return ((c[3]*t+c[2])*t+c[1])*t+c[0];
-}
+#define CS_INTERP_DELAY_FRAMES(ds) (3*(ds))
+#define CS_INTERP_DEFINE(N, T) \
+	struct N##_state { \
+		T c[4]; \
+		T y[4]; \
+	}; \
+	static inline void N##_insert(struct N##_state *s, T x) \
+	{ \
+		T *y = s->y, *c = s->c; \
+		memmove(y, y+1, sizeof(T)*3); \
+		y[3] = x; \
+		const T a = y[0]+y[2]; \
+		c[0] = (1.0/6.0)*a + (2.0/3.0)*y[1]; \
+		c[1] = (1.0/2.0)*(y[2]-y[0]); \
+		c[2] = (1.0/2.0)*a - y[1]; \
+		c[3] = (1.0/2.0)*(y[1]-y[2]) + (1.0/6.0)*(y[3]-y[0]); \
+	} \
+	static inline T N(const struct N##_state *s, double t) \
+	{ \
+		const T *c = s->c; \
+		return ((c[3]*t+c[2])*t+c[1])*t+c[0]; \
+	}
 #elif CS_INTERP_TYPE == 4
 /* cubic Hermite */
 #define CS_INTERP_PEEK(s) ((s)->y[2])
-#define CS_INTERP_DELAY_FRAMES (3*DOWNSAMPLE_FACTOR)
-struct cs_interp_state {
-	double c[4];
-	double y[4];
-};
-
-static void cs_interp_insert(struct cs_interp_state *s, double x)
-{
-	double *y = s->y, *c = s->c;
-	memmove(y, y+1, sizeof(double)*3);
-	y[3] = x;
-	c[0] = y[1];
-	c[1] = (1.0/2.0)*(y[2]-y[0]);
-	c[2] = y[0] - (5.0/2.0)*y[1] + 2.0*y[2] - (1.0/2.0)*y[3];
-	c[3] = (1.0/2.0)*(y[3]-y[0]) + (3.0/2.0)*(y[1]-y[2]);
-}
-
-static inline double cs_interp(const struct cs_interp_state *s, int x)
-{
-	const double *c = s->c, t = x * (1.0/DOWNSAMPLE_FACTOR);
-	return ((c[3]*t+c[2])*t+c[1])*t+c[0];
-}
-#elif CS_INTERP_TYPE == 5
-/* polyphase FIR (Blackman window) */
-#define CS_INTERP_PEEK(s) ((s)->y[DOWNSAMPLE_FACTOR-1])
-#if DOWNSAMPLE_FACTOR == 2
-#define CS_INTERP_DELAY_FRAMES (4*DOWNSAMPLE_FACTOR-1)
-struct cs_interp_state {
-	double y[2], m[12];
-	int p;
-};
-
-static void cs_interp_insert(struct cs_interp_state *state, double x)
-{
-	const double r[6] = {
-		1.070924528086533e-02*x, 5.158730158730156e-02*x,
-		1.349206349206349e-01*x, 2.499999999999999e-01*x,
-		3.543701197984997e-01*x, 3.968253968253968e-01*x,
-	};
-	int p = state->p;
-	double *m = state->m, *y = state->y;
-	y[0]=m[p++]+r[0]; y[1]=m[p++]+r[1];
-	memset(&m[state->p], 0, sizeof(double)*2);
-	if (p==12) p=0;
-	state->p = p;
-	m[p++]+=r[2]; m[p++]+=r[3]; if (p==12) p=0;
-	m[p++]+=r[4]; m[p++]+=r[5]; if (p==12) p=0;
-	m[p++]+=r[4]; m[p++]+=r[3]; if (p==12) p=0;
-	m[p++]+=r[2]; m[p++]+=r[1]; if (p==12) p=0;
-	m[p++]+=r[0];
-}
-#elif DOWNSAMPLE_FACTOR == 4
-#define CS_INTERP_DELAY_FRAMES (3*DOWNSAMPLE_FACTOR-1)
-struct cs_interp_state {
-	double y[4], m[16];
-	int p;
-};
-
-static void cs_interp_insert(struct cs_interp_state *state, double x)
-{
-	const double r[8] = {
-		8.707604904333586e-03*x, 3.955155321828940e-02*x,
-		1.024343698348400e-01*x, 2.023809523809523e-01*x,
-		3.302221271950125e-01*x, 4.604484467817105e-01*x,
-		5.586358980658138e-01*x, 5.952380952380951e-01*x,
-	};
-	int p = state->p;
-	double *m = state->m, *y = state->y;
-	y[0]=m[p++]+r[0]; y[1]=m[p++]+r[1]; y[2]=m[p++]+r[2]; y[3]=m[p++]+r[3];
-	memset(&m[state->p], 0, sizeof(double)*4);
-	p &= 0xf;
-	state->p = p;
-	m[p++]+=r[4]; m[p++]+=r[5]; m[p++]+=r[6]; m[p++]+=r[7];
-	p &= 0xf;
-	m[p++]+=r[6]; m[p++]+=r[5]; m[p++]+=r[4]; m[p++]+=r[3];
-	p &= 0xf;
-	m[p++]+=r[2]; m[p++]+=r[1]; m[p++]+=r[0];
-}
-#elif DOWNSAMPLE_FACTOR == 8
-#define CS_INTERP_DELAY_FRAMES (3*DOWNSAMPLE_FACTOR-1)
-struct cs_interp_state {
-	double y[8], m[32];
-	int p;
-};
-
-static void cs_interp_insert(struct cs_interp_state *state, double x)
-{
-	const double r[16] = {
-		2.093882380528402e-03*x, 8.707604904333586e-03*x,
-		2.076182645115152e-02*x, 3.955155321828940e-02*x,
-		6.642869577439980e-02*x, 1.024343698348400e-01*x,
-		1.479431407089482e-01*x, 2.023809523809523e-01*x,
-		2.640683323852150e-01*x, 3.302221271950125e-01*x,
-		3.971252630479725e-01*x, 4.604484467817105e-01*x,
-		5.156842147264761e-01*x, 5.586358980658138e-01*x,
-		5.858946445253084e-01*x, 5.952380952380952e-01*x,
-	};
-	int p = state->p;
-	double *m = state->m, *y = state->y;
-	y[0]=m[p++]+r[0]; y[1]=m[p++]+r[1]; y[2]=m[p++]+r[2]; y[3]=m[p++]+r[3];
-	y[4]=m[p++]+r[4]; y[5]=m[p++]+r[5]; y[6]=m[p++]+r[6]; y[7]=m[p++]+r[7];
-	memset(&m[state->p], 0, sizeof(double)*8);
-	p &= 0x1f;
-	state->p = p;
-	m[p++]+=r[8];  m[p++]+=r[9];  m[p++]+=r[10]; m[p++]+=r[11];
-	m[p++]+=r[12]; m[p++]+=r[13]; m[p++]+=r[14]; m[p++]+=r[15];
-	p &= 0x1f;
-	m[p++]+=r[14]; m[p++]+=r[13]; m[p++]+=r[12]; m[p++]+=r[11];
-	m[p++]+=r[10]; m[p++]+=r[9];  m[p++]+=r[8];  m[p++]+=r[7];
-	p &= 0x1f;
-	m[p++]+=r[6]; m[p++]+=r[5]; m[p++]+=r[4]; m[p++]+=r[3];
-	m[p++]+=r[2]; m[p++]+=r[1]; m[p++]+=r[0];
-}
-#else
-	#error "unsupported DOWNSAMPLE_FACTOR"
-#endif
-static inline double cs_interp(const struct cs_interp_state *state, int x)
-{
-	return state->y[x];
-}
+#define CS_INTERP_DELAY_FRAMES(ds) (3*(ds))
+#define CS_INTERP_DEFINE(N, T) \
+	struct N##_state { \
+		T c[4]; \
+		T y[4]; \
+	}; \
+	static inline void N##_insert(struct N##_state *s, T x) \
+	{ \
+		T *y = s->y, *c = s->c; \
+		memmove(y, y+1, sizeof(T)*3); \
+		y[3] = x; \
+		c[0] = y[1]; \
+		c[1] = (1.0/2.0)*(y[2]-y[0]); \
+		c[2] = y[0] - (5.0/2.0)*y[1] + 2.0*y[2] - (1.0/2.0)*y[3]; \
+		c[3] = (1.0/2.0)*(y[3]-y[0]) + (3.0/2.0)*(y[1]-y[2]); \
+	} \
+	static inline T N(const struct N##_state *s, double t) \
+	{ \
+		const T *c = s->c; \
+		return ((c[3]*t+c[2])*t+c[1])*t+c[0]; \
+	}
 #else
 	#error "illegal CS_INTERP_TYPE"
 #endif
+CS_INTERP_DEFINE(cs_interp, double)
+CS_INTERP_DEFINE(cs_interp2, cs_vec2)
+#undef CS_INTERP_DEFINE
+
 static inline void cs_interp_set(struct cs_interp_state *s, double x)
 {
 	for (int i = 0; i < LENGTH(s->y); ++i) cs_interp_insert(s, x);
 }
-#else
-/* dummy definitions for DOWNSAMPLE_FACTOR=1 */
-struct cs_interp_state {
-	double m;
-};
-#define cs_interp_insert(s, x) do { (s)->m = x; } while(0)
-#define cs_interp(s, x) ((s)->m)
-#define cs_interp_set(s, x) cs_interp_insert(s, x)
-#define CS_INTERP_PEEK(s) ((s)->m)
-#endif
 #endif /* DSP_MATRIX4_COMMON_H_NO_STATIC_FUNCTIONS */
 
 #endif
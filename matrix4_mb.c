@@ -28,7 +28,6 @@
 #include "fir.h"
 #include "smf.h"
 
-#define DOWNSAMPLE_FACTOR 32
 #define NORM_ACCOM_FACTOR 0.6
 #define DIFF_OVERSHOOT    1.01
 #include "matrix4_common.h"
@@ -73,23 +72,49 @@ struct fshape_state {
 	struct biquad_state lf, hf;
 };
 
+/*
+ * The filter bank runs both input channels in lockstep: lane 0 is c0 and
+ * lane 1 is c1. The coefficients are shared, so each section is a scalar
+ * by vector operation with the same arithmetic as ap2_run()/cap5_run().
+*/
+typedef sample_t fb_vec __attribute__((vector_size(2*sizeof(sample_t)), aligned(sizeof(sample_t))));
+
+struct fb_ap1_state {
+	sample_t c0;
+	fb_vec i0, o0;
+};
+
+struct fb_ap2_state {
+	sample_t c0, c1;
+	fb_vec i0, o0, i1, o1;
+};
+
+struct fb_cap5_state {
+	struct fb_ap2_state a1, a2;
+	struct fb_ap1_state a3;
+};
+
 struct filter_bank_frame {
-	sample_t s[N_BANDS];
+	fb_vec s[N_BANDS];
 };
 
 struct filter_bank {
-	struct cap5_state f[LENGTH(fb_fdiv)];
-	struct ap2_state ap[LENGTH(fb_ap_idx)];
-	sample_t s[N_BANDS];
+	struct fb_cap5_state f[LENGTH(fb_fdiv)];
+	struct fb_ap2_state ap[LENGTH(fb_ap_idx)];
+	fb_vec s[N_BANDS];
+};
+
+struct fb_smooth_state {
+	double g0;
+	fb_vec env[2], pwr_env[2];  /* {l, r}, {sum, diff} */
 };
 
 struct matrix4_band {
-	struct smooth_state sm;
+	struct fb_smooth_state sm;
 	struct event_state ev;
 	struct axes ax, ax_ev, ax_dpwr;
 	struct {
-		struct cs_interp_state ll, lr, rl, rr;
-		struct cs_interp_state lsl, lsr, rsl, rsr;
+		struct cs_interp2_state l, r, ls, rs;  /* matrix rows: {ll, lr}, {rl, rr}, etc. */
 	} m_interp;
 	struct cs_interp_state pf_ap_c0[2];
 	struct ap1_state pf_ap[2];
@@ -107,13 +132,14 @@ struct matrix4_band {
 };
 
 struct matrix4_mb_state {
-	int s, c0, c1;
+	int c0, c1;
 	char disable, do_phase_flip, do_direct_path, do_dpwr_decouple;
 	enum status_type status_type;
+	struct ctl_clock clk;
 	struct fshape_state fshape[2], inv_fshape[6];
-	struct filter_bank fb[2];
+	struct filter_bank fb;
 	struct matrix4_band band[N_BANDS];
-	struct filter_bank_frame *fb_buf[2];
+	struct filter_bank_frame *fb_buf;
 	struct event_config evc;
 	struct phase_flip_params pf_params;
 	calc_matrix_coefs_func calc_matrix_coefs;
@@ -147,8 +173,66 @@ static inline sample_t fshape_run(struct fshape_state *state, sample_t s)
 	return biquad(&state->hf, biquad(&state->lf, s));
 }
 
+static inline fb_vec fb_ap1_run(struct fb_ap1_state *state, fb_vec s)
+{
+	fb_vec r = state->i0
+		+ state->c0 * (s - state->o0);
+
+	state->i0 = s;
+	state->o0 = r;
+
+	return r;
+}
+
+static inline fb_vec fb_ap2_run(struct fb_ap2_state *state, fb_vec s)
+{
+	fb_vec r = state->i1
+		+ state->c0 * (state->i0 - state->o0)
+		+ state->c1 * (s - state->o1);
+
+	state->i1 = state->i0;
+	state->i0 = s;
+
+	state->o1 = state->o0;
+	state->o0 = r;
+
+	return r;
+}
+
+static inline void fb_cap5_run(struct fb_cap5_state *state, fb_vec s, fb_vec *lp, fb_vec *hp)
+{
+	fb_vec a1 = fb_ap2_run(&state->a1, s);
+	fb_vec a2 = fb_ap1_run(&state->a3, fb_ap2_run(&state->a2, s));
+	*lp = (a1+a2)*0.5;
+	*hp = (a1-a2)*0.5;
+}
+
+static inline void fb_ap1_reset(struct fb_ap1_state *state)
+{
+	state->i0 = state->o0 = (fb_vec) { 0.0, 0.0 };
+}
+
+static inline void fb_ap2_reset(struct fb_ap2_state *state)
+{
+	state->i0 = state->i1 = (fb_vec) { 0.0, 0.0 };
+	state->o0 = state->o1 = (fb_vec) { 0.0, 0.0 };
+}
+
+static void filter_bank_reset(struct filter_bank *fb)
+{
+	for (int i = 0; i < LENGTH(fb_fdiv); ++i) {
+		fb_ap2_reset(&fb->f[i].a1);
+		fb_ap2_reset(&fb->f[i].a2);
+		fb_ap1_reset(&fb->f[i].a3);
+	}
+	for (int i = 0; i < LENGTH(fb_ap_idx); ++i)
+		fb_ap2_reset(&fb->ap[i]);
+	memset(fb->s, 0, sizeof(fb->s));
+}
+
 static void filter_bank_init(struct filter_bank *fb, double fs, enum filter_bank_type fb_type, double fb_stop[2])
 {
+	struct cap5_state cap5;
 	double complex ap[3];
 	switch (fb_type) {
 	case FILTER_BANK_TYPE_BUTTERWORTH:
@@ -164,149 +248,186 @@ static void filter_bank_init(struct filter_bank *fb, double fs, enum filter_bank
 		cap5_elliptic_ap(fb_stop[0], fb_stop[1], ap);
 		break;
 	}
-	for (int i = 0; i < LENGTH(fb_fdiv); ++i)
-		cap5_init(&fb->f[i], fs, fb_fdiv[i], ap);
+	for (int i = 0; i < LENGTH(fb_fdiv); ++i) {
+		cap5_init(&cap5, fs, fb_fdiv[i], ap);
+		fb->f[i].a1.c0 = cap5.a1.c0;
+		fb->f[i].a1.c1 = cap5.a1.c1;
+		fb->f[i].a2.c0 = cap5.a2.ap2.c0;
+		fb->f[i].a2.c1 = cap5.a2.ap2.c1;
+		fb->f[i].a3.c0 = cap5.a2.ap1.c0;
+	}
 	for (int i = 0; i < LENGTH(fb_ap_idx); ++i)
 		fb->ap[i] = fb->f[fb_ap_idx[i]].a1;
+	filter_bank_reset(fb);
 }
 
-static void filter_bank_run(struct filter_bank *fb, sample_t s)
+static void filter_bank_run(struct filter_bank *fb, fb_vec s)
 {
 #if N_BANDS == 11
-	cap5_run(&fb->f[4], s, &fb->s[4], &fb->s[5]);  /* split at xover 4 (1244.5Hz) */
-	fb->s[4] = ap2_run(&fb->ap[0], fb->s[4]);  /* xover 5 ap */
-	fb->s[4] = ap2_run(&fb->ap[1], fb->s[4]);  /* xover 6 ap */
-	fb->s[4] = ap2_run(&fb->ap[2], fb->s[4]);  /* xover 7 ap */
-	fb->s[4] = ap2_run(&fb->ap[3], fb->s[4]);  /* xover 8 ap */
-	fb->s[4] = ap2_run(&fb->ap[4], fb->s[4]);  /* xover 9 ap */
-	fb->s[5] = ap2_run(&fb->ap[5], fb->s[5]);  /* xover 3 ap */
-	fb->s[5] = ap2_run(&fb->ap[6], fb->s[5]);  /* xover 2 ap */
-	fb->s[5] = ap2_run(&fb->ap[7], fb->s[5]);  /* xover 1 ap */
-	fb->s[5] = ap2_run(&fb->ap[8], fb->s[5]);  /* xover 0 ap */
+	fb_cap5_run(&fb->f[4], s, &fb->s[4], &fb->s[5]);  /* split at xover 4 (1244.5Hz) */
+	fb->s[4] = fb_ap2_run(&fb->ap[0], fb->s[4]);  /* xover 5 ap */
+	fb->s[4] = fb_ap2_run(&fb->ap[1], fb->s[4]);  /* xover 6 ap */
+	fb->s[4] = fb_ap2_run(&fb->ap[2], fb->s[4]);  /* xover 7 ap */
+	fb->s[4] = fb_ap2_run(&fb->ap[3], fb->s[4]);  /* xover 8 ap */
+	fb->s[4] = fb_ap2_run(&fb->ap[4], fb->s[4]);  /* xover 9 ap */
+	fb->s[5] = fb_ap2_run(&fb->ap[5], fb->s[5]);  /* xover 3 ap */
+	fb->s[5] = fb_ap2_run(&fb->ap[6], fb->s[5]);  /* xover 2 ap */
+	fb->s[5] = fb_ap2_run(&fb->ap[7], fb->s[5]);  /* xover 1 ap */
+	fb->s[5] = fb_ap2_run(&fb->ap[8], fb->s[5]);  /* xover 0 ap */
 
-	cap5_run(&fb->f[1], fb->s[4], &fb->s[1], &fb->s[2]);  /* split at xover 1 (329.29Hz) */
-	fb->s[1] = ap2_run(&fb->ap[9], fb->s[1]);  /* xover 2 ap */
-	fb->s[1] = ap2_run(&fb->ap[10], fb->s[1]);  /* xover 3 ap */
-	fb->s[2] = ap2_run(&fb->ap[11], fb->s[2]);  /* xover 0 ap */
+	fb_cap5_run(&fb->f[1], fb->s[4], &fb->s[1], &fb->s[2]);  /* split at xover 1 (329.29Hz) */
+	fb->s[1] = fb_ap2_run(&fb->ap[9], fb->s[1]);  /* xover 2 ap */
+	fb->s[1] = fb_ap2_run(&fb->ap[10], fb->s[1]);  /* xover 3 ap */
+	fb->s[2] = fb_ap2_run(&fb->ap[11], fb->s[2]);  /* xover 0 ap */
 
-	cap5_run(&fb->f[0], fb->s[1], &fb->s[0], &fb->s[1]);  /* split at xover 0 (175Hz) */
+	fb_cap5_run(&fb->f[0], fb->s[1], &fb->s[0], &fb->s[1]);  /* split at xover 0 (175Hz) */
 
-	cap5_run(&fb->f[2], fb->s[2], &fb->s[2], &fb->s[3]);  /* split at xover 2 (542.52Hz) */
-	fb->s[2] = ap2_run(&fb->ap[12], fb->s[2]);  /* xover 3 ap */
+	fb_cap5_run(&fb->f[2], fb->s[2], &fb->s[2], &fb->s[3]);  /* split at xover 2 (542.52Hz) */
+	fb->s[2] = fb_ap2_run(&fb->ap[12], fb->s[2]);  /* xover 3 ap */
 
-	cap5_run(&fb->f[3], fb->s[3], &fb->s[3], &fb->s[4]);  /* split at xover 3 (837.21Hz) */
+	fb_cap5_run(&fb->f[3], fb->s[3], &fb->s[3], &fb->s[4]);  /* split at xover 3 (837.21Hz) */
 
-	cap5_run(&fb->f[7], fb->s[5], &fb->s[7], &fb->s[8]);  /* split at xover 7 (3660.5Hz) */
-	fb->s[7] = ap2_run(&fb->ap[13], fb->s[7]);  /* xover 8 ap */
-	fb->s[7] = ap2_run(&fb->ap[14], fb->s[7]);  /* xover 9 ap */
-	fb->s[8] = ap2_run(&fb->ap[15], fb->s[8]);  /* xover 6 ap */
-	fb->s[8] = ap2_run(&fb->ap[16], fb->s[8]);  /* xover 5 ap */
+	fb_cap5_run(&fb->f[7], fb->s[5], &fb->s[7], &fb->s[8]);  /* split at xover 7 (3660.5Hz) */
+	fb->s[7] = fb_ap2_run(&fb->ap[13], fb->s[7]);  /* xover 8 ap */
+	fb->s[7] = fb_ap2_run(&fb->ap[14], fb->s[7]);  /* xover 9 ap */
+	fb->s[8] = fb_ap2_run(&fb->ap[15], fb->s[8]);  /* xover 6 ap */
+	fb->s[8] = fb_ap2_run(&fb->ap[16], fb->s[8]);  /* xover 5 ap */
 
-	cap5_run(&fb->f[5], fb->s[7], &fb->s[5], &fb->s[6]);  /* split at xover 5 (1807.4Hz) */
-	fb->s[5] = ap2_run(&fb->ap[17], fb->s[5]);  /* xover 6 ap */
+	fb_cap5_run(&fb->f[5], fb->s[7], &fb->s[5], &fb->s[6]);  /* split at xover 5 (1807.4Hz) */
+	fb->s[5] = fb_ap2_run(&fb->ap[17], fb->s[5]);  /* xover 6 ap */
 
-	cap5_run(&fb->f[6], fb->s[6], &fb->s[6], &fb->s[7]);  /* split at xover 6 (2585.3Hz) */
+	fb_cap5_run(&fb->f[6], fb->s[6], &fb->s[6], &fb->s[7]);  /* split at xover 6 (2585.3Hz) */
 
-	cap5_run(&fb->f[8], fb->s[8], &fb->s[8], &fb->s[9]);  /* split at xover 8 (5146.4Hz) */
-	fb->s[8] = ap2_run(&fb->ap[18], fb->s[8]);  /* xover 9 ap */
+	fb_cap5_run(&fb->f[8], fb->s[8], &fb->s[8], &fb->s[9]);  /* split at xover 8 (5146.4Hz) */
+	fb->s[8] = fb_ap2_run(&fb->ap[18], fb->s[8]);  /* xover 9 ap */
 
-	cap5_run(&fb->f[9], fb->s[9], &fb->s[9], &fb->s[10]);  /* split at xover 9 (7200Hz) */
+	fb_cap5_run(&fb->f[9], fb->s[9], &fb->s[9], &fb->s[10]);  /* split at xover 9 (7200Hz) */
 #elif N_BANDS == 12
-	cap5_run(&fb->f[5], s, &fb->s[5], &fb->s[6]);  /* split at xover 5 (1807.4Hz) */
-	fb->s[5] = ap2_run(&fb->ap[0], fb->s[5]);  /* xover 6 ap */
-	fb->s[5] = ap2_run(&fb->ap[1], fb->s[5]);  /* xover 7 ap */
-	fb->s[5] = ap2_run(&fb->ap[2], fb->s[5]);  /* xover 8 ap */
-	fb->s[5] = ap2_run(&fb->ap[3], fb->s[5]);  /* xover 9 ap */
-	fb->s[5] = ap2_run(&fb->ap[4], fb->s[5]);  /* xover 10 ap */
-	fb->s[6] = ap2_run(&fb->ap[5], fb->s[6]);  /* xover 4 ap */
-	fb->s[6] = ap2_run(&fb->ap[6], fb->s[6]);  /* xover 3 ap */
-	fb->s[6] = ap2_run(&fb->ap[7], fb->s[6]);  /* xover 2 ap */
-	fb->s[6] = ap2_run(&fb->ap[8], fb->s[6]);  /* xover 1 ap */
-	fb->s[6] = ap2_run(&fb->ap[9], fb->s[6]);  /* xover 0 ap */
+	fb_cap5_run(&fb->f[5], s, &fb->s[5], &fb->s[6]);  /* split at xover 5 (1807.4Hz) */
+	fb->s[5] = fb_ap2_run(&fb->ap[0], fb->s[5]);  /* xover 6 ap */
+	fb->s[5] = fb_ap2_run(&fb->ap[1], fb->s[5]);  /* xover 7 ap */
+	fb->s[5] = fb_ap2_run(&fb->ap[2], fb->s[5]);  /* xover 8 ap */
+	fb->s[5] = fb_ap2_run(&fb->ap[3], fb->s[5]);  /* xover 9 ap */
+	fb->s[5] = fb_ap2_run(&fb->ap[4], fb->s[5]);  /* xover 10 ap */
+	fb->s[6] = fb_ap2_run(&fb->ap[5], fb->s[6]);  /* xover 4 ap */
+	fb->s[6] = fb_ap2_run(&fb->ap[6], fb->s[6]);  /* xover 3 ap */
+	fb->s[6] = fb_ap2_run(&fb->ap[7], fb->s[6]);  /* xover 2 ap */
+	fb->s[6] = fb_ap2_run(&fb->ap[8], fb->s[6]);  /* xover 1 ap */
+	fb->s[6] = fb_ap2_run(&fb->ap[9], fb->s[6]);  /* xover 0 ap */
 
-	cap5_run(&fb->f[2], fb->s[5], &fb->s[2], &fb->s[3]);  /* split at xover 2 (542.52Hz) */
-	fb->s[2] = ap2_run(&fb->ap[10], fb->s[2]);  /* xover 3 ap */
-	fb->s[2] = ap2_run(&fb->ap[11], fb->s[2]);  /* xover 4 ap */
-	fb->s[3] = ap2_run(&fb->ap[12], fb->s[3]);  /* xover 1 ap */
-	fb->s[3] = ap2_run(&fb->ap[13], fb->s[3]);  /* xover 0 ap */
+	fb_cap5_run(&fb->f[2], fb->s[5], &fb->s[2], &fb->s[3]);  /* split at xover 2 (542.52Hz) */
+	fb->s[2] = fb_ap2_run(&fb->ap[10], fb->s[2]);  /* xover 3 ap */
+	fb->s[2] = fb_ap2_run(&fb->ap[11], fb->s[2]);  /* xover 4 ap */
+	fb->s[3] = fb_ap2_run(&fb->ap[12], fb->s[3]);  /* xover 1 ap */
+	fb->s[3] = fb_ap2_run(&fb->ap[13], fb->s[3]);  /* xover 0 ap */
 
-	cap5_run(&fb->f[0], fb->s[2], &fb->s[0], &fb->s[1]);  /* split at xover 0 (175Hz) */
-	fb->s[0] = ap2_run(&fb->ap[14], fb->s[0]);  /* xover 1 ap */
+	fb_cap5_run(&fb->f[0], fb->s[2], &fb->s[0], &fb->s[1]);  /* split at xover 0 (175Hz) */
+	fb->s[0] = fb_ap2_run(&fb->ap[14], fb->s[0]);  /* xover 1 ap */
 
-	cap5_run(&fb->f[1], fb->s[1], &fb->s[1], &fb->s[2]);  /* split at xover 1 (329.29Hz) */
+	fb_cap5_run(&fb->f[1], fb->s[1], &fb->s[1], &fb->s[2]);  /* split at xover 1 (329.29Hz) */
 
-	cap5_run(&fb->f[3], fb->s[3], &fb->s[3], &fb->s[4]);  /* split at xover 3 (837.21Hz) */
-	fb->s[3] = ap2_run(&fb->ap[15], fb->s[3]);  /* xover 4 ap */
+	fb_cap5_run(&fb->f[3], fb->s[3], &fb->s[3], &fb->s[4]);  /* split at xover 3 (837.21Hz) */
+	fb->s[3] = fb_ap2_run(&fb->ap[15], fb->s[3]);  /* xover 4 ap */
 
-	cap5_run(&fb->f[4], fb->s[4], &fb->s[4], &fb->s[5]);  /* split at xover 4 (1244.5Hz) */
+	fb_cap5_run(&fb->f[4], fb->s[4], &fb->s[4], &fb->s[5]);  /* split at xover 4 (1244.5Hz) */
 
-	cap5_run(&fb->f[8], fb->s[6], &fb->s[8], &fb->s[9]);  /* split at xover 8 (5146.4Hz) */
-	fb->s[8] = ap2_run(&fb->ap[16], fb->s[8]);  /* xover 9 ap */
-	fb->s[8] = ap2_run(&fb->ap[17], fb->s[8]);  /* xover 10 ap */
-	fb->s[9] = ap2_run(&fb->ap[18], fb->s[9]);  /* xover 7 ap */
-	fb->s[9] = ap2_run(&fb->ap[19], fb->s[9]);  /* xover 6 ap */
+	fb_cap5_run(&fb->f[8], fb->s[6], &fb->s[8], &fb->s[9]);  /* split at xover 8 (5146.4Hz) */
+	fb->s[8] = fb_ap2_run(&fb->ap[16], fb->s[8]);  /* xover 9 ap */
+	fb->s[8] = fb_ap2_run(&fb->ap[17], fb->s[8]);  /* xover 10 ap */
+	fb->s[9] = fb_ap2_run(&fb->ap[18], fb->s[9]);  /* xover 7 ap */
+	fb->s[9] = fb_ap2_run(&fb->ap[19], fb->s[9]);  /* xover 6 ap */
 
-	cap5_run(&fb->f[6], fb->s[8], &fb->s[6], &fb->s[7]);  /* split at xover 6 (2585.3Hz) */
-	fb->s[6] = ap2_run(&fb->ap[20], fb->s[6]);  /* xover 7 ap */
+	fb_cap5_run(&fb->f[6], fb->s[8], &fb->s[6], &fb->s[7]);  /* split at xover 6 (2585.3Hz) */
+	fb->s[6] = fb_ap2_run(&fb->ap[20], fb->s[6]);  /* xover 7 ap */
 
-	cap5_run(&fb->f[7], fb->s[7], &fb->s[7], &fb->s[8]);  /* split at xover 7 (3660.5Hz) */
+	fb_cap5_run(&fb->f[7], fb->s[7], &fb->s[7], &fb->s[8]);  /* split at xover 7 (3660.5Hz) */
 
-	cap5_run(&fb->f[9], fb->s[9], &fb->s[9], &fb->s[10]);  /* split at xover 9 (7200Hz) */
-	fb->s[9] = ap2_run(&fb->ap[21], fb->s[9]);  /* xover 10 ap */
+	fb_cap5_run(&fb->f[9], fb->s[9], &fb->s[9], &fb->s[10]);  /* split at xover 9 (7200Hz) */
+	fb->s[9] = fb_ap2_run(&fb->ap[21], fb->s[9]);  /* xover 10 ap */
 
-	cap5_run(&fb->f[10], fb->s[10], &fb->s[10], &fb->s[11]);  /* split at xover 10 (10038Hz) */
+	fb_cap5_run(&fb->f[10], fb->s[10], &fb->s[10], &fb->s[11]);  /* split at xover 10 (10038Hz) */
 #elif N_BANDS == 13
-	cap5_run(&fb->f[5], s, &fb->s[5], &fb->s[6]);  /* split at xover 5 (1675.4Hz) */
-	fb->s[5] = ap2_run(&fb->ap[0], fb->s[5]);  /* xover 6 ap */
-	fb->s[5] = ap2_run(&fb->ap[1], fb->s[5]);  /* xover 7 ap */
-	fb->s[5] = ap2_run(&fb->ap[2], fb->s[5]);  /* xover 8 ap */
-	fb->s[5] = ap2_run(&fb->ap[3], fb->s[5]);  /* xover 9 ap */
-	fb->s[5] = ap2_run(&fb->ap[4], fb->s[5]);  /* xover 10 ap */
-	fb->s[5] = ap2_run(&fb->ap[5], fb->s[5]);  /* xover 11 ap */
-	fb->s[6] = ap2_run(&fb->ap[6], fb->s[6]);  /* xover 4 ap */
-	fb->s[6] = ap2_run(&fb->ap[7], fb->s[6]);  /* xover 3 ap */
-	fb->s[6] = ap2_run(&fb->ap[8], fb->s[6]);  /* xover 2 ap */
-	fb->s[6] = ap2_run(&fb->ap[9], fb->s[6]);  /* xover 1 ap */
-	fb->s[6] = ap2_run(&fb->ap[10], fb->s[6]);  /* xover 0 ap */
-
-	cap5_run(&fb->f[2], fb->s[5], &fb->s[2], &fb->s[3]);  /* split at xover 2 (516.52Hz) */
-	fb->s[2] = ap2_run(&fb->ap[11], fb->s[2]);  /* xover 3 ap */
-	fb->s[2] = ap2_run(&fb->ap[12], fb->s[2]);  /* xover 4 ap */
-	fb->s[3] = ap2_run(&fb->ap[13], fb->s[3]);  /* xover 1 ap */
-	fb->s[3] = ap2_run(&fb->ap[14], fb->s[3]);  /* xover 0 ap */
-
-	cap5_run(&fb->f[0], fb->s[2], &fb->s[0], &fb->s[1]);  /* split at xover 0 (170Hz) */
-	fb->s[0] = ap2_run(&fb->ap[15], fb->s[0]);  /* xover 1 ap */
-
-	cap5_run(&fb->f[1], fb->s[1], &fb->s[1], &fb->s[2]);  /* split at xover 1 (316.39Hz) */
-
-	cap5_run(&fb->f[3], fb->s[3], &fb->s[3], &fb->s[4]);  /* split at xover 3 (790.1Hz) */
-	fb->s[3] = ap2_run(&fb->ap[16], fb->s[3]);  /* xover 4 ap */
-
-	cap5_run(&fb->f[4], fb->s[4], &fb->s[4], &fb->s[5]);  /* split at xover 4 (1164.1Hz) */
-
-	cap5_run(&fb->f[8], fb->s[6], &fb->s[8], &fb->s[9]);  /* split at xover 8 (4636.1Hz) */
-	fb->s[8] = ap2_run(&fb->ap[17], fb->s[8]);  /* xover 9 ap */
-	fb->s[8] = ap2_run(&fb->ap[18], fb->s[8]);  /* xover 10 ap */
-	fb->s[8] = ap2_run(&fb->ap[19], fb->s[8]);  /* xover 11 ap */
-	fb->s[9] = ap2_run(&fb->ap[20], fb->s[9]);  /* xover 7 ap */
-	fb->s[9] = ap2_run(&fb->ap[21], fb->s[9]);  /* xover 6 ap */
-
-	cap5_run(&fb->f[6], fb->s[8], &fb->s[6], &fb->s[7]);  /* split at xover 6 (2374.3Hz) */
-	fb->s[6] = ap2_run(&fb->ap[22], fb->s[6]);  /* xover 7 ap */
-
-	cap5_run(&fb->f[7], fb->s[7], &fb->s[7], &fb->s[8]);  /* split at xover 7 (3329.8Hz) */
-
-	cap5_run(&fb->f[10], fb->s[9], &fb->s[10], &fb->s[11]);  /* split at xover 10 (8862.9Hz) */
-	fb->s[10] = ap2_run(&fb->ap[23], fb->s[10]);  /* xover 11 ap */
-	fb->s[11] = ap2_run(&fb->ap[24], fb->s[11]);  /* xover 9 ap */
-
-	cap5_run(&fb->f[9], fb->s[10], &fb->s[9], &fb->s[10]);  /* split at xover 9 (6421.7Hz) */
-
-	cap5_run(&fb->f[11], fb->s[11], &fb->s[11], &fb->s[12]);  /* split at xover 11 (12200Hz) */
+	fb_cap5_run(&fb->f[5], s, &fb->s[5], &fb->s[6]);  /* split at xover 5 (1675.4Hz) */
+	fb->s[5] = fb_ap2_run(&fb->ap[0], fb->s[5]);  /* xover 6 ap */
+	fb->s[5] = fb_ap2_run(&fb->ap[1], fb->s[5]);  /* xover 7 ap */
+	fb->s[5] = fb_ap2_run(&fb->ap[2], fb->s[5]);  /* xover 8 ap */
+	fb->s[5] = fb_ap2_run(&fb->ap[3], fb->s[5]);  /* xover 9 ap */
+	fb->s[5] = fb_ap2_run(&fb->ap[4], fb->s[5]);  /* xover 10 ap */
+	fb->s[5] = fb_ap2_run(&fb->ap[5], fb->s[5]);  /* xover 11 ap */
+	fb->s[6] = fb_ap2_run(&fb->ap[6], fb->s[6]);  /* xover 4 ap */
+	fb->s[6] = fb_ap2_run(&fb->ap[7], fb->s[6]);  /* xover 3 ap */
+	fb->s[6] = fb_ap2_run(&fb->ap[8], fb->s[6]);  /* xover 2 ap */
+	fb->s[6] = fb_ap2_run(&fb->ap[9], fb->s[6]);  /* xover 1 ap */
+	fb->s[6] = fb_ap2_run(&fb->ap[10], fb->s[6]);  /* xover 0 ap */
+
+	fb_cap5_run(&fb->f[2], fb->s[5], &fb->s[2], &fb->s[3]);  /* split at xover 2 (516.52Hz) */
+	fb->s[2] = fb_ap2_run(&fb->ap[11], fb->s[2]);  /* xover 3 ap */
+	fb->s[2] = fb_ap2_run(&fb->ap[12], fb->s[2]);  /* xover 4 ap */
+	fb->s[3] = fb_ap2_run(&fb->ap[13], fb->s[3]);  /* xover 1 ap */
+	fb->s[3] = fb_ap2_run(&fb->ap[14], fb->s[3]);  /* xover 0 ap */
+
+	fb_cap5_run(&fb->f[0], fb->s[2], &fb->s[0], &fb->s[1]);  /* split at xover 0 (170Hz) */
+	fb->s[0] = fb_ap2_run(&fb->ap[15], fb->s[0]);  /* xover 1 ap */
+
+	fb_cap5_run(&fb->f[1], fb->s[1], &fb->s[1], &fb->s[2]);  /* split at xover 1 (316.39Hz) */
+
+	fb_cap5_run(&fb->f[3], fb->s[3], &fb->s[3], &fb->s[4]);  /* split at xover 3 (790.1Hz) */
+	fb->s[3] = fb_ap2_run(&fb->ap[16], fb->s[3]);  /* xover 4 ap */
+
+	fb_cap5_run(&fb->f[4], fb->s[4], &fb->s[4], &fb->s[5]);  /* split at xover 4 (1164.1Hz) */
+
+	fb_cap5_run(&fb->f[8], fb->s[6], &fb->s[8], &fb->s[9]);  /* split at xover 8 (4636.1Hz) */
+	fb->s[8] = fb_ap2_run(&fb->ap[17], fb->s[8]);  /* xover 9 ap */
+	fb->s[8] = fb_ap2_run(&fb->ap[18], fb->s[8]);  /* xover 10 ap */
+	fb->s[8] = fb_ap2_run(&fb->ap[19], fb->s[8]);  /* xover 11 ap */
+	fb->s[9] = fb_ap2_run(&fb->ap[20], fb->s[9]);  /* xover 7 ap */
+	fb->s[9] = fb_ap2_run(&fb->ap[21], fb->s[9]);  /* xover 6 ap */
+
+	fb_cap5_run(&fb->f[6], fb->s[8], &fb->s[6], &fb->s[7]);  /* split at xover 6 (2374.3Hz) */
+	fb->s[6] = fb_ap2_run(&fb->ap[22], fb->s[6]);  /* xover 7 ap */
+
+	fb_cap5_run(&fb->f[7], fb->s[7], &fb->s[7], &fb->s[8]);  /* split at xover 7 (3329.8Hz) */
+
+	fb_cap5_run(&fb->f[10], fb->s[9], &fb->s[10], &fb->s[11]);  /* split at xover 10 (8862.9Hz) */
+	fb->s[10] = fb_ap2_run(&fb->ap[23], fb->s[10]);  /* xover 11 ap */
+	fb->s[11] = fb_ap2_run(&fb->ap[24], fb->s[11]);  /* xover 9 ap */
+
+	fb_cap5_run(&fb->f[9], fb->s[10], &fb->s[9], &fb->s[10]);  /* split at xover 9 (6421.7Hz) */
+
+	fb_cap5_run(&fb->f[11], fb->s[11], &fb->s[11], &fb->s[12]);  /* split at xover 11 (12200Hz) */
 #endif
 }
 
+static void fb_smooth_state_init(struct fb_smooth_state *sm, const struct stream_info *istream)
+{
+	struct ewma_state tmp;
+	ewma_init(&tmp, istream->fs, EWMA_RISE_TIME(ENV_SMOOTH_TIME));
+	memset(sm, 0, sizeof(struct fb_smooth_state));
+	sm->g0 = tmp.g0;
+}
+
+/* same as calc_input_envs(), but with l/r and sum/diff in vector lanes */
+static inline void fb_calc_input_envs(struct fb_smooth_state *sm, fb_vec s, struct envs *env, struct envs *pwr_env)
+{
+	const fb_vec sd = { s[0]+s[1], s[0]-s[1] };
+	const fb_vec s_abs = { fabs(s[0]), fabs(s[1]) }, sd_abs = { fabs(sd[0]), fabs(sd[1]) };
+
+	sm->env[0] = sm->g0*(s_abs - sm->env[0]) + sm->env[0];
+	sm->env[1] = sm->g0*(sd_abs - sm->env[1]) + sm->env[1];
+	sm->pwr_env[0] = sm->g0*(s*s - sm->pwr_env[0]) + sm->pwr_env[0];
+	sm->pwr_env[1] = sm->g0*(sd*sd - sm->pwr_env[1]) + sm->pwr_env[1];
+
+	env->l = sm->env[0][0];
+	env->r = sm->env[0][1];
+	env->sum = sm->env[1][0];
+	env->diff = sm->env[1][1];
+
+	pwr_env->l = sm->pwr_env[0][0];
+	pwr_env->r = sm->pwr_env[0][1];
+	pwr_env->sum = sm->pwr_env[1][0];
+	pwr_env->diff = sm->pwr_env[1][1];
+}
+
 #if DO_FILTER_BANK_TEST
 static sample_t * matrix4_mb_test_fb_effect_run(struct effect *e, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
 {
@@ -314,16 +435,15 @@ static sample_t * matrix4_mb_test_fb_effect_run(struct effect *e, ssize_t *frame
 	for (ssize_t i = 0; i < *frames; ++i) {
 		const double s0 = fshape_run(&state->fshape[0], ibuf[i*e->istream.channels + state->c0]);
 		const double s1 = fshape_run(&state->fshape[1], ibuf[i*e->istream.channels + state->c1]);
-		filter_bank_run(&state->fb[0], s0);
-		filter_bank_run(&state->fb[1], s1);
+		filter_bank_run(&state->fb, (fb_vec) { s0, s1 });
 		double out_l = 0.0, out_r = 0.0, out_s = 0.0;
 		for (int k = 0; k < N_BANDS; ++k) {
 			struct matrix4_band *band = &state->band[k];
 			const double ct1 = (band->contour-1.0)*state->contour_pwrcmp + 1.0;
 			const double norm_mult = CALC_NORM_MULT(state->surr_mult[0]*ct1);
-			out_l += state->fb[0].s[k]*norm_mult;
-			out_r += state->fb[1].s[k]*norm_mult;
-			out_s += state->fb[0].s[k]*norm_mult*state->surr_mult[0]*band->contour;
+			out_l += state->fb.s[k][0]*norm_mult;
+			out_r += state->fb.s[k][1]*norm_mult;
+			out_s += state->fb.s[k][0]*norm_mult*state->surr_mult[0]*band->contour;
 		}
 		out_l = fshape_run(&state->inv_fshape[0], out_l);
 		out_r = fshape_run(&state->inv_fshape[1], out_r);
@@ -338,7 +458,7 @@ static sample_t * matrix4_mb_test_fb_effect_run(struct effect *e, ssize_t *frame
 		}
 		double s0_fb_fm = 0.0;
 		for (int k = 0; k < N_BANDS; ++k)
-			obuf[i*e->ostream.channels + e->istream.channels + k] = s0_fb_fm = state->fb[0].s[k] + state->freq_mask*s0_fb_fm;
+			obuf[i*e->ostream.channels + e->istream.channels + k] = s0_fb_fm = state->fb.s[k][0] + state->freq_mask*s0_fb_fm;
 		obuf[i*e->ostream.channels + e->istream.channels + N_BANDS] = out_s;
 	}
 	return obuf;
@@ -367,14 +487,10 @@ static sample_t * matrix4_mb_effect_run(struct effect *e, ssize_t *frames, sampl
 		sample_t out_l = 0.0, out_r = 0.0, out_ls = 0.0, out_rs = 0.0, out_ls_dir = 0.0, out_rs_dir = 0.0;
 		const sample_t s0 = fshape_run(&state->fshape[0], ibuf[i*e->istream.channels + state->c0]);
 		const sample_t s1 = fshape_run(&state->fshape[1], ibuf[i*e->istream.channels + state->c1]);
-		filter_bank_run(&state->fb[0], s0);
-		filter_bank_run(&state->fb[1], s1);
-		#if DOWNSAMPLE_FACTOR > 1
-		state->s = (state->s + 1 >= DOWNSAMPLE_FACTOR) ? 0 : state->s + 1;
-		if (state->s == 0) {
-		#else
-		if (1) {
-		#endif
+		filter_bank_run(&state->fb, (fb_vec) { s0, s1 });
+		const int ctl_update = ctl_clock_tick(&state->clk);
+		const double t = CTL_CLOCK_T(&state->clk);
+		if (ctl_update) {
 			/* find bands with possible events */
 			for (int k = 0; k < N_BANDS; ++k) {
 				struct matrix4_band *band = &state->band[k];
@@ -384,23 +500,19 @@ static sample_t * matrix4_mb_effect_run(struct effect *e, ssize_t *frames, sampl
 					angles[n_angles++] = ev->diff_last;
 			}
 		}
-		sample_t s0_fb_fm = 0.0, s1_fb_fm = 0.0;
+		fb_vec s_fb_fm = { 0.0, 0.0 };
+		struct filter_bank_frame *fb_frame = &state->fb_buf[state->fb_buf_p];
 		for (int k = 0; k < N_BANDS; ++k) {
 			struct matrix4_band *band = &state->band[k];
 
-			s0_fb_fm = state->fb[0].s[k] + state->freq_mask*s0_fb_fm;
-			s1_fb_fm = state->fb[1].s[k] + state->freq_mask*s1_fb_fm;
-			const sample_t s0_d_fb = state->fb_buf[0][state->fb_buf_p].s[k];
-			const sample_t s1_d_fb = state->fb_buf[1][state->fb_buf_p].s[k];
+			s_fb_fm = state->fb.s[k] + state->freq_mask*s_fb_fm;
+			const sample_t s0_d_fb = fb_frame->s[k][0];
+			const sample_t s1_d_fb = fb_frame->s[k][1];
 
 			struct envs env, pwr_env;
-			calc_input_envs(&band->sm, s0_fb_fm, s1_fb_fm, &env, &pwr_env);
+			fb_calc_input_envs(&band->sm, s_fb_fm, &env, &pwr_env);
 
-			#if DOWNSAMPLE_FACTOR > 1
-			if (state->s == 0) {
-			#else
-			if (1) {
-			#endif
+			if (ctl_update) {
 				/* modulate event threshold based on the number of
 				   bands with similar differential steering angles */
 				struct event_state *ev = &band->ev;
@@ -430,15 +542,10 @@ static sample_t * matrix4_mb_effect_run(struct effect *e, ssize_t *frames, sampl
 				state->calc_matrix_coefs(&band->ax, (state->do_dpwr_decouple) ? &band->ax_dpwr : &band->ax,
 					surr_mult*ct1, state->surr_mult[1]*cur_fade_mult, state->cmc_param, &m, NULL, 0);
 
-				cs_interp_insert(&band->m_interp.ll, m.ll);
-				cs_interp_insert(&band->m_interp.lr, m.lr);
-				cs_interp_insert(&band->m_interp.rl, m.rl);
-				cs_interp_insert(&band->m_interp.rr, m.rr);
-
-				cs_interp_insert(&band->m_interp.lsl, m.lsl*ct2);
-				cs_interp_insert(&band->m_interp.lsr, m.lsr*ct2);
-				cs_interp_insert(&band->m_interp.rsl, m.rsl*ct2);
-				cs_interp_insert(&band->m_interp.rsr, m.rsr*ct2);
+				cs_interp2_insert(&band->m_interp.l, (cs_vec2) { m.ll, m.lr });
+				cs_interp2_insert(&band->m_interp.r, (cs_vec2) { m.rl, m.rr });
+				cs_interp2_insert(&band->m_interp.ls, (cs_vec2) { m.lsl, m.lsr }*ct2);
+				cs_interp2_insert(&band->m_interp.rs, (cs_vec2) { m.rsl, m.rsr }*ct2);
 
 				if (state->do_phase_flip) {
 					const double pf_pos_rs = phase_flip_pos_rs(&band->ax);
@@ -453,10 +560,12 @@ static sample_t * matrix4_mb_effect_run(struct effect *e, ssize_t *frames, sampl
 				}
 			}
 
-			sample_t b_l = s0_d_fb*cs_interp(&band->m_interp.ll, state->s) + s1_d_fb*cs_interp(&band->m_interp.lr, state->s);
-			sample_t b_r = s0_d_fb*cs_interp(&band->m_interp.rl, state->s) + s1_d_fb*cs_interp(&band->m_interp.rr, state->s);
-			sample_t b_ls = s0_d_fb*cs_interp(&band->m_interp.lsl, state->s) + s1_d_fb*cs_interp(&band->m_interp.lsr, state->s);
-			sample_t b_rs = s0_d_fb*cs_interp(&band->m_interp.rsl, state->s) + s1_d_fb*cs_interp(&band->m_interp.rsr, state->s);
+			const cs_vec2 m_l = cs_interp2(&band->m_interp.l, t), m_r = cs_interp2(&band->m_interp.r, t);
+			const cs_vec2 m_ls = cs_interp2(&band->m_interp.ls, t), m_rs = cs_interp2(&band->m_interp.rs, t);
+			sample_t b_l = s0_d_fb*m_l[0] + s1_d_fb*m_l[1];
+			sample_t b_r = s0_d_fb*m_r[0] + s1_d_fb*m_r[1];
+			sample_t b_ls = s0_d_fb*m_ls[0] + s1_d_fb*m_ls[1];
+			sample_t b_rs = s0_d_fb*m_rs[0] + s1_d_fb*m_rs[1];
 
 		#if DEBUG_POWER_ERROR
 		#ifdef DSP_STATUSLINES
@@ -468,7 +577,7 @@ static sample_t * matrix4_mb_effect_run(struct effect *e, ssize_t *frames, sampl
 				const double pwr_out = ewma_run(&band->pwr_err[1], b_l*b_l + b_r*b_r + b_ls*b_ls + b_rs*b_rs);
 				const double pwr_ratio = MAXIMUM(pwr_out, DBL_MIN)/MAXIMUM(pwr_in, DBL_MIN);
 				const double pwr_ratio_sm = smf_run(&band->pwr_err_sm, pwr_ratio);
-				if (state->s == 0 && state->pwr_err_file)
+				if (ctl_update && state->pwr_err_file)
 					fprintf(state->pwr_err_file, "%.15e%c", pwr_ratio_sm, (k==N_BANDS-1)?'\n':' ');
 			}
 		#endif
@@ -477,14 +586,14 @@ static sample_t * matrix4_mb_effect_run(struct effect *e, ssize_t *frames, sampl
 			out_r += b_r;
 			sample_t b_ls_pf = b_ls, b_rs_pf = b_rs;
 			if (state->do_phase_flip) {
-				band->pf_ap[0].c0 = cs_interp(&band->pf_ap_c0[0], state->s);
-				band->pf_ap[1].c0 = cs_interp(&band->pf_ap_c0[1], state->s);
+				band->pf_ap[0].c0 = cs_interp(&band->pf_ap_c0[0], t);
+				band->pf_ap[1].c0 = cs_interp(&band->pf_ap_c0[1], t);
 				b_ls_pf = ap1_run(&band->pf_ap[0], b_ls_pf+1e-15)-1e-15;
 				b_rs_pf = ap1_run(&band->pf_ap[1], b_rs_pf+1e-15)-1e-15;
 			}
 			if (state->do_direct_path) {
-				const sample_t m_surr_amb = cs_interp(&band->m_surr_amb, state->s);
-				const sample_t m_surr_dir = cs_interp(&band->m_surr_dir, state->s);
+				const sample_t m_surr_amb = cs_interp(&band->m_surr_amb, t);
+				const sample_t m_surr_dir = cs_interp(&band->m_surr_dir, t);
 				out_ls += b_ls_pf*m_surr_amb; out_rs += b_rs_pf*m_surr_amb;
 				out_ls_dir += b_ls*m_surr_dir; out_rs_dir -= b_rs*m_surr_dir;
 			}
@@ -493,8 +602,7 @@ static sample_t * matrix4_mb_effect_run(struct effect *e, ssize_t *frames, sampl
 				out_rs += b_rs_pf;
 			}
 
-			state->fb_buf[0][state->fb_buf_p].s[k] = state->fb[0].s[k];
-			state->fb_buf[1][state->fb_buf_p].s[k] = state->fb[1].s[k];
+			fb_frame->s[k] = state->fb.s[k];
 		}
 
 		out_l = fshape_run(&state->inv_fshape[0], out_l);
@@ -574,8 +682,7 @@ static void matrix4_mb_effect_reset(struct effect *e)
 {
 	struct matrix4_mb_state *state = (struct matrix4_mb_state *) e->data;
 	state->fb_buf_p = 0;
-	memset(state->fb_buf[0], 0, state->fb_buf_len * sizeof(struct filter_bank_frame));
-	memset(state->fb_buf[1], 0, state->fb_buf_len * sizeof(struct filter_bank_frame));
+	memset(state->fb_buf, 0, state->fb_buf_len * sizeof(struct filter_bank_frame));
 }
 
 static void matrix4_mb_effect_signal(struct effect *e)
@@ -599,8 +706,7 @@ static void matrix4_mb_effect_drain_samples(struct effect *e, ssize_t *drain_sam
 static void matrix4_mb_effect_destroy(struct effect *e)
 {
 	struct matrix4_mb_state *state = (struct matrix4_mb_state *) e->data;
-	free(state->fb_buf[0]);
-	free(state->fb_buf[1]);
+	free(state->fb_buf);
 	for (int i = 0; i < N_BANDS; ++i)
 		event_state_cleanup(&state->band[i].ev);
 #if DEBUG_POWER_ERROR
@@ -688,18 +794,19 @@ struct effect * matrix4_mb_effect_init(const struct effect_info *ei, const struc
 	state->pwr_err_file = config.pwr_err_file;
 #endif
 
+	ctl_clock_init(&state->clk, config.ds_factor);
 	phase_flip_init_params(&state->pf_params, istream->fs);
 	for (int k = 0; k < N_BANDS; ++k) {
 		struct matrix4_band *band = &state->band[k];
-		smooth_state_init(&band->sm, istream);
+		fb_smooth_state_init(&band->sm, istream);
 		const double x = MAXIMUM(k-1, 0)*0.15*BAND_WEIGHT_IDX_MULT;
 		const double ev_thresh_mult = 1.0-(x/(x+1.0))*1.46*0.6;
 		band->ev_thresh_max = EVENT_THRESH_MAX * ev_thresh_mult;
 		band->ev_thresh_min = EVENT_THRESH_MIN * ev_thresh_mult;
 		const double ns_fc = fb_fc[k]/BASE_ORD_NOTCH_SCALE_F0;
-		if (event_state_init(&band->ev, istream, band->ev_thresh_max*(1.0/EVENT_THRESH),
+		if (event_state_init(&band->ev, istream, config.ds_factor, band->ev_thresh_max*(1.0/EVENT_THRESH),
 			exp(-3.465735902799727e-01*ns_fc*ns_fc))) goto fail;
-		ewma_init(&band->ev_thresh, DOWNSAMPLED_FS(istream->fs), EWMA_RISE_TIME(EVENT_SAMPLE_TIME));
+		ewma_init(&band->ev_thresh, DOWNSAMPLED_FS(istream->fs, config.ds_factor), EWMA_RISE_TIME(EVENT_SAMPLE_TIME));
 		ewma_set(&band->ev_thresh, band->ev_thresh_max);
 		const double pf_pos_rs = phase_flip_pos_rs(&band->ax);
 		cs_interp_set(&band->pf_ap_c0[0], phase_flip_ap1_c0(&state->pf_params, 1.0-pf_pos_rs));
@@ -715,16 +822,11 @@ struct effect * matrix4_mb_effect_init(const struct effect_info *ei, const struc
 	#endif
 	}
 
-	state->fb_buf_len = config.lookahead_frames;
-#if DOWNSAMPLE_FACTOR > 1
-	state->fb_buf_len += CS_INTERP_DELAY_FRAMES;
-#endif
-	state->fb_buf[0] = calloc(state->fb_buf_len, sizeof(struct filter_bank_frame));
-	if (check_alloc(ei->name, state->fb_buf[0])) goto fail;
-	state->fb_buf[1] = calloc(state->fb_buf_len, sizeof(struct filter_bank_frame));
-	if (check_alloc(ei->name, state->fb_buf[1])) goto fail;
+	state->fb_buf_len = config.lookahead_frames + CS_INTERP_DELAY_FRAMES(config.ds_factor);
+	state->fb_buf = calloc(state->fb_buf_len, sizeof(struct filter_bank_frame));
+	if (check_alloc(ei->name, state->fb_buf)) goto fail;
 	state->fade_frames = TIME_TO_FRAMES(FADE_TIME, istream->fs);
-	event_config_init(&state->evc, istream, config.rear_ev_mask);
+	event_config_init(&state->evc, istream, config.ds_factor, config.rear_ev_mask);
 #endif
 	fshape_init(&state->fshape[0], istream->fs, fshape_lf, fshape_hf, 0);
 	state->fshape[1] = state->fshape[0];
@@ -732,8 +834,7 @@ struct effect * matrix4_mb_effect_init(const struct effect_info *ei, const struc
 	for (int i = 1; i < LENGTH(state->inv_fshape); ++i)
 		state->inv_fshape[i] = state->inv_fshape[0];
 
-	filter_bank_init(&state->fb[0], istream->fs, config.fb_type, config.fb_stop);
-	state->fb[1] = state->fb[0];
+	filter_bank_init(&state->fb, istream->fs, config.fb_type, config.fb_stop);
 
 	const double shelf_mult2 = config.shelf_mult*config.shelf_mult;
 	const double shelf_f02 = config.shelf_f0*config.shelf_f0;
@@ -758,9 +859,9 @@ struct effect * matrix4_mb_effect_init(const struct effect_info *ei, const struc
 	sample_t *filter = calloc(phase_lin_frames, sizeof(sample_t));
 	if (check_alloc(ei->name, filter)) goto fail;
 	for (int i = phase_lin_frames-1; i >= 0; --i) {
-		filter_bank_run(&state->fb[1], (i == phase_lin_frames-1) ? 1.0 : 0.0);
+		filter_bank_run(&state->fb, (fb_vec) { (i == phase_lin_frames-1) ? 1.0 : 0.0, 0.0 });
 		for (int k = 0; k < N_BANDS; ++k)
-			filter[i] += state->fb[1].s[k];
+			filter[i] += state->fb.s[k][0];
 	}
 	int zx = 0;                      /* last zero crossing index */
 	double integ = fabs(filter[0]);  /* unsigned integral since last zero crossing */
@@ -775,7 +876,7 @@ struct effect * matrix4_mb_effect_init(const struct effect_info *ei, const struc
 	phase_lin_frames -= zx;
 	struct effect *e_fir = fir_effect_init_with_filter(ei, istream, channel_selector, &filter[zx], 1, phase_lin_frames, 0, 0);
 	free(filter);
-	state->fb[1] = state->fb[0];  /* reset */
+	filter_bank_reset(&state->fb);
 	state->len = state->fb_buf_len + (phase_lin_frames - 1);  /* total delay */
 	if (e_fir == NULL) {
 		destroy_effect(e);
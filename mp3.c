@@ -25,11 +25,25 @@
 #include <errno.h>
 #include <mad.h>
 #include "mp3.h"
+#include "seek_index.h"
 #include "util.h"
 
 /* largest possible frame size (http://www.mars.org/pipermail/mad-dev/2002-January/000425.html) */
 /* #define MP3_BUF_SIZE (2881 + MAD_BUFFER_GUARD) */
 #define MP3_BUF_SIZE (1<<12)
+/* add a seek index entry every MP3_INDEX_INTERVAL frames */
+#define MP3_INDEX_INTERVAL 32
+/* largest main_data_begin value, i.e. the number of bytes of main data a
+   Layer III frame may take from the frames before it (255 for MPEG-2 and
+   MPEG-2.5 LSF) */
+#define MP3_MAX_MAIN_DATA_BEGIN     511
+#define MP3_MAX_MAIN_DATA_BEGIN_LSF 255
+#define MP3_FILE_OFFSET(state, ptr) ((state)->buf_offset + ((ptr) - (state)->buf))
+
+struct mp3_seek_frame {
+	off_t offset;
+	int main_len;
+};
 
 struct mp3_state {
 	int fd;
@@ -37,12 +51,17 @@ struct mp3_state {
 	struct mad_frame frame;
 	struct mad_synth synth;
 	ssize_t pcm_pos;
+	off_t buf_offset;  /* file offset of buf[0] */
 	unsigned char *buf;
+	struct seek_index index;
+	struct mp3_seek_frame *seek_frames;
+	ssize_t seek_frames_cap;
 };
 
 static ssize_t refill_buffer(struct mp3_state *state, const char *type)
 {
 	ssize_t r, rem = state->stream.bufend - state->stream.next_frame;
+	state->buf_offset = MP3_FILE_OFFSET(state, state->stream.next_frame);
 	memmove(state->buf, state->stream.next_frame, rem);
 	if ((r = read(state->fd, state->buf + rem, MP3_BUF_SIZE - rem)) == -1) {
 		dsp_perror(DSP_EREAD, type, strerror(errno));
@@ -55,6 +74,34 @@ static ssize_t refill_buffer(struct mp3_state *state, const char *type)
 	return r;
 }
 
+static int buffer_at(struct mp3_state *state, off_t offset, const char *type)
+{
+	ssize_t r;
+	if (lseek(state->fd, offset, SEEK_SET) < 0) {
+		dsp_perror(DSP_ESEEK, type, strerror(errno));
+		return 1;
+	}
+	if ((r = read(state->fd, state->buf, MP3_BUF_SIZE)) == -1) {
+		dsp_perror(DSP_EREAD, type, strerror(errno));
+		return 1;
+	}
+	state->buf_offset = offset;
+	mad_stream_buffer(&state->stream, state->buf, r);
+	state->stream.error = 0;
+	return 0;
+}
+
+static void reset_decoder(struct mp3_state *state)
+{
+	mad_stream_finish(&state->stream);
+	mad_frame_finish(&state->frame);
+	mad_synth_finish(&state->synth);
+
+	mad_stream_init(&state->stream);
+	mad_frame_init(&state->frame);
+	mad_synth_init(&state->synth);
+}
+
 static ssize_t mp3_read(struct codec *c, sample_t *buf, ssize_t frames)
 {
 	struct mp3_state *state = (struct mp3_state *) c->data;
@@ -83,54 +130,110 @@ static ssize_t mp3_read(struct codec *c, sample_t *buf, ssize_t frames)
 	return buf_pos / c->channels;
 }
 
+/* returns the number of main data bytes in the frame whose header was
+   just decoded (zero for layers I and II, which have no bit reservoir) */
+static int frame_main_data_len(const struct mad_header *h, const struct mad_stream *stream)
+{
+	if (h->layer != MAD_LAYER_III) return 0;
+	const int mono = (h->mode == MAD_MODE_SINGLE_CHANNEL);
+	const int si_len = (h->flags & MAD_FLAG_LSF_EXT) ? ((mono) ? 9 : 17) : ((mono) ? 17 : 32);
+	const int len = (stream->next_frame - stream->this_frame) - 4
+		- ((h->flags & MAD_FLAG_PROTECTION) ? 2 : 0) - si_len;
+	return MAXIMUM(len, 0);
+}
+
 static ssize_t mp3_seek(struct codec *c, ssize_t pos)
 {
 	struct mp3_state *state = (struct mp3_state *) c->data;
-	ssize_t fpos = 0;
+	ssize_t fpos, n, start, len;
 
 	if (pos < 0)
 		pos = 0;
 	else if (pos >= c->frames)
 		pos = c->frames - 1;
 
-	if (lseek(state->fd, 0, SEEK_SET) < 0) {
-		dsp_perror(DSP_ESEEK, c->type, strerror(errno));
-		return -1;
-	}
-
-	mad_stream_finish(&state->stream);
-	mad_frame_finish(&state->frame);
-	mad_synth_finish(&state->synth);
+	/* Walk the frame headers from an earlier index entry to find the frame
+	   containing pos. Decoding starts far enough back that the frame before
+	   the target has its whole bit reservoir (so its output, which overlaps
+	   the target frame, is correct); if the walk did not cover enough main
+	   data, try again from further back. */
+	const ssize_t k_target = seek_index_find(&state->index, pos);
+	for (ssize_t back = 1;; back *= 2) {
+		const ssize_t k = k_target - back;
+		fpos = n = 0;
+		reset_decoder(state);
+		if (k >= 0) {
+			fpos = state->index.e[k].pos;
+			if (buffer_at(state, state->index.e[k].offset, c->type)) return -1;
+		}
+		else if (buffer_at(state, 0, c->type)) return -1;
 
-	mad_stream_init(&state->stream);
-	mad_frame_init(&state->frame);
-	mad_synth_init(&state->synth);
+		for (;;) {
+			while (mad_header_decode(&state->frame.header, &state->stream)) {
+				if (MAD_RECOVERABLE(state->stream.error))
+					continue;
+				if (state->stream.error == MAD_ERROR_BUFLEN) {
+					if (refill_buffer(state, c->type) == 0)
+						goto eof;
+					continue;
+				}
+				LOG_FMT(LL_ERROR, "%s: non-recoverable MAD error", c->type);
+				return -1;
+			}
+			if (n >= state->seek_frames_cap) {
+				const ssize_t cap = MAXIMUM(state->seek_frames_cap * 2, MP3_INDEX_INTERVAL * 4);
+				struct mp3_seek_frame *f = realloc(state->seek_frames, cap * sizeof(struct mp3_seek_frame));
+				if (check_alloc(c->type, f)) return -1;
+				state->seek_frames = f;
+				state->seek_frames_cap = cap;
+			}
+			state->seek_frames[n].offset = MP3_FILE_OFFSET(state, state->stream.this_frame);
+			state->seek_frames[n].main_len = frame_main_data_len(&state->frame.header, &state->stream);
+			++n;
+			len = mad_timer_count(state->frame.header.duration, state->frame.header.samplerate);
+			if (fpos + len > pos) break;
+			fpos += len;
+		}
 
-	if (read(state->fd, state->buf, MP3_BUF_SIZE) == -1) {
-		dsp_perror(DSP_EREAD, c->type, strerror(errno));
-		return -1;
+		/* the frame before the target fills the synthesis filterbank and
+		   the overlap buffer; the ones before it fill its bit reservoir */
+		const struct mad_header *h = &state->frame.header;
+		const int need = (h->layer != MAD_LAYER_III) ? 0
+			: (h->flags & MAD_FLAG_LSF_EXT) ? MP3_MAX_MAIN_DATA_BEGIN_LSF : MP3_MAX_MAIN_DATA_BEGIN;
+		int have = 0;
+		start = MAXIMUM(n - 2, 0);
+		while (have < need && start > 0)
+			have += state->seek_frames[--start].main_len;
+		if (have >= need || k < 0) break;
 	}
-	mad_stream_buffer(&state->stream, state->buf, MP3_BUF_SIZE);
-	state->stream.error = 0;
-	while (fpos < pos) {
-		while (mad_header_decode(&state->frame.header, &state->stream)) {
-			if (MAD_RECOVERABLE(state->stream.error))
-				continue;
-			if (state->stream.error == MAD_ERROR_BUFLEN) {
-				if (refill_buffer(state, c->type) == 0)
-					return pos;
+	const off_t target_offset = state->seek_frames[n-1].offset;
+
+	/* decode from the first preroll frame through the target frame */
+	reset_decoder(state);
+	if (buffer_at(state, state->seek_frames[start].offset, c->type)) return -1;
+	for (;;) {
+		const int err = mad_frame_decode(&state->frame, &state->stream);
+		if (err && !MAD_RECOVERABLE(state->stream.error)) {
+			if (state->stream.error == MAD_ERROR_BUFLEN && refill_buffer(state, c->type) > 0)
 				continue;
-			}
 			LOG_FMT(LL_ERROR, "%s: non-recoverable MAD error", c->type);
-			return pos;
+			return -1;
+		}
+		const off_t offset = MP3_FILE_OFFSET(state, state->stream.this_frame);
+		if (err) {
+			if (offset < target_offset) continue;
+			/* keep the position exact even if the target frame is undecodable */
+			mad_frame_mute(&state->frame);
 		}
-		fpos += mad_timer_count(state->frame.header.duration, state->frame.header.samplerate);
+		mad_synth_frame(&state->synth, &state->frame);
+		if (offset >= target_offset) break;
 	}
+	state->pcm_pos = pos - fpos;
+	return pos;
 
-	mad_frame_decode(&state->frame, &state->stream);
-	mad_synth_frame(&state->synth, &state->frame);
-
-	return fpos;
+	eof:
+	LOG_FMT(LL_ERROR, "%s: error: unexpected end of stream while seeking", c->type);
+	return -1;
 }
 
 static void mp3_destroy(struct codec *c)
@@ -142,25 +245,25 @@ static void mp3_destroy(struct codec *c)
 		mad_frame_finish(&state->frame);
 		mad_synth_finish(&state->synth);
 		free(state->buf);
+		seek_index_free(&state->index);
+		free(state->seek_frames);
 		free(state);
 	}
 }
 
-static ssize_t mp3_get_nframes(struct mp3_state *state, const char *type)
+/* scans the frame headers to find the length and build the seek index */
+static ssize_t mp3_scan(struct mp3_state *state, const char *type)
 {
-	ssize_t len = 0;
+	ssize_t len = 0, n = 0;
 
 	mad_stream_init(&state->stream);
 	mad_frame_init(&state->frame);
 	mad_synth_init(&state->synth);
 
-	if (read(state->fd, state->buf, MP3_BUF_SIZE) == -1) {
-		dsp_perror(DSP_EREAD, type, strerror(errno));
+	if (buffer_at(state, 0, type)) {
 		len = -1;
 		goto done;
 	}
-	mad_stream_buffer(&state->stream, state->buf, MP3_BUF_SIZE);
-	state->stream.error = 0;
 	for (;;) {
 		while (mad_header_decode(&state->frame.header, &state->stream)) {
 			if (MAD_RECOVERABLE(state->stream.error))
@@ -174,11 +277,15 @@ static ssize_t mp3_get_nframes(struct mp3_state *state, const char *type)
 			len = -1;
 			goto done;
 		}
+		if (n++ % MP3_INDEX_INTERVAL == 0
+				&& seek_index_add(&state->index, len, MP3_FILE_OFFSET(state, state->stream.this_frame))) {
+			len = -1;
+			goto done;
+		}
 		len += mad_timer_count(state->frame.header.duration, state->frame.header.samplerate);
 	}
 
 	done:
-	lseek(state->fd, 0, SEEK_SET);
 	mad_stream_finish(&state->stream);
 	mad_frame_finish(&state->frame);
 	mad_synth_finish(&state->synth);
@@ -212,19 +319,27 @@ struct codec * mp3_codec_init(const struct codec_params *p)
 	state->buf = calloc(MP3_BUF_SIZE, 1);
 	if (check_alloc(p->type, state->buf)) goto fail;
 
-	if ((nframes = mp3_get_nframes(state, p->type)) < 0)
-		goto fail;
+	if (p->index && p->index->frames >= 0) {
+		/* reopened by a lazy codec; reuse the index from the first open */
+		if (seek_index_copy(&state->index, p->index))
+			goto fail;
+		nframes = state->index.frames;
+	}
+	else if (seek_index_load(&state->index, p->path, "mp3") == 0)
+		nframes = state->index.frames;
+	else {
+		if ((nframes = mp3_scan(state, p->type)) < 0)
+			goto fail;
+		state->index.frames = nframes;
+		seek_index_save(&state->index, p->path, "mp3");
+	}
 
 	mad_stream_init(&state->stream);
 	mad_frame_init(&state->frame);
 	mad_synth_init(&state->synth);
 
-	if (read(state->fd, state->buf, MP3_BUF_SIZE) == -1) {
-		dsp_perror(DSP_EREAD, p->type, strerror(errno));
+	if (buffer_at(state, 0, p->type))
 		goto fail;
-	}
-	mad_stream_buffer(&state->stream, state->buf, MP3_BUF_SIZE);
-	state->stream.error = 0;
 	while (mad_frame_decode(&state->frame, &state->stream)) {
 		if (MAD_RECOVERABLE(state->stream.error))
 			continue;
@@ -242,6 +357,8 @@ struct codec * mp3_codec_init(const struct codec_params *p)
 	c->fs = state->frame.header.samplerate;
 	c->channels = MAD_NCHANNELS(&state->frame.header);
 	c->frames = nframes;
+	if (p->index && p->index->frames < 0 && seek_index_copy(p->index, &state->index))
+		goto fail;
 
 	return c;
 
@@ -18,7 +18,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <complex.h>
 #include "noise.h"
 #include "util.h"
 
@@ -54,20 +56,15 @@ static sample_t * noise_effect_run(struct effect *e, ssize_t *frames, sample_t *
 	return ibuf;
 }
 
-static void noise_effect_plot(struct effect *e, int i)
+static void noise_effect_plot(struct effect *e, ssize_t n, double df, const double complex *ih, double complex *oh)
 {
 	struct noise_state *state = (struct noise_state *) e->data;
+	memcpy(oh, ih, n * e->ostream.channels * sizeof(double complex));
 	for (int k = 0; k < e->ostream.channels; ++k) {
 		if (GET_BIT(e->channel_selector, k)) {
-			printf("H%d_%d_lw=NaN\n", k, i);
-			printf("H%d_%d_lv=0\n", k, i);
-			printf("H%d_%d_tpdf(w)=(w==H%d_%d_lw)?H%d_%d_lv:"
-				"(H%d_%d_lw=w, H%d_%d_lv=%.15e*((rand(0)-rand(0))+j*(rand(0)-rand(0))))\n",
-				k, i, k, i, k, i, k, i, k, i, state->mult*PM_RAND_MAX*M_SQRT1_2);
-			printf("H%d_%d(w)=Ht%d_%d(w*%d/2.0/pi)+H%d_%d_tpdf(w)\n", k, i, k, i, e->ostream.fs, k, i);
+			for (ssize_t i = 0; i < n; ++i)
+				oh[k*n + i] += (tpdf_noise(state->mult) + I*tpdf_noise(state->mult)) * M_SQRT1_2;
 		}
-		else
-			printf("H%d_%d(w)=Ht%d_%d(w*%d/2.0/pi)\n", k, i, k, i, e->ostream.fs);
 	}
 }
 
@@ -100,7 +97,6 @@ struct effect * noise_effect_init(const struct effect_info *ei, const struct str
 	e->channel_selector = NEW_SELECTOR(istream->channels);
 	if (check_alloc(ei->name, e->channel_selector)) goto fail;
 	COPY_SELECTOR(e->channel_selector, channel_selector, istream->channels);
-	e->flags |= EFFECT_FLAG_PLOT_MIX;
 	e->flags |= EFFECT_FLAG_CH_DEPS_IDENTITY;
 	e->run = noise_effect_run;
 	e->plot = noise_effect_plot;
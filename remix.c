@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <complex.h>
 #include "remix.h"
 #include "util.h"
 
@@ -28,12 +29,19 @@ struct fast_sel_4 {
 	int n, c[4];
 };
 
+struct remix_term {
+	int c;
+	sample_t g;
+};
+
 struct remix_state {
 	char **channel_selectors;
 	union {
 		int *s1;
 		struct fast_sel_4 *s4;
 	} fast_sel;
+	struct remix_term *terms;  /* weighted sums; used only by remix_effect_run_matrix() */
+	int *n_terms;
 };
 
 static sample_t * remix_effect_run_generic(struct effect *e, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
@@ -100,16 +108,43 @@ static sample_t * remix_effect_run_4(struct effect *e, ssize_t *frames, sample_t
 	return obuf;
 }
 
-static void remix_effect_plot(struct effect *e, int i)
+static sample_t * remix_effect_run_matrix(struct effect *e, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
+{
+	struct remix_state *state = (struct remix_state *) e->data;
+	sample_t *ibuf_p = ibuf, *obuf_p = obuf;
+	for (ssize_t i = 0; i < *frames; ++i) {
+		const struct remix_term *t = state->terms;
+		for (int k = 0; k < e->ostream.channels; ++k) {
+			sample_t s = 0.0;
+			for (int n = 0; n < state->n_terms[k]; ++n, ++t)
+				s += ibuf_p[t->c] * t->g;
+			obuf_p[k] = s;
+		}
+		ibuf_p += e->istream.channels;
+		obuf_p += e->ostream.channels;
+	}
+	return obuf;
+}
+
+static void remix_effect_plot(struct effect *e, ssize_t n, double df, const double complex *ih, double complex *oh)
 {
 	struct remix_state *state = (struct remix_state *) e->data;
+	const struct remix_term *t = state->terms;
+	memset(oh, 0, n * e->ostream.channels * sizeof(double complex));
 	for (int k = 0; k < e->ostream.channels; ++k) {
-		printf("H%d_%d(w)=0.0", k, i);
-		for (int j = 0; j < e->istream.channels; ++j) {
-			if (GET_BIT(state->channel_selectors[k], j))
-				printf("+Ht%d_%d(w*%d/2.0/pi)", j, i, e->ostream.fs);
+		double complex *oh_k = &oh[k*n];
+		if (t) {
+			for (int j = 0; j < state->n_terms[k]; ++j, ++t)
+				for (ssize_t i = 0; i < n; ++i)
+					oh_k[i] += ih[t->c*n + i] * t->g;
+		}
+		else {
+			for (int j = 0; j < e->istream.channels; ++j) {
+				if (GET_BIT(state->channel_selectors[k], j))
+					for (ssize_t i = 0; i < n; ++i)
+						oh_k[i] += ih[j*n + i];
+			}
 		}
-		putchar('\n');
 	}
 }
 
@@ -122,6 +157,8 @@ static void remix_effect_destroy(struct effect *e)
 		free(state->channel_selectors);
 	}
 	free(state->fast_sel.s1);
+	free(state->terms);
+	free(state->n_terms);
 	free(state);
 }
 
@@ -132,6 +169,85 @@ static void remix_effect_channel_deps(struct effect *e, char **deps)
 		COPY_SELECTOR(deps[k], state->channel_selectors[k], e->istream.channels);
 }
 
+static void remix_effect_matrix(struct effect *e, sample_t *m)
+{
+	struct remix_state *state = (struct remix_state *) e->data;
+	const struct remix_term *t = state->terms;
+	memset(m, 0, e->ostream.channels * e->istream.channels * sizeof(sample_t));
+	for (int k = 0; k < e->ostream.channels; ++k, m += e->istream.channels) {
+		if (t) {
+			for (int n = 0; n < state->n_terms[k]; ++n, ++t)
+				m[t->c] = t->g;
+		}
+		else {
+			for (int j = 0; j < e->istream.channels; ++j)
+				if (GET_BIT(state->channel_selectors[k], j)) m[j] = 1.0;
+		}
+	}
+}
+
+static struct effect * remix_effect_new(const char *name, const struct stream_info *istream, int out_channels)
+{
+	struct effect *e = calloc(1, sizeof(struct effect));
+	if (check_alloc(name, e)) return NULL;
+	e->name = name;
+	e->istream.fs = e->ostream.fs = istream->fs;
+	e->istream.channels = istream->channels;
+	e->ostream.channels = out_channels;
+	e->plot = remix_effect_plot;
+	e->destroy = remix_effect_destroy;
+	e->channel_deps = remix_effect_channel_deps;
+	e->matrix = remix_effect_matrix;
+
+	struct remix_state *state = e->data = calloc(1, sizeof(struct remix_state));
+	if (check_alloc(name, state)) goto fail;
+	state->channel_selectors = calloc(out_channels, sizeof(char *));
+	if (check_alloc(name, state->channel_selectors)) goto fail;
+	for (int k = 0; k < out_channels; ++k) {
+		state->channel_selectors[k] = NEW_SELECTOR(istream->channels);
+		if (check_alloc(name, state->channel_selectors[k])) goto fail;
+	}
+	return e;
+
+	fail:
+	if (state) remix_effect_destroy(e);
+	free(e);
+	return NULL;
+}
+
+struct effect * remix_effect_init_matrix(const char *name, const struct stream_info *istream, int out_channels, const sample_t *m)
+{
+	int nnz = 0, set_no_dither = 1;
+	for (int i = 0; i < out_channels * istream->channels; ++i)
+		if (m[i] != 0.0) ++nnz;
+	struct effect *e = remix_effect_new(name, istream, out_channels);
+	if (e == NULL) return NULL;
+	struct remix_state *state = (struct remix_state *) e->data;
+	state->terms = calloc(MAXIMUM(nnz, 1), sizeof(struct remix_term));
+	state->n_terms = calloc(out_channels, sizeof(int));
+	if (!state->terms || !state->n_terms) {
+		dsp_perror(DSP_ENOMEM, name, NULL);
+		destroy_effect(e);
+		return NULL;
+	}
+	for (int k = 0, n = 0; k < out_channels; ++k, m += istream->channels) {
+		for (int j = 0; j < istream->channels; ++j) {
+			if (m[j] != 0.0) {
+				SET_BIT(state->channel_selectors[k], j);
+				state->terms[n].c = j;
+				state->terms[n].g = m[j];
+				++state->n_terms[k];
+				++n;
+				if (m[j] != 1.0) set_no_dither = 0;
+			}
+		}
+		if (state->n_terms[k] > 1) set_no_dither = 0;
+	}
+	if (set_no_dither) e->flags |= EFFECT_FLAG_NO_DITHER;
+	e->run = remix_effect_run_matrix;
+	return e;
+}
+
 struct effect * remix_effect_init(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, const char *dir, int argc, const char *const *argv)
 {
 	struct effect *e = NULL;
@@ -146,25 +262,11 @@ struct effect * remix_effect_init(const struct effect_info *ei, const struct str
 	const int delta = n_selectors - mask_bits;
 	const int out_channels = istream->channels + delta;
 
-	e = calloc(1, sizeof(struct effect));
-	if (check_alloc(ei->name, e)) goto fail;
-	e->name = ei->name;
-	e->istream.fs = e->ostream.fs = istream->fs;
-	e->istream.channels = istream->channels;
-	e->ostream.channels = out_channels;
-	e->flags |= EFFECT_FLAG_PLOT_MIX;
-	e->plot = remix_effect_plot;
-	e->destroy = remix_effect_destroy;
-	e->channel_deps = remix_effect_channel_deps;
-
-	e->data = state = calloc(1, sizeof(struct remix_state));
-	if (check_alloc(ei->name, state)) goto fail;
-	state->channel_selectors = calloc(out_channels, sizeof(char *));
-	if (check_alloc(ei->name, state->channel_selectors)) goto fail;
+	e = remix_effect_new(ei->name, istream, out_channels);
+	if (e == NULL) return NULL;
+	state = (struct remix_state *) e->data;
 	int use_run_1a = 1, use_run_4 = 1, set_no_dither = 1;
 	for (int k = 0, i = 0, ch = 0; k < out_channels; ++k, ++ch) {
-		state->channel_selectors[k] = NEW_SELECTOR(istream->channels);
-		if (check_alloc(ei->name, state->channel_selectors[k])) goto fail;
 		if (ch >= istream->channels || GET_BIT(channel_selector, ch)) {
 			if (i < n_selectors) {
 				if (strcmp(argv[i+1], ".") != 0 && parse_selector_masked(argv[i+1], state->channel_selectors[k], channel_selector, istream->channels))
@@ -23,6 +23,8 @@
 #include "effect.h"
 
 struct effect * remix_effect_init(const struct effect_info *, const struct stream_info *, const char *, const char *, int, const char *const *);
+/* creates a remix effect that computes weighted sums; the matrix has out_channels rows of istream->channels coefficients */
+struct effect * remix_effect_init_matrix(const char *, const struct stream_info *, int, const sample_t *);
 
 #define REMIX_EFFECT_INFO \
 	{ "remix", "channel_selector|. ...", remix_effect_init, 0 }
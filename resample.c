@@ -23,6 +23,7 @@
 #include <complex.h>
 #include <fftw3.h>
 #include "resample.h"
+#include "shared_data.h"
 #include "util.h"
 
 /* Tunables */
@@ -40,7 +41,7 @@ struct resample_state {
 	struct {
 		int n, d;
 	} ratio;
-	int sinc_fr_len, tmp_fr_len, in_len, out_len;
+	int sinc_fr_len, sinc_fs, tmp_fr_len, in_len, out_len;
 	int in_buf_pos, out_buf_pos, drain_pos, drain_frames, out_delay;
 	fftw_complex *sinc_fr;
 	fftw_complex *tmp_fr, *tmp_fr_2;
@@ -49,6 +50,11 @@ struct resample_state {
 	int has_output, is_draining;
 };
 
+struct resample_sinc_key {
+	double fc_os;
+	int sinc_len, m_os;
+};
+
 static double window(const double x)
 {
 	if (x >= 1.0 || x <= 0.0) return 0.0;
@@ -155,7 +161,8 @@ static void resample_effect_reset(struct effect *e)
 {
 	struct resample_state *state = (struct resample_state *) e->data;
 	state->in_buf_pos = state->out_buf_pos = 0;
-	state->has_output = 0;
+	state->has_output = state->is_draining = 0;
+	state->drain_pos = state->drain_frames = 0;
 	for (int i = 0; i < e->ostream.channels; ++i)
 		memset(state->overlap[i], 0, state->out_len * sizeof(sample_t));
 }
@@ -187,10 +194,30 @@ static sample_t * resample_effect_drain2(struct effect *e, ssize_t *frames, samp
 	return rbuf;
 }
 
+static void resample_effect_plot(struct effect *e, ssize_t n, double df, const double complex *ih, double complex *oh)
+{
+	struct resample_state *state = (struct resample_state *) e->data;
+	const double bin_df = (double) state->sinc_fs / ((state->sinc_fr_len-1) * 2);
+	const double norm = 1.0 / cabs(state->sinc_fr[0]);
+	for (ssize_t i = 0; i < n; ++i) {
+		const double f = i*df;
+		double h = 0.0;
+		if (f <= e->istream.fs / 2.0 && f <= e->ostream.fs / 2.0) {
+			/* the filter is linear-phase and its delay is compensated */
+			const double x = f / bin_df;
+			const int k = (int) x;
+			if (k+1 < state->sinc_fr_len)
+				h = (cabs(state->sinc_fr[k])*(k+1-x) + cabs(state->sinc_fr[k+1])*(x-k)) * norm;
+		}
+		for (int c = 0; c < e->ostream.channels; ++c)
+			oh[c*n + i] = (h == 0.0) ? 0.0 : ih[c*n + i] * h;
+	}
+}
+
 static void resample_effect_destroy(struct effect *e)
 {
 	struct resample_state *state = (struct resample_state *) e->data;
-	fftw_free(state->sinc_fr);
+	shared_data_release(state->sinc_fr);
 	fftw_free(state->tmp_fr);
 	fftw_free(state->tmp_fr_2);
 	for (int i = 0; i < e->ostream.channels; ++i) {
@@ -210,13 +237,44 @@ static void resample_effect_destroy(struct effect *e)
 	free(state);
 }
 
+static int resample_sinc_fr_init(void *data, void *arg)
+{
+	const struct resample_sinc_key *k = (const struct resample_sinc_key *) arg;
+	fftw_complex *sinc_fr = (fftw_complex *) data;
+	sample_t *sinc = fftw_malloc(k->sinc_len * 2 * sizeof(sample_t));
+	if (check_alloc("resample", sinc)) return 1;
+	dsp_fftw_acquire();
+	fftw_plan sinc_plan = fftw_plan_dft_r2c_1d(k->sinc_len * 2, sinc, sinc_fr, FFTW_ESTIMATE);
+	dsp_fftw_release();
+	if (check_alloc("resample", sinc_plan)) {
+		fftw_free(sinc);
+		return 1;
+	}
+	memset(sinc, 0, k->sinc_len * 2 * sizeof(sample_t));
+
+	/* generate windowed sinc function */
+	/* note: all supported windows are zero at endpoints, so skip the first and last indicies */
+	for (int i = 1; i < k->m_os; ++i)
+		sinc[i] = norm_sinc((i*2 - k->m_os)/2.0, k->fc_os) * window((double) i / k->m_os);
+
+	fftw_execute(sinc_plan);
+	fftw_destroy_plan(sinc_plan);
+	fftw_free(sinc);
+
+#if SINC_SELF_CONVOLVE
+	/* convolve sinc function with itself (doubles stopband attenuation) */
+	for (int i = 0; i < k->sinc_len + 1; ++i)
+		sinc_fr[i] *= sinc_fr[i];
+#endif
+	return 0;
+}
+
 struct effect * resample_effect_init(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, const char *dir, int argc, const char *const *argv)
 {
 	char *endptr;
 	const char *rate_arg = NULL, *bw_arg = NULL;
 	int rate;
 	double bw = DEFAULT_BANDWIDTH;
-	sample_t *sinc = NULL;
 
 	if (argc < 2 || argc > 3) {
 		print_effect_usage(ei);
@@ -265,6 +323,7 @@ struct effect * resample_effect_init(const struct effect_info *ei, const struct
 	e->run = resample_effect_run;
 	e->reset = resample_effect_reset;
 	e->drain2 = resample_effect_drain2;
+	e->plot = resample_effect_plot;
 	e->destroy = resample_effect_destroy;
 
 	struct resample_state *state = calloc(1, sizeof(struct resample_state));
@@ -308,6 +367,7 @@ struct effect * resample_effect_init(const struct effect_info *ei, const struct
 	state->out_len = state->ratio.n * len_mult;
 	state->tmp_fr_len = max_factor * len_mult + 1;
 	state->sinc_fr_len = sinc_len + 1;
+	state->sinc_fs = max_rate * sinc_os;
 
 	/* calculate output delay */
 	if (rate == max_rate)
@@ -323,19 +383,15 @@ struct effect * resample_effect_init(const struct effect_info *ei, const struct
 	state->c2r_plan = calloc(e->ostream.channels, sizeof(fftw_plan));
 	state->tmp_fr = fftw_malloc(state->tmp_fr_len * sizeof(fftw_complex));
 	state->tmp_fr_2 = fftw_malloc(state->tmp_fr_len * sizeof(fftw_complex));
-	sinc = fftw_malloc(sinc_len * 2 * sizeof(sample_t));
-	state->sinc_fr = fftw_malloc(state->sinc_fr_len * sizeof(fftw_complex));
 	if (!state->input || !state->output || !state->overlap || !state->r2c_plan || !state->c2r_plan
-			|| !state->tmp_fr || !state->tmp_fr_2 || !sinc || !state->sinc_fr) {
+			|| !state->tmp_fr || !state->tmp_fr_2) {
 		dsp_perror(DSP_ENOMEM, ei->name, NULL);
 		goto fail;
 	}
 
 	dsp_fftw_acquire();
 	const int planner_flags = (dsp_fftw_load_wisdom()) ? FFTW_MEASURE : FFTW_ESTIMATE;
-	fftw_plan sinc_plan = fftw_plan_dft_r2c_1d(sinc_len * 2, sinc, state->sinc_fr, FFTW_ESTIMATE);
 	dsp_fftw_release();
-	if (check_alloc(ei->name, sinc_plan)) goto fail;
 	for (int i = 0; i < e->ostream.channels; ++i) {
 		state->input[i] = fftw_malloc(state->in_len * 2 * sizeof(sample_t));
 		state->output[i] = fftw_malloc(state->out_len * 2 * sizeof(sample_t));
@@ -345,7 +401,6 @@ struct effect * resample_effect_init(const struct effect_info *ei, const struct
 		state->c2r_plan[i] = fftw_plan_dft_c2r_1d(state->out_len * 2, state->tmp_fr_2, state->output[i], planner_flags);
 		dsp_fftw_release();
 		if (!state->input[i] || !state->output[i] || !state->overlap[i] || !state->r2c_plan[i] || !state->c2r_plan[i]) {
-			fftw_destroy_plan(sinc_plan);
 			dsp_perror(DSP_ENOMEM, ei->name, NULL);
 			goto fail;
 		}
@@ -353,25 +408,15 @@ struct effect * resample_effect_init(const struct effect_info *ei, const struct
 		memset(state->output[i], 0, state->out_len * 2 * sizeof(sample_t));
 		memset(state->overlap[i], 0, state->out_len * sizeof(sample_t));
 	}
-	memset(sinc, 0, sinc_len * 2 * sizeof(sample_t));
-	memset(state->sinc_fr, 0, state->sinc_fr_len * sizeof(fftw_complex));
 	memset(state->tmp_fr, 0, state->tmp_fr_len * sizeof(fftw_complex));
 	memset(state->tmp_fr_2, 0, state->tmp_fr_len * sizeof(fftw_complex));
 
-	/* generate windowed sinc function */
-	/* note: all supported windows are zero at endpoints, so skip the first and last indicies */
-	for (int i = 1; i < m_os; ++i)
-		sinc[i] = norm_sinc((i*2 - m_os)/2.0, fc_os) * window((double) i / m_os);
-
-	fftw_execute(sinc_plan);
-	fftw_destroy_plan(sinc_plan);
-	fftw_free(sinc);
-
-#if SINC_SELF_CONVOLVE
-	/* convolve sinc function with itself (doubles stopband attenuation) */
-	for (int i = 0; i < state->sinc_fr_len; ++i)
-		state->sinc_fr[i] *= state->sinc_fr[i];
-#endif
+	/* the sinc spectrum depends only on these parameters and is shared */
+	const struct resample_sinc_key sinc_key = { fc_os, sinc_len, m_os };
+	const struct shared_data_key key[] = { { &sinc_key, sizeof(sinc_key) } };
+	state->sinc_fr = shared_data_get("resample", key, LENGTH(key),
+		state->sinc_fr_len * sizeof(fftw_complex), resample_sinc_fr_init, (void *) &sinc_key);
+	if (!state->sinc_fr) goto fail;
 
 	LOG_FMT(LL_VERBOSE, "%s: info: gcd=%d ratio=%d/%d width=%fHz fc=%f filter_len=%d in_len=%d out_len=%d sinc_oversample=%d",
 		argv[0], gcd, state->ratio.n, state->ratio.d, width, fc, m1+1, state->in_len, state->out_len, sinc_os);
@@ -379,7 +424,6 @@ struct effect * resample_effect_init(const struct effect_info *ei, const struct
 	return e;
 
 	fail:
-	fftw_free(sinc);
 	if (state) resample_effect_destroy(e);
 	free(e);
 	return NULL;
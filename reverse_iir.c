@@ -36,6 +36,8 @@
 #define RIIR_RES_LIM       (1e-8/DBL_EPSILON)
 #define RIIR_SORT_SECTIONS 1
 #define RIIR_EXTRA_VERBOSE 0
+#define RIIR_BLOCK_RUN     1    /* set to 0 to use the per-sample reference implementation */
+#define RIIR_BLOCK_FRAMES  256
 
 enum riir_pq_type {
 	RIIR_PQ_TYPE_NONE = 0,
@@ -89,6 +91,71 @@ struct riir_state {
 	} fir;
 };
 
+#if RIIR_BLOCK_RUN
+/*
+ * Each stage computes y[n] = p^(2^j)*x[n] + x[n-2^j], so there is no
+ * feedback within a stage and a whole block can be run through one stage
+ * before moving on to the next. The history buffer is indexed by absolute
+ * sample position modulo its length, so it is accessed in contiguous runs
+ * that do not alias the block buffer.
+*/
+typedef double riir_vec __attribute__((vector_size(2*sizeof(double)), aligned(sizeof(double)), may_alias));
+#define RIIR_VEC(x) (*(riir_vec *) &(x))
+
+static inline void riir_stage_run_real(const double p, double *m, const int n_m, const int idx, double *x, const int frames)
+{
+	const riir_vec pv = { p, p };
+	for (int n = 0, mi = idx&(n_m-1); n < frames; mi = 0) {
+		const int run = MINIMUM(frames-n, n_m-mi);
+		double *restrict xr = &x[n], *restrict mr = &m[mi];
+		int i = 0;
+		for (; i+2 <= run; i += 2) {
+			const riir_vec xi = RIIR_VEC(xr[i]);
+			RIIR_VEC(xr[i]) = pv*xi + RIIR_VEC(mr[i]);
+			RIIR_VEC(mr[i]) = xi;
+		}
+		for (; i < run; ++i) {
+			const double xi = xr[i];
+			xr[i] = p*xi + mr[i];
+			mr[i] = xi;
+		}
+		n += run;
+	}
+}
+
+static inline void riir_stage_run_cc(const double complex p, double complex *m, const int n_m, const int idx, double complex *x, const int frames)
+{
+	/* one complex value per vector: p*x = {re(p),re(p)}*x + {-im(p),im(p)}*{im(x),re(x)} */
+	const riir_vec pr = { creal(p), creal(p) }, pi = { -cimag(p), cimag(p) };
+	for (int n = 0, mi = idx&(n_m-1); n < frames; mi = 0) {
+		const int run = MINIMUM(frames-n, n_m-mi);
+		double complex *restrict xr = &x[n], *restrict mr = &m[mi];
+		for (int i = 0; i < run; ++i) {
+			const riir_vec xi = RIIR_VEC(xr[i]);
+			const riir_vec xs = { xi[1], xi[0] };
+			RIIR_VEC(xr[i]) = pr*xi + pi*xs + RIIR_VEC(mr[i]);
+			RIIR_VEC(mr[i]) = xi;
+		}
+		n += run;
+	}
+}
+
+#define RIIR_SEC_RUN_BLOCK_X_DEFINE_FN(X, T) \
+	static void riir_sec_run_block_ ## X (struct riir_ ## X *sec, T *x, const int idx, const int N, const int frames) \
+	{ \
+		/* the static stages are too short to benefit from running separately */ \
+		for (int n = 0; n < frames; ++n) { \
+			T xn = x[n], y; \
+			int mi = 0;              y = sec->s0.p*xn + sec->s0.m[mi]; sec->s0.m[mi] = xn; xn = y; \
+			mi = (idx+n)&((1<<1)-1); y = sec->s1.p*xn + sec->s1.m[mi]; sec->s1.m[mi] = xn; xn = y; \
+			mi = (idx+n)&((1<<2)-1); y = sec->s2.p*xn + sec->s2.m[mi]; sec->s2.m[mi] = xn; x[n] = y; \
+		} \
+		for (int j = 0; j < N-3; ++j) \
+			riir_stage_run_ ## X (sec->sn[j].p, sec->sn[j].m, 1<<(j+3), idx, x, frames); \
+	}
+RIIR_SEC_RUN_BLOCK_X_DEFINE_FN(real, double)
+RIIR_SEC_RUN_BLOCK_X_DEFINE_FN(cc, double complex)
+#else
 #define RIIR_SEC_RUN_X_DEFINE_FN(X, T, C) \
 	static inline double riir_sec_run_ ## X (struct riir_ ## X *sec, const double s, const int idx, const int N) \
 	{ \
@@ -102,6 +169,7 @@ struct riir_state {
 	}
 RIIR_SEC_RUN_X_DEFINE_FN(real, double, return sec->res*y; )
 RIIR_SEC_RUN_X_DEFINE_FN(cc, double complex, return 2.0*creal(y*sec->res); )
+#endif
 
 static double riir_run_fir_part(struct riir_state *state, const double s, const int idx)
 {
@@ -122,6 +190,43 @@ static double riir_run_fir_part(struct riir_state *state, const double s, const
 	return r;
 }
 
+#if RIIR_BLOCK_RUN
+static void riir_run_filter(struct riir_state *state, sample_t *buf, ssize_t samples, ssize_t stride)
+{
+	double x[RIIR_BLOCK_FRAMES], y[RIIR_BLOCK_FRAMES], t[RIIR_BLOCK_FRAMES];
+	double complex tc[RIIR_BLOCK_FRAMES];
+	while (samples > 0) {
+		const int frames = MINIMUM(samples, RIIR_BLOCK_FRAMES);
+		for (int n = 0; n < frames; ++n) {
+			x[n] = buf[n*stride];
+			y[n] = 0.0;
+		}
+		for (int i = 0; i < state->n_real; ++i) {
+			const double res = state->real[i].res;
+			memcpy(t, x, frames*sizeof(double));
+			riir_sec_run_block_real(&state->real[i], t, state->idx, state->N, frames);
+			for (int n = 0; n < frames; ++n)
+				y[n] += res*t[n];
+		}
+		for (int i = 0; i < state->n_cc; ++i) {
+			const double complex res = state->cc[i].res;
+			for (int n = 0; n < frames; ++n)
+				tc[n] = x[n];
+			riir_sec_run_block_cc(&state->cc[i], tc, state->idx, state->N, frames);
+			for (int n = 0; n < frames; ++n)
+				y[n] += 2.0*creal(tc[n]*res);
+		}
+		for (int n = 0; n < frames; ++n) {
+			if (state->fir.n)
+				y[n] += riir_run_fir_part(state, x[n], state->idx);
+			buf[n*stride] = y[n];
+			state->idx = (state->idx+1)&(state->mask);
+		}
+		buf += frames*stride;
+		samples -= frames;
+	}
+}
+#else
 static void riir_run_filter(struct riir_state *state, sample_t *buf, ssize_t samples, ssize_t stride)
 {
 	while (samples-- > 0) {
@@ -137,6 +242,7 @@ static void riir_run_filter(struct riir_state *state, sample_t *buf, ssize_t sam
 		state->idx = (state->idx+1)&(state->mask);
 	}
 }
+#endif
 
 static sample_t * reverse_iir_effect_run(struct effect *e, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
 {
@@ -174,39 +280,51 @@ static void reverse_iir_effect_reset(struct effect *e)
 	}
 }
 
-#define PRINTF_CARGS(x) creal(x), cimag(x)
-static void reverse_iir_effect_plot(struct effect *e, int idx)
+static void reverse_iir_effect_plot(struct effect *e, ssize_t n, double df, const double complex *ih, double complex *oh)
 {
 	struct riir_state *state = (struct riir_state *) e->data;
 	for (int k = 0; k < e->istream.channels; ++k) {
+		const double complex *ih_k = &ih[k*n];
+		double complex *oh_k = &oh[k*n];
 		if (state[k].N > 0) {
-			printf("H%d_%d(w)=(abs(w)<=pi)?1.0", k, idx);
-			for (struct riir_state *cs = &state[k]; cs; cs = cs->cascade) {
-				fputs("*(0", stdout);
-				if (cs->fir.n > 0) {
-					printf("+(%.15e", cs->fir.c[0]);
-					for (int i = 1; i < cs->fir.n; ++i)
-						printf("+%.15e*exp(-%d*j*w)", cs->fir.c[i], i);
-					printf(")*exp(-2**%d*j*w)", cs->N);
-				}
-				for (int i = 0; i < cs->n_real; ++i) {
-					printf("+%.15e", cs->real[i].res);
-					for (int j = 0; j < cs->N; ++j)
-						printf("*((%.15e)**(2**%d)+exp(-2**%d*j*w))", cs->real[i].s0.p, j, j);
+			for (ssize_t idx = 0; idx < n; ++idx) {
+				const double w = 2.0*M_PI*idx*df/e->ostream.fs;
+				if (w > M_PI) {
+					oh_k[idx] = NAN;
+					continue;
 				}
-				for (int i = 0; i < cs->n_cc; ++i) {
-					printf("+{%.15e,%.15e}", PRINTF_CARGS(cs->cc[i].res));
-					for (int j = 0; j < cs->N; ++j)
-						printf("*({%.15e,%.15e}**(2**%d)+exp(-2**%d*j*w))", PRINTF_CARGS(cs->cc[i].s0.p), j, j);
-					printf("+{%.15e,%.15e}", PRINTF_CARGS(conj(cs->cc[i].res)));
-					for (int j = 0; j < cs->N; ++j)
-						printf("*({%.15e,%.15e}**(2**%d)+exp(-2**%d*j*w))", PRINTF_CARGS(conj(cs->cc[i].s0.p)), j, j);
+				double complex h = ih_k[idx] * cexp(I*w*state[k].latency);
+				for (struct riir_state *cs = &state[k]; cs; cs = cs->cascade) {
+					double complex s = 0.0;
+					if (cs->fir.n > 0) {
+						double complex f = 0.0;
+						for (int i = 0; i < cs->fir.n; ++i)
+							f += cs->fir.c[i] * cexp(-I*w*i);
+						s += f * cexp(-I*w*(1<<cs->N));
+					}
+					for (int i = 0; i < cs->n_real; ++i) {
+						double complex t = cs->real[i].res;
+						double p = cs->real[i].s0.p;
+						for (int j = 0; j < cs->N; ++j, p *= p)
+							t *= p + cexp(-I*w*(1<<j));
+						s += t;
+					}
+					for (int i = 0; i < cs->n_cc; ++i) {
+						double complex t0 = cs->cc[i].res, t1 = conj(cs->cc[i].res);
+						double complex p = cs->cc[i].s0.p;
+						for (int j = 0; j < cs->N; ++j, p *= p) {
+							const double complex zj = cexp(-I*w*(1<<j));
+							t0 *= p + zj;
+							t1 *= conj(p) + zj;
+						}
+						s += t0 + t1;
+					}
+					h *= s;
 				}
-				putchar(')');
+				oh_k[idx] = h;
 			}
-			printf("*exp(%d*j*w):0/0\n", state[k].latency);
 		}
-		else printf("H%d_%d(w)=1.0\n", k, idx);
+		else memcpy(oh_k, ih_k, n * sizeof(double complex));
 	}
 }
 
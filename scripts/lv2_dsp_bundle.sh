@@ -0,0 +1,106 @@
+#!/bin/sh
+
+#
+# Generate an LV2 bundle for the ladspa_dsp configuration files
+#
+# Usage:
+#     lv2_dsp_bundle.sh [-b bundle_dir] [-l ladspa_dsp.so]
+#
+# The bundle (default: ~/.lv2/ladspa_dsp.lv2) contains the plugin
+# descriptions and a symlink to ladspa_dsp.so (default:
+# /usr/lib/ladspa/ladspa_dsp.so). Config files are found the same way
+# ladspa_dsp finds them. Run again after adding or removing config files
+# or changing the number of channels.
+#
+
+URI_PREFIX='https://github.com/bmc0/dsp/lv2#'  # keep in sync with lv2_dsp.c
+BUNDLE="${HOME}/.lv2/ladspa_dsp.lv2"
+LIB=/usr/lib/ladspa/ladspa_dsp.so
+
+while getopts b:l: opt; do
+	case "$opt" in
+		b) BUNDLE="$OPTARG" ;;
+		l) LIB="$OPTARG" ;;
+		*) echo "usage: $0 [-b bundle_dir] [-l ladspa_dsp.so]" 1>&2; exit 1 ;;
+	esac
+done
+
+if [ -n "$LADSPA_DSP_CONFIG_PATH" ]; then
+	CONFIG_PATH="$LADSPA_DSP_CONFIG_PATH"
+elif [ -n "$XDG_CONFIG_HOME" ]; then
+	CONFIG_PATH="${XDG_CONFIG_HOME}/ladspa_dsp:/etc/ladspa_dsp"
+elif [ -n "$HOME" ]; then
+	CONFIG_PATH="${HOME}/.config/ladspa_dsp:/etc/ladspa_dsp"
+else
+	CONFIG_PATH=/etc/ladspa_dsp
+fi
+
+# prints "input_channels output_channels" for a config file
+AWK_SCRIPT='
+BEGIN { in_ch=1; out_ch=1 }
+{
+	sub(/^[ \t]+/, "")
+	if ($0=="[effects_chain]") exit
+	if ($0=="" || substr($0, 1, 1)=="#") next
+	i=index($0, "=")
+	if (i==0) next
+	key=substr($0, 1, i-1); value=substr($0, i+1)
+	if (key=="input_channels") in_ch=value+0
+	else if (key=="output_channels") out_ch=value+0
+}
+END { print in_ch, out_ch }
+'
+
+write_plugin() {
+	uri="${URI_PREFIX}$1"
+	echo "<${uri}> a lv2:Plugin ; lv2:binary <ladspa_dsp.so> ; rdfs:seeAlso <ladspa_dsp.ttl> ." >> "$BUNDLE/manifest.ttl"
+	{
+		echo
+		echo "<${uri}>"
+		echo "	a lv2:Plugin ;"
+		echo "	doap:name \"$1\" ;"
+		echo "	doap:license <http://opensource.org/licenses/isc> ;"
+		echo "	lv2:optionalFeature work:schedule, lv2:hardRTCapable ;"
+		echo "	lv2:extensionData work:interface ;"
+		echo "	lv2:port"
+		i=0
+		while [ $i -lt $2 ]; do
+			echo "		[ a lv2:InputPort, lv2:AudioPort ; lv2:index $i ; lv2:symbol \"in$i\" ; lv2:name \"Input$i\" ] ,"
+			i=$((i+1))
+		done
+		while [ $i -lt $(($2+$3)) ]; do
+			echo "		[ a lv2:OutputPort, lv2:AudioPort ; lv2:index $i ; lv2:symbol \"out$(($i-$2))\" ; lv2:name \"Output$(($i-$2))\" ] ,"
+			i=$((i+1))
+		done
+		echo "		[ a lv2:OutputPort, lv2:ControlPort ; lv2:index $i ; lv2:symbol \"latency\" ; lv2:name \"Latency\" ;"
+		echo "			lv2:designation lv2:latency ; lv2:portProperty lv2:reportsLatency, lv2:integer ] ."
+	} >> "$BUNDLE/ladspa_dsp.ttl"
+}
+
+mkdir -p "$BUNDLE" || exit 1
+PREFIXES='@prefix doap: <http://usefulinc.com/ns/doap#> .
+@prefix lv2:  <http://lv2plug.in/ns/lv2core#> .
+@prefix rdfs: <http://www.w3.org/2000/01/rdf-schema#> .
+@prefix work: <http://lv2plug.in/ns/ext/worker#> .'
+echo "$PREFIXES" > "$BUNDLE/manifest.ttl"
+echo "$PREFIXES" > "$BUNDLE/ladspa_dsp.ttl"
+ln -sf "$LIB" "$BUNDLE/ladspa_dsp.so" || exit 1
+
+n=0
+IFS_SAVE="$IFS"; IFS=:
+for dir in $CONFIG_PATH; do
+	IFS="$IFS_SAVE"
+	for f in "$dir"/config "$dir"/config_?*; do
+		[ -f "$f" ] || continue
+		name="${f##*/}"
+		if [ "$name" = config ]; then label=ladspa_dsp
+		else label="ladspa_dsp:${name#config_}"
+		fi
+		write_plugin "$label" $(awk "$AWK_SCRIPT" "$f")
+		echo "info: $f -> ${URI_PREFIX}${label}"
+		n=$((n+1))
+	done
+	IFS=:
+done
+IFS="$IFS_SAVE"
+[ $n -gt 0 ] || echo "warning: no config files found in $CONFIG_PATH" 1>&2
@@ -0,0 +1,174 @@
+/*
+ * This file is part of dsp.
+ *
+ * Copyright (c) 2026 Michael Barbour <barbour.michael.0@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "seek_index.h"
+#include "util.h"
+
+#define SEEK_INDEX_MAGIC "DSPSIDX1"
+
+struct seek_index_header {
+	char magic[8], tag[16];
+	int64_t size, mtime_sec, mtime_nsec, ino, frames, n;
+};
+
+int seek_index_add(struct seek_index *idx, int64_t pos, int64_t offset)
+{
+	if (idx->n == idx->cap) {
+		const ssize_t cap = (idx->cap > 0) ? idx->cap * 2 : 64;
+		struct seek_index_entry *e = realloc(idx->e, cap * sizeof(struct seek_index_entry));
+		if (check_alloc(__func__, e)) return 1;
+		idx->e = e;
+		idx->cap = cap;
+	}
+	idx->e[idx->n++] = (struct seek_index_entry) { .pos = pos, .offset = offset };
+	return 0;
+}
+
+ssize_t seek_index_find(const struct seek_index *idx, int64_t pos)
+{
+	ssize_t lo = 0, hi = idx->n;
+	while (lo < hi) {
+		const ssize_t mid = lo + (hi - lo) / 2;
+		if (idx->e[mid].pos <= pos) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo - 1;
+}
+
+void seek_index_free(struct seek_index *idx)
+{
+	free(idx->e);
+	idx->e = NULL;
+	idx->n = idx->cap = 0;
+}
+
+int seek_index_copy(struct seek_index *dst, const struct seek_index *src)
+{
+	struct seek_index_entry *e = NULL;
+	if (src->n > 0) {
+		e = malloc(src->n * sizeof(struct seek_index_entry));
+		if (check_alloc(__func__, e)) return 1;
+		memcpy(e, src->e, src->n * sizeof(struct seek_index_entry));
+	}
+	seek_index_free(dst);
+	dst->e = e;
+	dst->n = dst->cap = src->n;
+	dst->frames = src->frames;
+	return 0;
+}
+
+static char * get_cache_path(const char *path, const char *tag)
+{
+	const char *dir = getenv("DSP_SEEK_INDEX_DIR");
+	char rp[PATH_MAX];
+	uint64_t h = 0xcbf29ce484222325;  /* FNV-1a */
+	if (dir == NULL || dir[0] == '\0') return NULL;
+	if (realpath(path, rp) == NULL) return NULL;
+	for (const char *s = rp; *s; ++s) {
+		h ^= (unsigned char) *s;
+		h *= 0x100000001b3;
+	}
+	const int len = strlen(dir) + 1 + 16 + 1 + strlen(tag) + 1;
+	char *cp = calloc(len, sizeof(char));
+	if (check_alloc(__func__, cp)) return NULL;
+	snprintf(cp, len, "%s/%016llx.%s", dir, (unsigned long long) h, tag);
+	return cp;
+}
+
+static int fill_header(struct seek_index_header *hdr, const char *path, const char *tag)
+{
+	struct stat st;
+	if (stat(path, &st) < 0) return 1;
+	memset(hdr, 0, sizeof(struct seek_index_header));
+	memcpy(hdr->magic, SEEK_INDEX_MAGIC, sizeof(hdr->magic));
+	strncpy(hdr->tag, tag, sizeof(hdr->tag) - 1);
+	hdr->size = st.st_size;
+	hdr->mtime_sec = st.st_mtim.tv_sec;
+	hdr->mtime_nsec = st.st_mtim.tv_nsec;
+	hdr->ino = st.st_ino;
+	return 0;
+}
+
+int seek_index_load(struct seek_index *idx, const char *path, const char *tag)
+{
+	struct seek_index_header hdr, f_hdr;
+	FILE *f = NULL;
+	int r = 1;
+	char *cp = get_cache_path(path, tag);
+	if (cp == NULL || fill_header(&hdr, path, tag)) goto done;
+	if ((f = fopen(cp, "rb")) == NULL) goto done;
+	if (fread(&f_hdr, sizeof(f_hdr), 1, f) != 1) goto done;
+	hdr.frames = f_hdr.frames;
+	hdr.n = f_hdr.n;
+	if (memcmp(&hdr, &f_hdr, sizeof(hdr)) != 0 || f_hdr.n < 0) goto done;
+	seek_index_free(idx);
+	idx->e = calloc(MAXIMUM(f_hdr.n, 1), sizeof(struct seek_index_entry));
+	if (check_alloc(__func__, idx->e)) goto done;
+	idx->cap = MAXIMUM(f_hdr.n, 1);
+	if (fread(idx->e, sizeof(struct seek_index_entry), f_hdr.n, f) != (size_t) f_hdr.n) {
+		seek_index_free(idx);
+		goto done;
+	}
+	idx->n = f_hdr.n;
+	idx->frames = f_hdr.frames;
+	LOG_FMT(LL_VERBOSE, "%s: info: loaded seek index: %s", tag, cp);
+	r = 0;
+
+	done:
+	if (f) fclose(f);
+	free(cp);
+	return r;
+}
+
+void seek_index_save(const struct seek_index *idx, const char *path, const char *tag)
+{
+	struct seek_index_header hdr;
+	FILE *f;
+	char *cp = get_cache_path(path, tag);
+	if (cp == NULL || fill_header(&hdr, path, tag)) goto done;
+	hdr.frames = idx->frames;
+	hdr.n = idx->n;
+
+	/* write to a temporary file and rename so concurrent readers never see a partial index */
+	const int len = strlen(cp) + 32;
+	char *tmp = calloc(len, sizeof(char));
+	if (check_alloc(__func__, tmp)) goto done;
+	snprintf(tmp, len, "%s.%ld.tmp", cp, (long) getpid());
+	if ((f = fopen(tmp, "wb")) == NULL) {
+		LOG_FMT(LL_VERBOSE, "%s: warning: failed to save seek index: %s", tag, cp);
+		free(tmp);
+		goto done;
+	}
+	const int err = (fwrite(&hdr, sizeof(hdr), 1, f) != 1
+		|| fwrite(idx->e, sizeof(struct seek_index_entry), idx->n, f) != (size_t) idx->n);
+	if (fclose(f) || err || rename(tmp, cp)) {
+		LOG_FMT(LL_VERBOSE, "%s: warning: failed to save seek index: %s", tag, cp);
+		unlink(tmp);
+	}
+	else LOG_FMT(LL_VERBOSE, "%s: info: saved seek index: %s", tag, cp);
+	free(tmp);
+
+	done:
+	free(cp);
+}
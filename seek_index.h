@@ -0,0 +1,52 @@
+/*
+ * This file is part of dsp.
+ *
+ * Copyright (c) 2026 Michael Barbour <barbour.michael.0@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef DSP_SEEK_INDEX_H
+#define DSP_SEEK_INDEX_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Maps sample positions to byte offsets of independently decodable points
+   in a compressed stream. Entries must be added in increasing order. */
+struct seek_index_entry {
+	int64_t pos, offset;
+};
+
+struct seek_index {
+	struct seek_index_entry *e;
+	ssize_t n, cap;
+	ssize_t frames;  /* total length of the stream, or -1 if unknown */
+};
+
+int seek_index_add(struct seek_index *, int64_t, int64_t);
+/* returns the index of the last entry at or before the given position, or -1 */
+ssize_t seek_index_find(const struct seek_index *, int64_t);
+void seek_index_free(struct seek_index *);
+/* replaces the contents of the first index with a copy of the second */
+int seek_index_copy(struct seek_index *, const struct seek_index *);
+
+/* The index for a file can be cached in the directory given by the
+   DSP_SEEK_INDEX_DIR environment variable. Cache entries are keyed by the
+   file's path and are invalidated when its size or mtime change. The tag
+   identifies the codec that built the index. seek_index_load() returns
+   nonzero if no valid cache entry exists. */
+int seek_index_load(struct seek_index *, const char *, const char *);
+void seek_index_save(const struct seek_index *, const char *, const char *);
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * This file is part of dsp.
+ *
+ * Copyright (c) 2026 Michael Barbour <barbour.michael.0@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "shared_data.h"
+#include "dsp.h"
+#include "util.h"
+
+struct shared_data_entry {
+	struct shared_data_entry *next;
+	const char *kind;
+	uint64_t hash;
+	size_t key_size, size;
+	int refs;
+	char *key;
+	void *data;
+};
+
+static struct shared_data_entry *entries = NULL;
+static pthread_mutex_t shared_data_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t key_hash(const char *kind, const struct shared_data_key *key, int n)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;  /* FNV-1a */
+	for (const char *s = kind; *s != '\0'; ++s)
+		h = (h ^ (unsigned char) *s) * 0x100000001b3ULL;
+	for (int i = 0; i < n; ++i) {
+		const unsigned char *p = key[i].p;
+		for (size_t j = 0; j < key[i].size; ++j)
+			h = (h ^ p[j]) * 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static int key_matches(const struct shared_data_entry *ent, const char *kind, uint64_t hash, const struct shared_data_key *key, int n, size_t key_size, size_t size)
+{
+	if (ent->hash != hash || ent->key_size != key_size || ent->size != size || strcmp(ent->kind, kind) != 0)
+		return 0;
+	const char *p = ent->key;
+	for (int i = 0; i < n; ++i) {
+		if (memcmp(p, key[i].p, key[i].size) != 0) return 0;
+		p += key[i].size;
+	}
+	return 1;
+}
+
+static void entry_free(struct shared_data_entry *ent)
+{
+	free(ent->key);
+	free(ent->data);
+	free(ent);
+}
+
+void * shared_data_get(const char *kind, const struct shared_data_key *key, int n, size_t size, int (*init)(void *, void *), void *arg)
+{
+	struct shared_data_entry *ent;
+	size_t key_size = 0;
+	for (int i = 0; i < n; ++i)
+		key_size += key[i].size;
+	const uint64_t hash = key_hash(kind, key, n);
+
+	pthread_mutex_lock(&shared_data_lock);
+	for (ent = entries; ent; ent = ent->next) {
+		if (key_matches(ent, kind, hash, key, n, key_size, size)) {
+			++ent->refs;
+			LOG_FMT(LL_VERBOSE, "%s: info: using shared data: %zu bytes; refs=%d", kind, size, ent->refs);
+			pthread_mutex_unlock(&shared_data_lock);
+			return ent->data;
+		}
+	}
+	/* init() runs with the lock held so concurrent instantiations of the
+	   same configuration wait for the first one instead of duplicating it */
+	ent = calloc(1, sizeof(struct shared_data_entry));
+	if (ent == NULL) goto fail;
+	ent->kind = kind;
+	ent->hash = hash;
+	ent->key_size = key_size;
+	ent->size = size;
+	ent->refs = 1;
+	ent->key = malloc(MAXIMUM(key_size, 1));
+	if (ent->key == NULL || posix_memalign(&ent->data, SHARED_DATA_ALIGN, MAXIMUM(size, 1))) goto fail_alloc;
+	char *kp = ent->key;
+	for (int i = 0; i < n; kp += key[i].size, ++i)
+		memcpy(kp, key[i].p, key[i].size);
+	memset(ent->data, 0, size);
+	if (init(ent->data, arg)) {
+		entry_free(ent);
+		pthread_mutex_unlock(&shared_data_lock);
+		return NULL;
+	}
+	ent->next = entries;
+	entries = ent;
+	pthread_mutex_unlock(&shared_data_lock);
+	return ent->data;
+
+	fail_alloc:
+	ent->data = NULL;  /* unspecified on posix_memalign() failure */
+	entry_free(ent);
+	fail:
+	pthread_mutex_unlock(&shared_data_lock);
+	dsp_perror(DSP_ENOMEM, __func__, NULL);
+	return NULL;
+}
+
+void shared_data_release(void *data)
+{
+	if (data == NULL) return;
+	pthread_mutex_lock(&shared_data_lock);
+	for (struct shared_data_entry **ep = &entries; *ep; ep = &(*ep)->next) {
+		struct shared_data_entry *ent = *ep;
+		if (ent->data == data) {
+			if (--ent->refs == 0) {
+				*ep = ent->next;
+				entry_free(ent);
+			}
+			break;
+		}
+	}
+	pthread_mutex_unlock(&shared_data_lock);
+}
@@ -0,0 +1,43 @@
+/*
+ * This file is part of dsp.
+ *
+ * Copyright (c) 2026 Michael Barbour <barbour.michael.0@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef DSP_SHARED_DATA_H
+#define DSP_SHARED_DATA_H
+
+#include <stddef.h>
+
+/* Process-wide cache of immutable effect data (filter spectra and the
+   like). Entries are matched on the kind string plus an exact comparison
+   of the key, and are reference counted so that every effect instance
+   built from the same parameters uses a single copy. Data is aligned to
+   SHARED_DATA_ALIGN bytes and must not be modified after init() returns. */
+#define SHARED_DATA_ALIGN 64
+
+struct shared_data_key {
+	const void *p;
+	size_t size;
+};
+
+/* Returns a reference to the data for the given kind and key, calling
+   init(data, arg) to fill a new entry if none exists. Returns NULL if
+   allocation or init() fails. */
+void * shared_data_get(const char *, const struct shared_data_key *, int, size_t, int (*)(void *, void *), void *);
+/* Drops a reference obtained from shared_data_get(). NULL is ignored. */
+void shared_data_release(void *);
+
+#endif
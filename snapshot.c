@@ -0,0 +1,94 @@
+/*
+ * This file is part of dsp.
+ *
+ * Copyright (c) 2026 Michael Barbour <barbour.michael.0@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "snapshot.h"
+#include "util.h"
+
+static const unsigned char zero_pad[SNAPSHOT_ALIGN];
+
+void snapshot_write(struct snapshot_writer *w, const void *p, size_t len)
+{
+	const size_t pad = (SNAPSHOT_ALIGN - len % SNAPSHOT_ALIGN) % SNAPSHOT_ALIGN;
+	if (w->err) return;
+	if ((len > 0 && fwrite(p, 1, len, w->f) != len) || (pad > 0 && fwrite(zero_pad, 1, pad, w->f) != pad))
+		w->err = 1;
+}
+
+void snapshot_write_str(struct snapshot_writer *w, const char *s)
+{
+	const int64_t len = (s) ? (int64_t) strlen(s) : -1;
+	SNAPSHOT_WRITE_VAL(w, len);
+	if (s) snapshot_write(w, s, len + 1);
+}
+
+void snapshot_write_selector(struct snapshot_writer *w, const char *sel, int n)
+{
+	unsigned char b[n];
+	for (int i = 0; i < n; ++i)
+		b[i] = !!GET_BIT(sel, i);
+	snapshot_write(w, b, n);
+}
+
+const void * snapshot_read(struct snapshot_reader *r, size_t len)
+{
+	const size_t padded = len + (SNAPSHOT_ALIGN - len % SNAPSHOT_ALIGN) % SNAPSHOT_ALIGN;
+	if (r->err || padded < len || padded > (size_t) (r->end - r->p)) {
+		r->err = 1;
+		return NULL;
+	}
+	const void *p = r->p;
+	r->p += padded;
+	return p;
+}
+
+int snapshot_read_val(struct snapshot_reader *r, void *v, size_t len)
+{
+	const void *p = snapshot_read(r, len);
+	if (p == NULL) return 1;
+	memcpy(v, p, len);
+	return 0;
+}
+
+const char * snapshot_read_str(struct snapshot_reader *r)
+{
+	int64_t len;
+	if (SNAPSHOT_READ_VAL(r, len)) return NULL;
+	if (len == -1) return NULL;  /* NULL string */
+	if (len < 0) {
+		r->err = 1;
+		return NULL;
+	}
+	const char *s = snapshot_read(r, len + 1);
+	if (s == NULL || s[len] != '\0') {
+		r->err = 1;
+		return NULL;
+	}
+	return s;
+}
+
+int snapshot_read_selector(struct snapshot_reader *r, char *sel, int n)
+{
+	const unsigned char *b = snapshot_read(r, n);
+	if (b == NULL) return 1;
+	CLEAR_SELECTOR(sel, n);
+	for (int i = 0; i < n; ++i)
+		if (b[i]) SET_BIT(sel, i);
+	return 0;
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is part of dsp.
+ *
+ * Copyright (c) 2026 Michael Barbour <barbour.michael.0@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef DSP_SNAPSHOT_H
+#define DSP_SNAPSHOT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Serialization helpers for effects chain snapshots. Items are padded to
+   SNAPSHOT_ALIGN bytes so arrays can be used in place from a mapping of
+   the file. The format is native; byte order and type sizes are checked
+   by the loader. Errors are sticky and recorded in err. */
+#define SNAPSHOT_ALIGN 8
+
+struct snapshot_writer {
+	FILE *f;
+	int err;
+};
+
+struct snapshot_reader {
+	const unsigned char *p, *end;
+	int err;
+};
+
+void snapshot_write(struct snapshot_writer *, const void *, size_t);
+void snapshot_write_str(struct snapshot_writer *, const char *);
+void snapshot_write_selector(struct snapshot_writer *, const char *, int);
+
+/* Returns a pointer to the next item, or NULL (and sets err) if the item
+   extends past the end. */
+const void * snapshot_read(struct snapshot_reader *, size_t);
+/* copies the next item; returns nonzero on error */
+int snapshot_read_val(struct snapshot_reader *, void *, size_t);
+/* returns NULL for a NULL string or on error (check err) */
+const char * snapshot_read_str(struct snapshot_reader *);
+/* reads into a selector allocated by the caller; returns nonzero on error */
+int snapshot_read_selector(struct snapshot_reader *, char *, int);
+
+#define SNAPSHOT_WRITE_VAL(w, v) snapshot_write((w), &(v), sizeof(v))
+#define SNAPSHOT_READ_VAL(r, v)  snapshot_read_val((r), &(v), sizeof(v))
+
+#endif
@@ -18,6 +18,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <complex.h>
 #include "st2ms.h"
 #include "util.h"
 
@@ -53,19 +55,15 @@ static sample_t * ms2st_effect_run(struct effect *e, ssize_t *frames, sample_t *
 	return ibuf;
 }
 
-static void st2ms_effect_plot(struct effect *e, int i)
+static void st2ms_effect_plot(struct effect *e, ssize_t n, double df, const double complex *ih, double complex *oh)
 {
 	struct st2ms_state *state = (struct st2ms_state *) e->data;
-	const int is_ms2st = (e->run == ms2st_effect_run);
-	for (int k = 0; k < e->ostream.channels; ++k) {
-		if (k == state->c0)
-			printf("H%d_%d(w)=(Ht%d_%d(w*%d/2.0/pi)+Ht%d_%d(w*%d/2.0/pi))*%g\n",
-				k, i, state->c0, i, e->ostream.fs, state->c1, i, e->ostream.fs, (is_ms2st)?1.0:0.5);
-		else if (k == state->c1)
-			printf("H%d_%d(w)=(Ht%d_%d(w*%d/2.0/pi)-Ht%d_%d(w*%d/2.0/pi))*%g\n",
-				k, i, state->c0, i, e->ostream.fs, state->c1, i, e->ostream.fs, (is_ms2st)?1.0:0.5);
-		else
-			printf("H%d_%d(w)=Ht%d_%d(w*%d/2.0/pi)\n", k, i, k, i, e->ostream.fs);
+	const double g = (e->run == ms2st_effect_run) ? 1.0 : 0.5;
+	memcpy(oh, ih, n * e->ostream.channels * sizeof(double complex));
+	const double complex *ih_c0 = &ih[state->c0*n], *ih_c1 = &ih[state->c1*n];
+	for (ssize_t i = 0; i < n; ++i) {
+		oh[state->c0*n + i] = (ih_c0[i] + ih_c1[i]) * g;
+		oh[state->c1*n + i] = (ih_c0[i] - ih_c1[i]) * g;
 	}
 }
 
@@ -81,6 +79,20 @@ static void st2ms_effect_channel_deps(struct effect *e, char **deps)
 	SET_BIT(deps[state->c1], state->c0);
 }
 
+static void st2ms_effect_matrix(struct effect *e, sample_t *m)
+{
+	struct st2ms_state *state = (struct st2ms_state *) e->data;
+	const int n = e->istream.channels;
+	const sample_t g = (e->run == ms2st_effect_run) ? 1.0 : 0.5;
+	memset(m, 0, n * n * sizeof(sample_t));
+	for (int k = 0; k < n; ++k)
+		m[k*n + k] = 1.0;
+	m[state->c0*n + state->c0] = g;
+	m[state->c0*n + state->c1] = g;
+	m[state->c1*n + state->c0] = g;
+	m[state->c1*n + state->c1] = -g;
+}
+
 struct effect * st2ms_effect_init(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, const char *dir, int argc, const char *const *argv)
 {
 	if (argc != 1) {
@@ -97,7 +109,6 @@ struct effect * st2ms_effect_init(const struct effect_info *ei, const struct str
 	e->name = ei->name;
 	e->istream.fs = e->ostream.fs = istream->fs;
 	e->istream.channels = e->ostream.channels = istream->channels;
-	e->flags |= EFFECT_FLAG_PLOT_MIX;
 	switch (ei->effect_number) {
 	case ST2MS_EFFECT_NUMBER_ST2MS:
 		e->run = st2ms_effect_run;
@@ -113,6 +124,7 @@ struct effect * st2ms_effect_init(const struct effect_info *ei, const struct str
 	e->plot = st2ms_effect_plot;
 	e->destroy = st2ms_effect_destroy;
 	e->channel_deps = st2ms_effect_channel_deps;
+	e->matrix = st2ms_effect_matrix;
 
 	struct st2ms_state *state = calloc(1, sizeof(struct st2ms_state));
 	if (check_alloc(ei->name, state)) {
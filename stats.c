@@ -21,17 +21,28 @@
 #include <string.h>
 #include <math.h>
 #include "stats.h"
+#include "biquad.h"
 #include "util.h"
 
 #define STATS_DEFAULT_WIDTH 80
+#define STATS_BLOCK_FRAMES 256
+#define STATS_INTERP_DELAY 18  /* actually 7.75+1+9 samples (fir+quadratic+lookahead) */
+#define STATS_INTERP_LOOKAHEAD 9
+#define STATS_INTERP_HIST (15+STATS_INTERP_LOOKAHEAD)
+
+typedef double stats_vec __attribute__((vector_size(2*sizeof(double)), aligned(sizeof(double)), may_alias));
+typedef long long stats_mask __attribute__((vector_size(2*sizeof(long long))));
+
+#define STATS_VEC_MIN(a, b) ((stats_vec) (((stats_mask) (a) & ((a) < (b))) | ((stats_mask) (b) & ~((a) < (b)))))
+#define STATS_VEC_MAX(a, b) ((stats_vec) (((stats_mask) (a) & ((a) > (b))) | ((stats_mask) (b) & ~((a) > (b)))))
 
 struct stats_interp_state {
-	double m[64], y[6], tmin, tmax, z[9];
-	int p, zp, n;
+	double hist[STATS_INTERP_HIST], y[6], tmin, tmax;
+	int n;
 };
 
 struct stats_ch_state {
-	double sum, sum_sq, min, max, peak;
+	double sum, sum_sq, sum_c, sum_sq_c, min, max, peak;
 	ssize_t peak_count, peak_frame;
 	struct stats_interp_state interp;
 	int ch;
@@ -39,77 +50,141 @@ struct stats_ch_state {
 
 struct stats_state {
 	struct stats_ch_state *cs;
-	double ref;
+	double ref, x[STATS_INTERP_HIST+STATS_BLOCK_FRAMES];
 	ssize_t samples;
 	int width, n_cs;
 };
 
+struct stats_block {
+	double sum, sum_sq, min, max;
+};
+
+/* compensated (Neumaier) summation */
+static inline void stats_sum_add(double *sum, double *c, double x)
+{
+	const double t = *sum + x;
+	if (fabs(*sum) >= fabs(x)) *c += (*sum - t) + x;
+	else *c += (x - t) + *sum;
+	*sum = t;
+}
+
+#define STATS_SUM(cs) ((cs)->sum + (cs)->sum_c)
+#define STATS_SUM_SQ(cs) ((cs)->sum_sq + (cs)->sum_sq_c)
+
+static void stats_block_reduce(const double *x, ssize_t n, struct stats_block *b)
+{
+	stats_vec sum = {0.0, 0.0}, sum_sq = {0.0, 0.0};
+	stats_vec min = {x[0], x[0]}, max = {x[0], x[0]};
+	ssize_t i = 0;
+	for (; i+2 <= n; i += 2) {
+		const stats_vec v = *((const stats_vec *) &x[i]);
+		sum += v;
+		sum_sq += v*v;
+		min = STATS_VEC_MIN(v, min);
+		max = STATS_VEC_MAX(v, max);
+	}
+	b->sum = sum[0] + sum[1];
+	b->sum_sq = sum_sq[0] + sum_sq[1];
+	b->min = MINIMUM(min[0], min[1]);
+	b->max = MAXIMUM(max[0], max[1]);
+	for (; i < n; ++i) {
+		b->sum += x[i];
+		b->sum_sq += x[i]*x[i];
+		if (x[i] < b->min) b->min = x[i];
+		if (x[i] > b->max) b->max = x[i];
+	}
+}
+
+static inline const double * stats_gather(struct stats_state *state, const sample_t *ibuf, int stride, int ch, ssize_t n, int offset)
+{
+	if (stride == 1 && offset == 0) return ibuf;
+	double *x = &state->x[offset];
+	for (ssize_t i = 0; i < n; ++i)
+		x[i] = ibuf[i*stride + ch];
+	return x;
+}
+
+static void stats_block_peaks(struct stats_ch_state *cs, const double *x, ssize_t n, ssize_t frame)
+{
+	for (ssize_t i = 0; i < n; ++i) {
+		const double s = x[i];
+		int pk = 0;
+		if      (s <= cs->min) { cs->min = s; pk = 1; }
+		else if (s >= cs->max) { cs->max = s; pk = 1; }
+		if (pk) {
+			const double abs_s = fabs(s);
+			if (abs_s > 0.0 && abs_s == cs->peak)
+				++cs->peak_count;
+			else if (abs_s > cs->peak) {
+				cs->peak = abs_s;
+				cs->peak_frame = frame + i;
+				cs->peak_count = 1;
+			}
+		}
+	}
+}
+
 static sample_t * stats_effect_run(struct effect *e, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
 {
-	const ssize_t samples = *frames * e->ostream.channels;
 	struct stats_state *state = (struct stats_state *) e->data;
-	for (ssize_t i = 0; i < samples; i += e->ostream.channels) {
+	const int stride = e->ostream.channels;
+	for (ssize_t i = 0; i < *frames; i += STATS_BLOCK_FRAMES) {
+		const ssize_t n = MINIMUM(*frames - i, STATS_BLOCK_FRAMES);
 		for (int k = 0; k < state->n_cs; ++k) {
 			struct stats_ch_state *cs = &state->cs[k];
-			const double s = ibuf[i+cs->ch];
-			cs->sum += s;
-			cs->sum_sq += s*s;
-			int pk = 0;
-			if      (s <= cs->min) { cs->min = s; pk = 1; }
-			else if (s >= cs->max) { cs->max = s; pk = 1; }
-			if (pk) {
-				const double abs_s = fabs(s);
-				if (abs_s > 0.0 && abs_s == cs->peak)
-					++cs->peak_count;
-				else if (abs_s > cs->peak) {
-					cs->peak = abs_s;
-					cs->peak_frame = state->samples;
-					cs->peak_count = 1;
-				}
-			}
+			struct stats_block b;
+			const double *x = stats_gather(state, &ibuf[i*stride], stride, cs->ch, n, 0);
+			stats_block_reduce(x, n, &b);
+			stats_sum_add(&cs->sum, &cs->sum_c, b.sum);
+			stats_sum_add(&cs->sum_sq, &cs->sum_sq_c, b.sum_sq);
+			/* the peak tracking below is sequential, but only needs to
+			   run if the block reaches the current minimum or maximum */
+			if (b.min <= cs->min || b.max >= cs->max)
+				stats_block_peaks(cs, x, n, state->samples + i);
 		}
-		++state->samples;
 	}
+	state->samples += *frames;
 	return ibuf;
 }
 
-#define STATS_INTERP_DELAY 18  /* actually 7.75+1+9 samples (fir+quadratic+lookahead) */
-static void stats_interp_insert(struct stats_interp_state *state, double x)
+/*
+ * 4x interpolator (half filter with every 4th coefficient omitted) in
+ * polyphase form. Phases 0 and 2 are computed together in vector lanes
+ * (their coefficients are mirror images). Phase 3 is the input delayed by
+ * 7 samples. Taps are summed oldest first.
+*/
+static const stats_vec stats_interp_c02[16] = {
+	{ -9.353493881474939e-04, -3.165361696477658e-03 }, { +5.929994218827107e-03, +9.308373173634579e-03 },
+	{ -1.340062089976642e-02, -1.833945608477310e-02 }, { +2.430932418366197e-02, +3.157919724264597e-02 },
+	{ -4.056172445833198e-02, -5.192701793078084e-02 }, { +6.684049697012354e-02, +8.751763525896815e-02 },
+	{ -1.187292496637064e-01, -1.729186314209981e-01 }, { +2.957854651930789e-01, +8.988707620097378e-01 },
+	{ +8.988707620097378e-01, +2.957854651930789e-01 }, { -1.729186314209981e-01, -1.187292496637064e-01 },
+	{ +8.751763525896815e-02, +6.684049697012354e-02 }, { -5.192701793078084e-02, -4.056172445833198e-02 },
+	{ +3.157919724264597e-02, +2.430932418366197e-02 }, { -1.833945608477310e-02, -1.340062089976642e-02 },
+	{ +9.308373173634579e-03, +5.929994218827107e-03 }, { -3.165361696477658e-03, -9.353493881474939e-04 },
+};
+static const double stats_interp_c1[16] = {
+	-2.811275711123766e-03, +1.065865725083938e-02, -2.227979776029874e-02, +3.925899279385184e-02,
+	-6.489751870004079e-02, +1.078342211598459e-01, -2.001458972657618e-01, +6.325370350028462e-01,
+	+6.325370350028462e-01, -2.001458972657618e-01, +1.078342211598459e-01, -6.489751870004079e-02,
+	+3.925899279385184e-02, -2.227979776029874e-02, +1.065865725083938e-02, -2.811275711123766e-03,
+};
+
+/* x points to the newest input sample; x[-15] must be valid */
+static void stats_interp_run(struct stats_interp_state *state, const double *x)
 {
-	const double r[24] = {  /* 4x half filter with every 4th coefficient omitted */
-		-9.353493881474939e-04*x, -2.811275711123766e-03*x, -3.165361696477658e-03*x,
-		+5.929994218827107e-03*x, +1.065865725083938e-02*x, +9.308373173634579e-03*x,
-		-1.340062089976642e-02*x, -2.227979776029874e-02*x, -1.833945608477310e-02*x,
-		+2.430932418366197e-02*x, +3.925899279385184e-02*x, +3.157919724264597e-02*x,
-		-4.056172445833198e-02*x, -6.489751870004079e-02*x, -5.192701793078084e-02*x,
-		+6.684049697012354e-02*x, +1.078342211598459e-01*x, +8.751763525896815e-02*x,
-		-1.187292496637064e-01*x, -2.001458972657618e-01*x, -1.729186314209981e-01*x,
-		+2.957854651930789e-01*x, +6.325370350028462e-01*x, +8.988707620097378e-01*x,
-	};
-	int p = state->p;
-	double *m = state->m, *y = state->y;
+	double *y = state->y;
+	stats_vec p02 = stats_interp_c02[15] * x[-15];
+	double p1 = stats_interp_c1[15] * x[-15];
+	for (int j = 14; j >= 0; --j) {
+		p02 += stats_interp_c02[j] * x[-j];
+		p1 += stats_interp_c1[j] * x[-j];
+	}
 	y[0]=y[4]; y[1]=y[5];  /* for quadratic peak estimation */
-	y[2]=m[p++]+r[0]; y[3]=m[p++]+r[1]; y[4]=m[p++]+r[2]; y[5]=m[p++]; p&=0x3f;
-	memset(&m[state->p], 0, sizeof(double)*4);
-	state->p = p;
-	m[p++]+=r[3];  m[p++]+=r[4];  m[p++]+=r[5];  p++; p&=0x3f;
-	m[p++]+=r[6];  m[p++]+=r[7];  m[p++]+=r[8];  p++; p&=0x3f;
-	m[p++]+=r[9];  m[p++]+=r[10]; m[p++]+=r[11]; p++; p&=0x3f;
-	m[p++]+=r[12]; m[p++]+=r[13]; m[p++]+=r[14]; p++; p&=0x3f;
-	m[p++]+=r[15]; m[p++]+=r[16]; m[p++]+=r[17]; p++; p&=0x3f;
-	m[p++]+=r[18]; m[p++]+=r[19]; m[p++]+=r[20]; p++; p&=0x3f;
-	m[p++]+=r[21]; m[p++]+=r[22]; m[p++]+=r[23]; m[p++]+=x; p&=0x3f;
-	m[p++]+=r[23]; m[p++]+=r[22]; m[p++]+=r[21]; p++; p&=0x3f;
-	m[p++]+=r[20]; m[p++]+=r[19]; m[p++]+=r[18]; p++; p&=0x3f;
-	m[p++]+=r[17]; m[p++]+=r[16]; m[p++]+=r[15]; p++; p&=0x3f;
-	m[p++]+=r[14]; m[p++]+=r[13]; m[p++]+=r[12]; p++; p&=0x3f;
-	m[p++]+=r[11]; m[p++]+=r[10]; m[p++]+=r[9];  p++; p&=0x3f;
-	m[p++]+=r[8];  m[p++]+=r[7];  m[p++]+=r[6];  p++; p&=0x3f;
-	m[p++]+=r[5];  m[p++]+=r[4];  m[p++]+=r[3];  p++; p&=0x3f;
-	m[p++]+=r[2];  m[p++]+=r[1];  m[p++]+=r[0];
+	y[2]=p02[0]; y[3]=p1; y[4]=p02[1]; y[5]=x[-7];
 }
 
-static void stats_interp_peak(struct stats_state *state, struct stats_ch_state *cs)
+static void stats_interp_peak(struct stats_ch_state *cs, ssize_t frame)
 {
 	double *y = cs->interp.y;
 	int r = 0;
@@ -131,36 +206,65 @@ static void stats_interp_peak(struct stats_state *state, struct stats_ch_state *
 		}
 	}
 	if (r == 2) {
-		cs->peak_frame = state->samples - (STATS_INTERP_DELAY-1);
+		cs->peak_frame = frame - (STATS_INTERP_DELAY-1);
 		cs->peak_count = 1;
 	}
 	else if (r == 1)
 		++cs->peak_count;
 }
 
+/* x[-STATS_INTERP_HIST] through x[n-1] must be valid */
+static void stats_interp_block(struct stats_ch_state *cs, const double *x, ssize_t n, ssize_t frame)
+{
+	struct stats_interp_state *cis = &cs->interp;
+	for (ssize_t i = 0; i < n; ++i) {
+		if (x[i] < cis->tmin || x[i] > cis->tmax)
+			cis->n = STATS_INTERP_DELAY;
+		if (cis->n > 0) {
+			stats_interp_run(cis, &x[i-STATS_INTERP_LOOKAHEAD]);
+			stats_interp_peak(cs, frame + i);
+			--cis->n;
+		}
+	}
+}
+
+/* returns the gathered input; n must not exceed STATS_BLOCK_FRAMES */
+static const double * stats_interp_ch_run(struct stats_state *state, struct stats_ch_state *cs, const sample_t *ibuf, int stride, ssize_t n, ssize_t frame)
+{
+	struct stats_interp_state *cis = &cs->interp;
+	struct stats_block b;
+	memcpy(state->x, cis->hist, sizeof(cis->hist));
+	const double *x = stats_gather(state, ibuf, stride, cs->ch, n, STATS_INTERP_HIST);
+	stats_block_reduce(x, n, &b);
+	stats_sum_add(&cs->sum, &cs->sum_c, b.sum);
+	stats_sum_add(&cs->sum_sq, &cs->sum_sq_c, b.sum_sq);
+	/* the interpolator only runs near samples which could produce a new peak */
+	if (cis->n > 0 || b.min < cis->tmin || b.max > cis->tmax)
+		stats_interp_block(cs, x, n, frame);
+	memcpy(cis->hist, &state->x[n], sizeof(cis->hist));
+	return x;
+}
+
+static void stats_interp_flush(struct stats_state *state)
+{
+	for (int k = 0; k < state->n_cs; ++k) {
+		struct stats_ch_state *cs = &state->cs[k];
+		memcpy(state->x, cs->interp.hist, sizeof(cs->interp.hist));
+		memset(&state->x[STATS_INTERP_HIST], 0, sizeof(double)*STATS_INTERP_DELAY);
+		stats_interp_block(cs, &state->x[STATS_INTERP_HIST], STATS_INTERP_DELAY, state->samples);
+	}
+}
+
 static sample_t * stats_effect_run_interp(struct effect *e, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
 {
-	const ssize_t samples = *frames * e->ostream.channels;
 	struct stats_state *state = (struct stats_state *) e->data;
-	for (ssize_t i = 0; i < samples; i += e->ostream.channels) {
-		for (int k = 0; k < state->n_cs; ++k) {
-			struct stats_ch_state *cs = &state->cs[k];
-			struct stats_interp_state *cis = &cs->interp;
-			const double s = ibuf[i+cs->ch];
-			cs->sum += s;
-			cs->sum_sq += s*s;
-			if (s < cis->tmin || s > cis->tmax)
-				cis->n = STATS_INTERP_DELAY;
-			if (cis->n > 0) {
-				stats_interp_insert(cis, cis->z[cis->zp]);
-				stats_interp_peak(state, cs);
-				--cis->n;
-			}
-			cis->z[cis->zp++] = s;
-			if (cis->zp >= LENGTH(cis->z)) cis->zp = 0;
-		}
-		++state->samples;
+	const int stride = e->ostream.channels;
+	for (ssize_t i = 0; i < *frames; i += STATS_BLOCK_FRAMES) {
+		const ssize_t n = MINIMUM(*frames - i, STATS_BLOCK_FRAMES);
+		for (int k = 0; k < state->n_cs; ++k)
+			stats_interp_ch_run(state, &state->cs[k], &ibuf[i*stride], stride, n, state->samples + i);
 	}
+	state->samples += *frames;
 	return ibuf;
 }
 
@@ -172,7 +276,7 @@ static void stats_print_channels(struct effect *e, int start, int end)
 		dsp_log_printf(" %12d", state->cs[i].ch);
 	dsp_log_printf("\n%-18s", "DC offset");
 	for (int i = start; i < end; ++i)
-		dsp_log_printf(" %12.8f", state->cs[i].sum/state->samples);
+		dsp_log_printf(" %12.8f", STATS_SUM(&state->cs[i])/state->samples);
 	dsp_log_printf("\n%-18s", "Minimum");
 	for (int i = start; i < end; ++i)
 		dsp_log_printf(" %12.8f", state->cs[i].min);
@@ -189,15 +293,15 @@ static void stats_print_channels(struct effect *e, int start, int end)
 	}
 	dsp_log_printf("\n%-18s", "RMS level (dBFS)");
 	for (int i = start; i < end; ++i)
-		dsp_log_printf(" %12.4f", 20.0*log10(sqrt(state->cs[i].sum_sq/state->samples)));
+		dsp_log_printf(" %12.4f", 20.0*log10(sqrt(STATS_SUM_SQ(&state->cs[i])/state->samples)));
 	if (state->ref != -HUGE_VAL) {
 		dsp_log_printf("\n%-18s", "RMS level (dBr)");
 		for (int i = start; i < end; ++i)
-			dsp_log_printf(" %12.4f", state->ref + 20.0*log10(sqrt(state->cs[i].sum_sq/state->samples)));
+			dsp_log_printf(" %12.4f", state->ref + 20.0*log10(sqrt(STATS_SUM_SQ(&state->cs[i])/state->samples)));
 	}
 	dsp_log_printf("\n%-18s", "Crest factor (dB)");
 	for (int i = start; i < end; ++i)
-		dsp_log_printf(" %12.4f", 20.0*log10(state->cs[i].peak/sqrt(state->cs[i].sum_sq/state->samples)));
+		dsp_log_printf(" %12.4f", 20.0*log10(state->cs[i].peak/sqrt(STATS_SUM_SQ(&state->cs[i])/state->samples)));
 	dsp_log_printf("\n%-18s", "Peak count");
 	for (int i = start; i < end; ++i)
 		dsp_log_printf(" %12zd", state->cs[i].peak_count);
@@ -216,23 +320,8 @@ static void stats_print_channels(struct effect *e, int start, int end)
 static void stats_effect_destroy(struct effect *e)
 {
 	struct stats_state *state = (struct stats_state *) e->data;
-	if (e->run == stats_effect_run_interp) {
-		for (ssize_t i = 0; i < STATS_INTERP_DELAY; ++i) {
-			for (int k = 0; k < state->n_cs; ++k) {
-				struct stats_ch_state *cs = &state->cs[k];
-				struct stats_interp_state *cis = &cs->interp;
-				if (cis->n > 0) {
-					stats_interp_insert(cis, cis->z[cis->zp]);
-					stats_interp_peak(state, cs);
-					--cis->n;
-				}
-				cis->z[cis->zp++] = 0.0;
-				if (cis->zp >= LENGTH(cis->z)) cis->zp = 0;
-			}
-			++state->samples;
-		}
-		state->samples -= STATS_INTERP_DELAY;
-	}
+	if (e->run == stats_effect_run_interp)
+		stats_interp_flush(state);
 	int cols = state->n_cs;
 	dsp_log_acquire();
 #ifdef DSP_STATUSLINES
@@ -321,3 +410,283 @@ struct effect * stats_effect_init(const struct effect_info *ei, const struct str
 	free(e);
 	return NULL;
 }
+
+/*
+ * Loudness measurement per ITU-R BS.1770-4 and EBU Tech 3341/3342.
+ * Gating blocks (400ms momentary, 3s short-term) are built from 100ms
+ * sub-block energies kept in a ring. Integrated loudness and loudness
+ * range are computed from histograms of block loudness (0.1 LU bins)
+ * which also hold the exact energy sums, so memory use is constant
+ * regardless of input length. The relative gates are interpolated within
+ * the bin that contains them; the loudness range has 0.1 LU resolution.
+*/
+#define LOUDNESS_SUB_BLOCKS_M  4   /* 400ms */
+#define LOUDNESS_SUB_BLOCKS_S 30   /* 3s */
+#define LOUDNESS_ABS_GATE     -70.0
+#define LOUDNESS_REL_GATE_I   -10.0
+#define LOUDNESS_REL_GATE_LRA -20.0
+#define LOUDNESS_HIST_MIN     LOUDNESS_ABS_GATE
+#define LOUDNESS_HIST_RES     10   /* bins per LU */
+#define LOUDNESS_HIST_BINS    1000 /* -70 to +30 LUFS */
+#define LOUDNESS_FROM_ENERGY(x) (-0.691 + 10.0*log10(x))
+
+struct loudness_hist {
+	double energy[LOUDNESS_HIST_BINS];
+	ssize_t count[LOUDNESS_HIST_BINS];
+};
+
+struct loudness_state {
+	struct stats_state st;
+	struct biquad_state (*kw)[2];
+	double *weight, z[STATS_BLOCK_FRAMES];
+	double sub[LOUDNESS_SUB_BLOCKS_S], sub_acc, max_m, max_s;
+	ssize_t hop, hop_pos, n_sub;
+	struct loudness_hist *h_i, *h_s;
+};
+
+/* K-weighting filter coefficients for an arbitrary sample rate; these match
+   the tabulated 48kHz values in BS.1770 to within rounding */
+static void loudness_kw_init(struct biquad_state kw[2], double fs)
+{
+	const double f0_s = 1681.974450955533, g_s = 3.999843853973347, q_s = 0.7071752369554196;
+	const double k_s = tan(M_PI*f0_s/fs), vh = pow(10.0, g_s/20.0), vb = pow(vh, 0.4996667741545416);
+	biquad_init(&kw[0],
+		vh + vb*k_s/q_s + k_s*k_s, 2.0*(k_s*k_s - vh), vh - vb*k_s/q_s + k_s*k_s,
+		1.0 + k_s/q_s + k_s*k_s, 2.0*(k_s*k_s - 1.0), 1.0 - k_s/q_s + k_s*k_s);
+	const double f0_h = 38.13547087602444, q_h = 0.5003270373238773;
+	const double k_h = tan(M_PI*f0_h/fs), a0_h = 1.0 + k_h/q_h + k_h*k_h;
+	/* biquad_init() normalizes by a0; the numerator must come out as exactly {1, -2, 1} */
+	biquad_init(&kw[1],
+		a0_h, -2.0*a0_h, a0_h,
+		a0_h, 2.0*(k_h*k_h - 1.0), 1.0 - k_h/q_h + k_h*k_h);
+}
+
+static void loudness_hist_add(struct loudness_hist *h, double energy)
+{
+	const double l = LOUDNESS_FROM_ENERGY(energy);
+	if (!(l > LOUDNESS_ABS_GATE)) return;
+	const int bin = MINIMUM((int) ((l - LOUDNESS_HIST_MIN) * LOUDNESS_HIST_RES), LOUDNESS_HIST_BINS-1);
+	h->energy[bin] += energy;
+	++h->count[bin];
+}
+
+/* Returns the bin index containing the relative gate threshold and sets
+   *frac to the fraction of that bin above the threshold. Blocks within a bin
+   are assumed to be spread evenly, so the gate is interpolated rather than
+   rounded to a bin edge. */
+static int loudness_hist_rel_gate(const struct loudness_hist *h, double rel_gate, double *frac)
+{
+	double energy = 0.0;
+	ssize_t count = 0;
+	for (int i = 0; i < LOUDNESS_HIST_BINS; ++i) {
+		energy += h->energy[i];
+		count += h->count[i];
+	}
+	if (count == 0) return -1;
+	const double gate = LOUDNESS_FROM_ENERGY(energy / count) + rel_gate;
+	const double pos = (gate - LOUDNESS_HIST_MIN) * LOUDNESS_HIST_RES;
+	if (pos <= 0.0) {
+		*frac = 1.0;
+		return 0;
+	}
+	const int bin = MINIMUM((int) pos, LOUDNESS_HIST_BINS-1);
+	*frac = MAXIMUM(1.0 - (pos - bin), 0.0);
+	return bin;
+}
+
+static double loudness_integrated(const struct loudness_hist *h)
+{
+	double frac;
+	const int start = loudness_hist_rel_gate(h, LOUDNESS_REL_GATE_I, &frac);
+	if (start < 0) return -HUGE_VAL;
+	double energy = frac * h->energy[start], count = frac * h->count[start];
+	for (int i = start+1; i < LOUDNESS_HIST_BINS; ++i) {
+		energy += h->energy[i];
+		count += h->count[i];
+	}
+	return (count > 0.0) ? LOUDNESS_FROM_ENERGY(energy / count) : -HUGE_VAL;
+}
+
+/* the result has the resolution of the histogram (0.1 LU) */
+static double loudness_range(const struct loudness_hist *h)
+{
+	double frac;
+	const int start = loudness_hist_rel_gate(h, LOUDNESS_REL_GATE_LRA, &frac);
+	if (start < 0) return 0.0;
+	double count = frac * h->count[start];
+	for (int i = start+1; i < LOUDNESS_HIST_BINS; ++i)
+		count += h->count[i];
+	if (!(count > 0.0)) return 0.0;
+	const double lo_idx = count * 0.10, hi_idx = count * 0.95;
+	int lo = -1, hi = -1;
+	double c = 0.0;
+	for (int i = start; i < LOUDNESS_HIST_BINS && hi < 0; ++i) {
+		c += (i == start) ? frac * h->count[i] : h->count[i];
+		if (lo < 0 && c > lo_idx) lo = i;
+		if (c > hi_idx) hi = i;
+	}
+	if (lo < 0) lo = start;
+	if (hi < 0) hi = LOUDNESS_HIST_BINS-1;
+	return (double) (hi - lo) / LOUDNESS_HIST_RES;
+}
+
+static void loudness_push_sub_block(struct loudness_state *state, double energy)
+{
+	memmove(state->sub, state->sub+1, sizeof(double)*(LOUDNESS_SUB_BLOCKS_S-1));
+	state->sub[LOUDNESS_SUB_BLOCKS_S-1] = energy;
+	++state->n_sub;
+	if (state->n_sub >= LOUDNESS_SUB_BLOCKS_M) {
+		double e_m = 0.0;
+		for (int i = LOUDNESS_SUB_BLOCKS_S-LOUDNESS_SUB_BLOCKS_M; i < LOUDNESS_SUB_BLOCKS_S; ++i)
+			e_m += state->sub[i];
+		e_m /= state->hop * LOUDNESS_SUB_BLOCKS_M;
+		loudness_hist_add(state->h_i, e_m);
+		state->max_m = MAXIMUM(state->max_m, LOUDNESS_FROM_ENERGY(e_m));
+	}
+	if (state->n_sub >= LOUDNESS_SUB_BLOCKS_S) {
+		double e_s = 0.0;
+		for (int i = 0; i < LOUDNESS_SUB_BLOCKS_S; ++i)
+			e_s += state->sub[i];
+		e_s /= state->hop * LOUDNESS_SUB_BLOCKS_S;
+		loudness_hist_add(state->h_s, e_s);
+		state->max_s = MAXIMUM(state->max_s, LOUDNESS_FROM_ENERGY(e_s));
+	}
+}
+
+static sample_t * loudness_effect_run(struct effect *e, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
+{
+	struct loudness_state *state = (struct loudness_state *) e->data;
+	struct stats_state *st = &state->st;
+	const int stride = e->ostream.channels;
+	for (ssize_t i = 0; i < *frames; i += STATS_BLOCK_FRAMES) {
+		const ssize_t n = MINIMUM(*frames - i, STATS_BLOCK_FRAMES);
+		memset(state->z, 0, sizeof(double)*n);
+		for (int k = 0; k < st->n_cs; ++k) {
+			const double *x = stats_interp_ch_run(st, &st->cs[k], &ibuf[i*stride], stride, n, st->samples + i);
+			struct biquad_state kw0 = state->kw[k][0], kw1 = state->kw[k][1];
+			const double w = state->weight[k];
+			for (ssize_t j = 0; j < n; ++j) {
+				const double y = biquad(&kw1, biquad(&kw0, x[j]));
+				state->z[j] += w*y*y;
+			}
+			state->kw[k][0] = kw0;
+			state->kw[k][1] = kw1;
+		}
+		for (ssize_t j = 0; j < n;) {
+			const ssize_t m = MINIMUM(n - j, state->hop - state->hop_pos);
+			for (ssize_t end = j + m; j < end; ++j)
+				state->sub_acc += state->z[j];
+			state->hop_pos += m;
+			if (state->hop_pos == state->hop) {
+				loudness_push_sub_block(state, state->sub_acc);
+				state->sub_acc = 0.0;
+				state->hop_pos = 0;
+			}
+		}
+	}
+	st->samples += *frames;
+	return ibuf;
+}
+
+static void loudness_effect_destroy(struct effect *e)
+{
+	struct loudness_state *state = (struct loudness_state *) e->data;
+	struct stats_state *st = &state->st;
+	stats_interp_flush(st);
+	double tp = 0.0;
+	for (int k = 0; k < st->n_cs; ++k)
+		tp = MAXIMUM(tp, st->cs[k].peak);
+	dsp_log_acquire();
+	dsp_log_printf("\n%-28s %8.1f", "Integrated loudness (LUFS)", loudness_integrated(state->h_i));
+	dsp_log_printf("\n%-28s %8.1f", "Loudness range (LU)", loudness_range(state->h_s));
+	dsp_log_printf("\n%-28s %8.1f", "Momentary max (LUFS)", state->max_m);
+	dsp_log_printf("\n%-28s %8.1f", "Short-term max (LUFS)", state->max_s);
+	dsp_log_printf("\n%-28s %8.1f", "True peak (dBTP)", 20.0*log10(tp));
+	dsp_log_printf("\n%-28s %8.2f", "Length (s)", (double) st->samples / e->ostream.fs);
+	dsp_log_printf("\n");
+	dsp_log_release();
+	free(st->cs);
+	free(state->kw);
+	free(state->weight);
+	free(state->h_i);
+	free(state->h_s);
+	free(state);
+}
+
+struct effect * loudness_effect_init(const struct effect_info *ei, const struct stream_info *istream, const char *channel_selector, const char *dir, int argc, const char *const *argv)
+{
+	struct dsp_getopt_state g = DSP_GETOPT_STATE_INITIALIZER;
+	char *endptr;
+	int opt;
+
+	while ((opt = dsp_getopt(&g, argc, argv, "")) != -1) {
+		switch (opt) {
+		default:
+			dsp_getopt_print_error(&g, opt, argv[0]);
+			goto print_usage;
+		}
+	}
+	const int n_ch = num_bits_set(channel_selector, istream->channels);
+	if (g.ind != argc && argc-g.ind != n_ch) {
+		LOG_FMT(LL_ERROR, "%s: error: number of weights must match number of channels", argv[0]);
+		print_usage:
+		print_effect_usage(ei);
+		return NULL;
+	}
+
+	struct effect *e = calloc(1, sizeof(struct effect));
+	if (check_alloc(ei->name, e)) return NULL;
+	e->name = ei->name;
+	e->istream.fs = e->ostream.fs = istream->fs;
+	e->istream.channels = e->ostream.channels = istream->channels;
+	e->flags |= EFFECT_FLAG_NO_DITHER;
+	e->flags |= EFFECT_FLAG_CH_DEPS_IDENTITY;
+	e->flags |= EFFECT_FLAG_ALIGN_BARRIER;
+	e->run = loudness_effect_run;
+	e->plot = effect_plot_noop;
+	e->destroy = loudness_effect_destroy;
+	struct stats_state *st = NULL;
+	struct loudness_state *state = calloc(1, sizeof(struct loudness_state));
+	if (check_alloc(ei->name, state)) goto fail;
+	st = &state->st;
+	st->n_cs = n_ch;
+	st->cs = calloc(n_ch, sizeof(struct stats_ch_state));
+	if (check_alloc(ei->name, st->cs)) goto fail;
+	state->kw = calloc(n_ch, sizeof(state->kw[0]));
+	if (check_alloc(ei->name, state->kw)) goto fail;
+	state->weight = calloc(n_ch, sizeof(double));
+	if (check_alloc(ei->name, state->weight)) goto fail;
+	state->h_i = calloc(1, sizeof(struct loudness_hist));
+	if (check_alloc(ei->name, state->h_i)) goto fail;
+	state->h_s = calloc(1, sizeof(struct loudness_hist));
+	if (check_alloc(ei->name, state->h_s)) goto fail;
+	for (int i = 0, k = 0; k < istream->channels; ++k) {
+		if (GET_BIT(channel_selector, k))
+			st->cs[i++].ch = k;
+	}
+	for (int k = 0; k < n_ch; ++k) {
+		loudness_kw_init(state->kw[k], istream->fs);
+		if (g.ind < argc) {
+			state->weight[k] = strtod(argv[g.ind+k], &endptr);
+			CHECK_ENDPTR(argv[g.ind+k], endptr, "weight", goto fail);
+			CHECK_RANGE(state->weight[k] >= 0.0, "weight", goto fail);
+		}
+		else state->weight[k] = 1.0;
+	}
+	state->hop = lround(istream->fs * 0.1);
+	state->max_m = state->max_s = -HUGE_VAL;
+	e->data = state;
+	return e;
+
+	fail:
+	if (state) {
+		free(st->cs);
+		free(state->kw);
+		free(state->weight);
+		free(state->h_i);
+		free(state->h_s);
+	}
+	free(state);
+	free(e);
+	return NULL;
+}
@@ -23,8 +23,10 @@
 #include "effect.h"
 
 struct effect * stats_effect_init(const struct effect_info *, const struct stream_info *, const char *, const char *, int, const char *const *);
+struct effect * loudness_effect_init(const struct effect_info *, const struct stream_info *, const char *, const char *, int, const char *const *);
 
 #define STATS_EFFECT_INFO \
-	{ "stats", "[-i] [-w cols] [ref_level]", stats_effect_init, 0 }
+	{ "stats",    "[-i] [-w cols] [ref_level]", stats_effect_init,    0 }, \
+	{ "loudness", "[weight ...]",               loudness_effect_init, 0 }
 
 #endif
@@ -0,0 +1,36 @@
+#!/bin/sh
+
+#
+# Check the loudness effect against the reference loudness of a 997Hz
+# stereo tone at 48kHz (-23.00 LUFS at -23dBFS, computed from the
+# tabulated BS.1770 filter coefficients).
+#
+# Usage:
+#     loudness.sh [path_to_dsp]
+#
+# The integrated loudness is printed with 0.1 LU resolution, so the tone is
+# measured 0.04 LU above and below a rounding boundary. Both readings round
+# the expected way only if the error is less than 0.01 LU.
+#
+
+DSP="${1:-./dsp}"
+
+integrated() {
+	"$DSP" -q -t sgen -c 2 -r 48000 'sine:freq=997+20' -ot pcm -e double /dev/null \
+		gain "$1" loudness 2>&1 | awk '/^Integrated loudness/ { print $NF }'
+}
+
+fail=0
+check() {
+	result=$(integrated "$1")
+	if [ "$result" = "$2" ]; then
+		echo "pass: gain $1: $result LUFS"
+	else
+		echo "FAIL: gain $1: got ${result:-nothing}, expected $2 LUFS" 1>&2
+		fail=1
+	fi
+}
+
+check -22.96 -23.0
+check -22.94 -22.9
+exit $fail
@@ -0,0 +1,52 @@
+#!/bin/sh
+
+#
+# Check that seeking in a low-bitrate MP3 file is sample-accurate: the
+# output after a seek must match the same span of a full decode exactly.
+# At 32kbps, a frame may take its main data from several frames back.
+#
+# Usage:
+#     mp3_seek.sh [path_to_dsp]
+#
+# Skipped if lame is not installed or dsp was built without the mp3 type.
+#
+
+DSP="${1:-./dsp}"
+TMP="${TMPDIR:-/tmp}/dsp_mp3_seek.$$"
+
+if ! command -v lame >/dev/null 2>&1; then
+	echo "skip: lame not found"
+	exit 0
+fi
+if ! "$DSP" -h 2>&1 | grep -q '^  mp3 '; then
+	echo "skip: dsp built without mp3 support"
+	exit 0
+fi
+
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+if [ "$(printf '\001\000' | od -An -tx2 | tr -d ' ')" = 0001 ]; then
+	ENDIAN=--little-endian
+else
+	ENDIAN=--big-endian
+fi
+
+"$DSP" -q -t sgen -c 2 -r 44100 'sine@0:freq=100-10k+10/sine@1:freq=3k-200+10' \
+	-ot pcm -e s16 "$TMP/in.raw" gain -6 2>/dev/null || exit 1
+lame --quiet -r -s 44.1 --bitwidth 16 --signed $ENDIAN -m j -b 32 --cbr \
+	"$TMP/in.raw" "$TMP/test.mp3" || exit 1
+"$DSP" -q -t mp3 "$TMP/test.mp3" -ot pcm -e s16 "$TMP/full.raw" 2>/dev/null || exit 1
+
+fail=0
+for pos in 1 1151 1152 100000 123457 250001 400000; do
+	"$DSP" -q -T "${pos}S+4096S" -t mp3 "$TMP/test.mp3" -ot pcm -e s16 "$TMP/part.raw" 2>/dev/null
+	# 2 channels, 2 bytes per sample
+	if tail -c +$((pos*4 + 1)) "$TMP/full.raw" | head -c $((4096*4)) | cmp -s - "$TMP/part.raw"; then
+		echo "pass: seek to ${pos}S"
+	else
+		echo "FAIL: seek to ${pos}S: output differs from full decode" 1>&2
+		fail=1
+	fi
+done
+exit $fail
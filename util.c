@@ -489,6 +489,11 @@ int dsp_fftw_load_wisdom(void)
 	return (wisdom_path != NULL);
 }
 
+const char * dsp_fftw_wisdom_path(void)
+{
+	return wisdom_path;
+}
+
 void dsp_fftw_save_wisdom(void)
 {
 	if (wisdom_path) {
@@ -82,6 +82,7 @@ ssize_t next_fast_fftw_len(ssize_t);
 void dsp_fftw_acquire(void);
 void dsp_fftw_release(void);
 int dsp_fftw_load_wisdom(void);   /* Not MT-safe. Call before planning; returns true if a path was specified. */
+const char * dsp_fftw_wisdom_path(void);  /* Not MT-safe. NULL if no path was specified. */
 void dsp_fftw_save_wisdom(void);  /* Called at exit--do not use anywhere else. */
 #endif
 
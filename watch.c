@@ -22,25 +22,63 @@
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/stat.h>
 #include <pthread.h>
+#ifdef __linux__
+#define HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
 #include "watch.h"
 #include "effects_chain.h"
 #include "util.h"
 #include "list_util.h"
 
 #define POLL_INTERVAL 1000  /* milliseconds */
+#define SETTLE_TIME   50    /* milliseconds to wait for further events before reloading */
+#define SETTLE_MAX    20    /* max number of SETTLE_TIME waits */
+#ifdef HAVE_INOTIFY
+#define INOTIFY_MASK  (IN_CLOSE_WRITE|IN_MOVED_TO|IN_ATTRIB)
+#endif
 
+/* A chain built by the worker thread. If the chain needs more buffer space
+   than the enclosing chain provides, it runs in its own buffers and the
+   output is copied back. */
+struct watch_gen {
+	struct watch_gen *next;  /* link in watch_node.retired */
+	struct effects_chain chain;
+	sample_t *buf[2];
+	ssize_t in_frames;  /* value of watch_node.in_frames when built */
+};
+
+/* A file the chain depends on. The parent directory is watched rather than
+   the file itself so that files replaced by rename() are detected. If
+   inotify is not available, the file is polled with stat(). */
+struct watch_dep {
+	char *path;
+	const char *name;  /* points into path */
+	int wd;  /* inotify watch descriptor of the parent directory, or -1 */
+	struct timespec mtime;
+};
+
+/* The audio thread owns gen and xfade_gen and never blocks. New chains are
+   handed over through pending with an atomic exchange, and old ones are
+   pushed onto the retired stack to be destroyed by the worker thread. */
 struct watch_node {
 	struct watch_node *prev, *next;
-	struct timespec last_mtime;
-	pthread_mutex_t lock;
+	struct watch_dep *deps;  /* deps[0] is the watched file itself */
+	int n_deps, reload;
+	pthread_mutex_t lock;  /* protects in_frames and buf_len; not used by the audio thread */
 	char *path, *channel_mask;
-	struct effects_chain chain, new_chain;
 	struct effect *e;
-	struct effects_chain_xfade_state xfade;
+	struct watch_gen *gen, *xfade_gen;
+	struct watch_gen *pending, *retired;
+	sample_t *xfade_buf;
+	ssize_t xfade_frames, xfade_pos;
 	ssize_t in_frames, buf_len;
-	int update_chain, enforce_eof_marker;
+	int enforce_eof_marker, force_reload;
 };
 
 struct watch_list {
@@ -49,138 +87,469 @@ struct watch_list {
 
 static struct {
 	pthread_t thread;
-	pthread_mutex_t init_lock, lock;
+	pthread_mutex_t init_lock;
+	pthread_mutex_t lock;  /* recursive; held by the worker while it reloads, which may create or destroy nested watch nodes */
 	struct watch_list list;
-	int init_count;
+	int init_count, ino_fd, wake_fd[2];
 } watch_state = {
 	.init_lock = PTHREAD_MUTEX_INITIALIZER,
-	.lock = PTHREAD_MUTEX_INITIALIZER,
 };
 
+static void watch_gen_destroy(struct watch_gen *g)
+{
+	if (g == NULL) return;
+	destroy_effects_chain(&g->chain);
+	free(g->buf[0]);
+	free(g->buf[1]);
+	free(g);
+}
+
+static struct watch_gen * watch_gen_new(struct effects_chain *chain, ssize_t in_frames, ssize_t buf_len)
+{
+	struct watch_gen *g = calloc(1, sizeof(struct watch_gen));
+	if (g == NULL) return NULL;
+	g->chain = *chain;
+	g->in_frames = in_frames;
+	if (buf_len > 0) {
+		g->buf[0] = calloc(buf_len, sizeof(sample_t));
+		g->buf[1] = calloc(buf_len, sizeof(sample_t));
+		if (!g->buf[0] || !g->buf[1]) {
+			free(g->buf[0]);
+			free(g->buf[1]);
+			free(g);
+			return NULL;
+		}
+	}
+	return g;
+}
+
+static sample_t * watch_gen_run(struct watch_gen *g, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
+{
+	if (g->buf[0] == NULL)
+		return run_effects_chain(&g->chain, frames, ibuf, obuf);
+	memcpy(g->buf[0], ibuf, *frames * g->chain.istream.channels * sizeof(sample_t));
+	sample_t *rbuf = run_effects_chain(&g->chain, frames, g->buf[0], g->buf[1]);
+	memcpy(obuf, rbuf, *frames * g->chain.ostream.channels * sizeof(sample_t));
+	return obuf;
+}
+
+static sample_t * watch_gen_drain(struct watch_gen *g, ssize_t *frames, sample_t *buf1, sample_t *buf2)
+{
+	if (g->buf[0] == NULL)
+		return drain_effects_chain(&g->chain, frames, buf1, buf2);
+	sample_t *rbuf = drain_effects_chain(&g->chain, frames, g->buf[0], g->buf[1]);
+	if (*frames > 0)
+		memcpy(buf1, rbuf, *frames * g->chain.ostream.channels * sizeof(sample_t));
+	return buf1;
+}
+
+static int watch_add_dir(const char *path)
+{
+#ifdef HAVE_INOTIFY
+	if (watch_state.ino_fd < 0) return -1;
+	const char *b = strrchr(path, '/');
+	char *dir = (b == NULL) ? strdup(".") : (b == path) ? strdup("/") : strndup(path, b-path);
+	if (check_alloc(__func__, dir)) return -1;
+	const int wd = inotify_add_watch(watch_state.ino_fd, dir, INOTIFY_MASK);
+	if (wd < 0)
+		LOG_FMT(LL_VERBOSE, "watch: warning: inotify_add_watch() failed: %s: %s", dir, strerror(errno));
+	free(dir);
+	return wd;
+#else
+	return -1;
+#endif
+}
+
+#ifdef HAVE_INOTIFY
+static int watch_wd_in_use(int wd)
+{
+	LIST_FOREACH(&watch_state.list, node) {
+		for (int i = 0; i < node->n_deps; ++i)
+			if (node->deps[i].wd == wd) return 1;
+	}
+	return 0;
+}
+#endif
+
+/* Removes the inotify watches used by deps that no listed node uses any
+   more. Several dependencies may share a watch, as inotify_add_watch()
+   returns the same descriptor for the same directory. Must be called with
+   watch_state.lock held. */
+static void watch_rm_stale(const struct watch_dep *deps, int n)
+{
+#ifdef HAVE_INOTIFY
+	for (int i = 0; i < n; ++i) {
+		if (deps[i].wd < 0 || watch_wd_in_use(deps[i].wd)) continue;
+		for (int k = 0; k < i; ++k)
+			if (deps[k].wd == deps[i].wd) goto next;  /* already removed */
+		inotify_rm_watch(watch_state.ino_fd, deps[i].wd);
+		next:;
+	}
+#endif
+}
+
+static void watch_deps_free(struct watch_dep *deps, int n)
+{
+	for (int i = 0; i < n; ++i)
+		free(deps[i].path);
+	free(deps);
+}
+
+static int watch_deps_add(struct watch_dep *deps, int *n, const char *path, const struct watch_dep *old, int n_old)
+{
+	for (int i = 0; i < *n; ++i)
+		if (strcmp(deps[i].path, path) == 0) return 0;
+	struct watch_dep *d = &deps[*n];
+	if ((d->path = strdup(path)) == NULL) return 1;
+	const char *b = strrchr(d->path, '/');
+	d->name = (b) ? b+1 : d->path;
+	d->wd = watch_add_dir(d->path);
+	for (int i = 0; i < n_old; ++i) {
+		if (strcmp(old[i].path, path) == 0) {
+			d->mtime = old[i].mtime;  /* keep the time at which it was last read */
+			goto done;
+		}
+	}
+	struct stat sb;
+	if (stat(d->path, &sb) == 0) d->mtime = sb.st_mtim;
+	done:
+	++(*n);
+	return 0;
+}
+
+/* Replaces the node's dependency set with path plus the dependencies of
+   chain. Must not be called concurrently with the worker thread. If the
+   node is listed, watch_state.lock must be held. */
+static int watch_deps_update(struct watch_node *node, const struct effect_deps *chain_deps)
+{
+	struct watch_dep *old = node->deps;
+	const int n_old = node->n_deps;
+	struct watch_dep *deps = calloc(chain_deps->n + 1, sizeof(struct watch_dep));
+	int n = 0;
+	if (check_alloc(node->e->name, deps)) return 1;
+	if (watch_deps_add(deps, &n, node->path, node->deps, node->n_deps)) goto fail;
+	for (int i = 0; i < chain_deps->n; ++i)
+		if (watch_deps_add(deps, &n, chain_deps->paths[i], node->deps, node->n_deps)) goto fail;
+	node->deps = deps;
+	node->n_deps = n;
+	if (n_old > 0) watch_rm_stale(old, n_old);
+	watch_deps_free(old, n_old);
+	for (int i = 1; i < n; ++i)
+		LOG_FMT(LL_VERBOSE, "%s: info: dependency: %s", node->e->name, deps[i].path);
+	return 0;
+
+	fail:
+	dsp_perror(DSP_ENOMEM, node->e->name, NULL);
+	watch_deps_free(deps, n);
+	return 1;
+}
+
+/* Checks polled dependencies for changes. */
+static int watch_deps_poll(struct watch_node *node)
+{
+	int changed = 0;
+	for (int i = 0; i < node->n_deps; ++i) {
+		struct watch_dep *d = &node->deps[i];
+		struct stat sb;
+		if (d->wd >= 0) continue;
+		if (stat(d->path, &sb) < 0)
+			LOG_FMT(LL_VERBOSE, "%s: warning: stat() failed: %s: %s", node->e->name, d->path, strerror(errno));
+		else if (sb.st_mtim.tv_sec != d->mtime.tv_sec || sb.st_mtim.tv_nsec != d->mtime.tv_nsec) {
+			d->mtime = sb.st_mtim;
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+static int watch_node_needs_poll(struct watch_node *node)
+{
+	for (int i = 0; i < node->n_deps; ++i)
+		if (node->deps[i].wd < 0) return 1;
+	return 0;
+}
+
+/* Called from the audio thread only when a chain is retired or a reload
+   is forced, which is rare. The pipe is non-blocking, so this is a single
+   write() that never waits. */
+static void watch_wake(void)
+{
+	const char c = 0;
+	if (write(watch_state.wake_fd[1], &c, 1) < 0) { /* full; the worker will wake anyway */ }
+}
+
 static void watch_reload(struct watch_node *node)
 {
 	struct effects_chain new_chain = EFFECTS_CHAIN_INITIALIZER;
 	struct stream_info stream = node->e->istream;
 	LOG_FMT(LL_NORMAL, "%s: info: reloading %s", node->e->name, node->path);
-	if (build_effects_chain_from_file(node->path, &new_chain, &stream, node->channel_mask, NULL, node->enforce_eof_marker) == 0) {
-		if (stream.fs != node->e->ostream.fs) {
-			LOG_FMT(LL_ERROR, "%s: error: sample rate mismatch: %s", node->e->name, node->path);
-			destroy_effects_chain(&new_chain);
-		}
-		else if (stream.channels != node->e->ostream.channels) {
-			LOG_FMT(LL_ERROR, "%s: error: channels mismatch: %s", node->e->name, node->path);
-			destroy_effects_chain(&new_chain);
-		}
-		else {
-			pthread_mutex_lock(&node->lock);
-			const ssize_t buf_len = get_effects_chain_buffer_len(&new_chain, node->in_frames, node->e->istream.channels);
-			if (buf_len > node->buf_len) {
-				pthread_mutex_unlock(&node->lock);
-				LOG_FMT(LL_ERROR, "%s: error: buffer length: %s", node->e->name, node->path);
-				destroy_effects_chain(&new_chain);
-			}
-			else {
-				destroy_effects_chain(&node->new_chain);
-				effects_chain_set_dither_params(&new_chain, 0, 0);  /* disable auto dither */
-				node->new_chain = new_chain;
-				node->update_chain = 1;
-				pthread_mutex_unlock(&node->lock);
+	if (build_effects_chain_from_file(node->path, &new_chain, &stream, node->channel_mask, NULL, node->enforce_eof_marker))
+		goto fail;
+	if (stream.fs != node->e->ostream.fs) {
+		LOG_FMT(LL_ERROR, "%s: error: sample rate mismatch: %s", node->e->name, node->path);
+		goto fail;
+	}
+	if (stream.channels != node->e->ostream.channels) {
+		LOG_FMT(LL_ERROR, "%s: error: channels mismatch: %s", node->e->name, node->path);
+		goto fail;
+	}
+	pthread_mutex_lock(&node->lock);
+	const ssize_t in_frames = node->in_frames, buf_len = node->buf_len;
+	pthread_mutex_unlock(&node->lock);
+	const ssize_t new_buf_len = get_effects_chain_buffer_len(&new_chain, in_frames, node->e->istream.channels);
+	if (in_frames > 0 && get_effects_chain_max_out_frames(&new_chain, in_frames) * stream.channels > buf_len) {
+		LOG_FMT(LL_ERROR, "%s: error: buffer length: %s", node->e->name, node->path);
+		goto fail;
+	}
+	effects_chain_set_dither_params(&new_chain, 0, 0);  /* disable auto dither */
+	watch_deps_update(node, &new_chain.deps);
+	struct watch_gen *g = watch_gen_new(&new_chain, in_frames, (new_buf_len > buf_len) ? new_buf_len : 0);
+	if (check_alloc(node->e->name, g)) goto fail;
+	if (g->buf[0])
+		LOG_FMT(LL_VERBOSE, "%s: info: using separate buffers: %zd samples", node->e->name, new_buf_len);
+	/* a pending chain that the audio thread has not picked up yet is discarded */
+	watch_gen_destroy(__atomic_exchange_n(&node->pending, g, __ATOMIC_ACQ_REL));
+	return;
+
+	fail:
+	destroy_effects_chain(&new_chain);
+}
+
+static void watch_reap(struct watch_node *node)
+{
+	struct watch_gen *g = __atomic_exchange_n(&node->retired, NULL, __ATOMIC_ACQUIRE);
+	while (g) {
+		struct watch_gen *next = g->next;
+		watch_gen_destroy(g);
+		g = next;
+	}
+}
+
+#ifdef HAVE_INOTIFY
+/* Re-adds the watch of each dependency that used wd, which the kernel has
+   removed (e.g. because the directory was deleted or unmounted). If that
+   fails, the dependency is polled instead. */
+static void watch_rearm(struct watch_node *node, int wd)
+{
+	for (int i = 0; i < node->n_deps; ++i) {
+		struct watch_dep *d = &node->deps[i];
+		if (d->wd != wd) continue;
+		d->wd = watch_add_dir(d->path);
+		if (d->wd < 0)
+			LOG_FMT(LL_VERBOSE, "%s: info: polling %s", node->e->name, d->path);
+		node->reload = 1;
+	}
+}
+
+/* Reads pending inotify events and marks the nodes to reload. Must be
+   called with watch_state.lock held. Returns the number of events read. */
+static int watch_read_events(void)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+	int n = 0;
+	while ((len = read(watch_state.ino_fd, buf, sizeof(buf))) > 0) {
+		for (char *p = buf; p < buf + len; ++n) {
+			const struct inotify_event *ev = (const struct inotify_event *) p;
+			LIST_FOREACH(&watch_state.list, node) {
+				if (ev->mask & IN_Q_OVERFLOW) node->reload = 1;
+				else if (ev->mask & IN_IGNORED) watch_rearm(node, ev->wd);
+				else if (ev->len > 0) {
+					for (int i = 0; i < node->n_deps; ++i)
+						if (node->deps[i].wd == ev->wd && strcmp(node->deps[i].name, ev->name) == 0)
+							node->reload = 1;
+				}
 			}
+			p += sizeof(struct inotify_event) + ev->len;
 		}
 	}
-	else destroy_effects_chain(&new_chain);
+	return n;
 }
+#endif
 
 static void * watch_worker(void *arg)
 {
-	const struct timespec poll_int = {
-		.tv_sec = (POLL_INTERVAL)/1000,
-		.tv_nsec = ((POLL_INTERVAL)%1000)*1000000
-	};
+	int needs_poll = (watch_state.ino_fd < 0);
 	for (;;) {
-		nanosleep(&poll_int, NULL);
+		struct pollfd pfd[2] = {
+			{ .fd = watch_state.wake_fd[0], .events = POLLIN },
+			{ .fd = watch_state.ino_fd, .events = POLLIN },
+		};
+		/* only time out if a dependency needs to be polled */
+		const int r = poll(pfd, (watch_state.ino_fd < 0) ? 1 : 2, (needs_poll) ? POLL_INTERVAL : -1);
 		int old_cs;
 		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cs);
+		if (r > 0 && (pfd[0].revents & POLLIN)) {
+			char buf[64];
+			while (read(watch_state.wake_fd[0], buf, sizeof(buf)) > 0);
+		}
+	#ifdef HAVE_INOTIFY
+		if (r > 0 && (pfd[1].revents & POLLIN)) {
+			/* editors often write files in several steps */
+			for (int i = 0; i < SETTLE_MAX; ++i) {
+				pthread_mutex_lock(&watch_state.lock);
+				const int n = watch_read_events();
+				pthread_mutex_unlock(&watch_state.lock);
+				if (n == 0 || poll(&pfd[1], 1, SETTLE_TIME) <= 0) break;
+			}
+		}
+	#endif
 		pthread_mutex_lock(&watch_state.lock);
-		struct watch_list reload_list = watch_state.list;
-		watch_state.list.tail = watch_state.list.head = NULL;
-		pthread_mutex_unlock(&watch_state.lock);
-		LIST_FOREACH(&reload_list, node) {
-			struct stat sb;
-			if (stat(node->path, &sb) < 0)
-				LOG_FMT(LL_VERBOSE, "%s: warning: stat() failed: %s: %s", node->e->name, node->path, strerror(errno));
-			else if (sb.st_mtim.tv_sec != node->last_mtime.tv_sec || sb.st_mtim.tv_nsec != node->last_mtime.tv_nsec) {
-				node->last_mtime = sb.st_mtim;
+		needs_poll = 0;
+		LIST_FOREACH(&watch_state.list, node) {
+			watch_reap(node);
+			if (watch_deps_poll(node)) node->reload = 1;
+			if (__atomic_exchange_n(&node->force_reload, 0, __ATOMIC_ACQUIRE)) node->reload = 1;
+			if (node->reload) {
+				node->reload = 0;
 				watch_reload(node);
 			}
+			if (watch_node_needs_poll(node)) needs_poll = 1;
 		}
-		pthread_mutex_lock(&watch_state.lock);
-		LIST_CONCAT(&watch_state.list, &reload_list);
 		pthread_mutex_unlock(&watch_state.lock);
 		pthread_setcancelstate(old_cs, &old_cs);
 	}
 	return NULL;
 }
 
+static int watch_worker_start(const char *name)
+{
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&watch_state.lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	if (pipe(watch_state.wake_fd) < 0) {
+		LOG_FMT(LL_ERROR, "%s: error: pipe() failed: %s", name, strerror(errno));
+		pthread_mutex_destroy(&watch_state.lock);
+		return 1;
+	}
+	for (int i = 0; i < 2; ++i) {
+		fcntl(watch_state.wake_fd[i], F_SETFL, fcntl(watch_state.wake_fd[i], F_GETFL) | O_NONBLOCK);
+		fcntl(watch_state.wake_fd[i], F_SETFD, FD_CLOEXEC);
+	}
+#ifdef HAVE_INOTIFY
+	if ((watch_state.ino_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC)) < 0)
+		LOG_FMT(LL_VERBOSE, "%s: warning: inotify_init1() failed: %s; falling back to polling", name, strerror(errno));
+#else
+	watch_state.ino_fd = -1;
+#endif
+	if ((errno = pthread_create(&watch_state.thread, NULL, watch_worker, NULL)) != 0) {
+		LOG_FMT(LL_ERROR, "%s: error: pthread_create() failed: %s", name, strerror(errno));
+		close(watch_state.wake_fd[0]);
+		close(watch_state.wake_fd[1]);
+		if (watch_state.ino_fd >= 0) close(watch_state.ino_fd);
+		pthread_mutex_destroy(&watch_state.lock);
+		return 1;
+	}
+	return 0;
+}
+
+static void watch_worker_stop(void)
+{
+	pthread_cancel(watch_state.thread);
+	pthread_join(watch_state.thread, NULL);
+	close(watch_state.wake_fd[0]);
+	close(watch_state.wake_fd[1]);
+	if (watch_state.ino_fd >= 0) close(watch_state.ino_fd);
+	pthread_mutex_destroy(&watch_state.lock);
+}
+
+static void watch_retire(struct watch_node *node, struct watch_gen *g)
+{
+	g->next = __atomic_load_n(&node->retired, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&node->retired, &g->next, g, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
 static void watch_finish_xfade(struct watch_node *node)
 {
-	destroy_effects_chain(&node->chain);
-	node->chain = node->xfade.chain[1];
-	effects_chain_xfade_reset(&node->xfade);
+	watch_retire(node, node->gen);
+	watch_wake();
+	node->gen = node->xfade_gen;
+	node->xfade_gen = NULL;
+	node->xfade_pos = 0;
+}
+
+static void watch_take_pending(struct watch_node *node)
+{
+	if (node->xfade_gen || __atomic_load_n(&node->pending, __ATOMIC_RELAXED) == NULL)
+		return;
+	struct watch_gen *g = __atomic_exchange_n(&node->pending, NULL, __ATOMIC_ACQUIRE);
+	if (g == NULL) return;
+	if (g->in_frames != node->in_frames) {
+		/* block size changed while the chain was being built */
+		watch_retire(node, g);
+		__atomic_store_n(&node->force_reload, 1, __ATOMIC_RELEASE);
+		watch_wake();
+		return;
+	}
+	node->xfade_gen = g;
+	node->xfade_pos = node->xfade_frames;
+	if (node->xfade_buf == NULL || node->xfade_pos == 0)
+		watch_finish_xfade(node);  /* no crossfade */
+}
+
+static sample_t * watch_xfade_run(struct watch_node *node, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
+{
+	if (*frames < 1) return ibuf;
+	struct watch_gen *g = node->xfade_gen;
+	sample_t *rbuf[2];
+	ssize_t tmp_f = *frames;
+	const int has_output = (g->chain.oframes > 0);
+
+	memcpy(node->xfade_buf, ibuf, *frames * node->e->istream.channels * sizeof(sample_t));
+	rbuf[0] = watch_gen_run(node->gen, frames, ibuf, obuf);
+	rbuf[1] = (rbuf[0] == obuf) ? ibuf : obuf;
+	rbuf[1] = watch_gen_run(g, &tmp_f, node->xfade_buf, rbuf[1]);
+	if (g->chain.oframes <= 0) return rbuf[0];
+	return effects_chain_xfade_mix(rbuf[0], frames, rbuf[1], tmp_f, has_output,
+		node->e->ostream.channels, &node->xfade_pos, node->xfade_frames);
 }
 
 static sample_t * watch_effect_run(struct effect *e, ssize_t *frames, sample_t *ibuf, sample_t *obuf)
 {
 	struct watch_node *node = (struct watch_node *) e->data;
-	pthread_mutex_lock(&node->lock);
-	if (node->update_chain && node->xfade.pos == 0) {
-		node->xfade.chain[0] = node->chain;
-		node->xfade.chain[1] = node->new_chain;
-		node->xfade.pos = node->xfade.frames;
-		if (node->buf_len == 0 || node->xfade.pos == 0)
-			watch_finish_xfade(node);  /* no crossfade */
-		node->new_chain = (struct effects_chain) EFFECTS_CHAIN_INITIALIZER;
-		node->update_chain = 0;
-	}
-	pthread_mutex_unlock(&node->lock);
-	if (node->xfade.pos > 0) {
-		sample_t *rbuf = effects_chain_xfade_run(&node->xfade, frames, ibuf, obuf);
-		if (node->xfade.pos == 0) {
+	watch_take_pending(node);
+	if (node->xfade_gen) {
+		sample_t *rbuf = watch_xfade_run(node, frames, ibuf, obuf);
+		if (node->xfade_pos == 0) {
 			watch_finish_xfade(node);
 			LOG_FMT(LL_VERBOSE, "%s: info: end of crossfade", e->name);
 		}
 		return rbuf;
 	}
-	return run_effects_chain(&node->chain, frames, ibuf, obuf);
+	return watch_gen_run(node->gen, frames, ibuf, obuf);
 }
 
 static void watch_effect_reset(struct effect *e)
 {
 	struct watch_node *node = (struct watch_node *) e->data;
-	if (node->xfade.pos > 0) watch_finish_xfade(node);
-	reset_effects_chain(&node->chain);
+	if (node->xfade_gen) watch_finish_xfade(node);
+	reset_effects_chain(&node->gen->chain);
 }
 
 static void watch_effect_signal(struct effect *e)
 {
 	struct watch_node *node = (struct watch_node *) e->data;
-	signal_effects_chain(&node->chain);
+	signal_effects_chain(&node->gen->chain);
 }
 
 static sample_t * watch_effect_drain2(struct effect *e, ssize_t *frames, sample_t *buf1, sample_t *buf2)
 {
 	struct watch_node *node = (struct watch_node *) e->data;
-	if (node->xfade.pos > 0) watch_finish_xfade(node);
-	return drain_effects_chain(&node->chain, frames, buf1, buf2);
+	if (node->xfade_gen) watch_finish_xfade(node);
+	return watch_gen_drain(node->gen, frames, buf1, buf2);
 }
 
 static void watch_node_destroy(struct watch_node *node)
 {
 	pthread_mutex_destroy(&node->lock);
-	destroy_effects_chain(&node->chain);
-	destroy_effects_chain(&node->xfade.chain[1]);
-	destroy_effects_chain(&node->new_chain);
-	free(node->xfade.buf);
+	watch_gen_destroy(node->gen);
+	watch_gen_destroy(node->xfade_gen);
+	watch_gen_destroy(node->pending);
+	watch_reap(node);
+	watch_deps_free(node->deps, node->n_deps);
+	free(node->xfade_buf);
 	free(node->path);
 	free(node->channel_mask);
 	free(node);
@@ -192,13 +561,13 @@ static void watch_effect_destroy(struct effect *e)
 
 	pthread_mutex_lock(&watch_state.lock);
 	LIST_REMOVE(&watch_state.list, node);
+	watch_rm_stale(node->deps, node->n_deps);
 	pthread_mutex_unlock(&watch_state.lock);
 
 	watch_node_destroy(node);
 	pthread_mutex_lock(&watch_state.init_lock);
 	if (--watch_state.init_count == 0) {
-		pthread_cancel(watch_state.thread);
-		pthread_join(watch_state.thread, NULL);
+		watch_worker_stop();
 		/* LOG_FMT(LL_VERBOSE, "%s: info: worker thread exited", e->name); */
 	}
 	pthread_mutex_unlock(&watch_state.init_lock);
@@ -208,14 +577,14 @@ static ssize_t watch_effect_buffer_frames(struct effect *e, ssize_t in_frames)
 {
 	struct watch_node *node = (struct watch_node *) e->data;
 	pthread_mutex_lock(&node->lock);
-	const ssize_t buf_len = get_effects_chain_buffer_len(&node->chain, in_frames, e->istream.channels);
+	const ssize_t buf_len = get_effects_chain_buffer_len(&node->gen->chain, in_frames, e->istream.channels);
 	const ssize_t buf_frames = ratio_mult_ceil(buf_len, 1, e->ostream.channels);
 	if (buf_len > node->buf_len) {
 		node->in_frames = in_frames;
 		node->buf_len = buf_len;
-		free(node->xfade.buf);
-		node->xfade.buf = calloc(node->buf_len, sizeof(sample_t));
-		if (!node->xfade.buf) node->xfade.frames = 0;
+		free(node->xfade_buf);
+		node->xfade_buf = calloc(node->buf_len, sizeof(sample_t));
+		if (!node->xfade_buf) node->xfade_frames = 0;
 	}
 	pthread_mutex_unlock(&node->lock);
 	return buf_frames;
@@ -264,16 +633,16 @@ struct effect * watch_effect_init(const struct effect_info *ei, const struct str
 
 	node = calloc(1, sizeof(struct watch_node));
 	if (check_alloc(ei->name, node)) goto fail;
-	node->last_mtime = sb.st_mtim;
 	pthread_mutex_init(&node->lock, NULL);
 	node->path = path;
 	node->channel_mask = NEW_SELECTOR(istream->channels);
 	if (check_alloc(ei->name, node->channel_mask)) goto fail;
 	COPY_SELECTOR(node->channel_mask, channel_selector, istream->channels);
-	node->chain = chain;
+	node->gen = watch_gen_new(&chain, 0, 0);
+	if (check_alloc(ei->name, node->gen)) goto fail;
+	chain = (struct effects_chain) EFFECTS_CHAIN_INITIALIZER;  /* now owned by node->gen */
 	node->enforce_eof_marker = enforce_eof_marker;
-	node->xfade = (struct effects_chain_xfade_state) EFFECTS_CHAIN_XFADE_STATE_INITIALIZER;
-	node->xfade.frames = lround((EFFECTS_CHAIN_XFADE_TIME)/1000.0 * stream.fs);
+	node->xfade_frames = lround((EFFECTS_CHAIN_XFADE_TIME)/1000.0 * stream.fs);
 
 	e = calloc(1, sizeof(struct effect));
 	if (check_alloc(ei->name, e)) goto fail;
@@ -295,17 +664,25 @@ struct effect * watch_effect_init(const struct effect_info *ei, const struct str
 	pthread_mutex_lock(&watch_state.init_lock);
 	if (watch_state.init_count == 0) {
 		/* LOG_FMT(LL_VERBOSE, "%s: info: starting worker thread", argv[0]); */
-		if ((errno = pthread_create(&watch_state.thread, NULL, watch_worker, NULL)) != 0) {
-			LOG_FMT(LL_ERROR, "%s: error: pthread_create() failed: %s", argv[0], strerror(errno));
+		if (watch_worker_start(argv[0])) {
 			pthread_mutex_unlock(&watch_state.init_lock);
 			goto fail;
 		}
 	}
+	if (watch_deps_update(node, &node->gen->chain.deps)) {
+		if (watch_state.init_count == 0) watch_worker_stop();
+		pthread_mutex_unlock(&watch_state.init_lock);
+		goto fail;
+	}
 	++watch_state.init_count;
 	pthread_mutex_unlock(&watch_state.init_lock);
 	pthread_mutex_lock(&watch_state.lock);
 	LIST_APPEND(&watch_state.list, node);
+	/* the worker may have removed a watch shared with this node since it was added */
+	for (int i = 0; i < node->n_deps; ++i)
+		if (node->deps[i].wd >= 0) node->deps[i].wd = watch_add_dir(node->deps[i].path);
 	pthread_mutex_unlock(&watch_state.lock);
+	watch_wake();
 	return e;
 
 	open_fail:
@@ -314,6 +691,7 @@ struct effect * watch_effect_init(const struct effect_info *ei, const struct str
 	return NULL;
 
 	fail:
+	destroy_effects_chain(&chain);
 	if (node) watch_node_destroy(node);
 	free(e);
 	return NULL;
@@ -165,6 +165,7 @@ struct effect * zita_convolver_effect_init_with_filter(const struct effect_info
 	COPY_SELECTOR(e->channel_selector, channel_selector, istream->channels);
 	e->flags |= EFFECT_FLAG_OPT_REORDERABLE;
 	e->flags |= EFFECT_FLAG_CH_DEPS_IDENTITY;
+	e->flags |= EFFECT_FLAG_LTI;
 	e->run = zita_convolver_effect_run;
 	e->reset = zita_convolver_effect_reset;
 	e->drain_samples = zita_convolver_effect_drain_samples;